@@ -1,11 +1,68 @@
 #include "ast.h"
+#include "dtoa.h"
+#include "stats.h"
+#include "walk.h"
+
+Arena ast_arena;
+
+const char *typespec_kind_names[] = {
+        [TYPESPEC_NONE] = "none",
+        [TYPESPEC_NAME] = "name",
+        [TYPESPEC_FUNC] = "func",
+        [TYPESPEC_ARRAY] = "array",
+        [TYPESPEC_PTR] = "ptr",
+};
+
+const char *expr_kind_names[] = {
+        [EXPR_NONE] = "none",
+        [EXPR_INT] = "int",
+        [EXPR_FLOAT] = "float",
+        [EXPR_STR] = "str",
+        [EXPR_NAME] = "name",
+        [EXPR_CAST] = "cast",
+        [EXPR_CALL] = "call",
+        [EXPR_INDEX] = "index",
+        [EXPR_FIELD] = "field",
+        [EXPR_COMPOUND] = "compound",
+        [EXPR_UNARY] = "unary",
+        [EXPR_BINARY] = "binary",
+        [EXPR_TERNARY] = "ternary",
+};
+
+const char *stmt_kind_names[] = {
+        [STMT_NONE] = "none",
+        [STMT_RETURN] = "return",
+        [STMT_BREAK] = "break",
+        [STMT_CONTINUE] = "continue",
+        [STMT_BLOCK] = "block",
+        [STMT_IF] = "if",
+        [STMT_WHILE] = "while",
+        [STMT_FOR] = "for",
+        [STMT_DO] = "do",
+        [STMT_SWITCH] = "switch",
+        [STMT_ASSIGN] = "assign",
+        [STMT_AUTO_ASSIGN] = "auto_assign",
+        [STMT_EXPR] = "expr",
+};
+
+const char *decl_kind_names[] = {
+        [DECL_NONE] = "none",
+        [DECL_ENUM] = "enum",
+        [DECL_STRUCT] = "struct",
+        [DECL_UNION] = "union",
+        [DECL_VAR] = "var",
+        [DECL_CONST] = "const",
+        [DECL_TYPEDEF] = "typedef",
+        [DECL_FUNC] = "func",
+};
 
 Typespec *
 typespec_alloc(TypespecKind kind)
 {
         Typespec *t;
-        t = xcalloc(1, sizeof(Typespec));
+        t = ast_alloc(sizeof(Typespec));
         t->kind = kind;
+        STAT_INC(typespecs[kind]);
         return t;
 }
 
@@ -52,8 +109,9 @@ Expr *
 expr_alloc(ExprKind kind)
 {
         Expr *e;
-        e = xcalloc(1, sizeof(Expr));
+        e = ast_alloc(sizeof(Expr));
         e->kind = kind;
+        STAT_INC(exprs[kind]);
         return e;
 }
 
@@ -94,6 +152,17 @@ expr_name(const char *name)
         return e;
 }
 
+Expr *
+expr_compound(Typespec *type, Expr **args, size_t num_args)
+{
+        Expr *e;
+        e = expr_alloc(EXPR_COMPOUND);
+        e->compound.type = type;
+        e->compound.args = args;
+        e->compound.num_args = num_args;
+        return e;
+}
+
 Expr *
 expr_cast(Typespec *type, Expr *expr)
 {
@@ -167,38 +236,241 @@ expr_ternary(Expr *cond, Expr *if_true, Expr *if_false)
         return e;
 }
 
-void
-print_type(Typespec *type)
+Stmt *
+stmt_alloc(StmtKind kind)
+{
+        Stmt *s;
+        s = ast_alloc(sizeof(Stmt));
+        s->kind = kind;
+        STAT_INC(stmts[kind]);
+        return s;
+}
+
+Stmt *
+stmt_return(Expr *expr)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_RETURN);
+        s->expr = expr;
+        return s;
+}
+
+Stmt *
+stmt_break(void)
+{
+        return stmt_alloc(STMT_BREAK);
+}
+
+Stmt *
+stmt_continue(void)
+{
+        return stmt_alloc(STMT_CONTINUE);
+}
+
+Stmt *
+stmt_block(StmtBlock block)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_BLOCK);
+        s->block = block;
+        return s;
+}
+
+Stmt *
+stmt_if(Expr *cond, StmtBlock then_block, ElseIf *elseifs,
+                size_t num_elseifs, StmtBlock else_block)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_IF);
+        s->if_stmt.cond = cond;
+        s->if_stmt.then_block = then_block;
+        s->if_stmt.elseifs = elseifs;
+        s->if_stmt.num_elseifs = num_elseifs;
+        s->if_stmt.else_block = else_block;
+        return s;
+}
+
+Stmt *
+stmt_while(Expr *cond, StmtBlock block)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_WHILE);
+        s->while_stmt.cond = cond;
+        s->while_stmt.block = block;
+        return s;
+}
+
+Stmt *
+stmt_do(Expr *cond, StmtBlock block)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_DO);
+        s->while_stmt.cond = cond;
+        s->while_stmt.block = block;
+        return s;
+}
+
+Stmt *
+stmt_for(StmtBlock init, Expr *cond, StmtBlock next, StmtBlock block)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_FOR);
+        s->for_stmt.init = init;
+        s->for_stmt.cond = cond;
+        s->for_stmt.next = next;
+        s->for_stmt.block = block;
+        return s;
+}
+
+Stmt *
+stmt_switch(Expr *expr, SwitchCase *cases, size_t num_cases)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_SWITCH);
+        s->switch_stmt.expr = expr;
+        s->switch_stmt.cases = cases;
+        s->switch_stmt.num_cases = num_cases;
+        return s;
+}
+
+Stmt *
+stmt_assign(TokenKind op, Expr *left, Expr *right)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_ASSIGN);
+        s->assign.op = op;
+        s->assign.left = left;
+        s->assign.right = right;
+        return s;
+}
+
+Stmt *
+stmt_auto_assign(const char *name, Expr *init)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_AUTO_ASSIGN);
+        s->autoassign.name = name;
+        s->autoassign.init = init;
+        return s;
+}
+
+Stmt *
+stmt_expr(Expr *expr)
+{
+        Stmt *s;
+        s = stmt_alloc(STMT_EXPR);
+        s->expr = expr;
+        return s;
+}
+
+Decl *
+decl_alloc(DeclKind kind, const char *name)
+{
+        Decl *d;
+        d = ast_alloc(sizeof(Decl));
+        d->kind = kind;
+        d->name = name;
+        STAT_INC(decls[kind]);
+        return d;
+}
+
+Decl *
+decl_enum(const char *name, EnumItem *items, size_t num_items)
+{
+        Decl *d;
+        d = decl_alloc(DECL_ENUM, name);
+        d->enum_decl.items = items;
+        d->enum_decl.num_items = num_items;
+        return d;
+}
+
+Decl *
+decl_aggregate(DeclKind kind, const char *name, AggregateItem *items,
+                size_t num_items)
+{
+        Decl *d;
+        assert(kind == DECL_STRUCT || kind == DECL_UNION);
+        d = decl_alloc(kind, name);
+        d->aggregate.items = items;
+        d->aggregate.num_items = num_items;
+        return d;
+}
+
+Decl *
+decl_var(const char *name, Typespec *type, Expr *expr)
+{
+        Decl *d;
+        d = decl_alloc(DECL_VAR, name);
+        d->var.type = type;
+        d->var.expr = expr;
+        return d;
+}
+
+Decl *
+decl_const(const char *name, Expr *expr)
+{
+        Decl *d;
+        d = decl_alloc(DECL_CONST, name);
+        d->const_decl.expr = expr;
+        return d;
+}
+
+Decl *
+decl_typedef(const char *name, Typespec *type)
+{
+        Decl *d;
+        d = decl_alloc(DECL_TYPEDEF, name);
+        d->typedef_decl.type = type;
+        return d;
+}
+
+Decl *
+decl_func(const char *name, FuncParam *params, size_t num_params,
+                Typespec *ret_type, StmtBlock block)
+{
+        Decl *d;
+        d = decl_alloc(DECL_FUNC, name);
+        d->func.params = params;
+        d->func.num_params = num_params;
+        d->func.ret_type = ret_type;
+        d->func.block = block;
+        return d;
+}
+
+// Typespecs and expressions print through ast_walk, so that a tree of any
+// depth prints without recursing. Each node opens its list on the way down
+// and closes it on the way up; the space in front of a child depends on
+// where the child sits in its parent.
+static void
+print_separator(WalkFrame *frame)
+{
+        AstNode parent;
+
+        parent = frame->parent;
+        if (parent.kind == AST_TYPESPEC &&
+                        parent.type->kind == TYPESPEC_FUNC) {
+                printf(frame->index < parent.type->func.num_args ? " " : ") ");
+        } else if (frame->index > 0 || (parent.kind == AST_EXPR &&
+                                parent.expr->kind == EXPR_COMPOUND)) {
+                printf(" ");
+        }
+}
+
+static void
+print_typespec_pre(Typespec *t)
 {
-        Typespec *t;
-        t = type;
         switch (t->kind) {
         case TYPESPEC_NAME:
                 printf("%s", t->name);
                 break;
-        case TYPESPEC_FUNC: {
+        case TYPESPEC_FUNC:
                 printf("(func (");
-                for (Typespec **it = t->func.args;
-                                it != t->func.args + t->func.num_args; ++it) {
-                       printf(" ");
-                       print_type(*it);
-                }
-                printf(") ");
-                print_type(t->func.ret);
-                printf(")");
                 break;
-        }
         case TYPESPEC_ARRAY:
                 printf("(arr ");
-                print_type(t->array.elem);
-                printf(" ");
-                print_expr(t->array.size);
-                printf(")");
                 break;
         case TYPESPEC_PTR:
                 printf("(ptr ");
-                print_type(t->ptr.elem);
-                printf(")");
                 break;
         default:
                 assert(0);
@@ -206,17 +478,18 @@ print_type(Typespec *type)
         }
 }
 
-void
-print_expr(Expr *expr)
+static void
+print_expr_pre(Expr *e)
 {
-        Expr *e;
-        e = expr;
+        char buf[DTOA_BUF_SIZE];
+
         switch (e->kind) {
         case EXPR_INT:
                 printf("%" PRIu64, e->int_val);
                 break;
         case EXPR_FLOAT:
-                printf("%f", e->float_val);
+                double_to_str(e->float_val, buf);
+                printf("%s", buf);
                 break;
         case EXPR_STR:
                 printf("\"%s\"", e->str_val);
@@ -226,55 +499,322 @@ print_expr(Expr *expr)
                 break;
         case EXPR_CAST:
                 printf("(cast ");
-                print_type(e->cast.type);
-                printf(" ");
-                print_expr(e->cast.expr);
-                printf(")");
                 break;
         case EXPR_CALL:
                 printf("(");
-                print_expr(e->call.expr);
-                for (Expr **it = e->call.args;
-                                it != e->call.args + e->call.num_args; ++it) {
-                        printf(" ");
-                        print_expr(*it);
-                }
-                printf(")");
                 break;
         case EXPR_INDEX:
                 printf("(index ");
-                print_expr(e->index.expr);
-                printf(" ");
-                print_expr(e->index.index);
-                printf(")");
                 break;
         case EXPR_FIELD:
                 printf("(field ");
-                print_expr(e->field.expr);
-                printf(" %s)", e->field.name);
                 break;
         case EXPR_COMPOUND:
-                printf("(compound ...)");
+                printf("(compound");
                 break;
         case EXPR_UNARY:
-                printf("(%c ", e->unary.op);
-                print_expr(e->unary.expr);
-                printf(")");
+                printf("(%s ", token_kind_str(e->unary.op));
                 break;
         case EXPR_BINARY:
-                printf("(%c ", e->binary.op);
-                print_expr(e->binary.left);
-                printf(" ");
-                print_expr(e->binary.right);
-                printf(")");
+                printf("(%s ", token_kind_str(e->binary.op));
                 break;
         case EXPR_TERNARY:
                 printf("(if ");
-                print_expr(e->ternary.cond);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+static bool
+print_pre(void *ctx, WalkFrame *frame)
+{
+        print_separator(frame);
+        if (frame->node.kind == AST_TYPESPEC) {
+                print_typespec_pre(frame->node.type);
+        } else {
+                assert(frame->node.kind == AST_EXPR);
+                print_expr_pre(frame->node.expr);
+        }
+        return true;
+}
+
+static void
+print_post(void *ctx, WalkFrame *frame)
+{
+        Typespec *t;
+        Expr *e;
+
+        if (frame->node.kind == AST_TYPESPEC) {
+                t = frame->node.type;
+                if (t->kind == TYPESPEC_FUNC && !t->func.ret) {
+                        printf(") nil)");
+                } else if (t->kind != TYPESPEC_NAME) {
+                        printf(")");
+                }
+                return;
+        }
+        e = frame->node.expr;
+        switch (e->kind) {
+        case EXPR_INT:
+        case EXPR_FLOAT:
+        case EXPR_STR:
+        case EXPR_NAME:
+                break;
+        case EXPR_FIELD:
+                printf(" %s)", e->field.name);
+                break;
+        default:
+                printf(")");
+                break;
+        }
+}
+
+static Walker printer = { print_pre, print_post, NULL };
+
+void
+print_type(Typespec *type)
+{
+        ast_walk(AST_NODE(AST_TYPESPEC, type), &printer, 1);
+}
+
+void
+print_expr(Expr *expr)
+{
+        ast_walk(AST_NODE(AST_EXPR, expr), &printer, 1);
+}
+
+static int print_indent;
+
+static void
+print_newline(void)
+{
+        printf("\n%*s", 2 * print_indent, "");
+}
+
+static void
+print_block(StmtBlock block)
+{
+        printf("(block");
+        ++print_indent;
+        for (Stmt **it = block.stmts; it != block.stmts + block.num_stmts;
+                        ++it) {
+                print_newline();
+                print_stmt(*it);
+        }
+        --print_indent;
+        printf(")");
+}
+
+void
+print_stmt(Stmt *stmt)
+{
+        Stmt *s;
+        s = stmt;
+        switch (s->kind) {
+        case STMT_RETURN:
+                printf("(return");
+                if (s->expr) {
+                        printf(" ");
+                        print_expr(s->expr);
+                }
+                printf(")");
+                break;
+        case STMT_BREAK:
+                printf("(break)");
+                break;
+        case STMT_CONTINUE:
+                printf("(continue)");
+                break;
+        case STMT_BLOCK:
+                print_block(s->block);
+                break;
+        case STMT_IF:
+                printf("(if ");
+                print_expr(s->if_stmt.cond);
+                ++print_indent;
+                print_newline();
+                print_block(s->if_stmt.then_block);
+                for (ElseIf *it = s->if_stmt.elseifs;
+                                it != s->if_stmt.elseifs +
+                                s->if_stmt.num_elseifs; ++it) {
+                        print_newline();
+                        printf("(elseif ");
+                        print_expr(it->cond);
+                        print_newline();
+                        print_block(it->block);
+                        printf(")");
+                }
+                if (s->if_stmt.else_block.num_stmts) {
+                        print_newline();
+                        printf("(else ");
+                        print_block(s->if_stmt.else_block);
+                        printf(")");
+                }
+                --print_indent;
+                printf(")");
+                break;
+        case STMT_WHILE:
+        case STMT_DO:
+                printf(s->kind == STMT_WHILE ? "(while " : "(do-while ");
+                print_expr(s->while_stmt.cond);
+                ++print_indent;
+                print_newline();
+                print_block(s->while_stmt.block);
+                --print_indent;
+                printf(")");
+                break;
+        case STMT_FOR:
+                printf("(for ");
+                print_block(s->for_stmt.init);
                 printf(" ");
-                print_expr(e->ternary.if_true);
+                if (s->for_stmt.cond) {
+                        print_expr(s->for_stmt.cond);
+                } else {
+                        printf("()");
+                }
+                printf(" ");
+                print_block(s->for_stmt.next);
+                ++print_indent;
+                print_newline();
+                print_block(s->for_stmt.block);
+                --print_indent;
+                printf(")");
+                break;
+        case STMT_SWITCH:
+                printf("(switch ");
+                print_expr(s->switch_stmt.expr);
+                ++print_indent;
+                for (SwitchCase *it = s->switch_stmt.cases;
+                                it != s->switch_stmt.cases +
+                                s->switch_stmt.num_cases; ++it) {
+                        print_newline();
+                        printf("(case (%s", it->is_default ? "default" : "");
+                        for (Expr **expr = it->exprs;
+                                        expr != it->exprs + it->num_exprs;
+                                        ++expr) {
+                                printf(" ");
+                                print_expr(*expr);
+                        }
+                        printf(") ");
+                        print_block(it->block);
+                        printf(")");
+                }
+                --print_indent;
+                printf(")");
+                break;
+        case STMT_ASSIGN:
+                printf("(%s ", token_kind_str(s->assign.op));
+                print_expr(s->assign.left);
+                if (s->assign.right) {
+                        printf(" ");
+                        print_expr(s->assign.right);
+                }
+                printf(")");
+                break;
+        case STMT_AUTO_ASSIGN:
+                printf("(:= %s ", s->autoassign.name);
+                print_expr(s->autoassign.init);
+                printf(")");
+                break;
+        case STMT_EXPR:
+                print_expr(s->expr);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+void
+print_decl(Decl *decl)
+{
+        Decl *d;
+        d = decl;
+        switch (d->kind) {
+        case DECL_ENUM:
+                printf("(enum %s", d->name);
+                ++print_indent;
+                for (EnumItem *it = d->enum_decl.items;
+                                it != d->enum_decl.items +
+                                d->enum_decl.num_items; ++it) {
+                        print_newline();
+                        printf("(%s ", it->name);
+                        if (it->init) {
+                                print_expr(it->init);
+                        } else {
+                                printf("nil");
+                        }
+                        printf(")");
+                }
+                --print_indent;
+                printf(")");
+                break;
+        case DECL_STRUCT:
+        case DECL_UNION:
+                printf("(%s %s", d->kind == DECL_STRUCT ? "struct" : "union",
+                                d->name);
+                ++print_indent;
+                for (AggregateItem *it = d->aggregate.items;
+                                it != d->aggregate.items +
+                                d->aggregate.num_items; ++it) {
+                        print_newline();
+                        printf("(");
+                        print_type(it->type);
+                        for (const char **name = it->names;
+                                        name != it->names + it->num_names;
+                                        ++name) {
+                                printf(" %s", *name);
+                        }
+                        printf(")");
+                }
+                --print_indent;
+                printf(")");
+                break;
+        case DECL_VAR:
+                printf("(var %s ", d->name);
+                if (d->var.type) {
+                        print_type(d->var.type);
+                } else {
+                        printf("nil");
+                }
                 printf(" ");
-                print_expr(e->ternary.if_false);
+                if (d->var.expr) {
+                        print_expr(d->var.expr);
+                } else {
+                        printf("nil");
+                }
+                printf(")");
+                break;
+        case DECL_CONST:
+                printf("(const %s ", d->name);
+                print_expr(d->const_decl.expr);
+                printf(")");
+                break;
+        case DECL_TYPEDEF:
+                printf("(typedef %s ", d->name);
+                print_type(d->typedef_decl.type);
+                printf(")");
+                break;
+        case DECL_FUNC:
+                printf("(func %s (", d->name);
+                for (FuncParam *it = d->func.params;
+                                it != d->func.params + d->func.num_params;
+                                ++it) {
+                        printf(" %s ", it->name);
+                        print_type(it->type);
+                }
+                printf(") ");
+                if (d->func.ret_type) {
+                        print_type(d->func.ret_type);
+                } else {
+                        printf("nil");
+                }
+                ++print_indent;
+                print_newline();
+                print_block(d->func.block);
+                --print_indent;
                 printf(")");
                 break;
         default:
@@ -11,6 +11,11 @@ typedef struct Stmt Stmt;
 typedef struct Decl Decl;
 typedef struct Typespec Typespec;
 
+typedef struct StmtBlock {
+        Stmt **stmts;
+        size_t num_stmts;
+} StmtBlock;
+
 typedef enum TypespecKind {
         TYPESPEC_NONE,
         TYPESPEC_NAME,
@@ -36,6 +41,7 @@ typedef struct ArrayTypespec {
 
 struct Typespec {
         TypespecKind kind;
+        SrcPos pos;
         union {
                 const char *name;
                 FuncTypespec func;
@@ -64,20 +70,22 @@ typedef struct FuncDecl {
         FuncParam *params;
         size_t num_params;
         Typespec *ret_type;
+        StmtBlock block;
 } FuncDecl;
 
 typedef struct EnumItem {
         const char *name;
-        Typespec *type;
+        Expr *init;
 } EnumItem;
 
 typedef struct EnumDecl {
-        const char *name;
-        Typespec *type;
+        EnumItem *items;
+        size_t num_items;
 } EnumDecl;
 
 typedef struct AggregateItem {
         const char **names;
+        size_t num_names;
         Typespec *type;
 } AggregateItem;
 
@@ -101,6 +109,7 @@ typedef struct ConstDecl {
 
 struct Decl {
         DeclKind kind;
+        SrcPos pos;
         const char *name;
         union {
                 EnumDecl enum_decl;
@@ -174,6 +183,7 @@ typedef struct FieldExpr {
 
 struct Expr {
         ExprKind kind;
+        SrcPos pos;
         union {
                 uint64_t int_val;
                 double float_val;
@@ -206,14 +216,9 @@ typedef enum StmtKind {
         STMT_EXPR
 } StmtKind;
 
-typedef struct StmtBlock {
-        Stmt **stmts;
-        size_t num_stmts;
-} StmtBlock;
-
 typedef struct ElseIf {
         Expr *cond;
-        Stmt *block;
+        StmtBlock block;
 } ElseIf;
 
 typedef struct IfStmt {
@@ -233,11 +238,13 @@ typedef struct ForStmt {
         StmtBlock init;
         Expr *cond;
         StmtBlock next;
+        StmtBlock block;
 } ForStmt;
 
 typedef struct SwitchCase {
         Expr **exprs;
         size_t num_exprs;
+        bool is_default;
         StmtBlock block;
 } SwitchCase;
 
@@ -260,7 +267,10 @@ typedef struct AutoAssignStmt {
 
 struct Stmt {
         StmtKind kind;
+        SrcPos pos;
         union {
+                Expr *expr;
+                StmtBlock block;
                 IfStmt if_stmt;
                 WhileStmt while_stmt;
                 ForStmt for_stmt;
@@ -270,6 +280,21 @@ struct Stmt {
         };
 };
 
+// AST nodes and their lists live in ast_arena; lists are copied in with
+// ast_dup once they reach their final size. The parser sets each node's pos
+// to the offset of its first token; nodes built by hand have pos 0.
+// These are macros so that allocation tracking charges each node to the
+// constructor that asked for it.
+#define ast_alloc(size) memset(arena_alloc(&ast_arena, (size)), 0, (size))
+#define ast_dup(src, size) arena_dup(&ast_arena, (src), (size))
+#define ast_list(b) ast_dup((b), buf_len(b) * sizeof(*(b)))
+
+extern Arena ast_arena;
+extern const char *typespec_kind_names[];
+extern const char *expr_kind_names[];
+extern const char *stmt_kind_names[];
+extern const char *decl_kind_names[];
+
 Typespec *
 typespec_alloc(TypespecKind kind);
 
@@ -277,13 +302,13 @@ Typespec *
 typespec_name(const char *name);
 
 Typespec *
-Typespec_ptr(Typespec *elem);
+typespec_ptr(Typespec *elem);
 
 Typespec *
-Typespec_array(Typespec *elem, Expr *size);
+typespec_array(Typespec *elem, Expr *size);
 
 Typespec *
-Typespec_func(Typespec **args, size_t num_args, Typespec *ret);
+typespec_func(Typespec **args, size_t num_args, Typespec *ret);
 
 Expr *
 expr_alloc(ExprKind kind);
@@ -300,6 +325,9 @@ expr_str(const char *str_val);
 Expr *
 expr_name(const char *name);
 
+Expr *
+expr_compound(Typespec *type, Expr **args, size_t num_args);
+
 Expr *
 expr_cast(Typespec *type, Expr *expr);
 
@@ -321,12 +349,81 @@ expr_binary(TokenKind op, Expr *left, Expr *right);
 Expr *
 expr_ternary(Expr *cond, Expr *if_true, Expr *if_false);
 
+Stmt *
+stmt_alloc(StmtKind kind);
+
+Stmt *
+stmt_return(Expr *expr);
+
+Stmt *
+stmt_break(void);
+
+Stmt *
+stmt_continue(void);
+
+Stmt *
+stmt_block(StmtBlock block);
+
+Stmt *
+stmt_if(Expr *cond, StmtBlock then_block, ElseIf *elseifs,
+                size_t num_elseifs, StmtBlock else_block);
+
+Stmt *
+stmt_while(Expr *cond, StmtBlock block);
+
+Stmt *
+stmt_do(Expr *cond, StmtBlock block);
+
+Stmt *
+stmt_for(StmtBlock init, Expr *cond, StmtBlock next, StmtBlock block);
+
+Stmt *
+stmt_switch(Expr *expr, SwitchCase *cases, size_t num_cases);
+
+Stmt *
+stmt_assign(TokenKind op, Expr *left, Expr *right);
+
+Stmt *
+stmt_auto_assign(const char *name, Expr *init);
+
+Stmt *
+stmt_expr(Expr *expr);
+
+Decl *
+decl_alloc(DeclKind kind, const char *name);
+
+Decl *
+decl_enum(const char *name, EnumItem *items, size_t num_items);
+
+Decl *
+decl_aggregate(DeclKind kind, const char *name, AggregateItem *items,
+                size_t num_items);
+
+Decl *
+decl_var(const char *name, Typespec *type, Expr *expr);
+
+Decl *
+decl_const(const char *name, Expr *expr);
+
+Decl *
+decl_typedef(const char *name, Typespec *type);
+
+Decl *
+decl_func(const char *name, FuncParam *params, size_t num_params,
+                Typespec *ret_type, StmtBlock block);
+
 void
 print_type(Typespec *type);
 
 void
 print_expr(Expr *expr);
 
+void
+print_stmt(Stmt *stmt);
+
+void
+print_decl(Decl *decl);
+
 void
 expr_test(void);
 
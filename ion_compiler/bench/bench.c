@@ -0,0 +1,303 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "common.h"
+#include "corpus.h"
+#include "lex.h"
+#include "loc.h"
+#include "parse.h"
+#include "unicode.h"
+
+// End-to-end front end benchmark. For each corpus mix the source is
+// generated once and then every phase is timed over several runs:
+//
+//   intern  interning every identifier of the corpus
+//   lex     tokenizing the whole corpus
+//   parse   lexing and parsing into declarations
+//   pipe    the same with the lexer on its own thread (--ring batches)
+//   print   printing the declarations (stdout goes to /dev/null)
+//   lines   building the line table used to print source locations
+//   utf8    validating the source as UTF-8
+//
+// Median and p99 wall time are reported along with MB/s of source and a
+// line per (mix, phase) is appended to a JSON lines file so runs can be
+// compared across commits.
+
+#define DEFAULT_SIZE (128 << 10)
+#define DEFAULT_RUNS 9
+
+typedef enum Phase {
+        PHASE_INTERN,
+        PHASE_LEX,
+        PHASE_PARSE,
+        PHASE_PIPE,
+        PHASE_PRINT,
+        PHASE_LINES,
+        PHASE_UTF8,
+        NUM_PHASES
+} Phase;
+
+static const char *phase_names[NUM_PHASES] = {
+        [PHASE_INTERN] = "intern",
+        [PHASE_LEX] = "lex",
+        [PHASE_PARSE] = "parse",
+        [PHASE_PIPE] = "pipe",
+        [PHASE_PRINT] = "print",
+        [PHASE_LINES] = "lines",
+        [PHASE_UTF8] = "utf8",
+};
+
+typedef struct NameRange {
+        const char *start;
+        const char *end;
+} NameRange;
+
+static const char *src;
+static NameRange *names;
+static Decl **decls;
+static size_t ring_slots;
+
+static double
+now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+        double x = *(const double *) a;
+        double y = *(const double *) b;
+
+        return (x > y) - (x < y);
+}
+
+static void
+run_intern(void)
+{
+        for (NameRange *it = names; it != buf_end(names); ++it) {
+                str_intern_range(it->start, it->end);
+        }
+}
+
+static void
+run_lex(void)
+{
+        init_stream(src);
+        while (token.kind != TOKEN_EOF) {
+                next_token();
+        }
+}
+
+// Each run starts from an empty AST arena; its blocks are kept, so only
+// the first run pays for allocating them.
+static void
+run_parse(void)
+{
+        buf_free(decls);
+        arena_reset(&ast_arena, (ArenaMark) { 0 });
+        init_stream(src);
+        decls = parse_file();
+}
+
+static void
+run_pipe(void)
+{
+        buf_free(decls);
+        arena_reset(&ast_arena, (ArenaMark) { 0 });
+        init_stream_pipe(src, ring_slots);
+        decls = parse_file();
+        free_stream();
+}
+
+static void
+run_print(void)
+{
+        for (Decl **it = decls; it != buf_end(decls); ++it) {
+                print_decl(*it);
+                printf("\n");
+        }
+}
+
+static void
+run_lines(void)
+{
+        LineTable table;
+
+        line_table_init(&table, src, strlen(src));
+        line_table_lookup(&table, 0);
+        line_table_free(&table);
+}
+
+static void
+run_utf8(void)
+{
+        size_t len;
+
+        len = strlen(src);
+        if (utf8_valid_prefix(src, len) != len) {
+                fatal("corpus is not valid UTF-8");
+        }
+}
+
+static void (*phase_funcs[NUM_PHASES])(void) = {
+        [PHASE_INTERN] = run_intern,
+        [PHASE_LEX] = run_lex,
+        [PHASE_PARSE] = run_parse,
+        [PHASE_PIPE] = run_pipe,
+        [PHASE_PRINT] = run_print,
+        [PHASE_LINES] = run_lines,
+        [PHASE_UTF8] = run_utf8,
+};
+
+static void
+collect_names(void)
+{
+        buf_trunc(names, 0);
+        init_stream(src);
+        while (token.kind != TOKEN_EOF) {
+                if (token.kind == TOKEN_NAME) {
+                        buf_push(names, ((NameRange) { token.start,
+                                                token.end }));
+                }
+                next_token();
+        }
+}
+
+static double
+time_phase(Phase phase)
+{
+        double start;
+        double elapsed;
+        int null_fd;
+        int saved_fd;
+
+        null_fd = -1;
+        saved_fd = -1;
+        if (phase == PHASE_PRINT) {
+                fflush(stdout);
+                null_fd = open("/dev/null", O_WRONLY);
+                saved_fd = dup(STDOUT_FILENO);
+                if (null_fd < 0 || saved_fd < 0) {
+                        fatal("cannot redirect stdout");
+                }
+                dup2(null_fd, STDOUT_FILENO);
+        }
+        start = now();
+        phase_funcs[phase]();
+        if (phase == PHASE_PRINT) {
+                fflush(stdout);
+        }
+        elapsed = now() - start;
+        if (phase == PHASE_PRINT) {
+                dup2(saved_fd, STDOUT_FILENO);
+                close(saved_fd);
+                close(null_fd);
+        }
+        return elapsed;
+}
+
+int
+main(int argc, char **argv)
+{
+        const char *label;
+        const char *out_path;
+        FILE *out;
+        size_t size;
+        uint64_t seed;
+        int runs;
+        int only_mix;
+        double *samples;
+        double median;
+        double p99;
+        size_t len;
+        time_t stamp;
+
+        label = "";
+        out_path = "bench_results.jsonl";
+        size = DEFAULT_SIZE;
+        seed = 1;
+        runs = DEFAULT_RUNS;
+        only_mix = -1;
+        for (int i = 1; i + 1 < argc; i += 2) {
+                if (strcmp(argv[i], "--size") == 0) {
+                        size = strtoull(argv[i + 1], NULL, 10);
+                } else if (strcmp(argv[i], "--seed") == 0) {
+                        seed = strtoull(argv[i + 1], NULL, 10);
+                } else if (strcmp(argv[i], "--runs") == 0) {
+                        runs = atoi(argv[i + 1]);
+                } else if (strcmp(argv[i], "--mix") == 0) {
+                        only_mix = corpus_mix_from_name(argv[i + 1]);
+                        if (only_mix < 0) {
+                                fatal("unknown mix '%s'", argv[i + 1]);
+                        }
+                } else if (strcmp(argv[i], "--ring") == 0) {
+                        ring_slots = strtoull(argv[i + 1], NULL, 10);
+                } else if (strcmp(argv[i], "--label") == 0) {
+                        label = argv[i + 1];
+                } else if (strcmp(argv[i], "--out") == 0) {
+                        out_path = argv[i + 1];
+                } else {
+                        fatal("unknown option '%s'", argv[i]);
+                }
+        }
+        if (runs < 1) {
+                fatal("--runs must be positive");
+        }
+        out = fopen(out_path, "a");
+        if (!out) {
+                fatal("cannot open '%s'", out_path);
+        }
+
+        init_keywords();
+        samples = xmalloc(runs * sizeof(*samples));
+        stamp = time(NULL);
+        printf("%-10s %-8s %10s %10s %10s\n", "mix", "phase", "median ms",
+                        "p99 ms", "MB/s");
+        for (int mix = 0; mix < NUM_MIXES; ++mix) {
+                if (only_mix >= 0 && mix != only_mix) {
+                        continue;
+                }
+                src = corpus_generate(mix, size, seed);
+                len = strlen(src);
+                collect_names();
+                for (int phase = 0; phase < NUM_PHASES; ++phase) {
+                        if (phase == PHASE_PRINT) {
+                                run_parse();
+                        }
+                        for (int i = 0; i < runs; ++i) {
+                                samples[i] = time_phase(phase);
+                        }
+                        qsort(samples, runs, sizeof(*samples), cmp_double);
+                        median = samples[runs / 2];
+                        // Nearest rank.
+                        p99 = samples[(int) ceil(0.99 * runs) - 1];
+                        printf("%-10s %-8s %10.3f %10.3f %10.1f\n",
+                                        corpus_mix_names[mix],
+                                        phase_names[phase], median * 1e3,
+                                        p99 * 1e3, len / median / 1e6);
+                        fprintf(out, "{\"label\": \"%s\", \"timestamp\": "
+                                        "%lld, \"mix\": \"%s\", \"phase\": "
+                                        "\"%s\", \"bytes\": %zu, \"runs\": "
+                                        "%d, \"median_ms\": %.4f, \"p99_ms\": "
+                                        "%.4f, \"mb_per_s\": %.2f}\n", label,
+                                        (long long) stamp,
+                                        corpus_mix_names[mix],
+                                        phase_names[phase], len, runs,
+                                        median * 1e3, p99 * 1e3,
+                                        len / median / 1e6);
+                }
+                buf_free(names);
+                buf_free(src);
+        }
+        xfree(samples);
+        fclose(out);
+        return 0;
+}
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "cgen.h"
+#include "common.h"
+
+// Measures C backend output throughput on a synthetic module. The output
+// goes to /dev/null unless a path is given. The same declarations are
+// emitted for several rounds so peak RSS shows the backend's own footprint
+// staying flat as the output grows.
+
+#define NUM_FUNCS 1000
+#define NUM_ROUNDS 200
+
+static double
+now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Decl *
+make_func(const char *name)
+{
+        Stmt **stmts;
+        Stmt **body;
+        Stmt **init;
+        Stmt **next;
+        FuncParam *params;
+        Expr *cond;
+
+        params = NULL;
+        buf_push(params, ((FuncParam) { str_intern("n"),
+                                typespec_name(str_intern("int")) }));
+        buf_push(params, ((FuncParam) { str_intern("v"),
+                                typespec_ptr(typespec_array(typespec_name(
+                                                str_intern("float")),
+                                        expr_int(4))) }));
+
+        body = NULL;
+        buf_push(body, stmt_assign(TOKEN_ADD_ASSIGN, expr_name(str_intern("s")),
+                                expr_binary('*', expr_name(str_intern("i")),
+                                        expr_index(expr_unary('*',
+                                                expr_name(str_intern("v"))),
+                                                expr_binary('&',
+                                                        expr_name(str_intern(
+                                                                "i")),
+                                                        expr_int(3))))));
+
+        cond = expr_binary('<', expr_name(str_intern("i")),
+                        expr_name(str_intern("n")));
+        stmts = NULL;
+        buf_push(stmts, stmt_auto_assign(str_intern("s"), expr_float(0.5)));
+        init = NULL;
+        buf_push(init, stmt_auto_assign(str_intern("i"), expr_int(0)));
+        next = NULL;
+        buf_push(next, stmt_assign(TOKEN_INC, expr_name(str_intern("i")),
+                                NULL));
+        buf_push(stmts, stmt_for((StmtBlock) { init, 1 }, cond,
+                                (StmtBlock) { next, 1 },
+                                (StmtBlock) { body, buf_len(body) }));
+        buf_push(stmts, stmt_return(expr_ternary(expr_binary('>',
+                                                expr_name(str_intern("s")),
+                                                expr_int(100)),
+                                        expr_name(str_intern("s")),
+                                        expr_unary('-',
+                                                expr_name(str_intern("s"))))));
+        return decl_func(str_intern(name), params, buf_len(params),
+                        typespec_name(str_intern("float")),
+                        (StmtBlock) { stmts, buf_len(stmts) });
+}
+
+int
+main(int argc, char **argv)
+{
+        Decl **decls;
+        Writer *w;
+        struct rusage usage;
+        double start;
+        double elapsed;
+        char name[32];
+        int fd;
+
+        decls = NULL;
+        for (int i = 0; i < NUM_FUNCS; ++i) {
+                snprintf(name, sizeof(name), "func%d", i);
+                buf_push(decls, make_func(name));
+        }
+
+        fd = open(argc > 1 ? argv[1] : "/dev/null",
+                        O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                fatal("cannot open output file");
+        }
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, fd);
+
+        start = now();
+        for (int i = 0; i < NUM_ROUNDS; ++i) {
+                for (Decl **it = decls; it != buf_end(decls); ++it) {
+                        cgen_decl(w, *it);
+                }
+        }
+        writer_flush(w);
+        elapsed = now() - start;
+
+        getrusage(RUSAGE_SELF, &usage);
+        printf("cgen: %d decls, %.1f MB in %.3f s, %.1f MB/s, "
+                        "peak RSS %ld KB\n", NUM_FUNCS * NUM_ROUNDS,
+                        w->total / 1e6,
+                        elapsed, w->total / 1e6 / elapsed, usage.ru_maxrss);
+        close(fd);
+        xfree(w);
+        return 0;
+}
@@ -0,0 +1,294 @@
+#include "corpus.h"
+
+#define NUM_IDENTS 1024
+#define MAX_NESTING 24
+
+const char *corpus_mix_names[NUM_MIXES] = {
+        [MIX_IDENTS] = "idents",
+        [MIX_LITERALS] = "literals",
+        [MIX_NESTED] = "nested",
+        [MIX_FUNCS] = "funcs",
+};
+
+static const char *ident_stems[] = {
+        "count", "index", "buffer", "node", "value", "offset", "length",
+        "cursor", "parent", "child", "result", "state", "token", "scope"
+};
+
+static const char *bin_ops[] = {
+        "+", "-", "*", "/", "%", "&", "|", "^", "<<", ">>", "==", "!=", "<",
+        "<=", ">", ">=", "&&", "||"
+};
+
+static uint64_t rng_state;
+static char *out;
+
+static void
+emit_expr(int depth);
+
+static uint64_t
+rng_next(void)
+{
+        // xorshift64*
+        rng_state ^= rng_state >> 12;
+        rng_state ^= rng_state << 25;
+        rng_state ^= rng_state >> 27;
+        return rng_state * 2685821657736338717ULL;
+}
+
+static int
+rng_range(int n)
+{
+        return rng_next() % n;
+}
+
+static void
+emitf(const char *fmt, ...)
+{
+        va_list args;
+        int n;
+
+        va_start(args, fmt);
+        n = vsnprintf(NULL, 0, fmt, args);
+        va_end(args);
+        buf__fit(out, n + 1);
+        va_start(args, fmt);
+        vsnprintf(buf_end(out), n + 1, fmt, args);
+        va_end(args);
+        buf__hdr(out)->len += n;
+}
+
+static void
+emit_ident(void)
+{
+        int id;
+
+        id = rng_range(NUM_IDENTS);
+        emitf("%s_%d", ident_stems[id % (sizeof(ident_stems) /
+                                sizeof(*ident_stems))], id);
+}
+
+static void
+emit_literal(void)
+{
+        switch (rng_range(6)) {
+        case 0:
+                emitf("%d", rng_range(1000000));
+                break;
+        case 1:
+                emitf("0x%x", (unsigned) rng_next());
+                break;
+        case 2:
+                emitf("0b%d%d%d%d", rng_range(2), rng_range(2), rng_range(2),
+                                rng_range(2));
+                break;
+        case 3:
+                emitf("%d.%de%d", rng_range(100), rng_range(1000),
+                                rng_range(20) - 10);
+                break;
+        case 4:
+                emitf("'%c'", 'a' + rng_range(26));
+                break;
+        default:
+                emitf("\"literal %d with \\\"escapes\\\"\\n\"",
+                                rng_range(100000));
+                break;
+        }
+}
+
+static void
+emit_leaf(void)
+{
+        if (rng_range(2)) {
+                emit_ident();
+        } else {
+                emitf("%d", rng_range(1000));
+        }
+}
+
+// Only one operand recurses at full depth most of the time, so a tree stays
+// roughly linear in depth instead of exponential.
+static void
+emit_operand(int depth)
+{
+        if (rng_range(4) == 0) {
+                emit_expr(depth);
+        } else {
+                emit_leaf();
+        }
+}
+
+static void
+emit_expr(int depth)
+{
+        if (depth <= 0 || rng_range(16) == 0) {
+                emit_leaf();
+                return;
+        }
+        switch (rng_range(6)) {
+        case 0:
+                // The space keeps "- -x" from lexing as a decrement.
+                emitf("- ");
+                emit_expr(depth - 1);
+                break;
+        case 1:
+                emit_operand(depth - 1);
+                emitf(" ? ");
+                emit_expr(depth - 1);
+                emitf(" : ");
+                emit_operand(depth - 1);
+                break;
+        default:
+                emitf("(");
+                emit_expr(depth - 1);
+                emitf(" %s ", bin_ops[rng_range(sizeof(bin_ops) /
+                                        sizeof(*bin_ops))]);
+                emit_operand(depth - 1);
+                emitf(")");
+                break;
+        }
+}
+
+static void
+emit_idents_func(int n)
+{
+        emitf("func ");
+        emit_ident();
+        emitf("_%d(", n);
+        emit_ident();
+        emitf(": int, ");
+        emit_ident();
+        emitf(": Node*): int {\n");
+        for (int i = 0; i < 8; ++i) {
+                emitf("    ");
+                emit_ident();
+                switch (rng_range(3)) {
+                case 0:
+                        emitf(" := ");
+                        emit_ident();
+                        emitf(" + ");
+                        emit_ident();
+                        emitf(" * ");
+                        emit_ident();
+                        break;
+                case 1:
+                        emitf(" = ");
+                        emit_ident();
+                        emitf(".");
+                        emit_ident();
+                        emitf("[");
+                        emit_ident();
+                        emitf("]");
+                        break;
+                default:
+                        emitf(" += ");
+                        emit_ident();
+                        emitf("(");
+                        emit_ident();
+                        emitf(", ");
+                        emit_ident();
+                        emitf(")");
+                        break;
+                }
+                emitf(";\n");
+        }
+        emitf("    return ");
+        emit_ident();
+        emitf(";\n}\n\n");
+}
+
+static void
+emit_literals_func(int n)
+{
+        emitf("func literals_%d(): int {\n", n);
+        for (int i = 0; i < 8; ++i) {
+                emitf("    v%d := ", i);
+                emit_literal();
+                for (int j = rng_range(3); j > 0; --j) {
+                        emitf(" + ");
+                        emit_literal();
+                }
+                emitf(";\n");
+        }
+        emitf("    return v0;\n}\n\n");
+}
+
+static void
+emit_nested_func(int n)
+{
+        emitf("func nested_%d(a: int, b: int): int {\n    return ", n);
+        emit_expr(MAX_NESTING);
+        emitf(";\n}\n\n");
+}
+
+static void
+emit_small_decls(int n)
+{
+        switch (rng_range(6)) {
+        case 0:
+                emitf("func f%d(x: int): int {\n    return x + %d;\n}\n\n", n,
+                                n);
+                break;
+        case 1:
+                emitf("const C%d = %d * 2;\n\n", n, n);
+                break;
+        case 2:
+                emitf("var g%d: int = %d;\n\n", n, n);
+                break;
+        case 3:
+                emitf("struct S%d {\n    a, b: int;\n    next: S%d*;\n}\n\n",
+                                n, n);
+                break;
+        case 4:
+                emitf("enum E%d {\n    A%d,\n    B%d = %d,\n}\n\n", n, n, n,
+                                n);
+                break;
+        default:
+                emitf("typedef T%d = int[%d]*;\n\n", n, 1 + n % 16);
+                break;
+        }
+}
+
+int
+corpus_mix_from_name(const char *name)
+{
+        for (int i = 0; i < NUM_MIXES; ++i) {
+                if (strcmp(name, corpus_mix_names[i]) == 0) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+char *
+corpus_generate(CorpusMix mix, size_t size, uint64_t seed)
+{
+        char *result;
+
+        out = NULL;
+        rng_state = seed ? seed : 1;
+        for (int n = 0; buf_len(out) < size; ++n) {
+                switch (mix) {
+                case MIX_IDENTS:
+                        emit_idents_func(n);
+                        break;
+                case MIX_LITERALS:
+                        emit_literals_func(n);
+                        break;
+                case MIX_NESTED:
+                        emit_nested_func(n);
+                        break;
+                case MIX_FUNCS:
+                        emit_small_decls(n);
+                        break;
+                default:
+                        assert(0);
+                        break;
+                }
+        }
+        buf_push(out, 0);
+        --buf__hdr(out)->len;
+        result = out;
+        out = NULL;
+        return result;
+}
@@ -0,0 +1,24 @@
+#ifndef _CORPUS_H_
+#define _CORPUS_H_
+
+#include "common.h"
+
+typedef enum CorpusMix {
+        MIX_IDENTS,
+        MIX_LITERALS,
+        MIX_NESTED,
+        MIX_FUNCS,
+        NUM_MIXES
+} CorpusMix;
+
+extern const char *corpus_mix_names[NUM_MIXES];
+
+int
+corpus_mix_from_name(const char *name);
+
+// Returns a NUL-terminated stretchy buffer of at least size bytes of Ion
+// source. The same mix, size and seed always produce the same bytes.
+char *
+corpus_generate(CorpusMix mix, size_t size, uint64_t seed);
+
+#endif
@@ -0,0 +1,94 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <inttypes.h>
+#include <time.h>
+
+#include "common.h"
+#include "dtoa.h"
+
+// Measures double_to_str against printf("%.17g"), which is what the C
+// backend used to emit, on two sets of doubles: random bit patterns, which
+// need all 17 digits, and short decimals like the literals in real
+// sources. Every output is read back with strtod to check it round-trips.
+
+#define NUM_VALUES 1000000
+
+static double
+now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+bench(const char *name, const double *vals)
+{
+        char buf[DTOA_BUF_SIZE];
+        double start;
+        double shortest;
+        double printf_time;
+        size_t shortest_bytes;
+        size_t printf_bytes;
+        uint64_t fallbacks;
+
+        fallbacks = dtoa_fallbacks;
+        shortest_bytes = 0;
+        start = now();
+        for (int i = 0; i < NUM_VALUES; ++i) {
+                shortest_bytes += double_to_str(vals[i], buf);
+        }
+        shortest = now() - start;
+        fallbacks = dtoa_fallbacks - fallbacks;
+
+        printf_bytes = 0;
+        start = now();
+        for (int i = 0; i < NUM_VALUES; ++i) {
+                printf_bytes += snprintf(buf, sizeof(buf), "%.17g", vals[i]);
+        }
+        printf_time = now() - start;
+
+        for (int i = 0; i < NUM_VALUES; ++i) {
+                double_to_str(vals[i], buf);
+                if (strtod(buf, NULL) != vals[i]) {
+                        fatal("%s does not round-trip", buf);
+                }
+        }
+
+        printf("%s: shortest %.1f ns/value, %.1f bytes; %%.17g %.1f ns/value, "
+                        "%.1f bytes; %.2fx; %" PRIu64 " fallbacks\n", name,
+                        shortest * 1e9 / NUM_VALUES,
+                        (double) shortest_bytes / NUM_VALUES,
+                        printf_time * 1e9 / NUM_VALUES,
+                        (double) printf_bytes / NUM_VALUES,
+                        printf_time / shortest, fallbacks);
+}
+
+int
+main(void)
+{
+        double *vals;
+        uint64_t state;
+        uint64_t bits;
+
+        vals = xmalloc(NUM_VALUES * sizeof(double));
+        state = 0x9E3779B97F4A7C15ull;
+        for (int i = 0; i < NUM_VALUES; ++i) {
+                do {
+                        state ^= state << 13;
+                        state ^= state >> 7;
+                        state ^= state << 17;
+                        bits = state;
+                        memcpy(&vals[i], &bits, sizeof(double));
+                } while (!isfinite(vals[i]));
+        }
+        bench("random", vals);
+
+        for (int i = 0; i < NUM_VALUES; ++i) {
+                vals[i] = (i % 100000) / 1000.0;
+        }
+        bench("decimal", vals);
+        xfree(vals);
+        return 0;
+}
@@ -0,0 +1,36 @@
+#include "corpus.h"
+
+// Writes a synthetic Ion corpus to stdout:
+//   ion_gen [--mix idents|literals|nested|funcs] [--size bytes] [--seed n]
+
+int
+main(int argc, char **argv)
+{
+        char *src;
+        int mix;
+        size_t size;
+        uint64_t seed;
+
+        mix = MIX_IDENTS;
+        size = 1 << 20;
+        seed = 1;
+        for (int i = 1; i + 1 < argc; i += 2) {
+                if (strcmp(argv[i], "--mix") == 0) {
+                        mix = corpus_mix_from_name(argv[i + 1]);
+                        if (mix < 0) {
+                                fatal("unknown mix '%s'", argv[i + 1]);
+                        }
+                } else if (strcmp(argv[i], "--size") == 0) {
+                        size = strtoull(argv[i + 1], NULL, 10);
+                } else if (strcmp(argv[i], "--seed") == 0) {
+                        seed = strtoull(argv[i + 1], NULL, 10);
+                } else {
+                        fatal("unknown option '%s'", argv[i]);
+                }
+        }
+
+        src = corpus_generate(mix, size, seed);
+        fwrite(src, 1, buf_len(src), stdout);
+        buf_free(src);
+        return 0;
+}
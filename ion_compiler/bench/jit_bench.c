@@ -0,0 +1,335 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+
+#include "ast.h"
+#include "common.h"
+#include "jit.h"
+
+// Runs the same kernels through the JIT and through the C compiler at the
+// optimization level the bench target is built with (-O2), and reports the
+// best of several runs for each.
+
+#define RUNS 5
+
+#define BLOCK(...) ((StmtBlock) { (Stmt *[]) { __VA_ARGS__ }, \
+                sizeof((Stmt *[]) { __VA_ARGS__ }) / sizeof(Stmt *) })
+#define NAME(x) expr_name(str_intern(x))
+#define BIN(op, l, r) expr_binary((op), (l), (r))
+#define INT(x) expr_int(x)
+#define DEF(x, e) stmt_auto_assign(str_intern(x), (e))
+#define SET(x, e) stmt_assign('=', NAME(x), (e))
+
+typedef int64_t (*Kernel)(int64_t);
+
+typedef struct Bench {
+        const char *name;
+        int64_t arg;
+        Kernel native;
+} Bench;
+
+static int64_t __attribute__((noinline))
+fib_c(int64_t n)
+{
+        if (n < 2) {
+                return n;
+        }
+        return fib_c(n - 1) + fib_c(n - 2);
+}
+
+static int64_t __attribute__((noinline))
+mix_c(int64_t n)
+{
+        int64_t h;
+
+        h = 0;
+        for (int64_t i = 0; i < n; i++) {
+                h = h * 31 + (i ^ (i >> 3));
+        }
+        return h;
+}
+
+static int64_t __attribute__((noinline))
+gcd_sum_c(int64_t n)
+{
+        int64_t s;
+        int64_t a;
+        int64_t b;
+        int64_t t;
+
+        s = 0;
+        for (int64_t i = 1; i < n; i++) {
+                a = i;
+                b = 1000003 % i + 1;
+                while (b != 0) {
+                        t = b;
+                        b = a % b;
+                        a = t;
+                }
+                s += a;
+        }
+        return s;
+}
+
+static int64_t __attribute__((noinline))
+collatz_sum_c(int64_t n)
+{
+        int64_t s;
+        int64_t x;
+
+        s = 0;
+        for (int64_t i = 1; i < n; i++) {
+                x = i;
+                while (x != 1) {
+                        x = x & 1 ? 3 * x + 1 : x >> 1;
+                        s++;
+                }
+        }
+        return s;
+}
+
+// Sums a value picked by a 12 way switch on a hash of i, so that the
+// branches are hard to predict.
+static int64_t __attribute__((noinline))
+dispatch_sum_c(int64_t n)
+{
+        int64_t s;
+
+        s = 0;
+        for (int64_t i = 0; i < n; i++) {
+                switch ((i * 2654435761 >> 7) & 15) {
+                case 0: s += 1; break;
+                case 1: s += 2; break;
+                case 2: s += 5; break;
+                case 3: s += 10; break;
+                case 4: s += 17; break;
+                case 5: s += 26; break;
+                case 6: s += 37; break;
+                case 7: s += 50; break;
+                case 8: s += 65; break;
+                case 9: s += 82; break;
+                case 10: s += 101; break;
+                case 11: s += 122; break;
+                default: s -= 1; break;
+                }
+        }
+        return s;
+}
+
+// Sums the harmonic series in doubles, the way the JIT's SSE code adds
+// them, and returns it scaled to an integer.
+static int64_t __attribute__((noinline))
+harmonic_c(int64_t n)
+{
+        double s;
+
+        s = 0;
+        for (int64_t i = 1; i < n; i++) {
+                s += 1.0 / i;
+        }
+        return (int64_t) (s * 1e9);
+}
+
+// The cases are made in a loop, so their blocks are allocated rather than
+// compound literals.
+static SwitchCase
+dispatch_case(Expr *val, Stmt *stmt)
+{
+        SwitchCase c = { .block = { xmalloc(sizeof(Stmt *)), 1 } };
+
+        c.block.stmts[0] = stmt;
+        if (val) {
+                c.exprs = xmalloc(sizeof(Expr *));
+                c.exprs[0] = val;
+                c.num_exprs = 1;
+        } else {
+                c.is_default = true;
+        }
+        return c;
+}
+
+// The switch statement's cases; the function around it is built in main,
+// since the blocks BLOCK makes only live as long as the enclosing block.
+static SwitchCase *
+dispatch_sum_cases(void)
+{
+        SwitchCase *cases;
+
+        cases = NULL;
+        for (int64_t k = 0; k < 12; ++k) {
+                buf_push(cases, dispatch_case(INT(k), stmt_assign(
+                                TOKEN_ADD_ASSIGN, NAME("s"),
+                                INT(k * k + 1))));
+        }
+        buf_push(cases, dispatch_case(NULL, stmt_assign(TOKEN_SUB_ASSIGN,
+                                        NAME("s"), INT(1))));
+        return cases;
+}
+
+static double
+now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+best_time(Kernel kernel, int64_t arg, int64_t *result)
+{
+        double best;
+        double start;
+        double elapsed;
+
+        best = 1e30;
+        for (int i = 0; i < RUNS; ++i) {
+                start = now();
+                *result = kernel(arg);
+                elapsed = now() - start;
+                if (elapsed < best) {
+                        best = elapsed;
+                }
+        }
+        return best;
+}
+
+int
+main(int argc, char **argv)
+{
+        FuncParam n[] = { { str_intern("n") } };
+        StmtBlock empty = { 0 };
+        SwitchCase *dispatch_cases = dispatch_sum_cases();
+        Bench benches[] = {
+                { "fib", 32, fib_c },
+                { "mix", 200000000, mix_c },
+                { "gcd_sum", 2000000, gcd_sum_c },
+                { "collatz_sum", 1000000, collatz_sum_c },
+                { "dispatch_sum", 100000000, dispatch_sum_c },
+                { "harmonic", 100000000, harmonic_c },
+        };
+        Decl *decls[] = {
+                decl_func(str_intern("fib"), n, 1, NULL, BLOCK(
+                        stmt_if(BIN('<', NAME("n"), INT(2)),
+                                BLOCK(stmt_return(NAME("n"))), NULL, 0,
+                                empty),
+                        stmt_return(BIN('+',
+                                expr_call(NAME("fib"), (Expr *[]) {
+                                        BIN('-', NAME("n"), INT(1)) }, 1),
+                                expr_call(NAME("fib"), (Expr *[]) {
+                                        BIN('-', NAME("n"), INT(2)) }, 1))))),
+                decl_func(str_intern("mix"), n, 1, NULL, BLOCK(
+                        DEF("h", INT(0)),
+                        stmt_for(BLOCK(DEF("i", INT(0))),
+                                BIN('<', NAME("i"), NAME("n")),
+                                BLOCK(stmt_assign(TOKEN_INC, NAME("i"),
+                                                NULL)),
+                                BLOCK(SET("h", BIN('+',
+                                        BIN('*', NAME("h"), INT(31)),
+                                        BIN('^', NAME("i"),
+                                                BIN(TOKEN_RSHIFT, NAME("i"),
+                                                        INT(3))))))),
+                        stmt_return(NAME("h")))),
+                decl_func(str_intern("gcd_sum"), n, 1, NULL, BLOCK(
+                        DEF("s", INT(0)),
+                        stmt_for(BLOCK(DEF("i", INT(1))),
+                                BIN('<', NAME("i"), NAME("n")),
+                                BLOCK(stmt_assign(TOKEN_INC, NAME("i"),
+                                                NULL)),
+                                BLOCK(DEF("a", NAME("i")),
+                                        DEF("b", BIN('+', BIN('%',
+                                                INT(1000003), NAME("i")),
+                                                INT(1))),
+                                        stmt_while(BIN(TOKEN_NOTEQ,
+                                                        NAME("b"), INT(0)),
+                                                BLOCK(DEF("t", NAME("b")),
+                                                        SET("b", BIN('%',
+                                                                NAME("a"),
+                                                                NAME("b"))),
+                                                        SET("a", NAME("t")))),
+                                        stmt_assign(TOKEN_ADD_ASSIGN,
+                                                NAME("s"), NAME("a")))),
+                        stmt_return(NAME("s")))),
+                decl_func(str_intern("collatz_sum"), n, 1, NULL, BLOCK(
+                        DEF("s", INT(0)),
+                        stmt_for(BLOCK(DEF("i", INT(1))),
+                                BIN('<', NAME("i"), NAME("n")),
+                                BLOCK(stmt_assign(TOKEN_INC, NAME("i"),
+                                                NULL)),
+                                BLOCK(DEF("x", NAME("i")),
+                                        stmt_while(BIN(TOKEN_NOTEQ,
+                                                        NAME("x"), INT(1)),
+                                                BLOCK(SET("x", expr_ternary(
+                                                        BIN('&', NAME("x"),
+                                                                INT(1)),
+                                                        BIN('+', BIN('*',
+                                                                INT(3),
+                                                                NAME("x")),
+                                                                INT(1)),
+                                                        BIN(TOKEN_RSHIFT,
+                                                                NAME("x"),
+                                                                INT(1)))),
+                                                stmt_assign(TOKEN_INC,
+                                                        NAME("s"), NULL))))),
+                        stmt_return(NAME("s")))),
+                decl_func(str_intern("dispatch_sum"), n, 1, NULL, BLOCK(
+                        DEF("s", INT(0)),
+                        stmt_for(BLOCK(DEF("i", INT(0))),
+                                BIN('<', NAME("i"), NAME("n")),
+                                BLOCK(stmt_assign(TOKEN_INC, NAME("i"),
+                                                NULL)),
+                                BLOCK(stmt_switch(BIN('&',
+                                        BIN(TOKEN_RSHIFT, BIN('*', NAME("i"),
+                                                        INT(2654435761)),
+                                                INT(7)), INT(15)),
+                                        dispatch_cases,
+                                        buf_len(dispatch_cases)))),
+                        stmt_return(NAME("s")))),
+                decl_func(str_intern("harmonic"), n, 1, NULL, BLOCK(
+                        DEF("s", expr_float(0)),
+                        stmt_for(BLOCK(DEF("i", INT(1))),
+                                BIN('<', NAME("i"), NAME("n")),
+                                BLOCK(stmt_assign(TOKEN_INC, NAME("i"),
+                                                NULL)),
+                                BLOCK(stmt_assign(TOKEN_ADD_ASSIGN,
+                                        NAME("s"), BIN('/', expr_float(1),
+                                                NAME("i"))))),
+                        stmt_return(expr_cast(typespec_name(
+                                        str_intern("int")), BIN('*',
+                                        NAME("s"), expr_float(1e9)))))),
+        };
+        JitModule *module;
+        double start;
+        double compile_time;
+        double jit_time;
+        double native_time;
+        int64_t jit_result;
+        int64_t native_result;
+
+        start = now();
+        module = jit_compile(decls, sizeof(decls) / sizeof(*decls));
+        compile_time = now() - start;
+        printf("jit: compiled %zu functions into %zu bytes in %.1f us\n\n",
+                        sizeof(decls) / sizeof(*decls), jit_code_size(module),
+                        compile_time * 1e6);
+
+        printf("%-12s %12s %12s %8s\n", "kernel", "jit ms", "cc -O2 ms",
+                        "ratio");
+        for (Bench *b = benches; b != benches + sizeof(benches) /
+                        sizeof(*benches); ++b) {
+                jit_time = best_time((Kernel) jit_func(module, b->name),
+                                b->arg, &jit_result);
+                native_time = best_time(b->native, b->arg, &native_result);
+                if (jit_result != native_result) {
+                        fatal("%s: jit returned %" PRId64 ", expected %"
+                                        PRId64, b->name, jit_result,
+                                        native_result);
+                }
+                printf("%-12s %12.2f %12.2f %7.2fx\n", b->name,
+                                jit_time * 1e3, native_time * 1e3,
+                                jit_time / native_time);
+        }
+
+        jit_free(module);
+        return 0;
+}
@@ -0,0 +1,126 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "ion.h"
+
+// Measures what libion costs per snippet for an embedder that checks and
+// runs many small ones, using nothing but ion.h. Each snippet differs in
+// its constants, as generated code would. One context is reused for all
+// of them; the last run makes a new context per snippet for comparison.
+
+#define NUM_SNIPPETS 100000
+
+static double
+now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+fail(IonContext *ctx, const char *src)
+{
+        IonDiag diag;
+
+        diag = ion_diag(ctx, 0);
+        fprintf(stderr, "%u:%u: %s\n%s\n", diag.line, diag.col, diag.msg,
+                        src);
+        exit(1);
+}
+
+static int
+make_snippet(char *buf, size_t size, int i)
+{
+        return snprintf(buf, size,
+                        "func scale(x: int): int {\n"
+                        "    y := x * %d;\n"
+                        "    if (y > %d) {\n"
+                        "        return y - %d;\n"
+                        "    }\n"
+                        "    return y + 1;\n"
+                        "}\n", i % 97 + 1, i % 1000, i % 13);
+}
+
+typedef enum BenchMode {
+        BENCH_PARSE,
+        BENCH_RESOLVE,
+        BENCH_CALL,
+        BENCH_FRESH
+} BenchMode;
+
+static const char *bench_mode_names[] = {
+        [BENCH_PARSE] = "parse",
+        [BENCH_RESOLVE] = "parse+resolve",
+        [BENCH_CALL] = "parse+resolve+call",
+        [BENCH_FRESH] = "new context+parse",
+};
+
+static void
+bench(BenchMode mode, int num_snippets)
+{
+        IonContext *ctx;
+        char src[512];
+        double start;
+        double elapsed;
+        int64_t result;
+        int64_t sum;
+        int len;
+
+        ctx = mode == BENCH_FRESH ? NULL : ion_context_create();
+        sum = 0;
+        start = now();
+        for (int i = 0; i < num_snippets; ++i) {
+                len = make_snippet(src, sizeof(src), i);
+                if (mode == BENCH_FRESH) {
+                        ctx = ion_context_create();
+                }
+                if (ion_parse(ctx, src, len)) {
+                        fail(ctx, src);
+                }
+                if (mode >= BENCH_RESOLVE && mode != BENCH_FRESH &&
+                                ion_resolve(ctx, "scale")) {
+                        fail(ctx, src);
+                }
+                if (mode == BENCH_CALL) {
+                        if (!ion_call(ctx, "scale", (int64_t[]) { i }, 1,
+                                                &result)) {
+                                fail(ctx, src);
+                        }
+                        sum += result;
+                }
+                if (mode == BENCH_FRESH) {
+                        ion_context_destroy(ctx);
+                }
+        }
+        elapsed = now() - start;
+        if (mode != BENCH_FRESH) {
+                ion_context_destroy(ctx);
+        }
+        printf("%-20s %.2f us/snippet (%d snippets)", bench_mode_names[mode],
+                        elapsed * 1e6 / num_snippets, num_snippets);
+        if (mode == BENCH_CALL) {
+                printf(", sum %lld", (long long) sum);
+        }
+        printf("\n");
+}
+
+int
+main(void)
+{
+        struct rusage usage;
+
+        bench(BENCH_PARSE, NUM_SNIPPETS);
+        bench(BENCH_RESOLVE, NUM_SNIPPETS);
+        bench(BENCH_CALL, NUM_SNIPPETS);
+        bench(BENCH_FRESH, NUM_SNIPPETS);
+        getrusage(RUSAGE_SELF, &usage);
+        printf("peak RSS %ld KB\n", usage.ru_maxrss);
+        return 0;
+}
@@ -0,0 +1,861 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cgen.h"
+#include "dtoa.h"
+#include "prof.h"
+
+// Ion has no type checker yet, so ':=' declarations become GNU C
+// __auto_type and field access always uses '.'. Every compound expression
+// is parenthesized since Ion's operator precedence differs from C's.
+
+static char *gen_buf;
+static int gen_indent;
+// Constants that cannot be C enumerators, so later constants built from
+// them cannot be either.
+static const char **nonint_consts;
+
+static void
+gen_expr(Expr *expr);
+
+static void
+gen_stmt(Stmt *stmt);
+
+static void
+genf(const char *fmt, ...)
+{
+        va_list args;
+        size_t cap;
+        int n;
+
+        cap = buf_cap(gen_buf) - buf_len(gen_buf);
+        va_start(args, fmt);
+        n = vsnprintf(gen_buf ? buf_end(gen_buf) : NULL, cap, fmt, args);
+        va_end(args);
+        if ((size_t) n >= cap) {
+                buf__fit(gen_buf, n + 1);
+                va_start(args, fmt);
+                vsnprintf(buf_end(gen_buf), n + 1, fmt, args);
+                va_end(args);
+        }
+        buf__hdr(gen_buf)->len += n;
+}
+
+static void
+gen_str(const char *str)
+{
+        size_t len;
+
+        len = strlen(str);
+        buf__fit(gen_buf, len + 1);
+        memcpy(buf_end(gen_buf), str, len);
+        buf__hdr(gen_buf)->len += len;
+}
+
+static void
+genln(void)
+{
+        size_t len;
+
+        len = 1 + 4 * gen_indent;
+        buf__fit(gen_buf, len);
+        gen_buf[buf_len(gen_buf)] = '\n';
+        memset(gen_buf + buf_len(gen_buf) + 1, ' ', len - 1);
+        buf__hdr(gen_buf)->len += len;
+}
+
+static void
+gen_u64(uint64_t val)
+{
+        char digits[20];
+        int n;
+
+        n = 0;
+        do {
+                digits[n++] = '0' + val % 10;
+                val /= 10;
+        } while (val);
+        buf__fit(gen_buf, n);
+        while (n > 0) {
+                gen_buf[buf__hdr(gen_buf)->len++] = digits[--n];
+        }
+}
+
+// Operator spellings without going through snprintf in token_kind_str.
+static const char *
+op_str(TokenKind op)
+{
+        static char chars[128][2];
+
+        if (op < 128) {
+                chars[op][0] = op;
+                return chars[op];
+        }
+        return token_kind_names[op];
+}
+
+static void
+gen_flush(Writer *w)
+{
+        writer_write(w, gen_buf, buf_len(gen_buf));
+        buf_trunc(gen_buf, 0);
+}
+
+static char *
+expr_to_str(Expr *expr)
+{
+        size_t mark;
+        char *str;
+
+        mark = buf_len(gen_buf);
+        gen_expr(expr);
+        str = strf("%.*s", (int) (buf_len(gen_buf) - mark), gen_buf + mark);
+        buf_trunc(gen_buf, mark);
+        return str;
+}
+
+// Ion types read left to right (int[3]* is a pointer to an array of three
+// ints) while C declarators wrap around the name, so the declarator is built
+// inside out starting from the name.
+char *
+type_to_cdecl(Typespec *type, const char *str)
+{
+        char *args;
+        char *arg;
+        char *size;
+        char *inner;
+        char *result;
+
+        if (!type) {
+                return strf("void%s%s", *str ? " " : "", str);
+        }
+        switch (type->kind) {
+        case TYPESPEC_NAME:
+                return strf("%s%s%s", type->name, *str ? " " : "", str);
+        case TYPESPEC_PTR:
+                inner = strf("*%s", str);
+                result = type_to_cdecl(type->ptr.elem, inner);
+                xfree(inner);
+                return result;
+        case TYPESPEC_ARRAY:
+                size = type->array.size ? expr_to_str(type->array.size) :
+                        strf("");
+                inner = strf(*str == '*' ? "(%s)[%s]" : "%s[%s]", str, size);
+                result = type_to_cdecl(type->array.elem, inner);
+                xfree(size);
+                xfree(inner);
+                return result;
+        case TYPESPEC_FUNC:
+                args = strf(type->func.num_args ? "" : "void");
+                for (size_t i = 0; i < type->func.num_args; ++i) {
+                        arg = type_to_cdecl(type->func.args[i], "");
+                        inner = strf("%s%s%s", args, i ? ", " : "", arg);
+                        xfree(args);
+                        xfree(arg);
+                        args = inner;
+                }
+                inner = strf("(*%s)(%s)", str, args);
+                result = type_to_cdecl(type->func.ret, inner);
+                xfree(args);
+                xfree(inner);
+                return result;
+        default:
+                assert(0);
+                return NULL;
+        }
+}
+
+static void
+gen_cdecl(Typespec *type, const char *name)
+{
+        char *str;
+
+        str = type_to_cdecl(type, name);
+        gen_str(str);
+        xfree(str);
+}
+
+static void
+gen_str_lit(const char *str)
+{
+        gen_str("\"");
+        for (const char *c = str; *c; ++c) {
+                switch (*c) {
+                case '\n':
+                        gen_str("\\n");
+                        break;
+                case '\r':
+                        gen_str("\\r");
+                        break;
+                case '\t':
+                        gen_str("\\t");
+                        break;
+                case '"':
+                        gen_str("\\\"");
+                        break;
+                case '\\':
+                        gen_str("\\\\");
+                        break;
+                default:
+                        if (isprint((unsigned char) *c)) {
+                                genf("%c", *c);
+                        } else {
+                                genf("\\%03o", (unsigned char) *c);
+                        }
+                        break;
+                }
+        }
+        gen_str("\"");
+}
+
+static void
+gen_float_lit(double val)
+{
+        char buf[DTOA_BUF_SIZE];
+
+        double_to_str(val, buf);
+        gen_str(buf);
+}
+
+static void
+gen_expr(Expr *expr)
+{
+        switch (expr->kind) {
+        case EXPR_INT:
+                gen_u64(expr->int_val);
+                if (expr->int_val > INT32_MAX) {
+                        gen_str("ull");
+                }
+                break;
+        case EXPR_FLOAT:
+                gen_float_lit(expr->float_val);
+                break;
+        case EXPR_STR:
+                gen_str_lit(expr->str_val);
+                break;
+        case EXPR_NAME:
+                gen_str(expr->name);
+                break;
+        case EXPR_CAST:
+                gen_str("((");
+                gen_cdecl(expr->cast.type, "");
+                gen_str(")(");
+                gen_expr(expr->cast.expr);
+                gen_str("))");
+                break;
+        case EXPR_CALL:
+                gen_expr(expr->call.expr);
+                gen_str("(");
+                for (size_t i = 0; i < expr->call.num_args; ++i) {
+                        gen_str(i ? ", " : "");
+                        gen_expr(expr->call.args[i]);
+                }
+                gen_str(")");
+                break;
+        case EXPR_INDEX:
+                gen_expr(expr->index.expr);
+                gen_str("[");
+                gen_expr(expr->index.index);
+                gen_str("]");
+                break;
+        case EXPR_FIELD:
+                gen_expr(expr->field.expr);
+                gen_str(".");
+                gen_str(expr->field.name);
+                break;
+        case EXPR_COMPOUND:
+                if (expr->compound.type) {
+                        gen_str("(");
+                        gen_cdecl(expr->compound.type, "");
+                        gen_str(")");
+                }
+                gen_str("{");
+                for (size_t i = 0; i < expr->compound.num_args; ++i) {
+                        gen_str(i ? ", " : "");
+                        gen_expr(expr->compound.args[i]);
+                }
+                gen_str("}");
+                break;
+        case EXPR_UNARY:
+                gen_str("(");
+                gen_str(op_str(expr->unary.op));
+                gen_expr(expr->unary.expr);
+                gen_str(")");
+                break;
+        case EXPR_BINARY:
+                gen_str("(");
+                gen_expr(expr->binary.left);
+                gen_str(" ");
+                gen_str(op_str(expr->binary.op));
+                gen_str(" ");
+                gen_expr(expr->binary.right);
+                gen_str(")");
+                break;
+        case EXPR_TERNARY:
+                gen_str("(");
+                gen_expr(expr->ternary.cond);
+                gen_str(" ? ");
+                gen_expr(expr->ternary.if_true);
+                gen_str(" : ");
+                gen_expr(expr->ternary.if_false);
+                gen_str(")");
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+static void
+gen_block(StmtBlock block)
+{
+        gen_str("{");
+        ++gen_indent;
+        for (size_t i = 0; i < block.num_stmts; ++i) {
+                gen_stmt(block.stmts[i]);
+        }
+        --gen_indent;
+        genln();
+        gen_str("}");
+}
+
+static bool
+is_simple_stmt(Stmt *stmt)
+{
+        return stmt->kind == STMT_ASSIGN || stmt->kind == STMT_AUTO_ASSIGN ||
+                stmt->kind == STMT_EXPR;
+}
+
+static void
+gen_simple_stmt(Stmt *stmt)
+{
+        switch (stmt->kind) {
+        case STMT_ASSIGN:
+                gen_expr(stmt->assign.left);
+                if (stmt->assign.right) {
+                        gen_str(" ");
+                        gen_str(op_str(stmt->assign.op));
+                        gen_str(" ");
+                        gen_expr(stmt->assign.right);
+                } else {
+                        gen_str(op_str(stmt->assign.op));
+                }
+                break;
+        case STMT_AUTO_ASSIGN:
+                gen_str("__auto_type ");
+                gen_str(stmt->autoassign.name);
+                gen_str(" = ");
+                gen_expr(stmt->autoassign.init);
+                break;
+        case STMT_EXPR:
+                gen_expr(stmt->expr);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+static void
+gen_for(ForStmt *for_stmt)
+{
+        bool wrap;
+
+        for (size_t i = 0; i < for_stmt->next.num_stmts; ++i) {
+                if (for_stmt->next.stmts[i]->kind == STMT_AUTO_ASSIGN ||
+                                !is_simple_stmt(for_stmt->next.stmts[i])) {
+                        fatal("cgen: for loop step must be an assignment or "
+                                        "expression");
+                }
+        }
+
+        // C only has room for a single init clause.
+        wrap = for_stmt->init.num_stmts > 1 || (for_stmt->init.num_stmts ==
+                        1 && !is_simple_stmt(for_stmt->init.stmts[0]));
+        if (wrap) {
+                gen_str("{");
+                ++gen_indent;
+                for (size_t i = 0; i < for_stmt->init.num_stmts; ++i) {
+                        gen_stmt(for_stmt->init.stmts[i]);
+                }
+                genln();
+        }
+        gen_str("for (");
+        if (!wrap && for_stmt->init.num_stmts == 1) {
+                gen_simple_stmt(for_stmt->init.stmts[0]);
+        }
+        gen_str(";");
+        if (for_stmt->cond) {
+                gen_str(" ");
+                gen_expr(for_stmt->cond);
+        }
+        gen_str(";");
+        for (size_t i = 0; i < for_stmt->next.num_stmts; ++i) {
+                gen_str(i ? ", " : " ");
+                gen_simple_stmt(for_stmt->next.stmts[i]);
+        }
+        gen_str(") ");
+        gen_block(for_stmt->block);
+        if (wrap) {
+                --gen_indent;
+                genln();
+                gen_str("}");
+        }
+}
+
+static void
+gen_switch(SwitchStmt *switch_stmt)
+{
+        SwitchCase *c;
+
+        gen_str("switch (");
+        gen_expr(switch_stmt->expr);
+        gen_str(") {");
+        for (size_t i = 0; i < switch_stmt->num_cases; ++i) {
+                c = &switch_stmt->cases[i];
+                for (size_t j = 0; j < c->num_exprs; ++j) {
+                        genln();
+                        gen_str("case ");
+                        gen_expr(c->exprs[j]);
+                        gen_str(":");
+                }
+                if (c->is_default) {
+                        genln();
+                        gen_str("default:");
+                }
+                gen_str(" {");
+                ++gen_indent;
+                for (size_t j = 0; j < c->block.num_stmts; ++j) {
+                        gen_stmt(c->block.stmts[j]);
+                }
+                genln();
+                gen_str("break;");
+                --gen_indent;
+                genln();
+                gen_str("}");
+        }
+        genln();
+        gen_str("}");
+}
+
+static void
+gen_stmt(Stmt *stmt)
+{
+        IfStmt *if_stmt;
+
+        genln();
+        switch (stmt->kind) {
+        case STMT_RETURN:
+                gen_str("return");
+                if (stmt->expr) {
+                        gen_str(" ");
+                        gen_expr(stmt->expr);
+                }
+                gen_str(";");
+                break;
+        case STMT_BREAK:
+                gen_str("break;");
+                break;
+        case STMT_CONTINUE:
+                gen_str("continue;");
+                break;
+        case STMT_BLOCK:
+                gen_block(stmt->block);
+                break;
+        case STMT_IF:
+                if_stmt = &stmt->if_stmt;
+                gen_str("if (");
+                gen_expr(if_stmt->cond);
+                gen_str(") ");
+                gen_block(if_stmt->then_block);
+                for (size_t i = 0; i < if_stmt->num_elseifs; ++i) {
+                        gen_str(" else if (");
+                        gen_expr(if_stmt->elseifs[i].cond);
+                        gen_str(") ");
+                        gen_block(if_stmt->elseifs[i].block);
+                }
+                if (if_stmt->else_block.num_stmts) {
+                        gen_str(" else ");
+                        gen_block(if_stmt->else_block);
+                }
+                break;
+        case STMT_WHILE:
+                gen_str("while (");
+                gen_expr(stmt->while_stmt.cond);
+                gen_str(") ");
+                gen_block(stmt->while_stmt.block);
+                break;
+        case STMT_DO:
+                gen_str("do ");
+                gen_block(stmt->while_stmt.block);
+                gen_str(" while (");
+                gen_expr(stmt->while_stmt.cond);
+                gen_str(");");
+                break;
+        case STMT_FOR:
+                gen_for(&stmt->for_stmt);
+                break;
+        case STMT_SWITCH:
+                gen_switch(&stmt->switch_stmt);
+                break;
+        case STMT_ASSIGN:
+        case STMT_AUTO_ASSIGN:
+        case STMT_EXPR:
+                gen_simple_stmt(stmt);
+                gen_str(";");
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+static void
+gen_func_head(Decl *decl)
+{
+        FuncDecl *func;
+        char *params;
+        char *param;
+        char *head;
+
+        func = &decl->func;
+        params = strf(func->num_params ? "" : "void");
+        for (size_t i = 0; i < func->num_params; ++i) {
+                param = type_to_cdecl(func->params[i].type,
+                                func->params[i].name);
+                head = strf("%s%s%s", params, i ? ", " : "", param);
+                xfree(params);
+                xfree(param);
+                params = head;
+        }
+        head = strf("%s(%s)", decl->name, params);
+        gen_cdecl(func->ret_type, head);
+        xfree(params);
+        xfree(head);
+}
+
+// Whether expr is an integer constant expression as far as can be told
+// without types: integer literals and other integer constants combined by
+// operators.
+static bool
+is_int_const(Expr *expr)
+{
+        switch (expr->kind) {
+        case EXPR_INT:
+                return true;
+        case EXPR_NAME:
+                for (const char **it = nonint_consts; it !=
+                                buf_end(nonint_consts); ++it) {
+                        if (*it == expr->name) {
+                                return false;
+                        }
+                }
+                return true;
+        case EXPR_UNARY:
+                return expr->unary.op != '*' && expr->unary.op != '&' &&
+                        is_int_const(expr->unary.expr);
+        case EXPR_BINARY:
+                return is_int_const(expr->binary.left) &&
+                        is_int_const(expr->binary.right);
+        case EXPR_TERNARY:
+                return is_int_const(expr->ternary.cond) &&
+                        is_int_const(expr->ternary.if_true) &&
+                        is_int_const(expr->ternary.if_false);
+        default:
+                return false;
+        }
+}
+
+void
+cgen_forward_decl(Writer *w, Decl *decl)
+{
+        switch (decl->kind) {
+        case DECL_STRUCT:
+        case DECL_UNION:
+                genf("typedef %s %s %s;\n", decl->kind == DECL_STRUCT ?
+                                "struct" : "union", decl->name, decl->name);
+                break;
+        case DECL_FUNC:
+                gen_func_head(decl);
+                gen_str(";\n");
+                break;
+        default:
+                break;
+        }
+        gen_flush(w);
+}
+
+void
+cgen_decl(Writer *w, Decl *decl)
+{
+        AggregateItem *item;
+
+        gen_indent = 0;
+        switch (decl->kind) {
+        case DECL_ENUM:
+                genf(decl->name ? "typedef enum %s {" : "enum {",
+                                decl->name);
+                ++gen_indent;
+                for (size_t i = 0; i < decl->enum_decl.num_items; ++i) {
+                        genln();
+                        gen_str(decl->enum_decl.items[i].name);
+                        if (decl->enum_decl.items[i].init) {
+                                gen_str(" = ");
+                                gen_expr(decl->enum_decl.items[i].init);
+                        }
+                        gen_str(",");
+                }
+                --gen_indent;
+                genln();
+                genf(decl->name ? "} %s;" : "};", decl->name);
+                break;
+        case DECL_STRUCT:
+        case DECL_UNION:
+                genf("%s %s {", decl->kind == DECL_STRUCT ? "struct" :
+                                "union", decl->name);
+                ++gen_indent;
+                for (size_t i = 0; i < decl->aggregate.num_items; ++i) {
+                        item = &decl->aggregate.items[i];
+                        for (size_t j = 0; j < item->num_names; ++j) {
+                                genln();
+                                gen_cdecl(item->type, item->names[j]);
+                                gen_str(";");
+                        }
+                }
+                --gen_indent;
+                genln();
+                gen_str("};");
+                break;
+        case DECL_VAR:
+                if (decl->var.type) {
+                        gen_cdecl(decl->var.type, decl->name);
+                } else {
+                        genf("__auto_type %s", decl->name);
+                }
+                if (decl->var.expr) {
+                        gen_str(" = ");
+                        gen_expr(decl->var.expr);
+                }
+                gen_str(";");
+                break;
+        case DECL_CONST:
+                if (is_int_const(decl->const_decl.expr)) {
+                        genf("enum { %s = ", decl->name);
+                        gen_expr(decl->const_decl.expr);
+                        gen_str(" };");
+                } else {
+                        buf_push(nonint_consts, decl->name);
+                        genf("static const __auto_type %s = ", decl->name);
+                        gen_expr(decl->const_decl.expr);
+                        gen_str(";");
+                }
+                break;
+        case DECL_TYPEDEF:
+                gen_str("typedef ");
+                gen_cdecl(decl->typedef_decl.type, decl->name);
+                gen_str(";");
+                break;
+        case DECL_FUNC:
+                gen_func_head(decl);
+                gen_str(" ");
+                gen_block(decl->func.block);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+        gen_str("\n\n");
+        gen_flush(w);
+}
+
+void
+cgen_decls(Writer *w, Decl **decls, size_t num_decls)
+{
+        // A fatal error may have left a partial declaration behind.
+        buf_trunc(gen_buf, 0);
+        buf_trunc(nonint_consts, 0);
+        for (size_t i = 0; i < num_decls; ++i) {
+                cgen_forward_decl(w, decls[i]);
+        }
+        writer_write(w, "\n", 1);
+        for (size_t i = 0; i < num_decls; ++i) {
+                prof_decl = decls[i]->name;
+                cgen_decl(w, decls[i]);
+        }
+}
+
+#define BLOCK(...) ((StmtBlock) { (Stmt *[]) { __VA_ARGS__ }, \
+                sizeof((Stmt *[]) { __VA_ARGS__ }) / sizeof(Stmt *) })
+#define NAME(x) expr_name(str_intern(x))
+#define TYPE(x) typespec_name(str_intern(x))
+
+static void
+assert_cdecl(Typespec *type, const char *name, const char *expected)
+{
+        char *str;
+
+        str = type_to_cdecl(type, name);
+        assert(strcmp(str, expected) == 0);
+        xfree(str);
+}
+
+static void
+assert_cgen(Decl *decl, const char *expected)
+{
+        Writer *w;
+
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, -1);
+        cgen_decl(w, decl);
+        writer_flush(w);
+        assert(strcmp(w->mem, expected) == 0);
+        writer_free(w);
+        xfree(w);
+}
+
+// Feeds the C generated for decls to the system C compiler.
+static void
+assert_cgen_compiles(Decl **decls, size_t num_decls)
+{
+        Writer *w;
+        FILE *cc;
+
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, -1);
+        cgen_decls(w, decls, num_decls);
+        writer_flush(w);
+        cc = popen("cc -fsyntax-only -Werror -x c - 2>&1", "w");
+        assert(cc);
+        fwrite(w->mem, 1, buf_len(w->mem), cc);
+        assert(pclose(cc) == 0);
+        writer_free(w);
+        xfree(w);
+}
+
+void
+cgen_test(void)
+{
+        StmtBlock empty = { 0 };
+
+        assert_cdecl(TYPE("int"), "x", "int x");
+        assert_cdecl(typespec_ptr(TYPE("int")), "x", "int *x");
+        // int[3]* is a pointer to an array, int*[3] an array of pointers.
+        assert_cdecl(typespec_ptr(typespec_array(TYPE("int"),
+                                        expr_int(3))), "x", "int (*x)[3]");
+        assert_cdecl(typespec_array(typespec_ptr(TYPE("int")),
+                                expr_int(3)), "x", "int *x[3]");
+        assert_cdecl(typespec_array(typespec_array(TYPE("char"),
+                                        expr_int(4)), expr_int(2)), "x",
+                        "char x[2][4]");
+        assert_cdecl(typespec_func((Typespec *[]) { TYPE("int"),
+                                typespec_ptr(TYPE("char")) }, 2,
+                                typespec_ptr(TYPE("int"))), "f",
+                        "int *(*f)(int, char *)");
+        assert_cdecl(typespec_array(typespec_func(NULL, 0, NULL),
+                                expr_int(8)), "handlers",
+                        "void (*handlers[8])(void)");
+        assert_cdecl(typespec_ptr(TYPE("int")), "", "int *");
+
+        assert_cgen(decl_const(str_intern("N"), expr_binary('+', expr_int(1),
+                                        expr_binary('*', expr_int(2),
+                                                expr_int(3)))),
+                        "enum { N = (1 + (2 * 3)) };\n\n");
+        assert_cgen(decl_const(str_intern("PI"), expr_float(3.14)),
+                        "static const __auto_type PI = 3.14;\n\n");
+        assert_cgen_compiles((Decl *[]) {
+                        decl_const(str_intern("N"), expr_int(4)),
+                        decl_const(str_intern("PI"), expr_float(3.14)),
+                        decl_const(str_intern("TAU"), expr_binary('*',
+                                        NAME("PI"), expr_int(2))),
+                        decl_const(str_intern("GREETING"), expr_str("hi")),
+                        decl_var(str_intern("grid"), typespec_array(
+                                        TYPE("int"), NAME("N")), NULL),
+                        decl_func(str_intern("area"), NULL, 0, TYPE("double"),
+                                BLOCK(stmt_return(expr_binary('*', NAME("TAU"),
+                                                NAME("N"))))) }, 6);
+        assert_cgen(decl_var(str_intern("pi"), NULL, expr_float(3)),
+                        "__auto_type pi = 3.0;\n\n");
+        assert_cgen(decl_var(str_intern("msg"), typespec_ptr(TYPE("char")),
+                                expr_str("a\"b\n")),
+                        "char *msg = \"a\\\"b\\n\";\n\n");
+        assert_cgen(decl_typedef(str_intern("Grid"), typespec_array(
+                                        typespec_array(TYPE("int"),
+                                                NAME("N")), NAME("N"))),
+                        "typedef int Grid[N][N];\n\n");
+        assert_cgen(decl_enum(str_intern("Color"), (EnumItem[]) {
+                                { str_intern("RED"), expr_int(1) },
+                                { str_intern("GREEN") } }, 2),
+                        "typedef enum Color {\n    RED = 1,\n    GREEN,\n"
+                        "} Color;\n\n");
+        assert_cgen(decl_aggregate(DECL_STRUCT, str_intern("Vec"),
+                                (AggregateItem[]) {
+                                        { (const char *[]) { str_intern("x"),
+                                                str_intern("y") }, 2,
+                                                TYPE("float") },
+                                        { (const char *[]) {
+                                                str_intern("next") }, 1,
+                                                typespec_ptr(TYPE("Vec")) }
+                                }, 2),
+                        "struct Vec {\n    float x;\n    float y;\n"
+                        "    Vec *next;\n};\n\n");
+        assert_cgen(decl_func(str_intern("f"), (FuncParam[]) {
+                                { str_intern("n"), TYPE("int") } }, 1,
+                                TYPE("int"), BLOCK(
+                        stmt_auto_assign(str_intern("s"), expr_int(0)),
+                        stmt_for(BLOCK(stmt_auto_assign(str_intern("i"),
+                                                expr_int(0))),
+                                expr_binary('<', NAME("i"), NAME("n")),
+                                BLOCK(stmt_assign(TOKEN_INC, NAME("i"),
+                                                NULL)),
+                                BLOCK(stmt_assign(TOKEN_ADD_ASSIGN, NAME("s"),
+                                                NAME("i")))),
+                        stmt_switch(NAME("s"), (SwitchCase[]) {
+                                { (Expr *[]) { expr_int(1), expr_int(2) }, 2,
+                                        false, BLOCK(stmt_return(
+                                                expr_int(0))) },
+                                { NULL, 0, true, BLOCK(stmt_break()) }
+                        }, 2),
+                        stmt_if(expr_unary('!', NAME("s")),
+                                BLOCK(stmt_return(expr_int(1))),
+                                (ElseIf[]) { { expr_binary(TOKEN_LTEQ,
+                                                NAME("s"), expr_int(9)),
+                                        BLOCK(stmt_return(expr_int(2))) } },
+                                1, empty),
+                        stmt_do(expr_binary(TOKEN_AND, NAME("s"),
+                                        NAME("n")), BLOCK(stmt_assign(
+                                                TOKEN_DEC, NAME("s"), NULL))),
+                        stmt_return(expr_call(NAME("g"), (Expr *[]) {
+                                expr_cast(typespec_ptr(TYPE("void")),
+                                        expr_index(expr_field(NAME("v"),
+                                                        str_intern("items")),
+                                                expr_int(0))) }, 1)))),
+                        "int f(int n) {\n"
+                        "    __auto_type s = 0;\n"
+                        "    for (__auto_type i = 0; (i < n); i++) {\n"
+                        "        s += i;\n"
+                        "    }\n"
+                        "    switch (s) {\n"
+                        "    case 1:\n"
+                        "    case 2: {\n"
+                        "        return 0;\n"
+                        "        break;\n"
+                        "    }\n"
+                        "    default: {\n"
+                        "        break;\n"
+                        "        break;\n"
+                        "    }\n"
+                        "    }\n"
+                        "    if ((!s)) {\n"
+                        "        return 1;\n"
+                        "    } else if ((s <= 9)) {\n"
+                        "        return 2;\n"
+                        "    }\n"
+                        "    do {\n"
+                        "        s--;\n"
+                        "    } while ((s && n));\n"
+                        "    return g(((void *)(v.items[0])));\n"
+                        "}\n\n");
+}
+
+#undef BLOCK
+#undef NAME
+#undef TYPE
@@ -0,0 +1,27 @@
+#ifndef _CGEN_H_
+#define _CGEN_H_
+
+#include "ast.h"
+#include "common.h"
+
+// C is generated one top-level declaration at a time: each declaration is
+// rendered into a scratch buffer, handed to the writer and the buffer is
+// reused, so memory use is bounded by the largest declaration rather than
+// by the size of the module.
+
+void
+cgen_forward_decl(Writer *w, Decl *decl);
+
+void
+cgen_decl(Writer *w, Decl *decl);
+
+void
+cgen_decls(Writer *w, Decl **decls, size_t num_decls);
+
+char *
+type_to_cdecl(Typespec *type, const char *str);
+
+void
+cgen_test(void);
+
+#endif
@@ -0,0 +1,127 @@
+// Thin client for the ion compile server: forwards its arguments, working
+// directory, stdout and stderr to a running `ion --server` and exits with
+// the status the server reports.
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+
+static int
+send_request(int fd, char *payload, size_t len)
+{
+        union {
+                struct cmsghdr hdr;
+                char buf[CMSG_SPACE(2 * sizeof(int))];
+        } ctrl;
+        int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+        ServerRequest req = { SERVER_MAGIC, len };
+        struct msghdr msg = { 0 };
+        struct cmsghdr *cmsg;
+        struct iovec iov;
+        ssize_t n;
+
+        iov.iov_base = &req;
+        iov.iov_len = sizeof(req);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = sizeof(ctrl.buf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+        if (sendmsg(fd, &msg, 0) != sizeof(req)) {
+                return -1;
+        }
+        while (len) {
+                n = write(fd, payload, len);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                } else if (n <= 0) {
+                        return -1;
+                }
+                payload += n;
+                len -= n;
+        }
+        return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+        struct sockaddr_un addr = { 0 };
+        ServerReply reply;
+        const char *path;
+        const char *err;
+        char cwd[4096];
+        char *payload;
+        size_t len;
+        int fd;
+
+        addr.sun_family = AF_UNIX;
+        path = getenv(SERVER_SOCKET_ENV);
+        if (path) {
+                snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+        } else {
+                err = server_socket_path(addr.sun_path,
+                                sizeof(addr.sun_path), false);
+                if (err) {
+                        fprintf(stderr, "ionc: %s: %s\n", addr.sun_path,
+                                        err);
+                        return 1;
+                }
+        }
+
+        if (!getcwd(cwd, sizeof(cwd))) {
+                perror("ionc: getcwd");
+                return 1;
+        }
+        len = strlen(cwd) + 1;
+        for (int i = 0; i < argc; ++i) {
+                len += strlen(argv[i]) + 1;
+        }
+        if (len > SERVER_MAX_REQUEST) {
+                fprintf(stderr, "ionc: argument list too long\n");
+                return 1;
+        }
+        payload = malloc(len);
+        len = 0;
+        memcpy(payload, cwd, strlen(cwd) + 1);
+        len += strlen(cwd) + 1;
+        for (int i = 0; i < argc; ++i) {
+                memcpy(payload + len, argv[i], strlen(argv[i]) + 1);
+                len += strlen(argv[i]) + 1;
+        }
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *) &addr,
+                                sizeof(addr)) != 0) {
+                fprintf(stderr, "ionc: no compile server at %s: %s\n",
+                                addr.sun_path, strerror(errno));
+                return 1;
+        }
+        // Our stdout and stderr only go to a server run by the same user.
+        if (!server_peer_trusted(fd)) {
+                fprintf(stderr, "ionc: %s is owned by another user\n",
+                                addr.sun_path);
+                return 1;
+        }
+        if (send_request(fd, payload, len) != 0 ||
+                        read(fd, &reply, sizeof(reply)) != sizeof(reply)) {
+                fprintf(stderr, "ionc: request to %s failed\n",
+                                addr.sun_path);
+                return 1;
+        }
+        free(payload);
+        close(fd);
+        return reply.status;
+}
@@ -1,5 +1,298 @@
+#include <inttypes.h>
+#include <unistd.h>
+
 #include "common.h"
+#include "stats.h"
+
+Arena scratch_arena;
+jmp_buf *fatal_jmp;
+char **fatal_msg;
+
+#ifdef ION_ALLOC_TRACK
+#define ALLOC_MAX_SITES 1024
+#define ALLOC_NUM_BUCKETS 48
+
+typedef struct AllocSite {
+        const char *file;
+        const char *func;
+        int line;
+        uint64_t count;
+        uint64_t bytes;
+        uint64_t live;
+        uint64_t peak;
+        // hist[i] counts requests of bit width i, i.e. sizes below 2^i.
+        uint64_t hist[ALLOC_NUM_BUCKETS];
+        // Carved out of arena blocks, which are counted where they are
+        // malloced.
+        uint64_t arena_count;
+        uint64_t arena_bytes;
+} AllocSite;
+
+// Sits in front of every tracked block. The union keeps the user pointer
+// as aligned as malloc's.
+typedef union AllocHdr {
+        struct {
+                size_t size;
+                AllocSite *site;
+        };
+        long double align;
+} AllocHdr;
+
+static AllocSite alloc_sites[ALLOC_MAX_SITES];
+static size_t alloc_num_sites;
+static uint64_t alloc_live;
+static uint64_t alloc_peak;
+
+static void
+alloc_report_at_exit(void)
+{
+        alloc_report(stderr);
+}
+
+static AllocSite *
+alloc_site(const char *file, int line, const char *func)
+{
+        uintptr_t h;
+        size_t i;
+
+        h = (uintptr_t) file * 31 + line;
+        for (i = h & (ALLOC_MAX_SITES - 1); alloc_sites[i].file;
+                        i = (i + 1) & (ALLOC_MAX_SITES - 1)) {
+                if (alloc_sites[i].line == line && (alloc_sites[i].file ==
+                                        file || strcmp(alloc_sites[i].file,
+                                                file) == 0)) {
+                        return &alloc_sites[i];
+                }
+        }
+        if (alloc_num_sites == ALLOC_MAX_SITES - 1) {
+                perror("alloc_site: too many allocation sites");
+                exit(EXIT_FAILURE);
+        }
+        if (alloc_num_sites++ == 0) {
+                atexit(alloc_report_at_exit);
+        }
+        alloc_sites[i].file = file;
+        alloc_sites[i].line = line;
+        alloc_sites[i].func = func;
+        return &alloc_sites[i];
+}
+
+static void *
+alloc_track(AllocHdr *hdr, size_t num_bytes, AllocSite *site)
+{
+        int bucket;
+
+        hdr->size = num_bytes;
+        hdr->site = site;
+        bucket = 0;
+        while (bucket < ALLOC_NUM_BUCKETS - 1 && (num_bytes >> bucket)) {
+                ++bucket;
+        }
+        ++site->count;
+        ++site->hist[bucket];
+        site->bytes += num_bytes;
+        site->live += num_bytes;
+        site->peak = MAX(site->peak, site->live);
+        alloc_live += num_bytes;
+        alloc_peak = MAX(alloc_peak, alloc_live);
+        return hdr + 1;
+}
+
+static void
+alloc_untrack(AllocHdr *hdr)
+{
+        hdr->site->live -= hdr->size;
+        alloc_live -= hdr->size;
+}
+
+void *
+xmalloc_at(size_t num_bytes, const char *file, int line, const char *func)
+{
+        AllocHdr *hdr;
+
+        hdr = malloc(sizeof(AllocHdr) + num_bytes);
+        if (hdr == NULL) {
+                perror("xmalloc: failed to allocate memory");
+                exit(EXIT_FAILURE);
+        }
+        return alloc_track(hdr, num_bytes, alloc_site(file, line, func));
+}
+
+void *
+xcalloc_at(size_t num_items, size_t item_size, const char *file, int line,
+                const char *func)
+{
+        AllocHdr *hdr;
+        size_t num_bytes;
+
+        if (item_size && num_items > SIZE_MAX / item_size) {
+                perror("xcalloc: failed to allocate memory");
+                exit(EXIT_FAILURE);
+        }
+        num_bytes = num_items * item_size;
+        hdr = calloc(1, sizeof(AllocHdr) + num_bytes);
+        if (hdr == NULL) {
+                perror("xcalloc: failed to allocate memory");
+                exit(EXIT_FAILURE);
+        }
+        return alloc_track(hdr, num_bytes, alloc_site(file, line, func));
+}
+
+void *
+xrealloc_at(void *ptr, size_t num_bytes, const char *file, int line,
+                const char *func)
+{
+        AllocHdr *hdr;
+
+        hdr = NULL;
+        if (ptr) {
+                hdr = (AllocHdr *) ptr - 1;
+                alloc_untrack(hdr);
+        }
+        hdr = realloc(hdr, sizeof(AllocHdr) + num_bytes);
+        if (hdr == NULL) {
+                perror("xrealloc: failed to reallocate memory");
+                exit(EXIT_FAILURE);
+        }
+        return alloc_track(hdr, num_bytes, alloc_site(file, line, func));
+}
+
+void
+xfree(void *ptr)
+{
+        AllocHdr *hdr;
+
+        if (ptr) {
+                hdr = (AllocHdr *) ptr - 1;
+                alloc_untrack(hdr);
+                free(hdr);
+        }
+}
+
+static int
+cmp_site_bytes(const void *a, const void *b)
+{
+        const AllocSite *x = *(const AllocSite **) a;
+        const AllocSite *y = *(const AllocSite **) b;
+
+        return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+static int
+cmp_site_arena_bytes(const void *a, const void *b)
+{
+        const AllocSite *x = *(const AllocSite **) a;
+        const AllocSite *y = *(const AllocSite **) b;
+
+        return (x->arena_bytes < y->arena_bytes) -
+                (x->arena_bytes > y->arena_bytes);
+}
+
+void
+alloc_report(FILE *f)
+{
+        AllocSite **sorted;
+        uint64_t count;
+        uint64_t bytes;
+
+        AllocSite **arena_sorted;
+        size_t num_arena_sites;
+        uint64_t arena_count;
+        uint64_t arena_bytes;
 
+        sorted = malloc((alloc_num_sites + 1) * sizeof(*sorted));
+        arena_sorted = malloc((alloc_num_sites + 1) * sizeof(*sorted));
+        count = 0;
+        bytes = 0;
+        num_arena_sites = 0;
+        arena_count = 0;
+        arena_bytes = 0;
+        for (size_t i = 0, n = 0; i < ALLOC_MAX_SITES; ++i) {
+                if (alloc_sites[i].arena_count) {
+                        arena_sorted[num_arena_sites++] = &alloc_sites[i];
+                        arena_count += alloc_sites[i].arena_count;
+                        arena_bytes += alloc_sites[i].arena_bytes;
+                }
+                if (alloc_sites[i].file) {
+                        sorted[n++] = &alloc_sites[i];
+                        count += alloc_sites[i].count;
+                        bytes += alloc_sites[i].bytes;
+                }
+        }
+        qsort(sorted, alloc_num_sites, sizeof(*sorted), cmp_site_bytes);
+
+        fprintf(f, "alloc: %" PRIu64 " allocations, %" PRIu64 " bytes, peak "
+                        "live %" PRIu64 " bytes, live at exit %" PRIu64
+                        " bytes\n", count, bytes, alloc_peak, alloc_live);
+        fprintf(f, "%12s %10s %12s  %s\n", "bytes", "count", "peak live",
+                        "site");
+        for (size_t i = 0; i < alloc_num_sites; ++i) {
+                AllocSite *site = sorted[i];
+
+                if (!site->count) {
+                        continue;
+                }
+                fprintf(f, "%12" PRIu64 " %10" PRIu64 " %12" PRIu64
+                                "  %s:%d (%s)\n", site->bytes, site->count,
+                                site->peak, site->file, site->line,
+                                site->func);
+                fprintf(f, "%36s", "sizes");
+                for (int b = 0; b < ALLOC_NUM_BUCKETS; ++b) {
+                        if (site->hist[b]) {
+                                fprintf(f, " <%" PRIu64 ":%" PRIu64,
+                                                (uint64_t) 1 << b,
+                                                site->hist[b]);
+                        }
+                }
+                fprintf(f, "\n");
+        }
+
+        qsort(arena_sorted, num_arena_sites, sizeof(*arena_sorted),
+                        cmp_site_arena_bytes);
+        fprintf(f, "arena: %" PRIu64 " allocations, %" PRIu64 " bytes "
+                        "within the blocks above\n", arena_count, arena_bytes);
+        for (size_t i = 0; i < num_arena_sites; ++i) {
+                AllocSite *site = arena_sorted[i];
+
+                fprintf(f, "%12" PRIu64 " %10" PRIu64 "  %s:%d (%s)\n",
+                                site->arena_bytes, site->arena_count,
+                                site->file, site->line, site->func);
+        }
+        free(arena_sorted);
+        free(sorted);
+}
+
+void
+alloc_test(void)
+{
+        AllocSite *site;
+        uint64_t live;
+        Arena arena;
+        char *p;
+        int line;
+
+        live = alloc_live;
+        line = __LINE__ + 1;
+        p = xmalloc(100);
+        site = alloc_site(__FILE__, line, __func__);
+        assert(site->count >= 1 && site->hist[7] >= 1);
+        assert(alloc_live == live + 100);
+        p = xrealloc(p, 1000);
+        assert(alloc_live == live + 1000);
+        xfree(p);
+        assert(alloc_live == live);
+        assert(site->live == 0);
+
+        // Arena allocations are charged to their caller, not arena_grow.
+        arena = (Arena) { 0 };
+        line = __LINE__ + 1;
+        arena_alloc(&arena, 24);
+        site = alloc_site(__FILE__, line, __func__);
+        assert(site->arena_count == 1 && site->arena_bytes == 24);
+        assert(site->count == 0);
+        arena_free(&arena);
+}
+#else
 void *
 xmalloc(size_t num_bytes)
 {
@@ -37,32 +330,111 @@ xrealloc(void *ptr, size_t num_bytes)
         return ptr;
 }
 
+void
+xfree(void *ptr)
+{
+        free(ptr);
+}
+
+void
+alloc_report(FILE *f)
+{
+        fprintf(f, "alloc: tracking not compiled in (build with "
+                        "-DION_ALLOC_TRACK)\n");
+}
+
+void
+alloc_test(void)
+{
+}
+#endif
+
 void
 fatal(const char *fmt, ...)
 {
         va_list args;
+        char *msg;
+        int n;
+
+        if (fatal_jmp && fatal_msg) {
+                va_start(args, fmt);
+                n = vsnprintf(NULL, 0, fmt, args);
+                va_end(args);
+                msg = xmalloc(n + 1);
+                va_start(args, fmt);
+                vsnprintf(msg, n + 1, fmt, args);
+                va_end(args);
+                xfree(*fatal_msg);
+                *fatal_msg = msg;
+                longjmp(*fatal_jmp, 1);
+        }
         va_start(args, fmt);
         printf("FATAL: ");
         vprintf(fmt, args);
         printf("\n");
         va_end(args);
+        if (fatal_jmp) {
+                longjmp(*fatal_jmp, 1);
+        }
         exit(1);
 }
 
-void
-syntax_error(const char *fmt, ...)
+char *
+strf(const char *fmt, ...)
 {
         va_list args;
+        char *str;
+        int n;
+
         va_start(args, fmt);
-        printf("SYNTAX ERROR: ");
-        vprintf(fmt, args);
-        printf("\n");
+        n = vsnprintf(NULL, 0, fmt, args);
         va_end(args);
-        exit(1);
+        str = xmalloc(n + 1);
+        va_start(args, fmt);
+        vsnprintf(str, n + 1, fmt, args);
+        va_end(args);
+        return str;
+}
+
+// Returns the NUL-terminated contents of the file at path, or NULL if it
+// cannot be read.
+char *
+read_file(const char *path)
+{
+        FILE *file;
+        char *buf;
+        long len;
+
+        file = fopen(path, "rb");
+        if (!file) {
+                return NULL;
+        }
+        fseek(file, 0, SEEK_END);
+        len = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (len < 0) {
+                fclose(file);
+                return NULL;
+        }
+        buf = xmalloc(len + 1);
+        if (len && fread(buf, len, 1, file) != 1) {
+                fclose(file);
+                xfree(buf);
+                return NULL;
+        }
+        fclose(file);
+        buf[len] = 0;
+        return buf;
 }
 
+#ifdef ION_ALLOC_TRACK
+void *
+buf__grow_at(const void *buf, size_t new_len, size_t elem_size,
+                const char *file, int line, const char *func)
+#else
 void *
 buf__grow(const void *buf, size_t new_len, size_t elem_size)
+#endif
 {
         size_t new_cap;
         size_t new_size;
@@ -74,14 +446,35 @@ buf__grow(const void *buf, size_t new_len, size_t elem_size)
         assert(new_cap <= (SIZE_MAX - offsetof(BufHdr, buf)) / elem_size);
         new_size = (new_cap * elem_size) + offsetof(BufHdr, buf);
 
-        if (buf) {
-                new_hdr = xrealloc(buf__hdr(buf), new_size);
-        } else {
-                new_hdr = xmalloc(new_size);
+#ifdef ION_ALLOC_TRACK
+        // Charge the growth to whoever pushed, not to this function.
+        new_hdr = xrealloc_at(buf ? buf__hdr(buf) : NULL, new_size, file,
+                        line, func);
+#else
+        new_hdr = xrealloc(buf ? buf__hdr(buf) : NULL, new_size);
+#endif
+        if (!buf) {
                 new_hdr->len = 0;
         }
         new_hdr->cap = new_cap;
+        STAT_INC(buf_grows);
+        STAT_ADD(buf_grow_bytes, new_size);
+
+        return new_hdr->buf;
+}
 
+void *
+sbuf__grow(const void *buf, size_t elem_size)
+{
+        size_t new_cap;
+        BufHdr *new_hdr;
+
+        new_cap = 2 * buf_cap(buf);
+        new_hdr = arena_alloc(&scratch_arena, offsetof(BufHdr, buf) +
+                        new_cap * elem_size);
+        new_hdr->len = buf_len(buf);
+        new_hdr->cap = new_cap;
+        memcpy(new_hdr->buf, buf, buf_len(buf) * elem_size);
         return new_hdr->buf;
 }
 
@@ -110,27 +503,405 @@ buf_test(void)
         assert(buf_len(buf) == 0);
 }
 
+static void
+arena_grow(Arena *arena, size_t min_size)
+{
+        size_t next;
+        size_t size;
+        char *start;
+
+        next = arena->ptr ? arena->block + 1 : 0;
+        while (next < buf_len(arena->blocks) && (size_t) (arena->blocks[
+                                next].end - arena->blocks[next].start) <
+                        min_size) {
+                ++next;
+        }
+        if (next == buf_len(arena->blocks)) {
+                size = MAX(ARENA_BLOCK_SIZE, min_size);
+                start = xmalloc(size);
+                buf_push(arena->blocks, ((ArenaBlock) { start,
+                                        start + size }));
+        }
+        arena->block = next;
+        arena->ptr = arena->blocks[next].start;
+        arena->end = arena->blocks[next].end;
+}
+
+static void *
+arena__alloc(Arena *arena, size_t size)
+{
+        void *ptr;
+
+        size = ALIGN_UP(size, ARENA_ALIGNMENT);
+        if (size > (size_t) (arena->end - arena->ptr)) {
+                arena_grow(arena, size);
+        }
+        ptr = arena->ptr;
+        arena->ptr += size;
+        return ptr;
+}
+
+static void *
+arena__dup(Arena *arena, const void *src, size_t size)
+{
+        void *ptr;
+
+        if (size == 0) {
+                return NULL;
+        }
+        ptr = arena__alloc(arena, size);
+        memcpy(ptr, src, size);
+        return ptr;
+}
+
+#ifdef ION_ALLOC_TRACK
+static void
+alloc_track_arena(AllocSite *site, size_t size)
+{
+        ++site->arena_count;
+        site->arena_bytes += size;
+}
+
+void *
+arena_alloc_at(Arena *arena, size_t size, const char *file, int line,
+                const char *func)
+{
+        alloc_track_arena(alloc_site(file, line, func), size);
+        return arena__alloc(arena, size);
+}
+
+void *
+arena_dup_at(Arena *arena, const void *src, size_t size, const char *file,
+                int line, const char *func)
+{
+        alloc_track_arena(alloc_site(file, line, func), size);
+        return arena__dup(arena, src, size);
+}
+#else
+void *
+arena_alloc(Arena *arena, size_t size)
+{
+        return arena__alloc(arena, size);
+}
+
+void *
+arena_dup(Arena *arena, const void *src, size_t size)
+{
+        return arena__dup(arena, src, size);
+}
+#endif
+
+ArenaMark
+arena_mark(Arena *arena)
+{
+        return (ArenaMark) { arena->ptr, arena->block };
+}
+
+// Releases everything allocated since mark. Marks must be reset in LIFO
+// order.
+void
+arena_reset(Arena *arena, ArenaMark mark)
+{
+        arena->ptr = mark.ptr;
+        arena->block = mark.block;
+        arena->end = mark.ptr ? arena->blocks[mark.block].end : NULL;
+}
+
+// Bytes of blocks held by arena, used or not.
+size_t
+arena_size(Arena *arena)
+{
+        size_t size;
+
+        size = 0;
+        for (ArenaBlock *it = arena->blocks; it != buf_end(arena->blocks);
+                        ++it) {
+                size += it->end - it->start;
+        }
+        return size;
+}
+
+void
+arena_free(Arena *arena)
+{
+        for (ArenaBlock *it = arena->blocks; it != buf_end(arena->blocks);
+                        ++it) {
+                xfree(it->start);
+        }
+        buf_free(arena->blocks);
+        arena->ptr = NULL;
+        arena->end = NULL;
+        arena->block = 0;
+}
+
+void
+arena_test(void)
+{
+        Arena arena = {0};
+        ArenaMark mark;
+        char *a;
+        char *b;
+        char *big;
+        int *ints;
+
+        a = arena_alloc(&arena, 3);
+        b = arena_alloc(&arena, 5);
+        assert(b == a + ARENA_ALIGNMENT);
+        mark = arena_mark(&arena);
+        a = arena_alloc(&arena, 100);
+        big = arena_alloc(&arena, 2 * ARENA_BLOCK_SIZE);
+        big[2 * ARENA_BLOCK_SIZE - 1] = 1;
+        assert(buf_len(arena.blocks) == 2);
+        arena_reset(&arena, mark);
+        assert(arena_alloc(&arena, 100) == a);
+        assert(arena_alloc(&arena, ARENA_BLOCK_SIZE) == big);
+        assert(buf_len(arena.blocks) == 2);
+        arena_free(&arena);
+        assert(arena.blocks == NULL);
+
+        mark = arena_mark(&scratch_arena);
+        ints = buf_stack(int, 4);
+        assert(buf_len(ints) == 0 && buf_cap(ints) == 4);
+        for (int i = 0; i < 4; ++i) {
+                sbuf_push(ints, i);
+        }
+        assert(scratch_arena.ptr == mark.ptr);
+        for (int i = 4; i < 100; ++i) {
+                sbuf_push(ints, i);
+        }
+        assert(buf_len(ints) == 100 && buf_cap(ints) >= 100);
+        for (int i = 0; i < 100; ++i) {
+                assert(ints[i] == i);
+        }
+        arena_reset(&scratch_arena, mark);
+}
+
+void
+writer_init(Writer *w, int fd)
+{
+        w->fd = fd;
+        w->mem = NULL;
+        w->len = 0;
+        w->total = 0;
+}
+
+void
+writer_flush(Writer *w)
+{
+        const char *data;
+        ssize_t n;
+
+        if (w->fd < 0) {
+                buf__fit(w->mem, w->len + 1);
+                memcpy(buf_end(w->mem), w->buf, w->len);
+                buf__hdr(w->mem)->len += w->len;
+                w->mem[buf_len(w->mem)] = 0;
+        } else {
+                data = w->buf;
+                while (data != w->buf + w->len) {
+                        n = write(w->fd, data, w->buf + w->len - data);
+                        if (n < 0) {
+                                perror("writer_flush: write failed");
+                                exit(EXIT_FAILURE);
+                        }
+                        data += n;
+                }
+        }
+        w->len = 0;
+}
+
+void
+writer_write(Writer *w, const char *data, size_t len)
+{
+        size_t n;
+
+        w->total += len;
+        while (len > 0) {
+                if (w->len == WRITER_BUF_SIZE) {
+                        writer_flush(w);
+                }
+                n = WRITER_BUF_SIZE - w->len;
+                if (n > len) {
+                        n = len;
+                }
+                memcpy(w->buf + w->len, data, n);
+                w->len += n;
+                data += n;
+                len -= n;
+        }
+}
+
+void
+writer_vprintf(Writer *w, const char *fmt, va_list args)
+{
+        va_list copy;
+        char *str;
+        int n;
+
+        va_copy(copy, args);
+        n = vsnprintf(w->buf + w->len, WRITER_BUF_SIZE - w->len, fmt, copy);
+        va_end(copy);
+        assert(n >= 0);
+        if (w->len + n < WRITER_BUF_SIZE) {
+                w->len += n;
+                w->total += n;
+                return;
+        }
+
+        // Didn't fit in what was left of the buffer.
+        str = xmalloc(n + 1);
+        vsnprintf(str, n + 1, fmt, args);
+        writer_write(w, str, n);
+        xfree(str);
+}
+
+void
+writer_printf(Writer *w, const char *fmt, ...)
+{
+        va_list args;
+
+        va_start(args, fmt);
+        writer_vprintf(w, fmt, args);
+        va_end(args);
+}
+
+void
+writer_free(Writer *w)
+{
+        buf_free(w->mem);
+        w->len = 0;
+}
+
+void
+writer_test(void)
+{
+        Writer *w;
+        char big[WRITER_BUF_SIZE + 100];
+
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, -1);
+        writer_printf(w, "%d-%s", 42, "x");
+        writer_write(w, "yz", 2);
+        writer_flush(w);
+        assert(strcmp(w->mem, "42-xyz") == 0);
+
+        memset(big, 'a', sizeof(big) - 1);
+        big[sizeof(big) - 1] = 0;
+        writer_printf(w, "%s", big);
+        writer_printf(w, "!");
+        writer_flush(w);
+        assert(buf_len(w->mem) == 6 + sizeof(big));
+        assert(w->total == buf_len(w->mem));
+        assert(w->mem[buf_len(w->mem) - 1] == '!');
+        writer_free(w);
+        xfree(w);
+}
+
+// Interned strings live in their own arena and are found through an
+// open-addressing table of indices into interns, kept at most half full.
+// A string's index in interns is its symbol ID, and is also stored just
+// in front of the string so either maps to the other in O(1).
+
 static Intern *interns;
+static uint32_t *intern_slots;
+static size_t intern_cap;
+static Arena intern_arena;
 
-const char *
-str_intern_range(const char *start, const char *end)
+static uint64_t
+intern_hash(const char *str, size_t len)
+{
+        uint64_t hash;
+
+        hash = 0xcbf29ce484222325;
+        for (size_t i = 0; i < len; ++i) {
+                hash ^= (unsigned char) str[i];
+                hash *= 0x100000001b3;
+        }
+        return hash;
+}
+
+static void
+intern_grow(void)
 {
+        size_t i;
+
+        xfree(intern_slots);
+        intern_cap = intern_cap ? 2 * intern_cap : 1024;
+        intern_slots = xcalloc(intern_cap, sizeof(*intern_slots));
+        for (size_t n = 0; n < buf_len(interns); ++n) {
+                i = interns[n].hash & (intern_cap - 1);
+                while (intern_slots[i]) {
+                        i = (i + 1) & (intern_cap - 1);
+                }
+                intern_slots[i] = n + 1;
+        }
+}
+
+SymbolId
+str_intern_id(const char *start, const char *end)
+{
+        Intern *it;
+        SymbolId id;
+        uint64_t hash;
         size_t len;
+        size_t i;
         char *str;
 
+        if (2 * (buf_len(interns) + 1) > intern_cap) {
+                intern_grow();
+        }
         len = end - start;
-        for (Intern *it = interns; it != buf_end(interns); ++it) {
-                if (it->len == len && strncmp(it->str, start, len) == 0) {
-                        return it->str;
+        hash = intern_hash(start, len);
+        i = hash & (intern_cap - 1);
+        for (; intern_slots[i]; i = (i + 1) & (intern_cap - 1)) {
+                it = &interns[intern_slots[i] - 1];
+                if (it->hash == hash && it->len == len &&
+                                memcmp(it->str, start, len) == 0) {
+                        STAT_INC(intern_hits);
+                        return intern_slots[i] - 1;
                 }
         }
 
-        str = xmalloc(len + 1);
+        assert(buf_len(interns) < UINT32_MAX);
+        id = buf_len(interns);
+        str = arena_alloc(&intern_arena, sizeof(SymbolId) + len + 1);
+        memcpy(str, &id, sizeof(SymbolId));
+        str += sizeof(SymbolId);
         memcpy(str, start, len);
         str[len] = 0;
-        buf_push(interns, (Intern) { len, str });
+        buf_push(interns, (Intern) { len, str, hash });
+        intern_slots[i] = id + 1;
+        STAT_INC(intern_misses);
+        STAT_ADD(intern_bytes, len + 1);
 
-        return str;
+        return id;
+}
+
+const char *
+str_intern_range(const char *start, const char *end)
+{
+        SymbolId id;
+
+        // interns may move while the string is added.
+        id = str_intern_id(start, end);
+        return interns[id].str;
+}
+
+const char *
+symbol_str(SymbolId id)
+{
+        assert(id < buf_len(interns));
+        return interns[id].str;
+}
+
+SymbolId
+symbol_id(const char *str)
+{
+        SymbolId id;
+
+        memcpy(&id, str - sizeof(SymbolId), sizeof(SymbolId));
+        assert(id < buf_len(interns) && interns[id].str == str);
+        return id;
 }
 
 const char *
@@ -139,6 +910,31 @@ str_intern(const char *str)
         return str_intern_range(str, str + strlen(str));
 }
 
+// Number of distinct strings interned so far.
+size_t
+intern_count(void)
+{
+        return buf_len(interns);
+}
+
+// Bytes held by the intern table and its strings.
+size_t
+intern_size(void)
+{
+        return arena_size(&intern_arena) + intern_cap *
+                sizeof(*intern_slots) + buf_cap(interns) * sizeof(*interns);
+}
+
+void
+intern_reset(void)
+{
+        buf_free(interns);
+        xfree(intern_slots);
+        intern_slots = NULL;
+        intern_cap = 0;
+        arena_free(&intern_arena);
+}
+
 void
 intern_test()
 {
@@ -152,11 +948,34 @@ intern_test()
         char z[] = "hello!";
         const char *pz = str_intern(z);
         assert(pz != px);
+
+        // Enough names to make the table grow at least once.
+        char name[16];
+        size_t count = intern_count();
+        for (int i = 0; i < 5000; ++i) {
+                snprintf(name, sizeof(name), "intern_test%d", i);
+                str_intern(name);
+        }
+        assert(intern_count() == count + 5000);
+        assert(str_intern("intern_test1234") ==
+                        str_intern_range("intern_test12345",
+                                "intern_test12345" + 15));
+        assert(str_intern("hello") == px);
+
+        SymbolId id = str_intern_id(z, z + 5);
+        assert(symbol_str(id) == px && symbol_id(px) == id);
+        assert(symbol_id(pz) != id);
+        assert(symbol_id(str_intern("intern_test4999")) ==
+                        symbol_id(str_intern("intern_test4998")) + 1);
+        assert(symbol_id(str_intern("new_symbol")) == intern_count() - 1);
 }
 
 void
 common_test()
 {
+        alloc_test();
         buf_test();
+        arena_test();
+        writer_test();
         intern_test();
 }
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stddef.h>
@@ -21,11 +22,33 @@
 #define buf_len(b) ((b) ? buf__hdr(b)->len : 0)
 #define buf_cap(b) ((b) ? buf__hdr(b)->cap : 0)
 #define buf_end(b) ((b) + buf_len(b))
-#define buf_free(b) ((b) ? (free(buf__hdr(b)), (b) = NULL) : 0)
+#define buf_trunc(b, n) ((b) ? buf__hdr(b)->len = (n) : 0)
+#define buf_free(b) ((b) ? (xfree(buf__hdr(b)), (b) = NULL) : 0)
 #define buf_push(b, ...) (buf__fit((b), 1), \
                                 (b)[buf__hdr(b)->len++] = (__VA_ARGS__))
 
+// Scratch buffers start in a stack array of n elements and spill into
+// scratch_arena when they outgrow it. They are read with buf_len like any
+// stretchy buffer but must only be grown with sbuf_push and never freed;
+// their memory goes away with the enclosing block and the next reset of
+// scratch_arena.
+#define buf_stack(T, n) ((T *) (&(struct { BufHdr hdr; T items[n]; }) { \
+                                { 0, (n) } })->items)
+#define sbuf_push(b, ...) (buf__fits((b), 1) ? 0 : \
+                                ((b) = sbuf__grow((b), sizeof(*(b)))), \
+                                (b)[buf__hdr(b)->len++] = (__VA_ARGS__))
+
+// State that each thread needs its own copy of, such as the lexer's.
+#define THREAD_LOCAL __thread
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define ALIGN_UP(n, a) (((n) + (a) - 1) & ~((size_t) (a) - 1))
+
+#define ARENA_ALIGNMENT 8
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+#define WRITER_BUF_SIZE (64 * 1024)
 
 typedef struct {
         size_t len;
@@ -33,11 +56,91 @@ typedef struct {
         char buf[0];
 } BufHdr;
 
+// Buffered output. Writers with fd == -1 collect into the mem stretchy
+// buffer instead of a file descriptor.
+typedef struct Writer {
+        int fd;
+        char *mem;
+        size_t len;
+        size_t total;
+        char buf[WRITER_BUF_SIZE];
+} Writer;
+
+typedef struct ArenaBlock {
+        char *start;
+        char *end;
+} ArenaBlock;
+
+// Bump allocator over a list of blocks. Blocks are kept across resets and
+// reused, so a reset arena allocates nothing until it outgrows its old
+// high-water mark.
+typedef struct Arena {
+        char *ptr;
+        char *end;
+        ArenaBlock *blocks;
+        size_t block;
+} Arena;
+
+typedef struct ArenaMark {
+        char *ptr;
+        size_t block;
+} ArenaMark;
+
+// Interned strings are numbered densely from 0 in the order they were
+// first seen, so per-name data can live in flat arrays indexed by ID.
+typedef uint32_t SymbolId;
+
 typedef struct Intern {
         size_t len;
         const char *str;
+        uint64_t hash;
 } Intern;
 
+extern Arena scratch_arena;
+
+// When set, fatal() jumps here instead of exiting the process.
+extern jmp_buf *fatal_jmp;
+// When set as well, fatal() leaves its message here for whoever catches the
+// jump, freeing the one already there, instead of printing it.
+extern char **fatal_msg;
+
+// With -DION_ALLOC_TRACK every allocation records the file, line and
+// function that made it; alloc_report() prints the sites at exit. Memory
+// from the x* functions must be released with xfree().
+#ifdef ION_ALLOC_TRACK
+#define xmalloc(n) xmalloc_at((n), __FILE__, __LINE__, __func__)
+#define xcalloc(n, s) xcalloc_at((n), (s), __FILE__, __LINE__, __func__)
+#define xrealloc(p, n) xrealloc_at((p), (n), __FILE__, __LINE__, __func__)
+#define buf__grow(b, n, s) buf__grow_at((b), (n), (s), __FILE__, __LINE__, \
+                __func__)
+#define arena_alloc(a, n) arena_alloc_at((a), (n), __FILE__, __LINE__, \
+                __func__)
+#define arena_dup(a, s, n) arena_dup_at((a), (s), (n), __FILE__, __LINE__, \
+                __func__)
+
+void *
+xmalloc_at(size_t num_bytes, const char *file, int line, const char *func);
+
+void *
+xcalloc_at(size_t num_items, size_t item_size, const char *file, int line,
+                const char *func);
+
+void *
+xrealloc_at(void *ptr, size_t num_bytes, const char *file, int line,
+                const char *func);
+
+void *
+buf__grow_at(const void *buf, size_t new_len, size_t elem_size,
+                const char *file, int line, const char *func);
+
+void *
+arena_alloc_at(Arena *arena, size_t size, const char *file, int line,
+                const char *func);
+
+void *
+arena_dup_at(Arena *arena, const void *src, size_t size, const char *file,
+                int line, const char *func);
+#else
 void *
 xmalloc(size_t num_bytes);
 
@@ -47,24 +150,103 @@ xcalloc(size_t num_items, size_t item_size);
 void *
 xrealloc(void *ptr, size_t num_bytes);
 
+void *
+buf__grow(const void *buf, size_t new_len, size_t elem_size);
+
+void *
+arena_alloc(Arena *arena, size_t size);
+
+void *
+arena_dup(Arena *arena, const void *src, size_t size);
+#endif
+
 void
-fatal(const char *fmt, ...);
+xfree(void *ptr);
+
+void
+alloc_report(FILE *f);
 
 void
-syntax_error(const char *fmt, ...);
+alloc_test(void);
+
+void
+fatal(const char *fmt, ...);
+
+char *
+strf(const char *fmt, ...);
+
+char *
+read_file(const char *path);
 
 void *
-buf__grow(const void *buf, size_t new_len, size_t elem_size);
+sbuf__grow(const void *buf, size_t elem_size);
 
 void
 buf_test(void);
 
+ArenaMark
+arena_mark(Arena *arena);
+
+void
+arena_reset(Arena *arena, ArenaMark mark);
+
+size_t
+arena_size(Arena *arena);
+
+void
+arena_free(Arena *arena);
+
+void
+arena_test(void);
+
+void
+writer_init(Writer *w, int fd);
+
+void
+writer_flush(Writer *w);
+
+void
+writer_write(Writer *w, const char *data, size_t len);
+
+void
+writer_vprintf(Writer *w, const char *fmt, va_list args);
+
+void
+writer_printf(Writer *w, const char *fmt, ...);
+
+void
+writer_free(Writer *w);
+
+void
+writer_test(void);
+
+SymbolId
+str_intern_id(const char *start, const char *end);
+
 const char *
 str_intern_range(const char *start, const char *end);
 
+const char *
+symbol_str(SymbolId id);
+
+// The ID of str, which must have come from the intern table.
+SymbolId
+symbol_id(const char *str);
+
 const char *
 str_intern(const char *str);
 
+size_t
+intern_count(void);
+
+size_t
+intern_size(void);
+
+// Forgets every interned string. Anything still holding one, keywords
+// included, must be dropped or interned again.
+void
+intern_reset(void);
+
 void
 intern_test();
 
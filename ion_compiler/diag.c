@@ -0,0 +1,203 @@
+#include "diag.h"
+
+static DiagContext default_ctx;
+
+DiagContext *diag_ctx = &default_ctx;
+
+static const char *level_names[] = {
+        [DIAG_ERROR] = "error",
+        [DIAG_WARNING] = "warning",
+};
+
+void
+diag_begin(DiagContext *ctx, const char *path, const char *src)
+{
+        ctx->path = path;
+        ctx->src = src;
+        ctx->src_end = src ? src + strlen(src) : NULL;
+        line_table_init(&ctx->lines, src, src ? ctx->src_end - src : 0);
+        ctx->locate = NULL;
+        ctx->diags = NULL;
+        ctx->num_errors = 0;
+        diag_ctx = ctx;
+}
+
+static void
+diag_add(DiagLevel level, const char *start, const char *end,
+                const char *fmt, va_list args)
+{
+        va_list copy;
+        SrcLoc loc;
+        size_t seq;
+        char *msg;
+        int n;
+
+        va_copy(copy, args);
+        n = vsnprintf(NULL, 0, fmt, copy);
+        va_end(copy);
+        msg = xmalloc(n + 1);
+        vsnprintf(msg, n + 1, fmt, args);
+        loc = (SrcLoc) { 0 };
+        if (diag_ctx->locate && start) {
+                loc = diag_ctx->locate(start);
+        }
+        seq = buf_len(diag_ctx->diags);
+        buf_push(diag_ctx->diags, ((Diag) { level, start, end, loc, msg,
+                                seq }));
+        if (level == DIAG_ERROR) {
+                ++diag_ctx->num_errors;
+        }
+}
+
+void
+diag_verror(const char *start, const char *end, const char *fmt,
+                va_list args)
+{
+        diag_add(DIAG_ERROR, start, end, fmt, args);
+}
+
+void
+diag_error(const char *start, const char *end, const char *fmt, ...)
+{
+        va_list args;
+
+        va_start(args, fmt);
+        diag_add(DIAG_ERROR, start, end, fmt, args);
+        va_end(args);
+}
+
+void
+diag_warning(const char *start, const char *end, const char *fmt, ...)
+{
+        va_list args;
+
+        va_start(args, fmt);
+        diag_add(DIAG_WARNING, start, end, fmt, args);
+        va_end(args);
+}
+
+size_t
+diag_num_errors(void)
+{
+        return diag_ctx->num_errors;
+}
+
+static int
+cmp_diag(const void *a, const void *b)
+{
+        const Diag *x = a;
+        const Diag *y = b;
+
+        if (x->loc.line != y->loc.line) {
+                return x->loc.line < y->loc.line ? -1 : 1;
+        } else if (x->loc.col != y->loc.col) {
+                return x->loc.col < y->loc.col ? -1 : 1;
+        } else if (!x->loc.line && x->start != y->start) {
+                return x->start < y->start ? -1 : 1;
+        }
+        return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static bool
+in_source(DiagContext *ctx, const char *ptr)
+{
+        return ctx->src && ptr >= ctx->src && ptr <= ctx->src_end;
+}
+
+void
+diag_print(DiagContext *ctx, FILE *f)
+{
+        const char *line_start;
+        const char *line_end;
+        const char *end;
+        SrcLoc loc;
+
+        if (ctx->diags) {
+                qsort(ctx->diags, buf_len(ctx->diags), sizeof(Diag),
+                                cmp_diag);
+        }
+        for (Diag *it = ctx->diags; it != buf_end(ctx->diags); ++it) {
+                if (!in_source(ctx, it->start) && it->loc.line) {
+                        fprintf(f, "%s:%u:%u: %s: %s\n", ctx->path ?
+                                        ctx->path : "<input>", it->loc.line,
+                                        it->loc.col, level_names[it->level],
+                                        it->msg);
+                        continue;
+                } else if (!in_source(ctx, it->start)) {
+                        fprintf(f, "%s: %s: %s\n", ctx->path ? ctx->path :
+                                        "<input>", level_names[it->level],
+                                        it->msg);
+                        continue;
+                }
+                loc = line_table_lookup(&ctx->lines, it->start - ctx->src);
+                fprintf(f, "%s:%u:%u: %s: %s\n", ctx->path ? ctx->path :
+                                "<input>", loc.line, loc.col,
+                                level_names[it->level], it->msg);
+
+                line_start = it->start - (loc.col - 1);
+                line_end = line_start;
+                while (*line_end && *line_end != '\n') {
+                        ++line_end;
+                }
+                fprintf(f, "    %.*s\n    ", (int) (line_end - line_start),
+                                line_start);
+                for (const char *c = line_start; c < it->start; ++c) {
+                        fputc(*c == '\t' ? '\t' : ' ', f);
+                }
+                fputc('^', f);
+                end = it->end < line_end ? it->end : line_end;
+                for (const char *c = it->start + 1; c < end; ++c) {
+                        fputc('~', f);
+                }
+                fputc('\n', f);
+        }
+        if (ctx->num_errors) {
+                fprintf(f, "%zu error%s\n", ctx->num_errors,
+                                ctx->num_errors == 1 ? "" : "s");
+        }
+}
+
+void
+diag_free(DiagContext *ctx)
+{
+        for (Diag *it = ctx->diags; it != buf_end(ctx->diags); ++it) {
+                xfree(it->msg);
+        }
+        buf_free(ctx->diags);
+        line_table_free(&ctx->lines);
+        ctx->num_errors = 0;
+        if (diag_ctx == ctx) {
+                diag_ctx = &default_ctx;
+        }
+}
+
+void
+diag_test(void)
+{
+        DiagContext ctx;
+        const char *src;
+        FILE *f;
+        char out[512];
+        size_t n;
+
+        src = "a\nbb cc\n";
+        diag_begin(&ctx, "t.ion", src);
+        diag_error(src + 5, src + 7, "second %d", 2);
+        diag_warning(src, src + 1, "first");
+        diag_error(src + 2, src + 3, "middle");
+        assert(diag_num_errors() == 2);
+
+        f = tmpfile();
+        diag_print(&ctx, f);
+        rewind(f);
+        n = fread(out, 1, sizeof(out) - 1, f);
+        out[n] = 0;
+        fclose(f);
+        assert(strcmp(out,
+                        "t.ion:1:1: warning: first\n    a\n    ^\n"
+                        "t.ion:2:1: error: middle\n    bb cc\n    ^\n"
+                        "t.ion:2:4: error: second 2\n    bb cc\n       ^~\n"
+                        "2 errors\n") == 0);
+        diag_free(&ctx);
+        assert(diag_ctx != &ctx);
+}
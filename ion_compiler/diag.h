@@ -0,0 +1,68 @@
+#ifndef _DIAG_H_
+#define _DIAG_H_
+
+#include <stdbool.h>
+
+#include "common.h"
+#include "loc.h"
+
+// Diagnostics are collected rather than printed as they happen: each error
+// records the source span it refers to, compilation carries on, and
+// diag_print reports everything in source order once the caller is done.
+
+typedef enum DiagLevel {
+        DIAG_ERROR,
+        DIAG_WARNING
+} DiagLevel;
+
+typedef struct Diag {
+        DiagLevel level;
+        const char *start;
+        const char *end;
+        SrcLoc loc;
+        char *msg;
+        size_t seq;
+} Diag;
+
+typedef struct DiagContext {
+        const char *path;
+        const char *src;
+        const char *src_end;
+        LineTable lines;
+        // Inputs that are not kept in memory resolve locations as errors
+        // are reported instead of when they are printed.
+        SrcLoc (*locate)(const char *ptr);
+        Diag *diags;
+        size_t num_errors;
+} DiagContext;
+
+// Diagnostics go to the current context. Until diag_begin is called they
+// go to a default context with no source attached.
+extern DiagContext *diag_ctx;
+
+void
+diag_begin(DiagContext *ctx, const char *path, const char *src);
+
+void
+diag_verror(const char *start, const char *end, const char *fmt,
+                va_list args);
+
+void
+diag_error(const char *start, const char *end, const char *fmt, ...);
+
+void
+diag_warning(const char *start, const char *end, const char *fmt, ...);
+
+size_t
+diag_num_errors(void);
+
+void
+diag_print(DiagContext *ctx, FILE *f);
+
+void
+diag_free(DiagContext *ctx);
+
+void
+diag_test(void);
+
+#endif
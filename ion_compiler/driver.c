@@ -0,0 +1,577 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cgen.h"
+#include "driver.h"
+#include "ir.h"
+#include "lex.h"
+#include "load.h"
+#include "parse.h"
+#include "prof.h"
+#include "resolve.h"
+#include "stats.h"
+#include "switch.h"
+#include "trace.h"
+#include "unicode.h"
+#include "walk.h"
+
+SourceFile *(*source_load)(const char *path) = source_parse;
+void (*source_release)(SourceFile *file) = source_free;
+int source_jobs = 1;
+bool source_pipeline;
+
+// Whether compile writes the optimized IR of each function instead of C.
+static bool emit_ir;
+// Whether compile notes how each switch statement is dispatched.
+static bool switch_report;
+
+static void
+usage(const char *argv0)
+{
+        fatal("usage: %s [--stats | --stats-json] [-j jobs | --pipeline] "
+                        "[--export names]\n"
+                        "       %*s [--emit-ir] [--switch-report] "
+                        "[--profile out.folded]\n"
+                        "       %*s [--trace out.json] [-o out.c] "
+                        "[file.ion... | -]\n"
+                        "       %s --server [--socket path]",
+                        argv0, (int) strlen(argv0), "", (int) strlen(argv0),
+                        "", argv0);
+}
+
+// The paths are kept in scratch_arena.
+void
+parse_options(int argc, char **argv, Options *opts)
+{
+        *opts = (Options) { 0 };
+        opts->paths = arena_alloc(&scratch_arena, argc * sizeof(char *));
+        for (int i = 1; i < argc; ++i) {
+                if (strcmp(argv[i], "--stats") == 0) {
+                        opts->stats_mode = STATS_TEXT;
+                } else if (strcmp(argv[i], "--stats-json") == 0) {
+                        opts->stats_mode = STATS_JSON;
+                } else if (strcmp(argv[i], "--server") == 0) {
+                        opts->server = true;
+                } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+                        opts->socket_path = argv[++i];
+                } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                        opts->out_path = argv[++i];
+                } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                        opts->jobs = atoi(argv[++i]);
+                } else if (strcmp(argv[i], "--pipeline") == 0) {
+                        opts->pipeline = true;
+                } else if (strcmp(argv[i], "--emit-ir") == 0) {
+                        opts->emit_ir = true;
+                } else if (strcmp(argv[i], "--switch-report") == 0) {
+                        opts->switch_report = true;
+                } else if (strcmp(argv[i], "--profile") == 0 &&
+                                i + 1 < argc) {
+                        opts->profile_path = argv[++i];
+                } else if (strcmp(argv[i], "--trace") == 0 &&
+                                i + 1 < argc) {
+                        opts->trace_path = argv[++i];
+                } else if (strcmp(argv[i], "--export") == 0 &&
+                                i + 1 < argc) {
+                        opts->exports = argv[++i];
+                } else if (argv[i][0] == '-' && argv[i][1]) {
+                        usage(argv[0]);
+                } else {
+                        opts->paths[opts->num_paths++] = argv[i];
+                }
+        }
+        if (opts->num_paths > 1) {
+                // Several files all go to standard output.
+                for (size_t i = 0; i < opts->num_paths; ++i) {
+                        if (strcmp(opts->paths[i], "-") == 0) {
+                                usage(argv[0]);
+                        }
+                }
+                if (opts->out_path) {
+                        usage(argv[0]);
+                }
+        }
+        opts->path = opts->num_paths ? opts->paths[0] : NULL;
+}
+
+// Parses the lexer's input into file, with the file's arena standing in
+// for ast_arena.
+static void
+parse_source(SourceFile *file)
+{
+        Arena saved;
+
+        saved = ast_arena;
+        ast_arena = file->arena;
+        file->decls = parse_file();
+        file->arena = ast_arena;
+        ast_arena = saved;
+}
+
+// Reads and parses path into a new SourceFile. Returns NULL if the file
+// cannot be read; syntax errors are left in file->diags. A path of "-"
+// streams standard input through the lexer without keeping the source.
+SourceFile *
+source_parse(const char *path)
+{
+        SourceFile *file;
+        char *src;
+
+        if (strcmp(path, "-") == 0) {
+                STAT_PHASE_BEGIN(STATS_PHASE_PARSE);
+                file = xcalloc(1, sizeof(SourceFile));
+                file->path = strf("<stdin>");
+                prof_set_file(file->path);
+                trace_begin("parse", prof_file);
+                diag_begin(&file->diags, file->path, NULL);
+                file->diags.locate = stream_locate;
+                init_stream_fd(STDIN_FILENO, 0);
+                parse_source(file);
+                free_stream();
+                trace_end();
+                STAT_PHASE_END(STATS_PHASE_PARSE);
+                return file;
+        }
+
+        STAT_PHASE_BEGIN(STATS_PHASE_READ);
+        prof_set_file(path);
+        trace_begin("load", prof_file);
+        src = read_file(path);
+        trace_end();
+        STAT_PHASE_END(STATS_PHASE_READ);
+        if (!src) {
+                return NULL;
+        }
+        return source_parse_src(path, src);
+}
+
+// Parses src, the NUL-terminated contents of path, into a new SourceFile
+// that takes ownership of it.
+SourceFile *
+source_parse_src(const char *path, char *src)
+{
+        SourceFile *file;
+        Token *tokens;
+        size_t valid;
+
+        STAT_PHASE_BEGIN(STATS_PHASE_PARSE);
+        file = xcalloc(1, sizeof(SourceFile));
+        file->path = strf("%s", path);
+        file->src = src;
+        prof_set_file(path);
+        trace_begin("parse", prof_file);
+        diag_begin(&file->diags, file->path, src);
+        if (file->diags.src_end - src > SRCPOS_MAX) {
+                diag_error(NULL, NULL, "file is larger than 4 GB");
+                trace_end();
+                STAT_PHASE_END(STATS_PHASE_PARSE);
+                return file;
+        }
+        // Checking the whole file up front costs next to nothing for runs
+        // of ASCII and reports a bad byte once, where it is. The lexer
+        // still checks what it decodes, for sources streamed in.
+        valid = utf8_valid_prefix(src, file->diags.src_end - src);
+        if (src + valid != file->diags.src_end) {
+                diag_error(src + valid, src + valid + 1, "invalid UTF-8");
+                trace_end();
+                STAT_PHASE_END(STATS_PHASE_PARSE);
+                return file;
+        }
+        if (source_jobs > 1 && file->diags.src_end - src >=
+                        LEX_PARALLEL_MIN) {
+                trace_begin("lex", prof_file);
+                tokens = lex_parallel(src, file->diags.src_end - src,
+                                source_jobs);
+                trace_end();
+                init_stream_tokens(tokens);
+                parse_source(file);
+                free_stream();
+                buf_free(tokens);
+        } else if (source_pipeline) {
+                init_stream_pipe(src, 0);
+                parse_source(file);
+                free_stream();
+        } else {
+                init_stream(src);
+                parse_source(file);
+        }
+        trace_end();
+        STAT_PHASE_END(STATS_PHASE_PARSE);
+        return file;
+}
+
+void
+source_free(SourceFile *file)
+{
+        diag_free(&file->diags);
+        arena_free(&file->arena);
+        buf_free(file->decls);
+        xfree(file->src);
+        xfree(file->path);
+        xfree(file);
+}
+
+// Bytes held by file, for cache accounting.
+size_t
+source_size(SourceFile *file)
+{
+        size_t size;
+
+        size = sizeof(SourceFile) + buf_cap(file->decls) * sizeof(Decl *) +
+                (file->src ? strlen(file->src) + 1 : 0) +
+                arena_size(&file->arena);
+        return size;
+}
+
+void
+print_stats(StatsMode mode)
+{
+        if (mode == STATS_TEXT) {
+                stats_print(stderr);
+        } else if (mode == STATS_JSON) {
+                stats_print_json(stderr);
+        }
+}
+
+// Resolves what main and the comma-separated exports reach and returns
+// just those declarations in *live; a file with neither keeps everything.
+// The errors get a context of their own so that a file the compile server
+// has cached stays clean.
+static bool
+resolve_file(SourceFile *file, const char *exports, Decl ***live)
+{
+        DiagContext ctx;
+        Resolver r;
+        const char *name;
+        bool rooted;
+        bool ok;
+
+        STAT_PHASE_BEGIN(STATS_PHASE_RESOLVE);
+        trace_begin("resolve", prof_file);
+        diag_begin(&ctx, file->path, file->src);
+        resolver_init(&r, file->decls, buf_len(file->decls));
+        rooted = resolve_entry(&r, "main");
+        while (exports && *exports) {
+                name = exports;
+                exports += strcspn(exports, ",");
+                name = str_intern_range(name, exports);
+                if (*name && !resolve_entry(&r, name)) {
+                        diag_error(NULL, NULL, "cannot export '%s': no such "
+                                        "declaration", name);
+                }
+                rooted = true;
+                exports += *exports == ',';
+        }
+        if (!rooted) {
+                resolve_all(&r);
+        }
+        *live = resolve_live_decls(&r);
+        STAT_ADD(decls_live, buf_len(*live));
+        STAT_ADD(decls_pruned, r.num_decls - buf_len(*live));
+        resolver_free(&r);
+        trace_end();
+        STAT_PHASE_END(STATS_PHASE_RESOLVE);
+        diag_print(&ctx, stderr);
+        ok = ctx.num_errors == 0;
+        diag_free(&ctx);
+        return ok;
+}
+
+// Writes the optimized IR of each function in decls. A function that uses
+// something the IR does not cover is left out with a comment saying so,
+// and a warning on stderr saying what it was.
+static void
+emit_ir_decls(Writer *w, const char *path, Decl **decls, size_t num_decls)
+{
+        // Not a local, which could lose its value to the longjmp.
+        static char *msg;
+        jmp_buf jmp;
+        jmp_buf *saved_jmp;
+        char **saved_msg;
+        IrFunc *func;
+
+        STAT_PHASE_BEGIN(STATS_PHASE_IR);
+        saved_jmp = fatal_jmp;
+        saved_msg = fatal_msg;
+        fatal_jmp = &jmp;
+        fatal_msg = &msg;
+        for (size_t i = 0; i < num_decls; ++i) {
+                if (decls[i]->kind != DECL_FUNC) {
+                        continue;
+                }
+                prof_decl = decls[i]->name;
+                if (setjmp(jmp) == 0) {
+                        func = ir_build(decls[i]);
+                        STAT_INC(ir_funcs);
+                        STAT_ADD(ir_instrs, buf_len(func->instrs));
+                        ir_optimize(func);
+                        ir_dump(func, w);
+                        ir_func_free(func);
+                } else {
+                        fprintf(stderr, "%s: warning: %s\n", path, msg);
+                        writer_printf(w, "; %s: not supported by the IR\n",
+                                        decls[i]->name);
+                }
+        }
+        fatal_jmp = saved_jmp;
+        fatal_msg = saved_msg;
+        xfree(msg);
+        msg = NULL;
+        STAT_PHASE_END(STATS_PHASE_IR);
+}
+
+typedef struct SwitchReport {
+        SourceFile *file;
+        LineTable lines;
+        Writer *w;
+} SwitchReport;
+
+static bool
+report_switch(void *ctx, WalkFrame *frame)
+{
+        SwitchReport *report;
+        SwitchPlan plan;
+        SrcLoc loc;
+        Stmt *stmt;
+
+        if (frame->node.kind != AST_STMT ||
+                        frame->node.stmt->kind != STMT_SWITCH) {
+                return true;
+        }
+        report = ctx;
+        stmt = frame->node.stmt;
+        if (report->file->src) {
+                loc = line_table_lookup(&report->lines, stmt->pos);
+                writer_printf(report->w, "%s:%u:%u: note: switch: ",
+                                report->file->path, loc.line, loc.col);
+        } else {
+                writer_printf(report->w, "%s: note: switch: ",
+                                report->file->path);
+        }
+        if (switch_plan(&stmt->switch_stmt, &plan)) {
+                switch_plan_print(report->w, &plan);
+                switch_plan_free(&plan);
+        } else {
+                writer_printf(report->w, "compare chain, not all case values "
+                                "are constant");
+        }
+        writer_printf(report->w, "\n");
+        return true;
+}
+
+// Notes on stderr the dispatch planned for each switch in decls. Streamed
+// input is gone by now, so its notes go without line numbers.
+static void
+print_switch_report(SourceFile *file, Decl **decls, size_t num_decls)
+{
+        SwitchReport report;
+        Walker walker;
+
+        report.file = file;
+        report.lines = (LineTable) { 0 };
+        if (file->src) {
+                line_table_init(&report.lines, file->src, strlen(file->src));
+        }
+        report.w = xmalloc(sizeof(Writer));
+        writer_init(report.w, STDERR_FILENO);
+        walker = (Walker) { report_switch, NULL, &report };
+        for (size_t i = 0; i < num_decls; ++i) {
+                ast_walk(AST_NODE(AST_DECL, decls[i]), &walker, 1);
+        }
+        writer_flush(report.w);
+        writer_free(report.w);
+        xfree(report.w);
+        line_table_free(&report.lines);
+}
+
+// Compiles file to C, written to out_path or stdout, and releases it.
+// Diagnostics are printed to stderr once parsing is done; returns false if
+// there were errors, in which case no C is written. A fatal error in the
+// back end also returns false, after removing the partial output.
+static bool
+compile_source(SourceFile *file, const char *out_path, const char *exports)
+{
+        Decl **decls;
+        Writer *w;
+        jmp_buf jmp;
+        jmp_buf *saved_jmp;
+        volatile bool ok;
+        int fd;
+
+        prof_set_file(file->path);
+        diag_print(&file->diags, stderr);
+        decls = NULL;
+        if (file->diags.num_errors || !resolve_file(file, exports, &decls)) {
+                buf_free(decls);
+                source_release(file);
+                return false;
+        }
+
+        if (switch_report) {
+                print_switch_report(file, decls, buf_len(decls));
+        }
+
+        STAT_PHASE_BEGIN(STATS_PHASE_CGEN);
+        trace_begin("emit", prof_file);
+        fd = STDOUT_FILENO;
+        if (out_path) {
+                fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0) {
+                        fprintf(stderr, "%s: cannot open for writing\n",
+                                        out_path);
+                        trace_end();
+                        STAT_PHASE_END(STATS_PHASE_CGEN);
+                        buf_free(decls);
+                        source_release(file);
+                        return false;
+                }
+        }
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, fd);
+        ok = false;
+        saved_jmp = fatal_jmp;
+        fatal_jmp = &jmp;
+        if (setjmp(jmp) == 0) {
+                if (emit_ir) {
+                        emit_ir_decls(w, file->path, decls,
+                                        buf_len(decls));
+                } else {
+                        cgen_decls(w, decls, buf_len(decls));
+                }
+                writer_flush(w);
+                ok = true;
+        }
+        fatal_jmp = saved_jmp;
+        writer_free(w);
+        xfree(w);
+        if (out_path) {
+                close(fd);
+                if (!ok) {
+                        unlink(out_path);
+                }
+        }
+        trace_end();
+        STAT_PHASE_END(STATS_PHASE_CGEN);
+
+        buf_free(decls);
+        source_release(file);
+        prof_set_file(NULL);
+        return ok;
+}
+
+static bool
+compile_file(const char *path, const char *out_path, const char *exports)
+{
+        SourceFile *file;
+
+        file = source_load(path);
+        if (!file) {
+                fprintf(stderr, "%s: cannot read file\n", path);
+                return false;
+        }
+        return compile_source(file, out_path, exports);
+}
+
+// Compiles several files, one after the other, to stdout. Unless the
+// compile server is serving them from its cache, a loader reads them in
+// batches, so each file is parsed while the next ones are still being
+// read.
+static bool
+compile_files(const char **paths, size_t num_paths, const char *exports)
+{
+        LoadedFile loaded;
+        Loader *loader;
+        bool more;
+        bool ok;
+
+        ok = true;
+        if (source_load != source_parse) {
+                for (size_t i = 0; i < num_paths; ++i) {
+                        ok &= compile_file(paths[i], NULL, exports);
+                }
+                return ok;
+        }
+        loader = loader_new(paths, num_paths, 0);
+        // The loader hands the files out in order, so the wait for the ith
+        // is the wait for paths[i].
+        for (size_t i = 0;; ++i) {
+                STAT_PHASE_BEGIN(STATS_PHASE_READ);
+                prof_set_file(i < num_paths ? paths[i] : NULL);
+                trace_begin("load", prof_file);
+                more = loader_next(loader, &loaded);
+                trace_end();
+                STAT_PHASE_END(STATS_PHASE_READ);
+                if (!more) {
+                        break;
+                } else if (!loaded.src) {
+                        fprintf(stderr, "%s: cannot read file\n",
+                                        loaded.path);
+                        ok = false;
+                        continue;
+                }
+                ok &= compile_source(source_parse_src(loaded.path,
+                                        loaded.src), NULL, exports);
+        }
+        loader_free(loader);
+        return ok;
+}
+
+// Writes what --profile or --trace collected to path.
+static bool
+write_report(const char *path, void (*write)(Writer *w))
+{
+        Writer *w;
+        int fd;
+
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                fprintf(stderr, "%s: cannot open for writing\n", path);
+                return false;
+        }
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, fd);
+        write(w);
+        writer_flush(w);
+        writer_free(w);
+        xfree(w);
+        close(fd);
+        return true;
+}
+
+// Runs one compiler invocation described by opts and returns its exit
+// status.
+int
+compile(Options *opts)
+{
+        bool ok;
+
+        source_jobs = MAX(opts->jobs, 1);
+        source_pipeline = opts->pipeline;
+        emit_ir = opts->emit_ir;
+        switch_report = opts->switch_report;
+        if (opts->profile_path && !prof_start()) {
+                fprintf(stderr, "cannot start the profiler: %s\n",
+                                strerror(errno));
+                return 1;
+        }
+        if (opts->trace_path) {
+                trace_start();
+        }
+        if (opts->num_paths > 1) {
+                ok = compile_files(opts->paths, opts->num_paths,
+                                opts->exports);
+        } else {
+                ok = compile_file(opts->path, opts->out_path, opts->exports);
+        }
+        if (opts->profile_path) {
+                prof_stop();
+                ok &= write_report(opts->profile_path, prof_write);
+                fprintf(stderr, "profile: %" PRIu64 " samples written to "
+                                "%s\n", prof_samples(), opts->profile_path);
+        }
+        if (opts->trace_path) {
+                ok &= write_report(opts->trace_path, trace_write);
+        }
+        print_stats(opts->stats_mode);
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+#ifndef _DRIVER_H_
+#define _DRIVER_H_
+
+#include <stdbool.h>
+
+#include "ast.h"
+#include "common.h"
+#include "diag.h"
+
+typedef enum StatsMode {
+        STATS_OFF,
+        STATS_TEXT,
+        STATS_JSON
+} StatsMode;
+
+typedef struct Options {
+        // The first of num_paths input files, or NULL.
+        const char *path;
+        const char **paths;
+        size_t num_paths;
+        const char *out_path;
+        const char *socket_path;
+        // Comma-separated names kept alive besides main.
+        const char *exports;
+        // Where --profile writes its collapsed stacks, or NULL.
+        const char *profile_path;
+        // Where --trace writes its Chrome trace events, or NULL.
+        const char *trace_path;
+        StatsMode stats_mode;
+        int jobs;
+        bool pipeline;
+        bool emit_ir;
+        bool switch_report;
+        bool server;
+} Options;
+
+// A parsed source file. Its AST lives in its own arena so the file can be
+// dropped as a unit.
+typedef struct SourceFile {
+        char *path;
+        char *src;
+        Decl **decls;
+        DiagContext diags;
+        Arena arena;
+} SourceFile;
+
+// Where compile() gets its files from. The compile server points these at
+// its cache; by default every file is read, parsed and freed again.
+extern SourceFile *(*source_load)(const char *path);
+extern void (*source_release)(SourceFile *file);
+
+// Threads source_parse may lex a large file on.
+extern int source_jobs;
+// Whether source_parse lexes on a thread of its own, ahead of the parser.
+extern bool source_pipeline;
+
+void
+parse_options(int argc, char **argv, Options *opts);
+
+SourceFile *
+source_parse(const char *path);
+
+SourceFile *
+source_parse_src(const char *path, char *src);
+
+void
+source_free(SourceFile *file);
+
+size_t
+source_size(SourceFile *file);
+
+void
+print_stats(StatsMode mode);
+
+int
+compile(Options *opts);
+
+#endif
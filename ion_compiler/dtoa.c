@@ -0,0 +1,420 @@
+#include <float.h>
+
+#include "dtoa.h"
+#include "lex.h"
+
+// A floating point number f * 2^e with a 64-bit significand, as in
+// Loitsch's "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers".
+typedef struct DiyFp {
+        uint64_t f;
+        int e;
+} DiyFp;
+
+// Normalized 10^k for k = -348, -340, ..., 340: every eighth power is
+// enough to bring any double's exponent into [-60, -32].
+static const DiyFp cached_powers[] = {
+        { 0xFA8FD5A0081C0288ull, -1220 }, { 0xBAAEE17FA23EBF76ull, -1193 },
+        { 0x8B16FB203055AC76ull, -1166 }, { 0xCF42894A5DCE35EAull, -1140 },
+        { 0x9A6BB0AA55653B2Dull, -1113 }, { 0xE61ACF033D1A45DFull, -1087 },
+        { 0xAB70FE17C79AC6CAull, -1060 }, { 0xFF77B1FCBEBCDC4Full, -1034 },
+        { 0xBE5691EF416BD60Cull, -1007 }, { 0x8DD01FAD907FFC3Cull, -980 },
+        { 0xD3515C2831559A83ull, -954 }, { 0x9D71AC8FADA6C9B5ull, -927 },
+        { 0xEA9C227723EE8BCBull, -901 }, { 0xAECC49914078536Dull, -874 },
+        { 0x823C12795DB6CE57ull, -847 }, { 0xC21094364DFB5637ull, -821 },
+        { 0x9096EA6F3848984Full, -794 }, { 0xD77485CB25823AC7ull, -768 },
+        { 0xA086CFCD97BF97F4ull, -741 }, { 0xEF340A98172AACE5ull, -715 },
+        { 0xB23867FB2A35B28Eull, -688 }, { 0x84C8D4DFD2C63F3Bull, -661 },
+        { 0xC5DD44271AD3CDBAull, -635 }, { 0x936B9FCEBB25C996ull, -608 },
+        { 0xDBAC6C247D62A584ull, -582 }, { 0xA3AB66580D5FDAF6ull, -555 },
+        { 0xF3E2F893DEC3F126ull, -529 }, { 0xB5B5ADA8AAFF80B8ull, -502 },
+        { 0x87625F056C7C4A8Bull, -475 }, { 0xC9BCFF6034C13053ull, -449 },
+        { 0x964E858C91BA2655ull, -422 }, { 0xDFF9772470297EBDull, -396 },
+        { 0xA6DFBD9FB8E5B88Full, -369 }, { 0xF8A95FCF88747D94ull, -343 },
+        { 0xB94470938FA89BCFull, -316 }, { 0x8A08F0F8BF0F156Bull, -289 },
+        { 0xCDB02555653131B6ull, -263 }, { 0x993FE2C6D07B7FACull, -236 },
+        { 0xE45C10C42A2B3B06ull, -210 }, { 0xAA242499697392D3ull, -183 },
+        { 0xFD87B5F28300CA0Eull, -157 }, { 0xBCE5086492111AEBull, -130 },
+        { 0x8CBCCC096F5088CCull, -103 }, { 0xD1B71758E219652Cull, -77 },
+        { 0x9C40000000000000ull, -50 }, { 0xE8D4A51000000000ull, -24 },
+        { 0xAD78EBC5AC620000ull, 3 }, { 0x813F3978F8940984ull, 30 },
+        { 0xC097CE7BC90715B3ull, 56 }, { 0x8F7E32CE7BEA5C70ull, 83 },
+        { 0xD5D238A4ABE98068ull, 109 }, { 0x9F4F2726179A2245ull, 136 },
+        { 0xED63A231D4C4FB27ull, 162 }, { 0xB0DE65388CC8ADA8ull, 189 },
+        { 0x83C7088E1AAB65DBull, 216 }, { 0xC45D1DF942711D9Aull, 242 },
+        { 0x924D692CA61BE758ull, 269 }, { 0xDA01EE641A708DEAull, 295 },
+        { 0xA26DA3999AEF774Aull, 322 }, { 0xF209787BB47D6B85ull, 348 },
+        { 0xB454E4A179DD1877ull, 375 }, { 0x865B86925B9BC5C2ull, 402 },
+        { 0xC83553C5C8965D3Dull, 428 }, { 0x952AB45CFA97A0B3ull, 455 },
+        { 0xDE469FBD99A05FE3ull, 481 }, { 0xA59BC234DB398C25ull, 508 },
+        { 0xF6C69A72A3989F5Cull, 534 }, { 0xB7DCBF5354E9BECEull, 561 },
+        { 0x88FCF317F22241E2ull, 588 }, { 0xCC20CE9BD35C78A5ull, 614 },
+        { 0x98165AF37B2153DFull, 641 }, { 0xE2A0B5DC971F303Aull, 667 },
+        { 0xA8D9D1535CE3B396ull, 694 }, { 0xFB9B7CD9A4A7443Cull, 720 },
+        { 0xBB764C4CA7A44410ull, 747 }, { 0x8BAB8EEFB6409C1Aull, 774 },
+        { 0xD01FEF10A657842Cull, 800 }, { 0x9B10A4E5E9913129ull, 827 },
+        { 0xE7109BFBA19C0C9Dull, 853 }, { 0xAC2820D9623BF429ull, 880 },
+        { 0x80444B5E7AA7CF85ull, 907 }, { 0xBF21E44003ACDD2Dull, 933 },
+        { 0x8E679C2F5E44FF8Full, 960 }, { 0xD433179D9C8CB841ull, 986 },
+        { 0x9E19DB92B4E31BA9ull, 1013 }, { 0xEB96BF6EBADF77D9ull, 1039 },
+        { 0xAF87023B9BF0EE6Bull, 1066 },
+};
+
+#define CACHED_POWERS_MIN_EXP10 -348
+#define CACHED_POWERS_STEP 8
+
+// Grisu3 gives up on the few values it cannot prove shortest; no double
+// needs more digits than this.
+#define DTOA_MAX_DIGITS 17
+
+static const uint32_t pow10_u32[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+        1000000000,
+};
+
+uint64_t dtoa_fallbacks;
+
+static DiyFp
+diy_normalize(DiyFp x)
+{
+        int shift;
+
+        shift = __builtin_clzll(x.f);
+        return (DiyFp) { x.f << shift, x.e - shift };
+}
+
+// The product rounded to its upper 64 bits.
+static DiyFp
+diy_mul(DiyFp x, DiyFp y)
+{
+        unsigned __int128 p;
+
+        p = (unsigned __int128) x.f * y.f;
+        return (DiyFp) { (uint64_t) (p >> 64) + ((uint64_t) p >> 63),
+                x.e + y.e + 64 };
+}
+
+// Nudges the last digit toward w while that stays inside the unsafe
+// interval, then checks that the digits are certainly the closest to w;
+// false means Grisu cannot tell.
+static bool
+round_weed(char *digits, int len, uint64_t dist_too_high_w,
+                uint64_t unsafe_interval, uint64_t rest, uint64_t ten_kappa,
+                uint64_t unit)
+{
+        uint64_t small_dist;
+        uint64_t big_dist;
+
+        small_dist = dist_too_high_w - unit;
+        big_dist = dist_too_high_w + unit;
+        while (rest < small_dist && unsafe_interval - rest >= ten_kappa &&
+                        (rest + ten_kappa < small_dist ||
+                         small_dist - rest >= rest + ten_kappa - small_dist)) {
+                --digits[len - 1];
+                rest += ten_kappa;
+        }
+        if (rest < big_dist && unsafe_interval - rest >= ten_kappa &&
+                        (rest + ten_kappa < big_dist ||
+                         big_dist - rest > rest + ten_kappa - big_dist)) {
+                return false;
+        }
+        return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+// Generates the shortest digits of a number inside (low, high), the
+// scaled boundaries of w widened by the error of the scaling, and rounds
+// them toward w. The number is digits * 10^kappa.
+static bool
+digit_gen(DiyFp low, DiyFp w, DiyFp high, char *digits, int *len,
+                int *kappa)
+{
+        DiyFp too_low;
+        DiyFp too_high;
+        uint64_t unsafe_interval;
+        uint64_t unit;
+        uint64_t one;
+        uint64_t fractionals;
+        uint64_t rest;
+        uint32_t integrals;
+        uint32_t divisor;
+        int shift;
+
+        unit = 1;
+        too_low = (DiyFp) { low.f - unit, low.e };
+        too_high = (DiyFp) { high.f + unit, high.e };
+        unsafe_interval = too_high.f - too_low.f;
+        shift = -w.e;
+        one = 1ull << shift;
+        integrals = too_high.f >> shift;
+        fractionals = too_high.f & (one - 1);
+
+        *kappa = 10;
+        while (*kappa > 1 && pow10_u32[*kappa - 1] > integrals) {
+                --*kappa;
+        }
+        divisor = pow10_u32[*kappa - 1];
+        *len = 0;
+        while (*kappa > 0) {
+                digits[(*len)++] = '0' + integrals / divisor;
+                integrals %= divisor;
+                --*kappa;
+                rest = ((uint64_t) integrals << shift) + fractionals;
+                if (rest < unsafe_interval) {
+                        return round_weed(digits, *len, too_high.f - w.f,
+                                        unsafe_interval, rest,
+                                        (uint64_t) divisor << shift, unit);
+                }
+                divisor /= 10;
+        }
+        for (;;) {
+                fractionals *= 10;
+                unit *= 10;
+                unsafe_interval *= 10;
+                digits[(*len)++] = '0' + (fractionals >> shift);
+                fractionals &= one - 1;
+                --*kappa;
+                if (fractionals < unsafe_interval) {
+                        return round_weed(digits, *len,
+                                        (too_high.f - w.f) * unit,
+                                        unsafe_interval, fractionals, one,
+                                        unit);
+                } else if (*len == DTOA_MAX_DIGITS) {
+                        return false;
+                }
+        }
+}
+
+// The shortest digits of a positive finite val, which is then
+// digits * 10^exp10, if Grisu3 can prove them shortest and closest.
+static bool
+grisu3(double val, char *digits, int *len, int *exp10)
+{
+        DiyFp v;
+        DiyFp w;
+        DiyFp plus;
+        DiyFp minus;
+        DiyFp c;
+        uint64_t bits;
+        uint64_t frac;
+        double dk;
+        int biased;
+        int k;
+        int index;
+        int kappa;
+
+        memcpy(&bits, &val, sizeof(bits));
+        frac = bits & ((1ull << 52) - 1);
+        biased = bits >> 52 & 0x7FF;
+        if (biased) {
+                v = (DiyFp) { frac | 1ull << 52, biased - 1075 };
+        } else {
+                v = (DiyFp) { frac, -1074 };
+        }
+        w = diy_normalize(v);
+
+        // The boundaries are halfway to the neighbouring doubles; below a
+        // power of two the lower neighbour is twice as close.
+        plus = diy_normalize((DiyFp) { (v.f << 1) + 1, v.e - 1 });
+        if (frac == 0 && biased > 1) {
+                minus = (DiyFp) { (v.f << 2) - 1, v.e - 2 };
+        } else {
+                minus = (DiyFp) { (v.f << 1) - 1, v.e - 1 };
+        }
+        minus.f <<= minus.e - plus.e;
+        minus.e = plus.e;
+
+        // The smallest cached power that lifts w's exponent to -60 or more.
+        dk = (-61 - w.e) * 0.30102999566398114 + 347;
+        k = (int) dk;
+        if (dk > k) {
+                ++k;
+        }
+        index = (k >> 3) + 1;
+        c = cached_powers[index];
+        w = diy_mul(w, c);
+        assert(w.e >= -60 && w.e <= -32);
+        if (!digit_gen(diy_mul(minus, c), w, diy_mul(plus, c), digits, len,
+                                &kappa)) {
+                return false;
+        }
+        *exp10 = kappa - (CACHED_POWERS_MIN_EXP10 + index *
+                        CACHED_POWERS_STEP);
+        return true;
+}
+
+// The slow way: the fewest printf digits that strtod reads back as val.
+static void
+dtoa_fallback(double val, char *digits, int *len, int *exp10)
+{
+        char tmp[DTOA_BUF_SIZE];
+        const char *p;
+
+        for (int prec = 1; prec <= DTOA_MAX_DIGITS; ++prec) {
+                snprintf(tmp, sizeof(tmp), "%.*e", prec - 1, val);
+                if (strtod(tmp, NULL) == val) {
+                        break;
+                }
+        }
+        *len = 0;
+        for (p = tmp; *p != 'e'; ++p) {
+                if (isdigit(*p)) {
+                        digits[(*len)++] = *p;
+                }
+        }
+        *exp10 = atoi(p + 1) - (*len - 1);
+}
+
+// Lays out digits * 10^exp10 where %g would: plainly for decimal exponents
+// from -4 to 16, else in exponent form.
+static size_t
+format_digits(char *buf, const char *digits, int len, int exp10)
+{
+        char *p;
+        int point;
+
+        p = buf;
+        point = len + exp10;
+        if (point > 17 || point < -3) {
+                *p++ = digits[0];
+                if (len > 1) {
+                        *p++ = '.';
+                        memcpy(p, digits + 1, len - 1);
+                        p += len - 1;
+                }
+                p += sprintf(p, "e%d", point - 1);
+        } else if (point >= len) {
+                memcpy(p, digits, len);
+                p += len;
+                memset(p, '0', point - len);
+                p += point - len;
+                p += sprintf(p, ".0");
+        } else if (point > 0) {
+                memcpy(p, digits, point);
+                p += point;
+                *p++ = '.';
+                memcpy(p, digits + point, len - point);
+                p += len - point;
+                *p = 0;
+        } else {
+                p += sprintf(p, "0.");
+                memset(p, '0', -point);
+                p += -point;
+                memcpy(p, digits, len);
+                p += len;
+                *p = 0;
+        }
+        return p - buf;
+}
+
+// Writes the shortest literal that reads back as val into buf, which must
+// hold DTOA_BUF_SIZE bytes, and returns its length. Infinities and NaNs
+// come out as "inf" and "nan", which are not literals.
+size_t
+double_to_str(double val, char *buf)
+{
+        char digits[DTOA_BUF_SIZE];
+        char *p;
+        int len;
+        int exp10;
+
+        p = buf;
+        if (signbit(val)) {
+                *p++ = '-';
+                val = -val;
+        }
+        if (isnan(val)) {
+                return sprintf(buf, "nan");
+        } else if (isinf(val)) {
+                return p - buf + sprintf(p, "inf");
+        } else if (val == 0) {
+                return p - buf + sprintf(p, "0.0");
+        } else if (!grisu3(val, digits, &len, &exp10)) {
+                ++dtoa_fallbacks;
+                dtoa_fallback(val, digits, &len, &exp10);
+        }
+        return p - buf + format_digits(p, digits, len, exp10);
+}
+
+#define assert_dtoa(x, s) assert(double_to_str((x), buf) == strlen(s) && \
+                strcmp(buf, (s)) == 0)
+
+static uint64_t
+dtoa_test_rand(uint64_t *state)
+{
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+        return *state;
+}
+
+// Reads buf back through the lexer, as a source would.
+static bool
+dtoa_round_trips(const char *buf, double val)
+{
+        init_stream(buf);
+        return is_token(TOKEN_FLOAT) && memcmp(&token.float_val, &val,
+                        sizeof(val)) == 0;
+}
+
+void
+dtoa_test(void)
+{
+        char buf[DTOA_BUF_SIZE];
+        char digits[DTOA_BUF_SIZE];
+        uint64_t state;
+        uint64_t bits;
+        double val;
+        int len;
+        int exp10;
+        int slow_len;
+        int slow_exp10;
+
+        assert_dtoa(0.1, "0.1");
+        assert_dtoa(0.3, "0.3");
+        assert_dtoa(0.1 + 0.2, "0.30000000000000004");
+        assert_dtoa(2.0 / 3, "0.6666666666666666");
+        assert_dtoa(3.14, "3.14");
+        assert_dtoa(1.5, "1.5");
+        assert_dtoa(3, "3.0");
+        assert_dtoa(100, "100.0");
+        assert_dtoa(1e16, "10000000000000000.0");
+        assert_dtoa(1e17, "1e17");
+        assert_dtoa(123456789012345678.0, "1.2345678901234568e17");
+        assert_dtoa(0.0001, "0.0001");
+        assert_dtoa(0.00001, "1e-5");
+        assert_dtoa(1e-10, "1e-10");
+        assert_dtoa(-2.5e-300, "-2.5e-300");
+        assert_dtoa(5e-324, "5e-324");
+        assert_dtoa(2.2250738585072014e-308, "2.2250738585072014e-308");
+        assert_dtoa(DBL_MAX, "1.7976931348623157e308");
+        assert_dtoa(0.0, "0.0");
+        assert_dtoa(-0.0, "-0.0");
+        assert_dtoa(HUGE_VAL, "inf");
+        assert_dtoa(-HUGE_VAL, "-inf");
+        assert_dtoa(NAN, "nan");
+
+        // Any finite double reads back bit for bit, and Grisu's digits,
+        // when it finds them, are as few as the slow search's.
+        state = 0x9E3779B97F4A7C15ull;
+        for (int i = 0; i < 20000; ++i) {
+                bits = dtoa_test_rand(&state) & ~(1ull << 63);
+                memcpy(&val, &bits, sizeof(val));
+                if (!isfinite(val)) {
+                        continue;
+                }
+                double_to_str(val, buf);
+                assert(dtoa_round_trips(buf, val));
+                if (val != 0 && grisu3(val, digits, &len, &exp10)) {
+                        dtoa_fallback(val, buf, &slow_len, &slow_exp10);
+                        assert(len == slow_len && exp10 == slow_exp10);
+                        assert(memcmp(digits, buf, len) == 0);
+                }
+        }
+        // So do short decimals, which random bits seldom hit.
+        for (int i = 1; i < 20000; ++i) {
+                val = i / 1000.0;
+                double_to_str(val, buf);
+                assert(dtoa_round_trips(buf, val));
+                assert(strlen(buf) <= 6);
+        }
+}
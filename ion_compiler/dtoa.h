@@ -0,0 +1,24 @@
+#ifndef _DTOA_H_
+#define _DTOA_H_
+
+#include "common.h"
+
+// Shortest round-trip formatting of doubles: the fewest significant
+// digits that read back as the same double, in a form that is both a C
+// and an Ion float literal ("0.1", "100.0", "1e-10"). Grisu3 finds the
+// digits for nearly every value; the rest fall back to printf at rising
+// precision, which is exact but slow.
+
+// Enough for "-1.2345678901234567e-308" and a NUL.
+#define DTOA_BUF_SIZE 32
+
+// Values that needed the fallback so far.
+extern uint64_t dtoa_fallbacks;
+
+size_t
+double_to_str(double val, char *buf);
+
+void
+dtoa_test(void);
+
+#endif
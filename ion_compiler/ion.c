@@ -0,0 +1,494 @@
+#include "ast.h"
+#include "diag.h"
+#include "ion.h"
+#include "jit.h"
+#include "parse.h"
+#include "resolve.h"
+#include "unicode.h"
+#include "walk.h"
+
+// A snippet's AST goes in the context's own arena, which stands in for
+// ast_arena while it is parsed, as a SourceFile's does. Resetting rewinds
+// the arena and keeps its blocks, so a context that has seen one snippet
+// parses the next without asking malloc for AST memory.
+
+// Like the compile server, the library drops scratch memory beyond this
+// and starts interning over once the table outgrows its budget, provided
+// no other context still holds names from it.
+#define ION_SCRATCH_KEEP (4 << 20)
+#define ION_INTERN_BUDGET (64 << 20)
+
+struct IonContext {
+        // NUL-terminated copy of the snippet.
+        char *src;
+        size_t src_cap;
+        Decl **decls;
+        DiagContext diags;
+        Arena arena;
+        JitModule *module;
+};
+
+static size_t ion_num_contexts;
+
+IonContext *
+ion_context_create(void)
+{
+        IonContext *ctx;
+
+        if (ion_num_contexts++ == 0) {
+                init_keywords();
+        }
+        ctx = xcalloc(1, sizeof(IonContext));
+        return ctx;
+}
+
+void
+ion_context_destroy(IonContext *ctx)
+{
+        ion_reset(ctx);
+        arena_free(&ctx->arena);
+        xfree(ctx->src);
+        xfree(ctx);
+        --ion_num_contexts;
+}
+
+void
+ion_reset(IonContext *ctx)
+{
+        if (ctx->module) {
+                jit_free(ctx->module);
+                ctx->module = NULL;
+        }
+        buf_free(ctx->decls);
+        diag_free(&ctx->diags);
+        arena_reset(&ctx->arena, (ArenaMark) { 0 });
+        if (arena_size(&scratch_arena) > ION_SCRATCH_KEEP) {
+                arena_free(&scratch_arena);
+        }
+        if (ion_num_contexts == 1 && intern_size() > ION_INTERN_BUDGET) {
+                intern_reset();
+                init_keywords();
+        }
+}
+
+size_t
+ion_parse(IonContext *ctx, const char *src, size_t len)
+{
+        Arena saved;
+        size_t valid;
+
+        ion_reset(ctx);
+        if (len + 1 > ctx->src_cap) {
+                ctx->src_cap = len + 1 > 2 * ctx->src_cap ? len + 1 :
+                        2 * ctx->src_cap;
+                ctx->src = xrealloc(ctx->src, ctx->src_cap);
+        }
+        memcpy(ctx->src, src, len);
+        ctx->src[len] = 0;
+        diag_begin(&ctx->diags, NULL, ctx->src);
+        if (len > SRCPOS_MAX) {
+                diag_error(NULL, NULL, "snippet is larger than 4 GB");
+                return ctx->diags.num_errors;
+        } else if (ctx->diags.src_end != ctx->src + len) {
+                diag_error(ctx->diags.src_end, ctx->diags.src_end + 1,
+                                "NUL byte in source");
+                return ctx->diags.num_errors;
+        }
+        valid = utf8_valid_prefix(ctx->src, len);
+        if (valid != len) {
+                diag_error(ctx->src + valid, ctx->src + valid + 1,
+                                "invalid UTF-8");
+                return ctx->diags.num_errors;
+        }
+
+        init_stream(ctx->src);
+        saved = ast_arena;
+        ast_arena = ctx->arena;
+        ctx->decls = parse_file();
+        ctx->arena = ast_arena;
+        ast_arena = saved;
+        return ctx->diags.num_errors;
+}
+
+size_t
+ion_resolve(IonContext *ctx, const char *entry)
+{
+        Resolver r;
+
+        diag_ctx = &ctx->diags;
+        resolver_init(&r, ctx->decls, buf_len(ctx->decls));
+        if (!entry) {
+                resolve_all(&r);
+        } else if (!resolve_entry(&r, entry)) {
+                diag_error(NULL, NULL, "no declaration named '%s'", entry);
+        }
+        resolver_free(&r);
+        return ctx->diags.num_errors;
+}
+
+bool
+ion_call(IonContext *ctx, const char *func, const int64_t *args,
+                size_t num_args, int64_t *result)
+{
+        int64_t (*fn)(int64_t, int64_t, int64_t, int64_t, int64_t,
+                        int64_t);
+        // Not a local, which could lose its value to the longjmp.
+        static char *msg;
+        int64_t a[JIT_MAX_PARAMS];
+        jmp_buf jmp;
+        jmp_buf *saved_jmp;
+        char **saved_msg;
+        IonNode decl;
+
+        diag_ctx = &ctx->diags;
+        decl = ion_find_decl(ctx, func);
+        if (!decl.ptr || ((Decl *) decl.ptr)->kind != DECL_FUNC) {
+                diag_error(NULL, NULL, "no function named '%s'", func);
+                return false;
+        } else if (((Decl *) decl.ptr)->func.num_params != num_args) {
+                diag_error(NULL, NULL, "'%s' takes %zu arguments, not %zu",
+                                func, ((Decl *) decl.ptr)->func.num_params,
+                                num_args);
+                return false;
+        } else if (!jit_int_func((Decl *) decl.ptr)) {
+                diag_error(NULL, NULL, "'%s' does not take and return only "
+                                "integers", func);
+                return false;
+        }
+#if defined(__x86_64__)
+        if (!ctx->module) {
+                saved_jmp = fatal_jmp;
+                saved_msg = fatal_msg;
+                fatal_jmp = &jmp;
+                fatal_msg = &msg;
+                if (setjmp(jmp) == 0) {
+                        ctx->module = jit_compile(ctx->decls,
+                                        buf_len(ctx->decls));
+                }
+                fatal_jmp = saved_jmp;
+                fatal_msg = saved_msg;
+                if (!ctx->module) {
+                        jit_reset();
+                        diag_error(NULL, NULL, "%s", msg);
+                        xfree(msg);
+                        msg = NULL;
+                        return false;
+                }
+        }
+        // The arguments travel in registers, so the callee ignores any
+        // it does not take.
+        memset(a, 0, sizeof(a));
+        memcpy(a, args, num_args * sizeof(int64_t));
+        fn = jit_func(ctx->module, func);
+        *result = fn(a[0], a[1], a[2], a[3], a[4], a[5]);
+        return true;
+#else
+        (void) a;
+        (void) jmp;
+        (void) saved_jmp;
+        (void) saved_msg;
+        (void) fn;
+        (void) result;
+        diag_error(NULL, NULL, "cannot call '%s': no JIT for this machine",
+                        func);
+        return false;
+#endif
+}
+
+size_t
+ion_num_errors(IonContext *ctx)
+{
+        return ctx->diags.num_errors;
+}
+
+size_t
+ion_num_diags(IonContext *ctx)
+{
+        return buf_len(ctx->diags.diags);
+}
+
+IonDiag
+ion_diag(IonContext *ctx, size_t i)
+{
+        Diag *d;
+        SrcLoc loc;
+
+        assert(i < buf_len(ctx->diags.diags));
+        d = &ctx->diags.diags[i];
+        loc = d->loc;
+        if (d->start && d->start >= ctx->diags.src &&
+                        d->start <= ctx->diags.src_end) {
+                loc = line_table_lookup(&ctx->diags.lines,
+                                d->start - ctx->diags.src);
+        }
+        return (IonDiag) { d->msg, loc.line, loc.col,
+                d->level == DIAG_ERROR };
+}
+
+size_t
+ion_num_decls(IonContext *ctx)
+{
+        return buf_len(ctx->decls);
+}
+
+IonNode
+ion_decl(IonContext *ctx, size_t i)
+{
+        assert(i < buf_len(ctx->decls));
+        return (IonNode) { ION_NODE_DECL, ctx->decls[i] };
+}
+
+IonNode
+ion_find_decl(IonContext *ctx, const char *name)
+{
+        name = str_intern(name);
+        for (Decl **it = ctx->decls; it != buf_end(ctx->decls); ++it) {
+                if ((*it)->name == name) {
+                        return (IonNode) { ION_NODE_DECL, *it };
+                }
+        }
+        return (IonNode) { ION_NODE_NONE, NULL };
+}
+
+const char *
+ion_node_kind_name(IonNode node)
+{
+        switch (node.kind) {
+        case ION_NODE_TYPE:
+                return typespec_kind_names[((Typespec *) node.ptr)->kind];
+        case ION_NODE_EXPR:
+                return expr_kind_names[((Expr *) node.ptr)->kind];
+        case ION_NODE_STMT:
+                return stmt_kind_names[((Stmt *) node.ptr)->kind];
+        case ION_NODE_DECL:
+                return decl_kind_names[((Decl *) node.ptr)->kind];
+        default:
+                return "none";
+        }
+}
+
+const char *
+ion_node_name(IonNode node)
+{
+        const Typespec *type;
+        const Expr *expr;
+        const Stmt *stmt;
+
+        switch (node.kind) {
+        case ION_NODE_TYPE:
+                type = node.ptr;
+                return type->kind == TYPESPEC_NAME ? type->name : NULL;
+        case ION_NODE_EXPR:
+                expr = node.ptr;
+                return expr->kind == EXPR_NAME ? expr->name : NULL;
+        case ION_NODE_STMT:
+                stmt = node.ptr;
+                return stmt->kind == STMT_AUTO_ASSIGN ?
+                        stmt->autoassign.name : NULL;
+        case ION_NODE_DECL:
+                return ((Decl *) node.ptr)->name;
+        default:
+                return NULL;
+        }
+}
+
+bool
+ion_node_int(IonNode node, uint64_t *val)
+{
+        const Expr *expr;
+
+        expr = node.ptr;
+        if (node.kind != ION_NODE_EXPR || expr->kind != EXPR_INT) {
+                return false;
+        }
+        *val = expr->int_val;
+        return true;
+}
+
+bool
+ion_node_location(IonContext *ctx, IonNode node, unsigned *line,
+                unsigned *col)
+{
+        SrcPos pos;
+        SrcLoc loc;
+
+        switch (node.kind) {
+        case ION_NODE_TYPE:
+                pos = ((Typespec *) node.ptr)->pos;
+                break;
+        case ION_NODE_EXPR:
+                pos = ((Expr *) node.ptr)->pos;
+                break;
+        case ION_NODE_STMT:
+                pos = ((Stmt *) node.ptr)->pos;
+                break;
+        case ION_NODE_DECL:
+                pos = ((Decl *) node.ptr)->pos;
+                break;
+        default:
+                return false;
+        }
+        loc = line_table_lookup(&ctx->diags.lines, pos);
+        *line = loc.line;
+        *col = loc.col;
+        return true;
+}
+
+typedef struct IonVisitCtx {
+        IonVisit visit;
+        void *user;
+} IonVisitCtx;
+
+// Blocks, else-ifs and switch cases are only passed through.
+static bool
+ion_visit_pre(void *ctx, WalkFrame *frame)
+{
+        IonVisitCtx *v;
+        IonNodeKind kind;
+
+        v = ctx;
+        switch (frame->node.kind) {
+        case AST_TYPESPEC:
+                kind = ION_NODE_TYPE;
+                break;
+        case AST_EXPR:
+                kind = ION_NODE_EXPR;
+                break;
+        case AST_STMT:
+                kind = ION_NODE_STMT;
+                break;
+        case AST_DECL:
+                kind = ION_NODE_DECL;
+                break;
+        default:
+                return true;
+        }
+        return v->visit(v->user, (IonNode) { kind, frame->node.ptr });
+}
+
+void
+ion_visit(IonNode root, IonVisit visit, void *user)
+{
+        static const AstKind kinds[] = {
+                [ION_NODE_NONE] = AST_NONE,
+                [ION_NODE_TYPE] = AST_TYPESPEC,
+                [ION_NODE_EXPR] = AST_EXPR,
+                [ION_NODE_STMT] = AST_STMT,
+                [ION_NODE_DECL] = AST_DECL,
+        };
+        IonVisitCtx v;
+
+        if (root.kind == ION_NODE_NONE) {
+                return;
+        }
+        v = (IonVisitCtx) { visit, user };
+        ast_walk(AST_NODE(kinds[root.kind], (void *) root.ptr),
+                        &(Walker) { ion_visit_pre, NULL, &v }, 1);
+}
+
+static bool
+ion_test_count(void *user, IonNode node)
+{
+        const char *name;
+
+        name = ion_node_name(node);
+        if (node.kind == ION_NODE_EXPR && name && strcmp(name, "n") == 0) {
+                ++*(int *) user;
+        }
+        return node.kind != ION_NODE_TYPE;
+}
+
+void
+ion_test(void)
+{
+        const char *src;
+        IonContext *ctx;
+        IonContext *other;
+        IonNode decl;
+        IonNode ret;
+        IonDiag diag;
+        uint64_t val;
+        int64_t result;
+        unsigned line;
+        unsigned col;
+        size_t used;
+        int uses;
+
+        ctx = ion_context_create();
+        src = "func fact(n: int): int {\n"
+                "    if (n <= 1) { return 1; }\n"
+                "    return n * fact(n - 1);\n"
+                "}\n"
+                "const K = 42;\n";
+        assert(ion_parse(ctx, src, strlen(src)) == 0);
+        assert(ion_num_decls(ctx) == 2 && ion_num_diags(ctx) == 0);
+        decl = ion_decl(ctx, 0);
+        assert(strcmp(ion_node_kind_name(decl), "func") == 0);
+        assert(strcmp(ion_node_name(decl), "fact") == 0);
+        ret = (IonNode) { ION_NODE_STMT,
+                ((Decl *) decl.ptr)->func.block.stmts[1] };
+        assert(strcmp(ion_node_kind_name(ret), "return") == 0);
+        assert(ion_node_location(ctx, ret, &line, &col) &&
+                        line == 3 && col == 5);
+        uses = 0;
+        ion_visit(decl, ion_test_count, &uses);
+        assert(uses == 3);
+        decl = ion_find_decl(ctx, "K");
+        assert(decl.kind == ION_NODE_DECL);
+        assert(ion_node_int((IonNode) { ION_NODE_EXPR,
+                                ((Decl *) decl.ptr)->const_decl.expr }, &val) &&
+                        val == 42);
+        assert(ion_find_decl(ctx, "nope").kind == ION_NODE_NONE);
+        assert(ion_resolve(ctx, "fact") == 0);
+#if defined(__x86_64__)
+        assert(ion_call(ctx, "fact", (int64_t[]) { 10 }, 1, &result) &&
+                        result == 3628800);
+        assert(ion_call(ctx, "fact", (int64_t[]) { 5 }, 1, &result) &&
+                        result == 120);
+#endif
+        assert(!ion_call(ctx, "fact", NULL, 0, &result));
+        assert(!ion_call(ctx, "K", NULL, 0, &result));
+        assert(ion_num_errors(ctx) == 2);
+
+        // What the JIT refuses comes back as a diagnostic.
+        src = "func half(x: double): double { return x / 2; }\n"
+                "func first(p: int*): int { return 0; }\n"
+                "func one(): int { return 1; }\n";
+        assert(ion_parse(ctx, src, strlen(src)) == 0);
+        assert(!ion_call(ctx, "half", (int64_t[]) { 1 }, 1, &result));
+        assert(strstr(ion_diag(ctx, 0).msg, "only integers"));
+#if defined(__x86_64__)
+        assert(!ion_call(ctx, "one", NULL, 0, &result));
+        assert(ion_num_diags(ctx) == 2);
+        assert(strstr(ion_diag(ctx, 1).msg, "parameter 'p' of 'first'"));
+#endif
+
+        // Errors carry their place in the snippet.
+        src = "func f(): int {\n    return g();\n}\n";
+        assert(ion_parse(ctx, src, strlen(src)) == 0);
+        assert(ion_resolve(ctx, NULL) == 1);
+        diag = ion_diag(ctx, 0);
+        assert(diag.error && diag.line == 2 && diag.col == 12);
+        assert(strstr(diag.msg, "undeclared name 'g'"));
+        assert(ion_parse(ctx, "var x = ;", 9) == 1);
+        assert(ion_diag(ctx, 0).line == 1);
+        assert(ion_parse(ctx, "var x = 1;\x80", 11) == 1);
+        assert(ion_diag(ctx, 0).col == 11);
+        assert(ion_parse(ctx, "var x\0 = 1;", 11) == 1);
+
+        // Another context's snippet is left alone, and a context that
+        // parses the same snippet over and over needs no more memory.
+        other = ion_context_create();
+        src = "var y = 1;";
+        assert(ion_parse(other, src, strlen(src)) == 0);
+        src = "func g(a: int): int { return a + 1; }";
+        assert(ion_parse(ctx, src, strlen(src)) == 0);
+        used = arena_size(&ctx->arena);
+        for (int i = 0; i < 1000; ++i) {
+                assert(ion_parse(ctx, src, strlen(src)) == 0);
+        }
+        assert(arena_size(&ctx->arena) == used);
+        assert(strcmp(ion_node_name(ion_decl(other, 0)), "y") == 0);
+        ion_context_destroy(other);
+        ion_context_destroy(ctx);
+}
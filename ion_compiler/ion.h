@@ -0,0 +1,122 @@
+#ifndef _ION_H_
+#define _ION_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The public interface of libion, for embedding the front end. A context
+// parses one snippet at a time from a buffer; the snippet's AST, names and
+// diagnostics stay valid until the context's next ion_parse or ion_reset,
+// which keep its memory for the next snippet instead of freeing it.
+//
+// The front end keeps some state in globals, the intern table and the
+// lexer among them, so the library must only be used from one thread at a
+// time. Any number of contexts may hold snippets side by side.
+
+#if defined(__GNUC__)
+#define ION_API __attribute__((visibility("default")))
+#else
+#define ION_API
+#endif
+
+typedef struct IonContext IonContext;
+
+typedef enum IonNodeKind {
+        ION_NODE_NONE,
+        ION_NODE_TYPE,
+        ION_NODE_EXPR,
+        ION_NODE_STMT,
+        ION_NODE_DECL
+} IonNodeKind;
+
+typedef struct IonNode {
+        IonNodeKind kind;
+        const void *ptr;
+} IonNode;
+
+typedef struct IonDiag {
+        const char *msg;
+        // Both 0 when the diagnostic has no place in the source.
+        unsigned line;
+        unsigned col;
+        bool error;
+} IonDiag;
+
+// Called for each node of a tree, parents first. Returning false skips
+// the node's children.
+typedef bool (*IonVisit)(void *user, IonNode node);
+
+ION_API IonContext *
+ion_context_create(void);
+
+ION_API void
+ion_context_destroy(IonContext *ctx);
+
+// Drops the current snippet, keeping its memory for the next one.
+ION_API void
+ion_reset(IonContext *ctx);
+
+// Parses the len bytes at src, which must be UTF-8 without NUL bytes, in
+// place of the current snippet. Returns the number of errors.
+ION_API size_t
+ion_parse(IonContext *ctx, const char *src, size_t len);
+
+// Resolves the names used by the declaration entry and everything it
+// reaches, or by every declaration if entry is NULL. Returns the number of
+// errors, including those from parsing.
+ION_API size_t
+ion_resolve(IonContext *ctx, const char *entry);
+
+// Compiles the snippet's functions to machine code, once, and calls func
+// with num_args integer arguments. func must take and return integers.
+// Compile errors become the context's diagnostics. Only on x86-64.
+ION_API bool
+ion_call(IonContext *ctx, const char *func, const int64_t *args,
+                size_t num_args, int64_t *result);
+
+ION_API size_t
+ion_num_errors(IonContext *ctx);
+
+ION_API size_t
+ion_num_diags(IonContext *ctx);
+
+ION_API IonDiag
+ion_diag(IonContext *ctx, size_t i);
+
+ION_API size_t
+ion_num_decls(IonContext *ctx);
+
+ION_API IonNode
+ion_decl(IonContext *ctx, size_t i);
+
+// The top-level declaration called name, or a node of kind ION_NODE_NONE.
+ION_API IonNode
+ion_find_decl(IonContext *ctx, const char *name);
+
+// What the node is, such as "func", "call" or "while".
+ION_API const char *
+ion_node_kind_name(IonNode node);
+
+// The name a declaration declares or a name expression or type uses, or
+// NULL.
+ION_API const char *
+ion_node_name(IonNode node);
+
+// The value of an integer literal.
+ION_API bool
+ion_node_int(IonNode node, uint64_t *val);
+
+// Where the node starts in the snippet, 1-based.
+ION_API bool
+ion_node_location(IonContext *ctx, IonNode node, unsigned *line,
+                unsigned *col);
+
+ION_API void
+ion_visit(IonNode root, IonVisit visit, void *user);
+
+// Run by the compiler's own tests; not exported.
+void
+ion_test(void);
+
+#endif
@@ -0,0 +1,1401 @@
+#include "diag.h"
+#include "ir.h"
+#include "parse.h"
+
+// SSA construction follows Braun et al., "Simple and Efficient Construction
+// of Static Single Assignment Form": locals are looked up block by block as
+// they are read, and phis are placed only where a read reaches a join. A
+// block is sealed once all of its predecessors are known; reads in a block
+// that is not sealed yet get an operandless phi that is completed when it
+// is. Trivial phis are left in place for copy propagation to remove.
+
+typedef struct IrIncomplete {
+        uint32_t block;
+        uint32_t var;
+        uint32_t phi;
+} IrIncomplete;
+
+typedef struct IrLoop {
+        uint32_t break_block;
+        uint32_t continue_block;
+} IrLoop;
+
+#define IR_NO_BLOCK UINT32_MAX
+
+const char *ir_op_names[NUM_IR_OPS] = {
+        [IR_NOP] = "nop",
+        [IR_UNDEF] = "undef",
+        [IR_CONST] = "const",
+        [IR_PARAM] = "param",
+        [IR_PHI] = "phi",
+        [IR_COPY] = "copy",
+        [IR_NEG] = "neg",
+        [IR_NOT] = "not",
+        [IR_LNOT] = "lnot",
+        [IR_ADD] = "add",
+        [IR_SUB] = "sub",
+        [IR_MUL] = "mul",
+        [IR_DIV] = "div",
+        [IR_MOD] = "mod",
+        [IR_AND] = "and",
+        [IR_OR] = "or",
+        [IR_XOR] = "xor",
+        [IR_SHL] = "shl",
+        [IR_SHR] = "shr",
+        [IR_EQ] = "eq",
+        [IR_NE] = "ne",
+        [IR_LT] = "lt",
+        [IR_LE] = "le",
+        [IR_GT] = "gt",
+        [IR_GE] = "ge",
+        [IR_CALL] = "call",
+        [IR_JMP] = "jmp",
+        [IR_BR] = "br",
+        [IR_RET] = "ret",
+};
+
+// Per function state.
+static IrFunc *ir_func;
+static uint32_t ir_cur;
+static const char **ir_vars;
+static uint32_t *ir_scope;
+// The value of each variable at the end of each block, plus one, or 0
+// where the block does not define it.
+static uint32_t **ir_defs;
+static bool *ir_sealed;
+static IrIncomplete *ir_incomplete;
+static IrLoop *ir_loops;
+
+static uint32_t
+ir_expr(Expr *expr);
+
+static void
+ir_stmt(Stmt *stmt);
+
+bool
+ir_is_pure(IrOp op)
+{
+        return op != IR_NOP && op != IR_CALL && !ir_is_terminator(op);
+}
+
+bool
+ir_is_terminator(IrOp op)
+{
+        return op == IR_JMP || op == IR_BR || op == IR_RET;
+}
+
+static IrInstr *
+ir_last(IrFunc *func, uint32_t block)
+{
+        IrBlock *b;
+
+        b = &func->blocks[block];
+        if (buf_len(b->instrs) == 0) {
+                return NULL;
+        }
+        return &func->instrs[b->instrs[buf_len(b->instrs) - 1]];
+}
+
+size_t
+ir_num_succs(IrFunc *func, uint32_t block)
+{
+        IrInstr *last;
+
+        last = ir_last(func, block);
+        if (!last) {
+                return 0;
+        }
+        return last->op == IR_JMP ? 1 : last->op == IR_BR ? 2 : 0;
+}
+
+uint32_t
+ir_succ(IrFunc *func, uint32_t block, size_t i)
+{
+        assert(i < ir_num_succs(func, block));
+        return ir_last(func, block)->targets[i];
+}
+
+static bool
+ir_shift_ok(int64_t b)
+{
+        return b >= 0 && b < 64;
+}
+
+// Folds op over constant operands the way the generated code computes it,
+// with wrapping arithmetic and an arithmetic right shift. Fails where the
+// result is undefined, so that the operation is left for run time.
+bool
+ir_fold(IrOp op, int64_t a, int64_t b, int64_t *result)
+{
+        switch (op) {
+        case IR_COPY:
+                *result = a;
+                break;
+        case IR_NEG:
+                *result = (int64_t) -(uint64_t) a;
+                break;
+        case IR_NOT:
+                *result = ~a;
+                break;
+        case IR_LNOT:
+                *result = !a;
+                break;
+        case IR_ADD:
+                *result = (int64_t) ((uint64_t) a + (uint64_t) b);
+                break;
+        case IR_SUB:
+                *result = (int64_t) ((uint64_t) a - (uint64_t) b);
+                break;
+        case IR_MUL:
+                *result = (int64_t) ((uint64_t) a * (uint64_t) b);
+                break;
+        case IR_DIV:
+        case IR_MOD:
+                if (b == 0 || (a == INT64_MIN && b == -1)) {
+                        return false;
+                }
+                *result = op == IR_DIV ? a / b : a % b;
+                break;
+        case IR_AND:
+                *result = a & b;
+                break;
+        case IR_OR:
+                *result = a | b;
+                break;
+        case IR_XOR:
+                *result = a ^ b;
+                break;
+        case IR_SHL:
+                if (!ir_shift_ok(b)) {
+                        return false;
+                }
+                *result = (int64_t) ((uint64_t) a << b);
+                break;
+        case IR_SHR:
+                if (!ir_shift_ok(b)) {
+                        return false;
+                }
+                *result = a < 0 ? ~(~a >> b) : a >> b;
+                break;
+        case IR_EQ:
+                *result = a == b;
+                break;
+        case IR_NE:
+                *result = a != b;
+                break;
+        case IR_LT:
+                *result = a < b;
+                break;
+        case IR_LE:
+                *result = a <= b;
+                break;
+        case IR_GT:
+                *result = a > b;
+                break;
+        case IR_GE:
+                *result = a >= b;
+                break;
+        default:
+                return false;
+        }
+        return true;
+}
+
+// Drops one edge from -> to along with the phi operands that came in on it.
+// Phis killed by an optimization may still sit among the others as nops.
+void
+ir_remove_edge(IrFunc *func, uint32_t from, uint32_t to)
+{
+        IrBlock *b;
+        size_t k;
+
+        b = &func->blocks[to];
+        for (k = 0; k < buf_len(b->preds) && b->preds[k] != from; ++k) {
+        }
+        assert(k < buf_len(b->preds));
+        memmove(b->preds + k, b->preds + k + 1,
+                        (buf_len(b->preds) - k - 1) * sizeof(*b->preds));
+        buf_trunc(b->preds, buf_len(b->preds) - 1);
+        for (size_t i = 0; i < buf_len(b->instrs); ++i) {
+                IrInstr *phi = &func->instrs[b->instrs[i]];
+
+                if (phi->op == IR_NOP) {
+                        continue;
+                } else if (phi->op != IR_PHI) {
+                        break;
+                }
+                memmove(phi->args + k, phi->args + k + 1,
+                                (buf_len(phi->args) - k - 1) *
+                                sizeof(*phi->args));
+                buf_trunc(phi->args, buf_len(phi->args) - 1);
+        }
+}
+
+void
+ir_func_free(IrFunc *func)
+{
+        if (!func) {
+                return;
+        }
+        for (IrInstr *it = func->instrs; it != buf_end(func->instrs); ++it) {
+                buf_free(it->args);
+        }
+        for (IrBlock *it = func->blocks; it != buf_end(func->blocks); ++it) {
+                buf_free(it->instrs);
+                buf_free(it->preds);
+        }
+        buf_free(func->instrs);
+        buf_free(func->blocks);
+        xfree(func);
+}
+
+static void
+ir_builder_free(void)
+{
+        for (size_t i = 0; i < buf_len(ir_defs); ++i) {
+                buf_free(ir_defs[i]);
+        }
+        buf_free(ir_defs);
+        buf_free(ir_vars);
+        buf_free(ir_scope);
+        buf_free(ir_sealed);
+        buf_free(ir_incomplete);
+        buf_free(ir_loops);
+}
+
+static uint32_t
+ir_new_block(void)
+{
+        buf_push(ir_func->blocks, (IrBlock) { 0 });
+        buf_push(ir_defs, NULL);
+        buf_push(ir_sealed, false);
+        return buf_len(ir_func->blocks) - 1;
+}
+
+static uint32_t
+ir_new_instr(IrOp op, uint32_t block)
+{
+        buf_push(ir_func->instrs, (IrInstr) { .op = op, .block = block });
+        return buf_len(ir_func->instrs) - 1;
+}
+
+static uint32_t
+ir_emit(IrOp op)
+{
+        uint32_t id;
+
+        id = ir_new_instr(op, ir_cur);
+        buf_push(ir_func->blocks[ir_cur].instrs, id);
+        return id;
+}
+
+static uint32_t
+ir_emit1(IrOp op, uint32_t a)
+{
+        uint32_t id;
+
+        id = ir_emit(op);
+        buf_push(ir_func->instrs[id].args, a);
+        return id;
+}
+
+static uint32_t
+ir_emit2(IrOp op, uint32_t a, uint32_t b)
+{
+        uint32_t id;
+
+        id = ir_emit1(op, a);
+        buf_push(ir_func->instrs[id].args, b);
+        return id;
+}
+
+static uint32_t
+ir_const(int64_t val)
+{
+        uint32_t id;
+
+        id = ir_emit(IR_CONST);
+        ir_func->instrs[id].imm = val;
+        return id;
+}
+
+// Phis and undefs go to the front of a block, after the phis already
+// there, since they may be created after the rest of the block.
+static uint32_t
+ir_emit_front(IrOp op, uint32_t block)
+{
+        IrBlock *b;
+        uint32_t id;
+        size_t pos;
+
+        id = ir_new_instr(op, block);
+        b = &ir_func->blocks[block];
+        for (pos = 0; pos < buf_len(b->instrs) &&
+                        ir_func->instrs[b->instrs[pos]].op == IR_PHI; ++pos) {
+        }
+        buf_push(b->instrs, 0);
+        memmove(b->instrs + pos + 1, b->instrs + pos,
+                        (buf_len(b->instrs) - pos - 1) * sizeof(*b->instrs));
+        b->instrs[pos] = id;
+        return id;
+}
+
+static void
+ir_add_edge(uint32_t to)
+{
+        buf_push(ir_func->blocks[to].preds, ir_cur);
+}
+
+static void
+ir_jmp(uint32_t target)
+{
+        uint32_t id;
+
+        id = ir_emit(IR_JMP);
+        ir_func->instrs[id].targets[0] = target;
+        ir_add_edge(target);
+}
+
+static void
+ir_br(uint32_t cond, uint32_t if_true, uint32_t if_false)
+{
+        uint32_t id;
+
+        assert(if_true != if_false);
+        id = ir_emit1(IR_BR, cond);
+        ir_func->instrs[id].targets[0] = if_true;
+        ir_func->instrs[id].targets[1] = if_false;
+        ir_add_edge(if_true);
+        ir_add_edge(if_false);
+}
+
+static void
+ir_start(uint32_t block)
+{
+        ir_cur = block;
+}
+
+static void
+ir_write_var(uint32_t block, uint32_t var, uint32_t val)
+{
+        while (buf_len(ir_defs[block]) <= var) {
+                buf_push(ir_defs[block], 0);
+        }
+        ir_defs[block][var] = val + 1;
+}
+
+static uint32_t
+ir_read_var(uint32_t block, uint32_t var);
+
+static void
+ir_add_phi_operands(uint32_t block, uint32_t phi, uint32_t var)
+{
+        uint32_t val;
+
+        for (size_t i = 0; i < buf_len(ir_func->blocks[block].preds); ++i) {
+                val = ir_read_var(ir_func->blocks[block].preds[i], var);
+                buf_push(ir_func->instrs[phi].args, val);
+        }
+}
+
+static uint32_t
+ir_read_var(uint32_t block, uint32_t var)
+{
+        IrBlock *b;
+        uint32_t val;
+
+        if (var < buf_len(ir_defs[block]) && ir_defs[block][var]) {
+                return ir_defs[block][var] - 1;
+        }
+        b = &ir_func->blocks[block];
+        if (!ir_sealed[block]) {
+                val = ir_emit_front(IR_PHI, block);
+                ir_func->instrs[val].name = ir_vars[var];
+                buf_push(ir_incomplete, (IrIncomplete) { block, var, val });
+        } else if (buf_len(b->preds) == 1) {
+                val = ir_read_var(b->preds[0], var);
+        } else if (buf_len(b->preds) == 0) {
+                // Only unreachable code can read a variable nothing wrote.
+                val = ir_emit_front(IR_UNDEF, block);
+        } else {
+                // Break cycles by defining the variable before reading the
+                // predecessors, which may loop back here.
+                val = ir_emit_front(IR_PHI, block);
+                ir_func->instrs[val].name = ir_vars[var];
+                ir_write_var(block, var, val);
+                ir_add_phi_operands(block, val, var);
+        }
+        ir_write_var(block, var, val);
+        return val;
+}
+
+static void
+ir_seal(uint32_t block)
+{
+        IrIncomplete *pending;
+        size_t n;
+
+        pending = NULL;
+        n = 0;
+        for (size_t i = 0; i < buf_len(ir_incomplete); ++i) {
+                if (ir_incomplete[i].block == block) {
+                        buf_push(pending, ir_incomplete[i]);
+                } else {
+                        ir_incomplete[n++] = ir_incomplete[i];
+                }
+        }
+        buf_trunc(ir_incomplete, n);
+        for (IrIncomplete *it = pending; it != buf_end(pending); ++it) {
+                ir_add_phi_operands(block, it->phi, it->var);
+        }
+        buf_free(pending);
+        ir_sealed[block] = true;
+}
+
+// Code after a return, break or continue goes to a block of its own that
+// nothing jumps to.
+static void
+ir_start_unreachable(void)
+{
+        ir_start(ir_new_block());
+        ir_seal(ir_cur);
+}
+
+static uint32_t
+ir_def_var(const char *name)
+{
+        buf_push(ir_vars, name);
+        buf_push(ir_scope, buf_len(ir_vars) - 1);
+        return buf_len(ir_vars) - 1;
+}
+
+static uint32_t
+ir_find_var(const char *name)
+{
+        for (size_t i = buf_len(ir_scope); i-- > 0; ) {
+                if (ir_vars[ir_scope[i]] == name) {
+                        return ir_scope[i];
+                }
+        }
+        // Names were resolved before the IR was built, so this is a global.
+        fatal("ir: '%s' uses global '%s', and the IR only covers locals",
+                        ir_func->name, name);
+        return 0;
+}
+
+static IrOp
+ir_binary_op(TokenKind op)
+{
+        switch ((int) op) {
+        case '+':
+                return IR_ADD;
+        case '-':
+                return IR_SUB;
+        case '*':
+                return IR_MUL;
+        case '/':
+                return IR_DIV;
+        case '%':
+                return IR_MOD;
+        case '&':
+                return IR_AND;
+        case '|':
+                return IR_OR;
+        case '^':
+                return IR_XOR;
+        case TOKEN_LSHIFT:
+                return IR_SHL;
+        case TOKEN_RSHIFT:
+                return IR_SHR;
+        case TOKEN_EQ:
+                return IR_EQ;
+        case TOKEN_NOTEQ:
+                return IR_NE;
+        case '<':
+                return IR_LT;
+        case TOKEN_LTEQ:
+                return IR_LE;
+        case '>':
+                return IR_GT;
+        case TOKEN_GTEQ:
+                return IR_GE;
+        default:
+                fatal("ir: unsupported binary operator %s",
+                                token_kind_str(op));
+                return IR_NOP;
+        }
+}
+
+static IrOp
+ir_assign_op(TokenKind op)
+{
+        switch (op) {
+        case TOKEN_ADD_ASSIGN:
+        case TOKEN_INC:
+                return IR_ADD;
+        case TOKEN_SUB_ASSIGN:
+        case TOKEN_DEC:
+                return IR_SUB;
+        case TOKEN_OR_ASSIGN:
+                return IR_OR;
+        case TOKEN_AND_ASSIGN:
+                return IR_AND;
+        case TOKEN_XOR_ASSIGN:
+                return IR_XOR;
+        case TOKEN_LSHIFT_ASSIGN:
+                return IR_SHL;
+        case TOKEN_RSHIFT_ASSIGN:
+                return IR_SHR;
+        case TOKEN_MUL_ASSIGN:
+                return IR_MUL;
+        case TOKEN_DIV_ASSIGN:
+                return IR_DIV;
+        case TOKEN_MOD_ASSIGN:
+                return IR_MOD;
+        default:
+                fatal("ir: unsupported assignment operator %s",
+                                token_kind_str(op));
+                return IR_NOP;
+        }
+}
+
+// Joins two values computed on different paths into done, in the order of
+// done's predecessors.
+static uint32_t
+ir_join(uint32_t done, uint32_t first_block, uint32_t first,
+                uint32_t second)
+{
+        IrBlock *b;
+        uint32_t phi;
+
+        phi = ir_emit_front(IR_PHI, done);
+        b = &ir_func->blocks[done];
+        for (size_t i = 0; i < buf_len(b->preds); ++i) {
+                buf_push(ir_func->instrs[phi].args,
+                                b->preds[i] == first_block ? first : second);
+        }
+        return phi;
+}
+
+static uint32_t
+ir_logical(TokenKind op, Expr *left, Expr *right)
+{
+        uint32_t left_block;
+        uint32_t short_val;
+        uint32_t val;
+        uint32_t rhs;
+        uint32_t done;
+
+        val = ir_expr(left);
+        short_val = ir_const(op == TOKEN_OR);
+        left_block = ir_cur;
+        rhs = ir_new_block();
+        done = ir_new_block();
+        if (op == TOKEN_AND) {
+                ir_br(val, rhs, done);
+        } else {
+                ir_br(val, done, rhs);
+        }
+        ir_seal(rhs);
+        ir_start(rhs);
+        val = ir_expr(right);
+        val = ir_emit2(IR_NE, val, ir_const(0));
+        ir_jmp(done);
+        ir_seal(done);
+        ir_start(done);
+        return ir_join(done, left_block, short_val, val);
+}
+
+static uint32_t
+ir_ternary(TernaryExpr *ternary)
+{
+        uint32_t true_block;
+        uint32_t if_true;
+        uint32_t if_false;
+        uint32_t done;
+
+        true_block = ir_new_block();
+        if_false = ir_new_block();
+        done = ir_new_block();
+        ir_br(ir_expr(ternary->cond), true_block, if_false);
+        ir_seal(true_block);
+        ir_seal(if_false);
+
+        ir_start(true_block);
+        if_true = ir_expr(ternary->if_true);
+        true_block = ir_cur;
+        ir_jmp(done);
+        ir_start(if_false);
+        if_false = ir_expr(ternary->if_false);
+        ir_jmp(done);
+        ir_seal(done);
+        ir_start(done);
+        return ir_join(done, true_block, if_true, if_false);
+}
+
+static uint32_t
+ir_call(CallExpr *call)
+{
+        uint32_t *args;
+        uint32_t id;
+
+        if (call->expr->kind != EXPR_NAME) {
+                fatal("ir: call target must be a function name");
+        }
+        args = NULL;
+        for (size_t i = 0; i < call->num_args; ++i) {
+                buf_push(args, ir_expr(call->args[i]));
+        }
+        id = ir_emit(IR_CALL);
+        ir_func->instrs[id].name = call->expr->name;
+        ir_func->instrs[id].args = args;
+        return id;
+}
+
+static uint32_t
+ir_expr(Expr *expr)
+{
+        uint32_t val;
+
+        switch (expr->kind) {
+        case EXPR_INT:
+                return ir_const((int64_t) expr->int_val);
+        case EXPR_NAME:
+                return ir_read_var(ir_cur, ir_find_var(expr->name));
+        case EXPR_CALL:
+                return ir_call(&expr->call);
+        case EXPR_UNARY:
+                val = ir_expr(expr->unary.expr);
+                switch ((int) expr->unary.op) {
+                case '+':
+                        return val;
+                case '-':
+                        return ir_emit1(IR_NEG, val);
+                case '~':
+                        return ir_emit1(IR_NOT, val);
+                case '!':
+                        return ir_emit1(IR_LNOT, val);
+                default:
+                        fatal("ir: unsupported unary operator %s",
+                                        token_kind_str(expr->unary.op));
+                        return 0;
+                }
+        case EXPR_BINARY:
+                if (expr->binary.op == TOKEN_AND ||
+                                expr->binary.op == TOKEN_OR) {
+                        return ir_logical(expr->binary.op, expr->binary.left,
+                                        expr->binary.right);
+                }
+                val = ir_expr(expr->binary.left);
+                return ir_emit2(ir_binary_op(expr->binary.op), val,
+                                ir_expr(expr->binary.right));
+        case EXPR_TERNARY:
+                return ir_ternary(&expr->ternary);
+        default:
+                fatal("ir: unsupported expression kind %s in '%s'",
+                                expr_kind_names[expr->kind], ir_func->name);
+                return 0;
+        }
+}
+
+static void
+ir_block(StmtBlock block)
+{
+        size_t mark;
+
+        mark = buf_len(ir_scope);
+        for (size_t i = 0; i < block.num_stmts; ++i) {
+                ir_stmt(block.stmts[i]);
+        }
+        buf_trunc(ir_scope, mark);
+}
+
+static void
+ir_loop_body(StmtBlock block, uint32_t break_block, uint32_t continue_block)
+{
+        buf_push(ir_loops, (IrLoop) { break_block, continue_block });
+        ir_block(block);
+        buf_trunc(ir_loops, buf_len(ir_loops) - 1);
+}
+
+static void
+ir_assign(AssignStmt *assign)
+{
+        uint32_t var;
+        uint32_t val;
+
+        if (assign->left->kind != EXPR_NAME) {
+                fatal("ir: can only assign to local variables");
+        }
+        var = ir_find_var(assign->left->name);
+        if (assign->op == '=') {
+                val = ir_expr(assign->right);
+        } else {
+                val = assign->right ? ir_expr(assign->right) : ir_const(1);
+                val = ir_emit2(ir_assign_op(assign->op),
+                                ir_read_var(ir_cur, var), val);
+        }
+        ir_write_var(ir_cur, var, val);
+}
+
+static void
+ir_if(IfStmt *if_stmt)
+{
+        uint32_t then_block;
+        uint32_t next;
+        uint32_t end;
+
+        end = ir_new_block();
+        for (size_t i = 0; i <= if_stmt->num_elseifs; ++i) {
+                Expr *cond = i ? if_stmt->elseifs[i - 1].cond : if_stmt->cond;
+
+                then_block = ir_new_block();
+                next = ir_new_block();
+                ir_br(ir_expr(cond), then_block, next);
+                ir_seal(then_block);
+                ir_seal(next);
+                ir_start(then_block);
+                ir_block(i ? if_stmt->elseifs[i - 1].block :
+                                if_stmt->then_block);
+                ir_jmp(end);
+                ir_start(next);
+        }
+        ir_block(if_stmt->else_block);
+        ir_jmp(end);
+        ir_seal(end);
+        ir_start(end);
+}
+
+static void
+ir_switch(SwitchStmt *switch_stmt)
+{
+        uint32_t *case_blocks;
+        uint32_t default_block;
+        uint32_t continue_block;
+        uint32_t end;
+        uint32_t next;
+        uint32_t val;
+        uint32_t test;
+
+        val = ir_expr(switch_stmt->expr);
+        case_blocks = NULL;
+        end = ir_new_block();
+        default_block = end;
+        for (size_t i = 0; i < switch_stmt->num_cases; ++i) {
+                SwitchCase *c = &switch_stmt->cases[i];
+
+                buf_push(case_blocks, ir_new_block());
+                if (c->is_default) {
+                        default_block = case_blocks[i];
+                }
+                for (size_t j = 0; j < c->num_exprs; ++j) {
+                        test = ir_emit2(IR_EQ, val, ir_expr(c->exprs[j]));
+                        next = ir_new_block();
+                        ir_br(test, case_blocks[i], next);
+                        ir_seal(next);
+                        ir_start(next);
+                }
+        }
+        ir_jmp(default_block);
+
+        // Cases don't fall through, so break leaves the switch and continue
+        // goes to the enclosing loop.
+        continue_block = buf_len(ir_loops) ?
+                ir_loops[buf_len(ir_loops) - 1].continue_block : IR_NO_BLOCK;
+        buf_push(ir_loops, (IrLoop) { end, continue_block });
+        for (size_t i = 0; i < switch_stmt->num_cases; ++i) {
+                ir_seal(case_blocks[i]);
+                ir_start(case_blocks[i]);
+                ir_block(switch_stmt->cases[i].block);
+                ir_jmp(end);
+        }
+        buf_trunc(ir_loops, buf_len(ir_loops) - 1);
+        ir_seal(end);
+        ir_start(end);
+        buf_free(case_blocks);
+}
+
+static void
+ir_stmt(Stmt *stmt)
+{
+        uint32_t header;
+        uint32_t body;
+        uint32_t next;
+        uint32_t end;
+        size_t mark;
+
+        switch (stmt->kind) {
+        case STMT_RETURN:
+                ir_emit1(IR_RET, stmt->expr ? ir_expr(stmt->expr) :
+                                ir_const(0));
+                ir_start_unreachable();
+                break;
+        case STMT_BREAK:
+        case STMT_CONTINUE:
+                if (buf_len(ir_loops) == 0) {
+                        fatal("ir: break or continue outside of loop");
+                }
+                end = stmt->kind == STMT_BREAK ?
+                        ir_loops[buf_len(ir_loops) - 1].break_block :
+                        ir_loops[buf_len(ir_loops) - 1].continue_block;
+                if (end == IR_NO_BLOCK) {
+                        fatal("ir: continue outside of loop");
+                }
+                ir_jmp(end);
+                ir_start_unreachable();
+                break;
+        case STMT_BLOCK:
+                ir_block(stmt->block);
+                break;
+        case STMT_IF:
+                ir_if(&stmt->if_stmt);
+                break;
+        case STMT_WHILE:
+                header = ir_new_block();
+                body = ir_new_block();
+                end = ir_new_block();
+                ir_jmp(header);
+                ir_start(header);
+                ir_br(ir_expr(stmt->while_stmt.cond), body, end);
+                ir_seal(body);
+                ir_start(body);
+                ir_loop_body(stmt->while_stmt.block, end, header);
+                ir_jmp(header);
+                ir_seal(header);
+                ir_seal(end);
+                ir_start(end);
+                break;
+        case STMT_DO:
+                body = ir_new_block();
+                next = ir_new_block();
+                end = ir_new_block();
+                ir_jmp(body);
+                ir_start(body);
+                ir_loop_body(stmt->while_stmt.block, end, next);
+                ir_jmp(next);
+                ir_seal(next);
+                ir_start(next);
+                ir_br(ir_expr(stmt->while_stmt.cond), body, end);
+                ir_seal(body);
+                ir_seal(end);
+                ir_start(end);
+                break;
+        case STMT_FOR:
+                mark = buf_len(ir_scope);
+                for (size_t i = 0; i < stmt->for_stmt.init.num_stmts; ++i) {
+                        ir_stmt(stmt->for_stmt.init.stmts[i]);
+                }
+                header = ir_new_block();
+                body = ir_new_block();
+                next = ir_new_block();
+                end = ir_new_block();
+                ir_jmp(header);
+                ir_start(header);
+                if (stmt->for_stmt.cond) {
+                        ir_br(ir_expr(stmt->for_stmt.cond), body, end);
+                } else {
+                        ir_jmp(body);
+                }
+                ir_seal(body);
+                ir_start(body);
+                ir_loop_body(stmt->for_stmt.block, end, next);
+                ir_jmp(next);
+                ir_seal(next);
+                ir_start(next);
+                ir_block(stmt->for_stmt.next);
+                ir_jmp(header);
+                ir_seal(header);
+                ir_seal(end);
+                ir_start(end);
+                buf_trunc(ir_scope, mark);
+                break;
+        case STMT_SWITCH:
+                ir_switch(&stmt->switch_stmt);
+                break;
+        case STMT_ASSIGN:
+                ir_assign(&stmt->assign);
+                break;
+        case STMT_AUTO_ASSIGN:
+                next = ir_expr(stmt->autoassign.init);
+                ir_write_var(ir_cur, ir_def_var(stmt->autoassign.name), next);
+                break;
+        case STMT_EXPR:
+                ir_expr(stmt->expr);
+                break;
+        default:
+                fatal("ir: unsupported statement kind %s in '%s'",
+                                stmt_kind_names[stmt->kind], ir_func->name);
+                break;
+        }
+}
+
+IrFunc *
+ir_build(Decl *decl)
+{
+        FuncDecl *func;
+        IrFunc *result;
+        uint32_t id;
+
+        assert(decl->kind == DECL_FUNC);
+        // A fatal error may have left the last function half built.
+        ir_func_free(ir_func);
+        ir_builder_free();
+
+        func = &decl->func;
+        ir_func = xcalloc(1, sizeof(IrFunc));
+        ir_func->name = decl->name;
+        ir_func->num_params = func->num_params;
+        ir_start(ir_new_block());
+        ir_seal(ir_cur);
+        for (size_t i = 0; i < func->num_params; ++i) {
+                id = ir_emit(IR_PARAM);
+                ir_func->instrs[id].imm = i;
+                ir_func->instrs[id].name = func->params[i].name;
+                ir_write_var(ir_cur, ir_def_var(func->params[i].name), id);
+        }
+        ir_block(func->block);
+        ir_emit1(IR_RET, ir_const(0));
+        assert(buf_len(ir_incomplete) == 0);
+
+        result = ir_func;
+        ir_func = NULL;
+        ir_builder_free();
+        ir_verify(result);
+        return result;
+}
+
+void
+ir_verify(IrFunc *func)
+{
+        assert(buf_len(func->blocks) > 0);
+        assert(buf_len(func->blocks[0].preds) == 0);
+        for (uint32_t b = 0; b < buf_len(func->blocks); ++b) {
+                IrBlock *block = &func->blocks[b];
+                bool phis = true;
+
+                if (block->dead) {
+                        assert(buf_len(block->instrs) == 0);
+                        assert(buf_len(block->preds) == 0);
+                        continue;
+                }
+                assert(buf_len(block->instrs) > 0);
+                for (size_t i = 0; i < buf_len(block->instrs); ++i) {
+                        IrInstr *instr = &func->instrs[block->instrs[i]];
+
+                        assert(instr->block == b);
+                        assert(instr->op != IR_NOP);
+                        assert(ir_is_terminator(instr->op) ==
+                                        (i == buf_len(block->instrs) - 1));
+                        if (instr->op == IR_PHI) {
+                                assert(phis);
+                                assert(buf_len(instr->args) ==
+                                                buf_len(block->preds));
+                        } else {
+                                phis = false;
+                        }
+                        for (size_t j = 0; j < buf_len(instr->args); ++j) {
+                                IrInstr *arg = &func->instrs[instr->args[j]];
+
+                                assert(arg->op != IR_NOP);
+                                assert(!func->blocks[arg->block].dead);
+                        }
+                }
+                for (size_t i = 0; i < ir_num_succs(func, b); ++i) {
+                        IrBlock *succ = &func->blocks[ir_succ(func, b, i)];
+                        size_t n = 0;
+
+                        assert(!succ->dead);
+                        for (size_t j = 0; j < buf_len(succ->preds); ++j) {
+                                n += succ->preds[j] == b;
+                        }
+                        assert(n >= 1);
+                }
+                for (size_t i = 0; i < buf_len(block->preds); ++i) {
+                        uint32_t pred = block->preds[i];
+                        bool found = false;
+
+                        assert(!func->blocks[pred].dead);
+                        for (size_t j = 0; j < ir_num_succs(func, pred);
+                                        ++j) {
+                                found |= ir_succ(func, pred, j) == b;
+                        }
+                        assert(found);
+                }
+        }
+}
+
+static void
+ir_dump_instr(IrFunc *func, uint32_t id, Writer *w)
+{
+        IrInstr *instr;
+        IrBlock *block;
+
+        instr = &func->instrs[id];
+        writer_printf(w, "    ");
+        if (!ir_is_terminator(instr->op)) {
+                writer_printf(w, "%%%u = ", id);
+        }
+        writer_printf(w, "%s", ir_op_names[instr->op]);
+        switch (instr->op) {
+        case IR_CONST:
+        case IR_PARAM:
+                writer_printf(w, " %" PRId64, instr->imm);
+                break;
+        case IR_PHI:
+                block = &func->blocks[instr->block];
+                for (size_t i = 0; i < buf_len(instr->args); ++i) {
+                        writer_printf(w, "%s [%%%u, b%u]", i ? "," : "",
+                                        instr->args[i], block->preds[i]);
+                }
+                break;
+        case IR_CALL:
+                writer_printf(w, " %s(", instr->name);
+                for (size_t i = 0; i < buf_len(instr->args); ++i) {
+                        writer_printf(w, "%s%%%u", i ? ", " : "",
+                                        instr->args[i]);
+                }
+                writer_printf(w, ")");
+                break;
+        default:
+                for (size_t i = 0; i < buf_len(instr->args); ++i) {
+                        writer_printf(w, "%s %%%u", i ? "," : "",
+                                        instr->args[i]);
+                }
+                break;
+        }
+        if (instr->op == IR_JMP) {
+                writer_printf(w, " b%u", instr->targets[0]);
+        } else if (instr->op == IR_BR) {
+                writer_printf(w, ", b%u, b%u", instr->targets[0],
+                                instr->targets[1]);
+        }
+        if ((instr->op == IR_PARAM || instr->op == IR_PHI) && instr->name) {
+                writer_printf(w, "  ; %s", instr->name);
+        }
+        writer_printf(w, "\n");
+}
+
+void
+ir_dump(IrFunc *func, Writer *w)
+{
+        writer_printf(w, "func %s {\n", func->name);
+        for (uint32_t b = 0; b < buf_len(func->blocks); ++b) {
+                IrBlock *block = &func->blocks[b];
+
+                if (block->dead) {
+                        continue;
+                }
+                writer_printf(w, "b%u:", b);
+                for (size_t i = 0; i < buf_len(block->preds); ++i) {
+                        writer_printf(w, "%s b%u", i ? "," : "  ; preds",
+                                        block->preds[i]);
+                }
+                writer_printf(w, "\n");
+                for (size_t i = 0; i < buf_len(block->instrs); ++i) {
+                        ir_dump_instr(func, block->instrs[i], w);
+                }
+        }
+        writer_printf(w, "}\n");
+}
+
+// A reference interpreter, so that the tests can check that optimized
+// functions compute what the unoptimized ones do.
+static int64_t
+ir_eval(IrFunc **funcs, size_t num_funcs, IrFunc *func, const int64_t *args)
+{
+        int64_t *vals;
+        int64_t *phis;
+        int64_t result;
+        uint32_t block;
+        uint32_t prev;
+        IrFunc *callee;
+
+        vals = xcalloc(buf_len(func->instrs) + 1, sizeof(int64_t));
+        phis = NULL;
+        block = 0;
+        prev = IR_NO_BLOCK;
+        for (;;) {
+                IrBlock *b = &func->blocks[block];
+                size_t k = 0;
+                size_t i;
+
+                assert(!b->dead);
+                if (prev != IR_NO_BLOCK) {
+                        while (b->preds[k] != prev) {
+                                ++k;
+                        }
+                }
+                // Phis read their operands all at once.
+                buf_trunc(phis, 0);
+                for (i = 0; func->instrs[b->instrs[i]].op == IR_PHI; ++i) {
+                        buf_push(phis,
+                                vals[func->instrs[b->instrs[i]].args[k]]);
+                }
+                for (size_t j = 0; j < i; ++j) {
+                        vals[b->instrs[j]] = phis[j];
+                }
+                for (; i < buf_len(b->instrs); ++i) {
+                        uint32_t id = b->instrs[i];
+                        IrInstr *instr = &func->instrs[id];
+                        int64_t a = 0;
+                        int64_t c = 0;
+
+                        if (buf_len(instr->args) > 0) {
+                                a = vals[instr->args[0]];
+                        }
+                        if (buf_len(instr->args) > 1) {
+                                c = vals[instr->args[1]];
+                        }
+                        switch (instr->op) {
+                        case IR_UNDEF:
+                                vals[id] = 0;
+                                break;
+                        case IR_CONST:
+                                vals[id] = instr->imm;
+                                break;
+                        case IR_PARAM:
+                                vals[id] = args[instr->imm];
+                                break;
+                        case IR_CALL:
+                                callee = NULL;
+                                for (size_t j = 0; j < num_funcs; ++j) {
+                                        if (funcs[j]->name == instr->name) {
+                                                callee = funcs[j];
+                                        }
+                                }
+                                assert(callee);
+                                assert(callee->num_params ==
+                                                buf_len(instr->args));
+                                {
+                                        int64_t call_args[8];
+
+                                        for (size_t j = 0; j < buf_len(
+                                                                instr->args);
+                                                        ++j) {
+                                                call_args[j] =
+                                                        vals[instr->args[j]];
+                                        }
+                                        vals[id] = ir_eval(funcs, num_funcs,
+                                                        callee, call_args);
+                                }
+                                break;
+                        case IR_JMP:
+                                prev = block;
+                                block = instr->targets[0];
+                                break;
+                        case IR_BR:
+                                prev = block;
+                                block = instr->targets[a ? 0 : 1];
+                                break;
+                        case IR_RET:
+                                result = a;
+                                xfree(vals);
+                                buf_free(phis);
+                                return result;
+                        default:
+                                if (!ir_fold(instr->op, a, c, &vals[id])) {
+                                        fatal("ir: %s traps",
+                                                ir_op_names[instr->op]);
+                                }
+                                break;
+                        }
+                }
+        }
+}
+
+static size_t
+ir_count_op(IrFunc *func, IrOp op)
+{
+        size_t n;
+
+        n = 0;
+        for (IrBlock *b = func->blocks; b != buf_end(func->blocks); ++b) {
+                for (size_t i = 0; i < buf_len(b->instrs); ++i) {
+                        n += func->instrs[b->instrs[i]].op == op;
+                }
+        }
+        return n;
+}
+
+static void
+assert_ir_dump(IrFunc *func, const char *expected)
+{
+        Writer *w;
+
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, -1);
+        ir_dump(func, w);
+        writer_flush(w);
+        assert(strcmp(w->mem, expected) == 0);
+        writer_free(w);
+        xfree(w);
+}
+
+void
+ir_test(void)
+{
+        const char *src =
+                "func fold(): int {\n"
+                "    x := 2; y := x * 21;\n"
+                "    if (y == 42) { return y; }\n"
+                "    return 0;\n"
+                "}\n"
+                "func sum(n: int): int {\n"
+                "    s := 0;\n"
+                "    for (i := 0; i < n; i++) {\n"
+                "        if (i % 3 == 0) { continue; }\n"
+                "        s += i;\n"
+                "    }\n"
+                "    return s;\n"
+                "}\n"
+                "func cse(a: int, b: int): int {\n"
+                "    return (a + b) * (b + a) - (a + b);\n"
+                "}\n"
+                "func logic(a: int, b: int): int {\n"
+                "    return a > 0 && b > 0 || a == b ? a - b : b - a;\n"
+                "}\n"
+                "func branchy(x: int): int {\n"
+                "    r := 0;\n"
+                "    switch (x) {\n"
+                "    case 1, 2: r = 10;\n"
+                "    case 3: r = 20; break;\n"
+                "    default: r = -1;\n"
+                "    }\n"
+                "    while (1) { r++; if (r > 30) { break; } }\n"
+                "    do { r--; } while (r > 100);\n"
+                "    return r;\n"
+                "}\n"
+                "func fact(n: int): int {\n"
+                "    if (n == 0) { return 1; }\n"
+                "    return n * fact(n - 1);\n"
+                "}\n"
+                "func dead(a: int): int {\n"
+                "    k := 5;\n"
+                "    if (k > 10) { a = a / 0; } else if (k == 5) { a += 1; }\n"
+                "    else { a <<= 70; }\n"
+                "    return a;\n"
+                "    a = 3;\n"
+                "}\n"
+                "func zero(a: int): int {\n"
+                "    for (i := 0; i < 0; i++) { a = 1; }\n"
+                "    return a;\n"
+                "}\n"
+                "func never(a: int): int {\n"
+                "    x := 0;\n"
+                "    while (x > 0) { a += x; x--; }\n"
+                "    c := 0;\n"
+                "    do { a++; } while (c > 0);\n"
+                "    return a;\n"
+                "}\n"
+                "func skip(n: int): int {\n"
+                "    s := 0;\n"
+                "    for (i := 0; i < n; i++) {\n"
+                "        switch (i % 3) { case 1: continue; }\n"
+                "        s += i;\n"
+                "    }\n"
+                "    return s;\n"
+                "}\n"
+                "func lost(): int { x := 1.5; return 0; }\n";
+        IrFunc *plain[16];
+        IrFunc *opt[16];
+        DiagContext ctx;
+        jmp_buf jmp;
+        Decl **decls;
+        size_t n;
+
+        diag_begin(&ctx, "ir.ion", src);
+        init_stream(src);
+        decls = parse_file();
+        assert(diag_num_errors() == 0);
+        n = buf_len(decls) - 1;
+        for (size_t i = 0; i < n; ++i) {
+                plain[i] = ir_build(decls[i]);
+                opt[i] = ir_build(decls[i]);
+                ir_optimize(opt[i]);
+        }
+
+        // Optimized or not, every function computes the same thing.
+        for (int64_t a = -4; a <= 40; ++a) {
+                for (int64_t b = -3; b <= 3; ++b) {
+                        int64_t args[] = { a, b };
+
+                        for (size_t i = 0; i < n; ++i) {
+                                if (plain[i]->name == str_intern("fact") &&
+                                                (a < 0 || a > 20)) {
+                                        continue;
+                                }
+                                assert(ir_eval(plain, n, plain[i], args) ==
+                                                ir_eval(opt, n, opt[i], args));
+                        }
+                }
+        }
+        assert(ir_eval(opt, n, opt[1], (int64_t[]) { 10 }) == 27);
+        assert(ir_eval(opt, n, opt[5], (int64_t[]) { 5 }) == 120);
+
+        assert_ir_dump(opt[0],
+                        "func fold {\n"
+                        "b0:\n"
+                        "    %2 = const 42\n"
+                        "    jmp b2\n"
+                        "b2:  ; preds b0\n"
+                        "    ret %2\n"
+                        "}\n");
+        assert(ir_count_op(plain[2], IR_ADD) == 3);
+        assert(ir_count_op(opt[2], IR_ADD) == 1);
+        assert(ir_count_op(opt[6], IR_DIV) == 0);
+        assert(ir_count_op(opt[6], IR_SHL) == 0);
+        assert(ir_count_op(opt[6], IR_BR) == 0);
+        assert(ir_count_op(plain[1], IR_PHI) > ir_count_op(opt[1], IR_PHI));
+
+        // Loops that never run, or run once, fold away with the phis of
+        // their headers, and continue in a switch goes to the loop.
+        assert(ir_count_op(opt[7], IR_PHI) == 0);
+        assert(ir_count_op(opt[7], IR_BR) == 0);
+        assert(ir_count_op(opt[8], IR_PHI) == 0);
+        assert(ir_count_op(opt[8], IR_BR) == 0);
+        assert(ir_eval(opt, n, opt[8], (int64_t[]) { 4 }) == 5);
+        assert(ir_eval(opt, n, opt[9], (int64_t[]) { 10 }) == 33);
+
+        // Code after a return lands in blocks nothing reaches, here b4 and
+        // b5, until SCCP drops them.
+        assert_ir_dump(plain[5],
+                        "func fact {\n"
+                        "b0:\n"
+                        "    %0 = param 0  ; n\n"
+                        "    %1 = const 0\n"
+                        "    %2 = eq %0, %1\n"
+                        "    br %2, b2, b3\n"
+                        "b1:  ; preds b4, b3\n"
+                        "    %8 = phi [%9, b4], [%0, b3]  ; n\n"
+                        "    %10 = const 1\n"
+                        "    %11 = sub %8, %10\n"
+                        "    %12 = call fact(%11)\n"
+                        "    %13 = mul %8, %12\n"
+                        "    ret %13\n"
+                        "b2:  ; preds b0\n"
+                        "    %4 = const 1\n"
+                        "    ret %4\n"
+                        "b3:  ; preds b0\n"
+                        "    jmp b1\n"
+                        "b4:\n"
+                        "    %9 = undef\n"
+                        "    jmp b1\n"
+                        "b5:\n"
+                        "    %15 = const 0\n"
+                        "    ret %15\n"
+                        "}\n");
+
+        fatal_jmp = &jmp;
+        if (setjmp(jmp) == 0) {
+                ir_build(decls[n]);
+                assert(0);
+        }
+        fatal_jmp = NULL;
+
+        for (size_t i = 0; i < n; ++i) {
+                ir_func_free(plain[i]);
+                ir_func_free(opt[i]);
+        }
+        buf_free(decls);
+        diag_free(&ctx);
+}
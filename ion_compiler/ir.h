@@ -0,0 +1,132 @@
+#ifndef _IR_H_
+#define _IR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "common.h"
+
+// SSA intermediate representation of function bodies.
+//
+// A function is a list of basic blocks over one array of instructions;
+// an instruction's index in that array is the value it defines, and its
+// operands are the indices of the values it uses. Each block lists its
+// instructions in order, phis first and a jump, branch or return last.
+// A phi has one operand per predecessor, in the order of the block's
+// preds.
+//
+// Like the JIT, the IR covers the integer subset of Ion: every value is an
+// int64_t, comparisons give 0 or 1, and locals and parameters are the only
+// variables. Anything else is a fatal error.
+
+typedef enum IrOp {
+        IR_NOP,
+        IR_UNDEF,
+        IR_CONST,
+        IR_PARAM,
+        IR_PHI,
+        IR_COPY,
+        IR_NEG,
+        IR_NOT,
+        IR_LNOT,
+        IR_ADD,
+        IR_SUB,
+        IR_MUL,
+        IR_DIV,
+        IR_MOD,
+        IR_AND,
+        IR_OR,
+        IR_XOR,
+        IR_SHL,
+        IR_SHR,
+        IR_EQ,
+        IR_NE,
+        IR_LT,
+        IR_LE,
+        IR_GT,
+        IR_GE,
+        IR_CALL,
+        IR_JMP,
+        IR_BR,
+        IR_RET,
+        NUM_IR_OPS
+} IrOp;
+
+typedef struct IrInstr {
+        IrOp op;
+        uint32_t block;
+        // The constant of IR_CONST and the index of IR_PARAM.
+        int64_t imm;
+        // The callee of IR_CALL; the variable of IR_PARAM and IR_PHI.
+        const char *name;
+        uint32_t *args;
+        // Successors of IR_JMP and IR_BR, taken and not taken.
+        uint32_t targets[2];
+} IrInstr;
+
+typedef struct IrBlock {
+        uint32_t *instrs;
+        uint32_t *preds;
+        // Set on blocks that passes have found unreachable and emptied.
+        bool dead;
+} IrBlock;
+
+typedef struct IrFunc {
+        const char *name;
+        size_t num_params;
+        IrInstr *instrs;
+        IrBlock *blocks;
+} IrFunc;
+
+typedef enum IrPassKind {
+        IR_PASS_SCCP,
+        IR_PASS_COPYPROP,
+        IR_PASS_CSE,
+        IR_PASS_DCE,
+        NUM_IR_PASSES
+} IrPassKind;
+
+extern const char *ir_op_names[NUM_IR_OPS];
+extern const char *ir_pass_names[NUM_IR_PASSES];
+
+IrFunc *
+ir_build(Decl *decl);
+
+void
+ir_func_free(IrFunc *func);
+
+bool
+ir_is_pure(IrOp op);
+
+bool
+ir_is_terminator(IrOp op);
+
+size_t
+ir_num_succs(IrFunc *func, uint32_t block);
+
+uint32_t
+ir_succ(IrFunc *func, uint32_t block, size_t i);
+
+bool
+ir_fold(IrOp op, int64_t a, int64_t b, int64_t *result);
+
+void
+ir_remove_edge(IrFunc *func, uint32_t from, uint32_t to);
+
+void
+ir_verify(IrFunc *func);
+
+void
+ir_dump(IrFunc *func, Writer *w);
+
+bool
+ir_run_pass(IrFunc *func, IrPassKind pass);
+
+void
+ir_optimize(IrFunc *func);
+
+void
+ir_test(void);
+
+#endif
@@ -0,0 +1,657 @@
+#include "ir.h"
+#include "stats.h"
+
+// Optimization passes over the SSA IR. Each pass returns whether it changed
+// the function, and ir_optimize runs them in turn until none does. Passes
+// remove an instruction by turning it into a nop, and ir_run_pass drops the
+// nops from their blocks afterwards.
+
+#define IR_MAX_ROUNDS 8
+#define IR_NONE UINT32_MAX
+
+const char *ir_pass_names[NUM_IR_PASSES] = {
+        [IR_PASS_SCCP] = "sccp",
+        [IR_PASS_COPYPROP] = "copyprop",
+        [IR_PASS_CSE] = "cse",
+        [IR_PASS_DCE] = "dce",
+};
+
+typedef enum IrLatticeKind {
+        LATTICE_TOP,
+        LATTICE_CONST,
+        LATTICE_BOTTOM
+} IrLatticeKind;
+
+typedef struct IrLattice {
+        IrLatticeKind kind;
+        int64_t val;
+} IrLattice;
+
+typedef struct Sccp {
+        IrFunc *func;
+        IrLattice *values;
+        bool *reachable;
+        // Two per block, one for each successor edge.
+        bool *edges;
+        uint32_t **uses;
+        uint32_t *block_work;
+        uint32_t *value_work;
+} Sccp;
+
+static void
+ir_kill(IrFunc *func, uint32_t id)
+{
+        func->instrs[id].op = IR_NOP;
+        buf_free(func->instrs[id].args);
+}
+
+static void
+ir_sweep(IrFunc *func)
+{
+        for (IrBlock *b = func->blocks; b != buf_end(func->blocks); ++b) {
+                size_t n = 0;
+
+                for (size_t i = 0; i < buf_len(b->instrs); ++i) {
+                        if (func->instrs[b->instrs[i]].op != IR_NOP) {
+                                b->instrs[n++] = b->instrs[i];
+                        }
+                }
+                buf_trunc(b->instrs, n);
+        }
+}
+
+// The instructions that use each value, once per operand.
+static uint32_t **
+ir_uses(IrFunc *func)
+{
+        uint32_t **uses;
+
+        uses = xcalloc(buf_len(func->instrs), sizeof(*uses));
+        for (IrBlock *b = func->blocks; b != buf_end(func->blocks); ++b) {
+                for (size_t i = 0; i < buf_len(b->instrs); ++i) {
+                        IrInstr *instr = &func->instrs[b->instrs[i]];
+
+                        for (size_t j = 0; j < buf_len(instr->args); ++j) {
+                                buf_push(uses[instr->args[j]], b->instrs[i]);
+                        }
+                }
+        }
+        return uses;
+}
+
+static void
+ir_uses_free(uint32_t **uses, size_t n)
+{
+        for (size_t i = 0; i < n; ++i) {
+                buf_free(uses[i]);
+        }
+        xfree(uses);
+}
+
+static bool
+sccp_edge_live(Sccp *s, uint32_t from, uint32_t to)
+{
+        for (size_t i = 0; i < ir_num_succs(s->func, from); ++i) {
+                if (ir_succ(s->func, from, i) == to && s->edges[2 * from + i]) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+static IrLattice
+sccp_meet(IrLattice a, IrLattice b)
+{
+        if (a.kind == LATTICE_TOP) {
+                return b;
+        } else if (b.kind == LATTICE_TOP) {
+                return a;
+        } else if (a.kind == LATTICE_CONST && b.kind == LATTICE_CONST &&
+                        a.val == b.val) {
+                return a;
+        }
+        return (IrLattice) { LATTICE_BOTTOM };
+}
+
+static IrLattice
+sccp_eval(Sccp *s, IrInstr *instr)
+{
+        IrLattice result;
+        IrLattice a;
+        IrLattice b;
+        IrBlock *block;
+
+        switch (instr->op) {
+        case IR_CONST:
+                return (IrLattice) { LATTICE_CONST, instr->imm };
+        case IR_PHI:
+                result = (IrLattice) { LATTICE_TOP };
+                block = &s->func->blocks[instr->block];
+                for (size_t i = 0; i < buf_len(instr->args); ++i) {
+                        if (sccp_edge_live(s, block->preds[i],
+                                                instr->block)) {
+                                result = sccp_meet(result,
+                                                s->values[instr->args[i]]);
+                        }
+                }
+                return result;
+        case IR_UNDEF:
+        case IR_PARAM:
+        case IR_CALL:
+                return (IrLattice) { LATTICE_BOTTOM };
+        default:
+                a = s->values[instr->args[0]];
+                b = buf_len(instr->args) > 1 ? s->values[instr->args[1]] :
+                        (IrLattice) { LATTICE_CONST, 0 };
+                if (a.kind == LATTICE_BOTTOM || b.kind == LATTICE_BOTTOM) {
+                        return (IrLattice) { LATTICE_BOTTOM };
+                } else if (a.kind == LATTICE_TOP || b.kind == LATTICE_TOP) {
+                        return (IrLattice) { LATTICE_TOP };
+                }
+                result.kind = LATTICE_CONST;
+                if (!ir_fold(instr->op, a.val, b.val, &result.val)) {
+                        result.kind = LATTICE_BOTTOM;
+                }
+                return result;
+        }
+}
+
+static void
+sccp_visit(Sccp *s, uint32_t id);
+
+static void
+sccp_mark_edge(Sccp *s, uint32_t from, size_t i)
+{
+        IrBlock *to;
+
+        if (s->edges[2 * from + i]) {
+                return;
+        }
+        s->edges[2 * from + i] = true;
+        to = &s->func->blocks[ir_succ(s->func, from, i)];
+        if (!s->reachable[to - s->func->blocks]) {
+                s->reachable[to - s->func->blocks] = true;
+                buf_push(s->block_work, to - s->func->blocks);
+                return;
+        }
+        // The new edge brings another operand to the phis.
+        for (size_t j = 0; j < buf_len(to->instrs) &&
+                        s->func->instrs[to->instrs[j]].op == IR_PHI; ++j) {
+                sccp_visit(s, to->instrs[j]);
+        }
+}
+
+static void
+sccp_visit(Sccp *s, uint32_t id)
+{
+        IrInstr *instr;
+        IrLattice old;
+        IrLattice val;
+
+        instr = &s->func->instrs[id];
+        switch (instr->op) {
+        case IR_JMP:
+                sccp_mark_edge(s, instr->block, 0);
+                return;
+        case IR_BR:
+                // A condition that is not known yet takes both ways, which
+                // is safe if it turns out to be constant after all.
+                val = s->values[instr->args[0]];
+                if (val.kind != LATTICE_CONST || val.val) {
+                        sccp_mark_edge(s, instr->block, 0);
+                }
+                if (val.kind != LATTICE_CONST || !val.val) {
+                        sccp_mark_edge(s, instr->block, 1);
+                }
+                return;
+        case IR_RET:
+                return;
+        default:
+                old = s->values[id];
+                val = sccp_eval(s, instr);
+                if (val.kind != old.kind || val.val != old.val) {
+                        s->values[id] = val;
+                        buf_push(s->value_work, id);
+                }
+                return;
+        }
+}
+
+// Replaces a phi known to be constant with a constant after the phis of
+// its block, and after the nops left by phis replaced before it.
+static void
+sccp_replace_phi(Sccp *s, uint32_t phi, int64_t val)
+{
+        IrFunc *func;
+        IrBlock *b;
+        uint32_t id;
+        size_t pos;
+
+        func = s->func;
+        buf_push(func->instrs, (IrInstr) { .op = IR_CONST, .imm = val,
+                        .block = func->instrs[phi].block });
+        id = buf_len(func->instrs) - 1;
+        b = &func->blocks[func->instrs[phi].block];
+        for (pos = 0; func->instrs[b->instrs[pos]].op == IR_PHI ||
+                        func->instrs[b->instrs[pos]].op == IR_NOP; ++pos) {
+        }
+        buf_push(b->instrs, 0);
+        memmove(b->instrs + pos + 1, b->instrs + pos,
+                        (buf_len(b->instrs) - pos - 1) * sizeof(*b->instrs));
+        b->instrs[pos] = id;
+        for (size_t i = 0; i < buf_len(s->uses[phi]); ++i) {
+                IrInstr *user = &func->instrs[s->uses[phi][i]];
+
+                for (size_t j = 0; j < buf_len(user->args); ++j) {
+                        if (user->args[j] == phi) {
+                                user->args[j] = id;
+                        }
+                }
+        }
+        ir_kill(func, phi);
+}
+
+static size_t
+sccp_rewrite(Sccp *s)
+{
+        IrFunc *func;
+        IrInstr *instr;
+        size_t changes;
+        uint32_t other;
+        uint32_t id;
+
+        func = s->func;
+        changes = 0;
+        for (uint32_t b = 0; b < buf_len(func->blocks); ++b) {
+                if (!s->reachable[b]) {
+                        continue;
+                }
+                for (size_t i = 0; i < buf_len(func->blocks[b].instrs); ++i) {
+                        id = func->blocks[b].instrs[i];
+                        instr = &func->instrs[id];
+                        if (instr->op == IR_CONST ||
+                                        s->values[id].kind != LATTICE_CONST) {
+                                continue;
+                        }
+                        if (instr->op == IR_PHI) {
+                                sccp_replace_phi(s, id, s->values[id].val);
+                        } else {
+                                instr->op = IR_CONST;
+                                instr->imm = s->values[id].val;
+                                buf_free(instr->args);
+                        }
+                        ++changes;
+                }
+                instr = &func->instrs[buf_end(func->blocks[b].instrs)[-1]];
+                if (instr->op == IR_BR &&
+                                s->values[instr->args[0]].kind ==
+                                LATTICE_CONST) {
+                        id = instr->targets[s->values[instr->args[0]].val ?
+                                0 : 1];
+                        other = instr->targets[0] + instr->targets[1] - id;
+                        instr->op = IR_JMP;
+                        instr->targets[0] = id;
+                        buf_free(instr->args);
+                        ir_remove_edge(func, b, other);
+                        ++changes;
+                }
+        }
+        for (uint32_t b = 0; b < buf_len(func->blocks); ++b) {
+                IrBlock *block = &func->blocks[b];
+
+                if (s->reachable[b] || block->dead) {
+                        continue;
+                }
+                for (size_t i = 0; i < ir_num_succs(func, b); ++i) {
+                        id = ir_succ(func, b, i);
+                        if (s->reachable[id]) {
+                                ir_remove_edge(func, b, id);
+                        }
+                }
+                for (size_t i = 0; i < buf_len(block->instrs); ++i) {
+                        ir_kill(func, block->instrs[i]);
+                }
+                buf_free(block->instrs);
+                buf_free(block->preds);
+                block->dead = true;
+                ++changes;
+        }
+        return changes;
+}
+
+// Sparse conditional constant propagation (Wegman and Zadeck): values
+// start out unknown and only blocks reached along edges that may be taken
+// are evaluated, so constants flow through branches they decide. Constant
+// values are then materialized, decided branches become jumps and blocks
+// never reached are dropped.
+static size_t
+ir_sccp(IrFunc *func)
+{
+        Sccp s;
+        size_t num_blocks;
+        size_t num_instrs;
+        size_t changes;
+        uint32_t id;
+
+        num_blocks = buf_len(func->blocks);
+        num_instrs = buf_len(func->instrs);
+        s = (Sccp) { func };
+        s.values = xcalloc(num_instrs, sizeof(*s.values));
+        s.reachable = xcalloc(num_blocks, sizeof(*s.reachable));
+        s.edges = xcalloc(2 * num_blocks, sizeof(*s.edges));
+        s.uses = ir_uses(func);
+
+        s.reachable[0] = true;
+        buf_push(s.block_work, 0);
+        while (buf_len(s.block_work) || buf_len(s.value_work)) {
+                if (buf_len(s.block_work)) {
+                        id = s.block_work[buf_len(s.block_work) - 1];
+                        buf_trunc(s.block_work, buf_len(s.block_work) - 1);
+                        for (size_t i = 0;
+                                        i < buf_len(func->blocks[id].instrs);
+                                        ++i) {
+                                sccp_visit(&s, func->blocks[id].instrs[i]);
+                        }
+                        continue;
+                }
+                id = s.value_work[buf_len(s.value_work) - 1];
+                buf_trunc(s.value_work, buf_len(s.value_work) - 1);
+                for (size_t i = 0; i < buf_len(s.uses[id]); ++i) {
+                        uint32_t user = s.uses[id][i];
+
+                        if (s.reachable[func->instrs[user].block]) {
+                                sccp_visit(&s, user);
+                        }
+                }
+        }
+
+        changes = sccp_rewrite(&s);
+        ir_uses_free(s.uses, num_instrs);
+        buf_free(s.block_work);
+        buf_free(s.value_work);
+        xfree(s.values);
+        xfree(s.reachable);
+        xfree(s.edges);
+        return changes;
+}
+
+static uint32_t
+ir_find(uint32_t *repl, uint32_t id)
+{
+        while (repl[id] != id) {
+                id = repl[id];
+        }
+        return id;
+}
+
+// Points every operand at the value it was replaced with and drops the
+// replaced instructions.
+static size_t
+ir_replace(IrFunc *func, uint32_t *repl)
+{
+        size_t changes;
+
+        changes = 0;
+        for (IrBlock *b = func->blocks; b != buf_end(func->blocks); ++b) {
+                for (size_t i = 0; i < buf_len(b->instrs); ++i) {
+                        IrInstr *instr = &func->instrs[b->instrs[i]];
+
+                        for (size_t j = 0; j < buf_len(instr->args); ++j) {
+                                instr->args[j] = ir_find(repl,
+                                                instr->args[j]);
+                        }
+                }
+        }
+        for (uint32_t id = 0; id < buf_len(func->instrs); ++id) {
+                if (repl[id] != id) {
+                        ir_kill(func, id);
+                        ++changes;
+                }
+        }
+        return changes;
+}
+
+static uint32_t *
+ir_repl_new(IrFunc *func)
+{
+        uint32_t *repl;
+
+        repl = xmalloc(buf_len(func->instrs) * sizeof(*repl));
+        for (uint32_t id = 0; id < buf_len(func->instrs); ++id) {
+                repl[id] = id;
+        }
+        return repl;
+}
+
+// Removes copies and the phis whose operands are all one value, or the phi
+// itself. Removing one phi can make another trivial, so this goes on until
+// nothing more is found.
+static size_t
+ir_copyprop(IrFunc *func)
+{
+        uint32_t *repl;
+        size_t changes;
+        bool progress;
+        uint32_t same;
+        uint32_t val;
+
+        repl = ir_repl_new(func);
+        do {
+                progress = false;
+                for (IrBlock *b = func->blocks; b != buf_end(func->blocks);
+                                ++b) {
+                        for (size_t i = 0; i < buf_len(b->instrs); ++i) {
+                                uint32_t id = b->instrs[i];
+                                IrInstr *instr = &func->instrs[id];
+
+                                if (repl[id] != id || (instr->op != IR_COPY &&
+                                                instr->op != IR_PHI)) {
+                                        continue;
+                                }
+                                same = IR_NONE;
+                                for (size_t j = 0; j < buf_len(instr->args);
+                                                ++j) {
+                                        val = ir_find(repl, instr->args[j]);
+                                        if (val == id || val == same) {
+                                                continue;
+                                        } else if (same != IR_NONE) {
+                                                same = IR_NONE;
+                                                break;
+                                        }
+                                        same = val;
+                                }
+                                if (same != IR_NONE) {
+                                        repl[id] = same;
+                                        progress = true;
+                                }
+                        }
+                }
+        } while (progress);
+        changes = ir_replace(func, repl);
+        xfree(repl);
+        return changes;
+}
+
+static bool
+ir_is_commutative(IrOp op)
+{
+        return op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR ||
+                op == IR_XOR || op == IR_EQ || op == IR_NE;
+}
+
+static bool
+ir_cse_ok(IrOp op)
+{
+        return op == IR_CONST || (op >= IR_NEG && op <= IR_GE);
+}
+
+static uint64_t
+ir_cse_hash(IrInstr *instr)
+{
+        uint64_t a;
+        uint64_t b;
+
+        a = buf_len(instr->args) > 0 ? instr->args[0] : 0;
+        b = buf_len(instr->args) > 1 ? instr->args[1] : 0;
+        if (ir_is_commutative(instr->op) && a > b) {
+                a ^= b;
+                b ^= a;
+                a ^= b;
+        }
+        return ((((uint64_t) instr->op * 0x9E3779B97F4A7C15ull) ^
+                        (uint64_t) instr->imm) * 0xFF51AFD7ED558CCDull ^
+                        (a << 32 | b)) * 0xC4CEB9FE1A85EC53ull;
+}
+
+static bool
+ir_cse_equal(IrInstr *x, IrInstr *y)
+{
+        if (x->op != y->op || x->imm != y->imm ||
+                        buf_len(x->args) != buf_len(y->args)) {
+                return false;
+        }
+        if (buf_len(x->args) < 2) {
+                return buf_len(x->args) == 0 || x->args[0] == y->args[0];
+        }
+        return (x->args[0] == y->args[0] && x->args[1] == y->args[1]) ||
+                (ir_is_commutative(x->op) && x->args[0] == y->args[1] &&
+                 x->args[1] == y->args[0]);
+}
+
+// Local common subexpression elimination: within a block, a pure operation
+// on the same operands as an earlier one is replaced by it. Operands are
+// renamed as the block is scanned, so chains of equal expressions collapse
+// in one pass.
+static size_t
+ir_cse(IrFunc *func)
+{
+        uint32_t *repl;
+        uint32_t *table;
+        size_t changes;
+        size_t cap;
+
+        repl = ir_repl_new(func);
+        table = NULL;
+        for (IrBlock *b = func->blocks; b != buf_end(func->blocks); ++b) {
+                for (cap = 16; cap < 2 * buf_len(b->instrs); cap *= 2) {
+                }
+                buf_trunc(table, 0);
+                buf__fit(table, cap);
+                memset(table, 0xFF, cap * sizeof(*table));
+                for (size_t i = 0; i < buf_len(b->instrs); ++i) {
+                        uint32_t id = b->instrs[i];
+                        IrInstr *instr = &func->instrs[id];
+                        size_t slot;
+
+                        for (size_t j = 0; j < buf_len(instr->args); ++j) {
+                                instr->args[j] = repl[instr->args[j]];
+                        }
+                        if (!ir_cse_ok(instr->op)) {
+                                continue;
+                        }
+                        slot = ir_cse_hash(instr) & (cap - 1);
+                        while (table[slot] != IR_NONE && !ir_cse_equal(
+                                                &func->instrs[table[slot]],
+                                                instr)) {
+                                slot = (slot + 1) & (cap - 1);
+                        }
+                        if (table[slot] == IR_NONE) {
+                                table[slot] = id;
+                        } else {
+                                repl[id] = table[slot];
+                        }
+                }
+        }
+        changes = ir_replace(func, repl);
+        buf_free(table);
+        xfree(repl);
+        return changes;
+}
+
+// Dead code elimination by marking: everything a call, a branch or a return
+// depends on is live, and the rest goes, cycles of phis included.
+static size_t
+ir_dce(IrFunc *func)
+{
+        uint32_t *work;
+        size_t changes;
+        bool *live;
+
+        live = xcalloc(buf_len(func->instrs), sizeof(*live));
+        work = NULL;
+        for (IrBlock *b = func->blocks; b != buf_end(func->blocks); ++b) {
+                for (size_t i = 0; i < buf_len(b->instrs); ++i) {
+                        if (!ir_is_pure(func->instrs[b->instrs[i]].op)) {
+                                live[b->instrs[i]] = true;
+                                buf_push(work, b->instrs[i]);
+                        }
+                }
+        }
+        while (buf_len(work)) {
+                IrInstr *instr = &func->instrs[work[buf_len(work) - 1]];
+
+                buf_trunc(work, buf_len(work) - 1);
+                for (size_t i = 0; i < buf_len(instr->args); ++i) {
+                        if (!live[instr->args[i]]) {
+                                live[instr->args[i]] = true;
+                                buf_push(work, instr->args[i]);
+                        }
+                }
+        }
+        changes = 0;
+        for (IrBlock *b = func->blocks; b != buf_end(func->blocks); ++b) {
+                for (size_t i = 0; i < buf_len(b->instrs); ++i) {
+                        if (!live[b->instrs[i]]) {
+                                ir_kill(func, b->instrs[i]);
+                                ++changes;
+                        }
+                }
+        }
+        buf_free(work);
+        xfree(live);
+        return changes;
+}
+
+bool
+ir_run_pass(IrFunc *func, IrPassKind pass)
+{
+        size_t changes;
+
+        assert(pass < STATS_MAX_PASSES);
+        STAT_PASS_BEGIN();
+        switch (pass) {
+        case IR_PASS_SCCP:
+                changes = ir_sccp(func);
+                break;
+        case IR_PASS_COPYPROP:
+                changes = ir_copyprop(func);
+                break;
+        case IR_PASS_CSE:
+                changes = ir_cse(func);
+                break;
+        case IR_PASS_DCE:
+                changes = ir_dce(func);
+                break;
+        default:
+                assert(0);
+                return false;
+        }
+        ir_sweep(func);
+        STAT_PASS_END(pass, changes);
+        return changes > 0;
+}
+
+void
+ir_optimize(IrFunc *func)
+{
+        bool changed;
+
+        changed = true;
+        for (int round = 0; changed && round < IR_MAX_ROUNDS; ++round) {
+                changed = false;
+                for (int pass = 0; pass < NUM_IR_PASSES; ++pass) {
+                        changed |= ir_run_pass(func, pass);
+                        ir_verify(func);
+                }
+        }
+}
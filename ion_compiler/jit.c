@@ -0,0 +1,2283 @@
+#define _DEFAULT_SOURCE
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "jit.h"
+#include "parse.h"
+#include "switch.h"
+
+// In-process x86-64 code generator for function declarations.
+//
+// Locals and parameters are assigned to callee-saved registers by a linear
+// scan over their live intervals, everything that doesn't fit is spilled to
+// a frame slot. Expressions are evaluated into RAX with RCX/RDX as scratch
+// and intermediate results pushed on the machine stack, so the allocator
+// never has to deal with temporaries.
+//
+// There is no type checker yet, so the JIT types expressions itself: every
+// integer is an int64_t, and float and double values are computed in
+// double precision in XMM0 with XMM1 as scratch, rounding to single
+// precision wherever C would have a float. Float locals keep their bits in
+// the same registers and slots as integers; SysV has no callee-saved XMM
+// registers to give them. Strings, pointers and aggregates are rejected
+// with a fatal error.
+
+enum {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+enum {
+        CC_B = 0x2,
+        CC_AE = 0x3,
+        CC_E = 0x4,
+        CC_NE = 0x5,
+        CC_A = 0x7,
+        CC_P = 0xA,
+        CC_NP = 0xB,
+        CC_L = 0xC,
+        CC_GE = 0xD,
+        CC_LE = 0xE,
+        CC_G = 0xF
+};
+
+enum {
+        ALU_ADD = 0,
+        ALU_OR = 1,
+        ALU_AND = 4,
+        ALU_SUB = 5,
+        ALU_XOR = 6,
+        ALU_CMP = 7
+};
+
+// F32 values are held as doubles that a float can represent exactly.
+typedef enum JitType {
+        JIT_INT,
+        JIT_F32,
+        JIT_F64,
+        JIT_NONE
+} JitType;
+
+typedef struct JitVar {
+        const char *name;
+        int start;
+        int end;
+        int reg;
+        int slot;
+        JitType type;
+} JitVar;
+
+typedef struct JitRange {
+        int start;
+        int end;
+} JitRange;
+
+// The label's offset from base is patched in at pos: base is the end of
+// the displacement for a jump, and the start of the table for a jump table
+// entry.
+typedef struct JitFixup {
+        size_t pos;
+        int label;
+        size_t base;
+} JitFixup;
+
+typedef struct JitCall {
+        size_t pos;
+        const char *name;
+} JitCall;
+
+typedef struct JitLoop {
+        int break_label;
+        int continue_label;
+} JitLoop;
+
+typedef struct JitEntry {
+        const char *name;
+        Decl *decl;
+        size_t offset;
+} JitEntry;
+
+struct JitModule {
+        uint8_t *code;
+        size_t code_size;
+        size_t map_size;
+        JitEntry *entries;
+};
+
+static const int arg_regs[JIT_MAX_PARAMS] = { RDI, RSI, RDX, RCX, R8, R9 };
+static const int alloc_regs[] = { RBX, R12, R13, R14, R15 };
+
+#define NUM_ALLOC_REGS (sizeof(alloc_regs) / sizeof(*alloc_regs))
+
+static uint8_t *jit_code;
+static JitEntry *jit_entries;
+static JitCall *jit_calls;
+
+// Per function state.
+static JitVar *jit_vars;
+static int *jit_scope;
+static JitRange *jit_loop_ranges;
+static int jit_pos;
+static int jit_next_var;
+static size_t *jit_labels;
+static JitFixup *jit_fixups;
+static JitLoop *jit_loops;
+static int jit_depth;
+static int jit_num_saved;
+static int jit_num_slots;
+static int jit_saved[NUM_ALLOC_REGS];
+static int jit_epilogue;
+static JitType jit_ret_type;
+
+static void
+jit_scan_stmt(Stmt *stmt);
+
+static void
+jit_expr(Expr *expr);
+
+static void
+jit_stmt(Stmt *stmt);
+
+static JitEntry *
+jit_entry(const char *name)
+{
+        for (JitEntry *it = jit_entries; it != buf_end(jit_entries); ++it) {
+                if (it->name == name) {
+                        return it;
+                }
+        }
+        return NULL;
+}
+
+static int
+jit_lookup_var(const char *name)
+{
+        for (int i = buf_len(jit_scope) - 1; i >= 0; --i) {
+                if (jit_vars[jit_scope[i]].name == name) {
+                        return jit_scope[i];
+                }
+        }
+        return -1;
+}
+
+static int
+jit_find_var(const char *name)
+{
+        int var;
+
+        var = jit_lookup_var(name);
+        if (var < 0) {
+                fatal("jit: undeclared variable '%s'", name);
+        }
+        return var;
+}
+
+// Live interval construction. The scan walks the body in the same order as
+// code generation so that the n-th definition seen here is the n-th variable
+// defined during emission.
+
+static int
+jit_scan_def(const char *name)
+{
+        int var;
+
+        var = buf_len(jit_vars);
+        buf_push(jit_vars, (JitVar) { name, jit_pos, jit_pos, -1, -1 });
+        buf_push(jit_scope, var);
+        ++jit_pos;
+        return var;
+}
+
+static void
+jit_scan_use(int var)
+{
+        jit_vars[var].end = jit_pos++;
+}
+
+static void
+jit_scan_expr(Expr *expr)
+{
+        if (!expr) {
+                return;
+        }
+        switch (expr->kind) {
+        case EXPR_NAME:
+                if (jit_lookup_var(expr->name) >= 0) {
+                        jit_scan_use(jit_lookup_var(expr->name));
+                }
+                break;
+        case EXPR_CALL:
+                for (size_t i = 0; i < expr->call.num_args; ++i) {
+                        jit_scan_expr(expr->call.args[i]);
+                }
+                break;
+        case EXPR_UNARY:
+                jit_scan_expr(expr->unary.expr);
+                break;
+        case EXPR_CAST:
+                jit_scan_expr(expr->cast.expr);
+                break;
+        case EXPR_BINARY:
+                jit_scan_expr(expr->binary.left);
+                jit_scan_expr(expr->binary.right);
+                break;
+        case EXPR_TERNARY:
+                jit_scan_expr(expr->ternary.cond);
+                jit_scan_expr(expr->ternary.if_true);
+                jit_scan_expr(expr->ternary.if_false);
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+jit_scan_block(StmtBlock block)
+{
+        size_t mark;
+
+        mark = buf_len(jit_scope);
+        for (size_t i = 0; i < block.num_stmts; ++i) {
+                jit_scan_stmt(block.stmts[i]);
+        }
+        buf_trunc(jit_scope, mark);
+}
+
+static void
+jit_scan_loop(StmtBlock block, Expr *cond, StmtBlock next)
+{
+        int start;
+
+        start = jit_pos;
+        jit_scan_expr(cond);
+        jit_scan_block(block);
+        jit_scan_block(next);
+        buf_push(jit_loop_ranges, (JitRange) { start, jit_pos++ });
+}
+
+static void
+jit_scan_stmt(Stmt *stmt)
+{
+        size_t mark;
+        int var;
+
+        ++jit_pos;
+        switch (stmt->kind) {
+        case STMT_RETURN:
+        case STMT_EXPR:
+                jit_scan_expr(stmt->expr);
+                break;
+        case STMT_BLOCK:
+                jit_scan_block(stmt->block);
+                break;
+        case STMT_IF:
+                jit_scan_expr(stmt->if_stmt.cond);
+                jit_scan_block(stmt->if_stmt.then_block);
+                for (size_t i = 0; i < stmt->if_stmt.num_elseifs; ++i) {
+                        jit_scan_expr(stmt->if_stmt.elseifs[i].cond);
+                        jit_scan_block(stmt->if_stmt.elseifs[i].block);
+                }
+                jit_scan_block(stmt->if_stmt.else_block);
+                break;
+        case STMT_WHILE:
+        case STMT_DO:
+                jit_scan_loop(stmt->while_stmt.block, stmt->while_stmt.cond,
+                                (StmtBlock) { 0 });
+                break;
+        case STMT_FOR:
+                mark = buf_len(jit_scope);
+                for (size_t i = 0; i < stmt->for_stmt.init.num_stmts; ++i) {
+                        jit_scan_stmt(stmt->for_stmt.init.stmts[i]);
+                }
+                jit_scan_loop(stmt->for_stmt.block, stmt->for_stmt.cond,
+                                stmt->for_stmt.next);
+                buf_trunc(jit_scope, mark);
+                break;
+        case STMT_SWITCH:
+                jit_scan_expr(stmt->switch_stmt.expr);
+                mark = buf_len(jit_scope);
+                var = jit_scan_def(NULL);
+                for (size_t i = 0; i < stmt->switch_stmt.num_cases; ++i) {
+                        SwitchCase *c = &stmt->switch_stmt.cases[i];
+                        for (size_t j = 0; j < c->num_exprs; ++j) {
+                                jit_scan_expr(c->exprs[j]);
+                                jit_scan_use(var);
+                        }
+                }
+                buf_trunc(jit_scope, mark);
+                for (size_t i = 0; i < stmt->switch_stmt.num_cases; ++i) {
+                        jit_scan_block(stmt->switch_stmt.cases[i].block);
+                }
+                break;
+        case STMT_ASSIGN:
+                jit_scan_expr(stmt->assign.right);
+                jit_scan_expr(stmt->assign.left);
+                break;
+        case STMT_AUTO_ASSIGN:
+                jit_scan_expr(stmt->autoassign.init);
+                jit_scan_def(stmt->autoassign.name);
+                break;
+        default:
+                break;
+        }
+}
+
+// A variable that is live on entry to a loop and used inside it must stay
+// live until the back edge, otherwise the next iteration would see a
+// clobbered register.
+static void
+jit_extend_intervals(void)
+{
+        bool changed;
+
+        do {
+                changed = false;
+                for (JitRange *r = jit_loop_ranges;
+                                r != buf_end(jit_loop_ranges); ++r) {
+                        for (JitVar *v = jit_vars; v != buf_end(jit_vars);
+                                        ++v) {
+                                if (v->start < r->start && v->end >= r->start
+                                                && v->end < r->end) {
+                                        v->end = r->end;
+                                        changed = true;
+                                }
+                        }
+                }
+        } while (changed);
+}
+
+static int
+jit_cmp_start(const void *a, const void *b)
+{
+        const JitVar *x;
+        const JitVar *y;
+
+        x = &jit_vars[*(const int *) a];
+        y = &jit_vars[*(const int *) b];
+        return x->start - y->start;
+}
+
+static void
+jit_alloc_regs(void)
+{
+        int *order;
+        int active[NUM_ALLOC_REGS];
+        bool taken[NUM_ALLOC_REGS];
+        bool used[NUM_ALLOC_REGS];
+        int num_active;
+        int furthest;
+        JitVar *v;
+
+        // Nothing to allocate, and qsort must not be handed a NULL buffer.
+        if (buf_len(jit_vars) == 0) {
+                jit_num_saved = 0;
+                jit_num_slots = 0;
+                return;
+        }
+        order = NULL;
+        for (int i = 0; i < (int) buf_len(jit_vars); ++i) {
+                buf_push(order, i);
+        }
+        qsort(order, buf_len(order), sizeof(int), jit_cmp_start);
+
+        memset(used, 0, sizeof(used));
+        num_active = 0;
+        for (int *it = order; it != buf_end(order); ++it) {
+                v = &jit_vars[*it];
+
+                // Expire intervals that ended before this one starts.
+                for (int j = 0; j < num_active; ) {
+                        if (jit_vars[active[j]].end < v->start) {
+                                active[j] = active[--num_active];
+                        } else {
+                                ++j;
+                        }
+                }
+
+                if (num_active < (int) NUM_ALLOC_REGS) {
+                        memset(taken, 0, sizeof(taken));
+                        for (int j = 0; j < num_active; ++j) {
+                                taken[jit_vars[active[j]].reg] = true;
+                        }
+                        for (int r = 0; r < (int) NUM_ALLOC_REGS; ++r) {
+                                if (!taken[r]) {
+                                        v->reg = r;
+                                        break;
+                                }
+                        }
+                        active[num_active++] = *it;
+                        used[v->reg] = true;
+                        continue;
+                }
+
+                // Spill whichever interval ends last.
+                furthest = 0;
+                for (int j = 1; j < num_active; ++j) {
+                        if (jit_vars[active[j]].end >
+                                        jit_vars[active[furthest]].end) {
+                                furthest = j;
+                        }
+                }
+                if (jit_vars[active[furthest]].end > v->end) {
+                        v->reg = jit_vars[active[furthest]].reg;
+                        jit_vars[active[furthest]].reg = -1;
+                        active[furthest] = *it;
+                }
+        }
+        buf_free(order);
+
+        jit_num_saved = 0;
+        for (int r = 0; r < (int) NUM_ALLOC_REGS; ++r) {
+                if (used[r]) {
+                        jit_saved[jit_num_saved++] = alloc_regs[r];
+                }
+        }
+
+        // Spill slots live below the saved registers.
+        jit_num_slots = 0;
+        for (v = jit_vars; v != buf_end(jit_vars); ++v) {
+                if (v->reg < 0) {
+                        v->slot = -8 * (jit_num_saved + ++jit_num_slots);
+                } else {
+                        v->reg = alloc_regs[v->reg];
+                }
+        }
+}
+
+// Instruction encoding.
+
+static void
+emit8(uint8_t byte)
+{
+        buf_push(jit_code, byte);
+}
+
+static void
+emit32(uint32_t val)
+{
+        emit8(val);
+        emit8(val >> 8);
+        emit8(val >> 16);
+        emit8(val >> 24);
+}
+
+static void
+emit64(uint64_t val)
+{
+        emit32(val);
+        emit32(val >> 32);
+}
+
+static void
+emit_rex(int reg, int base)
+{
+        emit8(0x48 | ((reg >> 3) << 2) | (base >> 3));
+}
+
+static void
+emit_modrm(int mod, int reg, int rm)
+{
+        emit8((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void
+emit_mov_rr(int dst, int src)
+{
+        if (dst != src) {
+                emit_rex(src, dst);
+                emit8(0x89);
+                emit_modrm(3, src, dst);
+        }
+}
+
+static bool
+is_imm32(int64_t val)
+{
+        return val >= INT32_MIN && val <= INT32_MAX;
+}
+
+static void
+emit_mov_ri(int dst, int64_t val)
+{
+        if (is_imm32(val)) {
+                emit_rex(0, dst);
+                emit8(0xC7);
+                emit_modrm(3, 0, dst);
+                emit32(val);
+        } else {
+                emit_rex(0, dst);
+                emit8(0xB8 + (dst & 7));
+                emit64(val);
+        }
+}
+
+static void
+emit_load(int dst, int32_t disp)
+{
+        emit_rex(dst, RBP);
+        emit8(0x8B);
+        emit_modrm(2, dst, RBP);
+        emit32(disp);
+}
+
+static void
+emit_store(int32_t disp, int src)
+{
+        emit_rex(src, RBP);
+        emit8(0x89);
+        emit_modrm(2, src, RBP);
+        emit32(disp);
+}
+
+static void
+emit_alu_rr(uint8_t op, int dst, int src)
+{
+        emit_rex(src, dst);
+        emit8(op);
+        emit_modrm(3, src, dst);
+}
+
+static void
+emit_alu_ri(int ext, int dst, int32_t imm)
+{
+        emit_rex(0, dst);
+        emit8(0x81);
+        emit_modrm(3, ext, dst);
+        emit32(imm);
+}
+
+static void
+emit_group3(int ext, int reg)
+{
+        emit_rex(0, reg);
+        emit8(0xF7);
+        emit_modrm(3, ext, reg);
+}
+
+static void
+emit_push(int reg)
+{
+        if (reg >= R8) {
+                emit8(0x41);
+        }
+        emit8(0x50 + (reg & 7));
+}
+
+static void
+emit_pop(int reg)
+{
+        if (reg >= R8) {
+                emit8(0x41);
+        }
+        emit8(0x58 + (reg & 7));
+}
+
+static void
+emit_setcc(int cc)
+{
+        // setcc al; movzx eax, al
+        emit8(0x0F);
+        emit8(0x90 + cc);
+        emit8(0xC0);
+        emit8(0x0F);
+        emit8(0xB6);
+        emit8(0xC0);
+}
+
+// An SSE instruction between registers: prefix, 0F, op. Wide ones take a
+// 64-bit general purpose register.
+static void
+emit_sse(uint8_t prefix, uint8_t op, int reg, int rm, bool wide)
+{
+        emit8(prefix);
+        if (wide || reg >= R8 || rm >= R8) {
+                emit8(0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3));
+        }
+        emit8(0x0F);
+        emit8(op);
+        emit_modrm(3, reg, rm);
+}
+
+// movq xmm, reg
+static void
+emit_movq_to_xmm(int xmm, int reg)
+{
+        emit_sse(0x66, 0x6E, xmm, reg, true);
+}
+
+// movq reg, xmm
+static void
+emit_movq_from_xmm(int reg, int xmm)
+{
+        emit_sse(0x66, 0x7E, xmm, reg, true);
+}
+
+// Leaves in RAX whether the last ucomisd found its operands equal or, with
+// eq false, unequal. Unordered operands are unequal.
+static void
+emit_float_equal(bool eq)
+{
+        // sete al; setnp cl; and al, cl  or  setne al; setp cl; or al, cl
+        emit8(0x0F);
+        emit8(0x90 + (eq ? CC_E : CC_NE));
+        emit8(0xC0);
+        emit8(0x0F);
+        emit8(0x90 + (eq ? CC_NP : CC_P));
+        emit8(0xC1);
+        emit8(eq ? 0x20 : 0x08);
+        emit8(0xC8);
+        // movzx eax, al
+        emit8(0x0F);
+        emit8(0xB6);
+        emit8(0xC0);
+}
+
+static int
+jit_new_label(void)
+{
+        buf_push(jit_labels, SIZE_MAX);
+        return buf_len(jit_labels) - 1;
+}
+
+static void
+jit_bind(int label)
+{
+        jit_labels[label] = buf_len(jit_code);
+}
+
+static void
+emit_jmp(int label)
+{
+        emit8(0xE9);
+        buf_push(jit_fixups, (JitFixup) { buf_len(jit_code), label,
+                        buf_len(jit_code) + 4 });
+        emit32(0);
+}
+
+static void
+emit_jcc(int cc, int label)
+{
+        emit8(0x0F);
+        emit8(0x80 + cc);
+        buf_push(jit_fixups, (JitFixup) { buf_len(jit_code), label,
+                        buf_len(jit_code) + 4 });
+        emit32(0);
+}
+
+static void
+emit_test_rax(void)
+{
+        emit_alu_rr(0x85, RAX, RAX);
+}
+
+static void
+patch32(size_t pos, int32_t val)
+{
+        memcpy(jit_code + pos, &val, sizeof(val));
+}
+
+// Types.
+
+static const char *jit_int_types[] = {
+        "int", "uint", "char", "bool", "long", "ulong", "int8", "uint8",
+        "int16", "uint16", "int32", "uint32", "int64", "uint64",
+};
+
+// Untyped parameters, as built by hand in tests, are taken to be ints.
+static JitType
+jit_type_of(Typespec *type)
+{
+        if (!type) {
+                return JIT_INT;
+        } else if (type->kind != TYPESPEC_NAME) {
+                return JIT_NONE;
+        } else if (type->name == str_intern("float")) {
+                return JIT_F32;
+        } else if (type->name == str_intern("double")) {
+                return JIT_F64;
+        }
+        for (size_t i = 0; i < sizeof(jit_int_types) /
+                        sizeof(*jit_int_types); ++i) {
+                if (type->name == str_intern(jit_int_types[i])) {
+                        return JIT_INT;
+                }
+        }
+        return JIT_NONE;
+}
+
+// C's usual arithmetic conversions.
+static JitType
+jit_arith_type(JitType a, JitType b)
+{
+        if (a == JIT_F64 || b == JIT_F64) {
+                return JIT_F64;
+        } else if (a == JIT_F32 || b == JIT_F32) {
+                return JIT_F32;
+        }
+        return JIT_INT;
+}
+
+static JitType
+jit_binary_type(TokenKind op, JitType left, JitType right)
+{
+        switch ((int) op) {
+        case '+':
+        case '-':
+        case '*':
+        case '/':
+                return jit_arith_type(left, right);
+        default:
+                return JIT_INT;
+        }
+}
+
+static JitType
+jit_expr_type(Expr *expr)
+{
+        JitEntry *callee;
+
+        switch (expr->kind) {
+        case EXPR_FLOAT:
+                return JIT_F64;
+        case EXPR_NAME:
+                return jit_vars[jit_find_var(expr->name)].type;
+        case EXPR_CALL:
+                if (expr->call.expr->kind == EXPR_NAME &&
+                                (callee = jit_entry(expr->call.expr->name))) {
+                        return jit_type_of(callee->decl->func.ret_type);
+                }
+                return JIT_INT;
+        case EXPR_CAST:
+                return jit_type_of(expr->cast.type);
+        case EXPR_UNARY:
+                return expr->unary.op == '!' ? JIT_INT :
+                        jit_expr_type(expr->unary.expr);
+        case EXPR_BINARY:
+                return jit_binary_type(expr->binary.op,
+                                jit_expr_type(expr->binary.left),
+                                jit_expr_type(expr->binary.right));
+        case EXPR_TERNARY:
+                return jit_arith_type(jit_expr_type(expr->ternary.if_true),
+                                jit_expr_type(expr->ternary.if_false));
+        default:
+                return JIT_INT;
+        }
+}
+
+// Code generation.
+
+static void
+jit_load_var(int dst, int var)
+{
+        if (jit_vars[var].reg >= 0) {
+                emit_mov_rr(dst, jit_vars[var].reg);
+        } else {
+                emit_load(dst, jit_vars[var].slot);
+        }
+}
+
+static void
+jit_store_var(int var, int src)
+{
+        if (jit_vars[var].reg >= 0) {
+                emit_mov_rr(jit_vars[var].reg, src);
+        } else {
+                emit_store(jit_vars[var].slot, src);
+        }
+}
+
+static int
+jit_def_var(const char *name)
+{
+        int var;
+
+        var = jit_next_var++;
+        assert(jit_vars[var].name == name);
+        buf_push(jit_scope, var);
+        return var;
+}
+
+// Stores a value of the variable's type, from RAX or XMM0.
+static void
+jit_store_value(int var)
+{
+        if (jit_vars[var].type != JIT_INT) {
+                emit_movq_from_xmm(RAX, 0);
+        }
+        jit_store_var(var, RAX);
+}
+
+// cvtsd2ss xmm0, xmm0; cvtss2sd xmm0, xmm0
+static void
+jit_round_f32(void)
+{
+        emit_sse(0xF2, 0x5A, 0, 0, false);
+        emit_sse(0xF3, 0x5A, 0, 0, false);
+}
+
+// Converts the value in RAX or XMM0 from one type to the other. Integers
+// are signed, here as everywhere in the JIT.
+static void
+jit_convert(JitType from, JitType to)
+{
+        if (from == to) {
+                return;
+        } else if (to == JIT_INT) {
+                // cvttsd2si rax, xmm0
+                emit_sse(0xF2, 0x2C, RAX, 0, true);
+        } else if (from == JIT_INT) {
+                // cvtsi2sd xmm0, rax, or cvtsi2ss and widen. The convert
+                // only writes the low lanes, so clear XMM0 first to not wait
+                // on whatever last wrote it.
+                emit_sse(0x66, 0x57, 0, 0, false);
+                emit_sse(to == JIT_F32 ? 0xF3 : 0xF2, 0x2A, 0, RAX, true);
+                if (to == JIT_F32) {
+                        emit_sse(0xF3, 0x5A, 0, 0, false);
+                }
+        } else if (to == JIT_F32) {
+                jit_round_f32();
+        }
+}
+
+static void
+jit_expr_to(Expr *expr, JitType type)
+{
+        JitType from;
+
+        from = jit_expr_type(expr);
+        jit_expr(expr);
+        jit_convert(from, type);
+}
+
+static bool
+is_imm_expr(Expr *expr)
+{
+        return expr->kind == EXPR_INT && expr->int_val <= INT32_MAX;
+}
+
+static bool
+is_leaf_expr(Expr *expr)
+{
+        return is_imm_expr(expr) || (expr->kind == EXPR_NAME &&
+                        jit_lookup_var(expr->name) >= 0);
+}
+
+static int
+jit_cmp_cc(TokenKind op)
+{
+        switch ((int) op) {
+        case TOKEN_EQ:
+                return CC_E;
+        case TOKEN_NOTEQ:
+                return CC_NE;
+        case '<':
+                return CC_L;
+        case TOKEN_LTEQ:
+                return CC_LE;
+        case '>':
+                return CC_G;
+        case TOKEN_GTEQ:
+                return CC_GE;
+        default:
+                return -1;
+        }
+}
+
+static int
+jit_alu_ext(TokenKind op)
+{
+        switch ((int) op) {
+        case '+':
+                return ALU_ADD;
+        case '-':
+                return ALU_SUB;
+        case '&':
+                return ALU_AND;
+        case '|':
+                return ALU_OR;
+        case '^':
+                return ALU_XOR;
+        default:
+                return jit_cmp_cc(op) >= 0 ? ALU_CMP : -1;
+        }
+}
+
+// Leaves left in RAX and right in RCX.
+static void
+jit_operands(Expr *left, Expr *right)
+{
+        if (is_leaf_expr(right)) {
+                jit_expr(left);
+                if (right->kind == EXPR_INT) {
+                        emit_mov_ri(RCX, right->int_val);
+                } else {
+                        jit_load_var(RCX, jit_find_var(right->name));
+                }
+        } else {
+                jit_expr(left);
+                emit_push(RAX);
+                ++jit_depth;
+                jit_expr(right);
+                emit_mov_rr(RCX, RAX);
+                emit_pop(RAX);
+                --jit_depth;
+        }
+}
+
+// Leaves left in XMM0 and right in XMM1, both converted to type.
+static void
+jit_float_operands(Expr *left, Expr *right, JitType type)
+{
+        if (is_leaf_expr(left) || left->kind == EXPR_FLOAT) {
+                // Loading left cannot disturb XMM1, so skip the stack.
+                jit_expr_to(right, type);
+                emit_sse(0x66, 0x28, 1, 0, false);
+                jit_expr_to(left, type);
+                return;
+        }
+        jit_expr_to(left, type);
+        emit_movq_from_xmm(RAX, 0);
+        emit_push(RAX);
+        ++jit_depth;
+        jit_expr_to(right, type);
+        // movapd xmm1, xmm0
+        emit_sse(0x66, 0x28, 1, 0, false);
+        emit_pop(RAX);
+        --jit_depth;
+        emit_movq_to_xmm(0, RAX);
+}
+
+// Compares operands of which at least one is a float and returns the
+// condition code that holds when op does. Comparisons with NaN are false
+// but for !=, so < and <= are turned around to use the codes that fail on
+// unordered operands.
+static int
+jit_float_compare(TokenKind op, Expr *left, Expr *right)
+{
+        jit_float_operands(left, right, jit_arith_type(jit_expr_type(left),
+                                jit_expr_type(right)));
+        switch ((int) op) {
+        case '<':
+        case TOKEN_LTEQ:
+                // ucomisd xmm1, xmm0
+                emit_sse(0x66, 0x2E, 1, 0, false);
+                return op == '<' ? CC_A : CC_AE;
+        case '>':
+        case TOKEN_GTEQ:
+                // ucomisd xmm0, xmm1
+                emit_sse(0x66, 0x2E, 0, 1, false);
+                return op == '>' ? CC_A : CC_AE;
+        default:
+                emit_sse(0x66, 0x2E, 0, 1, false);
+                emit_float_equal(op == TOKEN_EQ);
+                emit_test_rax();
+                return CC_NE;
+        }
+}
+
+// Tests the float in XMM0 against zero; NaN is true, as in C.
+static int
+jit_float_truth(void)
+{
+        // xorpd xmm1, xmm1; ucomisd xmm0, xmm1
+        emit_sse(0x66, 0x57, 1, 1, false);
+        emit_sse(0x66, 0x2E, 0, 1, false);
+        emit_float_equal(false);
+        emit_test_rax();
+        return CC_NE;
+}
+
+// Evaluates a comparison or a truth value into flags and returns the
+// condition code that holds when the expression is true.
+static int
+jit_cond(Expr *expr)
+{
+        int cc;
+
+        if (expr->kind == EXPR_BINARY) {
+                cc = jit_cmp_cc(expr->binary.op);
+                if (cc >= 0 && (jit_expr_type(expr->binary.left) != JIT_INT ||
+                                jit_expr_type(expr->binary.right) !=
+                                JIT_INT)) {
+                        return jit_float_compare(expr->binary.op,
+                                        expr->binary.left,
+                                        expr->binary.right);
+                } else if (cc >= 0) {
+                        if (is_imm_expr(expr->binary.right)) {
+                                jit_expr(expr->binary.left);
+                                emit_alu_ri(ALU_CMP, RAX,
+                                                expr->binary.right->int_val);
+                        } else {
+                                jit_operands(expr->binary.left,
+                                                expr->binary.right);
+                                emit_alu_rr(0x39, RAX, RCX);
+                        }
+                        return cc;
+                }
+        }
+        if (jit_expr_type(expr) != JIT_INT) {
+                jit_expr(expr);
+                return jit_float_truth();
+        }
+        jit_expr(expr);
+        emit_test_rax();
+        return CC_NE;
+}
+
+static void
+jit_branch_false(Expr *expr, int label)
+{
+        emit_jcc(jit_cond(expr) ^ 1, label);
+}
+
+static void
+jit_logical(TokenKind op, Expr *left, Expr *right)
+{
+        int short_label;
+        int end_label;
+
+        short_label = jit_new_label();
+        end_label = jit_new_label();
+        if (op == TOKEN_AND) {
+                emit_jcc(jit_cond(left) ^ 1, short_label);
+        } else {
+                emit_jcc(jit_cond(left), short_label);
+        }
+        emit_setcc(jit_cond(right));
+        emit_jmp(end_label);
+        jit_bind(short_label);
+        emit_mov_ri(RAX, op == TOKEN_OR);
+        jit_bind(end_label);
+}
+
+static void
+jit_float_binary(TokenKind op, Expr *left, Expr *right, JitType type)
+{
+        uint8_t code;
+
+        switch ((int) op) {
+        case '+':
+                code = 0x58;
+                break;
+        case '*':
+                code = 0x59;
+                break;
+        case '-':
+                code = 0x5C;
+                break;
+        case '/':
+                code = 0x5E;
+                break;
+        default:
+                if (jit_cmp_cc(op) < 0) {
+                        fatal("jit: %s needs integer operands",
+                                        token_kind_str(op));
+                }
+                emit_setcc(jit_float_compare(op, left, right));
+                return;
+        }
+        // addsd, mulsd, subsd or divsd xmm0, xmm1
+        jit_float_operands(left, right, type);
+        emit_sse(0xF2, code, 0, 1, false);
+        if (type == JIT_F32) {
+                jit_round_f32();
+        }
+}
+
+static void
+jit_binary(TokenKind op, Expr *left, Expr *right)
+{
+        JitType left_type;
+        JitType right_type;
+        int ext;
+
+        if (op == TOKEN_AND || op == TOKEN_OR) {
+                jit_logical(op, left, right);
+                return;
+        }
+        left_type = jit_expr_type(left);
+        right_type = jit_expr_type(right);
+        if (left_type != JIT_INT || right_type != JIT_INT) {
+                jit_float_binary(op, left, right, jit_arith_type(left_type,
+                                        right_type));
+                return;
+        }
+
+        ext = jit_alu_ext(op);
+        if (ext >= 0 && is_imm_expr(right)) {
+                jit_expr(left);
+                emit_alu_ri(ext, RAX, right->int_val);
+        } else {
+                jit_operands(left, right);
+                switch ((int) op) {
+                case '+':
+                        emit_alu_rr(0x01, RAX, RCX);
+                        break;
+                case '-':
+                        emit_alu_rr(0x29, RAX, RCX);
+                        break;
+                case '&':
+                        emit_alu_rr(0x21, RAX, RCX);
+                        break;
+                case '|':
+                        emit_alu_rr(0x09, RAX, RCX);
+                        break;
+                case '^':
+                        emit_alu_rr(0x31, RAX, RCX);
+                        break;
+                case '*':
+                        // imul rax, rcx
+                        emit_rex(RAX, RCX);
+                        emit8(0x0F);
+                        emit8(0xAF);
+                        emit_modrm(3, RAX, RCX);
+                        break;
+                case '/':
+                case '%':
+                        // cqo; idiv rcx
+                        emit8(0x48);
+                        emit8(0x99);
+                        emit_group3(7, RCX);
+                        if (op == '%') {
+                                emit_mov_rr(RAX, RDX);
+                        }
+                        break;
+                case TOKEN_LSHIFT:
+                case TOKEN_RSHIFT:
+                        // shl/sar rax, cl
+                        emit_rex(0, RAX);
+                        emit8(0xD3);
+                        emit_modrm(3, op == TOKEN_LSHIFT ? 4 : 7, RAX);
+                        break;
+                default:
+                        if (jit_cmp_cc(op) < 0) {
+                                fatal("jit: unsupported binary operator %s",
+                                                token_kind_str(op));
+                        }
+                        emit_alu_rr(0x39, RAX, RCX);
+                        break;
+                }
+        }
+        if (jit_cmp_cc(op) >= 0) {
+                emit_setcc(jit_cmp_cc(op));
+        }
+}
+
+static void
+jit_call(Expr *expr)
+{
+        JitEntry *callee;
+        FuncParam *params;
+        JitType type;
+        size_t num_args;
+        int regs[JIT_MAX_PARAMS];
+        int num_ints;
+        int num_floats;
+        bool pad;
+
+        if (expr->call.expr->kind != EXPR_NAME ||
+                        !(callee = jit_entry(expr->call.expr->name))) {
+                fatal("jit: call target must be a function in the module");
+        }
+        num_args = expr->call.num_args;
+        if (num_args != callee->decl->func.num_params) {
+                fatal("jit: '%s' expects %zu arguments, got %zu",
+                                callee->name, callee->decl->func.num_params,
+                                num_args);
+        }
+
+        params = callee->decl->func.params;
+        for (size_t i = 0; i < num_args; ++i) {
+                type = jit_type_of(params[i].type);
+                jit_expr_to(expr->call.args[i], type);
+                if (type != JIT_INT) {
+                        emit_movq_from_xmm(RAX, 0);
+                }
+                emit_push(RAX);
+                ++jit_depth;
+        }
+        // Integers take the argument registers in order, floats XMM0 up.
+        num_ints = 0;
+        num_floats = 0;
+        for (size_t i = 0; i < num_args; ++i) {
+                regs[i] = jit_type_of(params[i].type) == JIT_INT ?
+                        arg_regs[num_ints++] : num_floats++;
+        }
+        for (size_t i = num_args; i-- > 0; ) {
+                type = jit_type_of(params[i].type);
+                if (type == JIT_INT) {
+                        emit_pop(regs[i]);
+                } else {
+                        emit_pop(RAX);
+                        emit_movq_to_xmm(regs[i], RAX);
+                        if (type == JIT_F32) {
+                                // cvtsd2ss xmmN, xmmN
+                                emit_sse(0xF2, 0x5A, regs[i], regs[i],
+                                                false);
+                        }
+                }
+                --jit_depth;
+        }
+
+        pad = jit_depth % 2 != 0;
+        if (pad) {
+                emit_alu_ri(ALU_SUB, RSP, 8);
+        }
+        emit8(0xE8);
+        buf_push(jit_calls, (JitCall) { buf_len(jit_code), callee->name });
+        emit32(0);
+        if (pad) {
+                emit_alu_ri(ALU_ADD, RSP, 8);
+        }
+        if (jit_type_of(callee->decl->func.ret_type) == JIT_F32) {
+                // cvtss2sd xmm0, xmm0
+                emit_sse(0xF3, 0x5A, 0, 0, false);
+        }
+}
+
+static void
+jit_float_unary(TokenKind op, Expr *operand)
+{
+        jit_expr(operand);
+        switch ((int) op) {
+        case '+':
+                break;
+        case '-':
+                // movq rax, xmm0; btc rax, 63; movq xmm0, rax
+                emit_movq_from_xmm(RAX, 0);
+                emit_rex(0, RAX);
+                emit8(0x0F);
+                emit8(0xBA);
+                emit_modrm(3, 7, RAX);
+                emit8(63);
+                emit_movq_to_xmm(0, RAX);
+                break;
+        case '!':
+                emit_setcc(jit_float_truth() ^ 1);
+                break;
+        default:
+                fatal("jit: %s needs an integer operand",
+                                token_kind_str(op));
+                break;
+        }
+}
+
+static void
+jit_expr(Expr *expr)
+{
+        JitType type;
+        uint64_t bits;
+        int else_label;
+        int end_label;
+        int var;
+
+        switch (expr->kind) {
+        case EXPR_INT:
+                emit_mov_ri(RAX, expr->int_val);
+                break;
+        case EXPR_FLOAT:
+                memcpy(&bits, &expr->float_val, sizeof(bits));
+                emit_mov_ri(RAX, bits);
+                emit_movq_to_xmm(0, RAX);
+                break;
+        case EXPR_NAME:
+                var = jit_find_var(expr->name);
+                jit_load_var(RAX, var);
+                if (jit_vars[var].type != JIT_INT) {
+                        emit_movq_to_xmm(0, RAX);
+                }
+                break;
+        case EXPR_CALL:
+                jit_call(expr);
+                break;
+        case EXPR_CAST:
+                type = jit_type_of(expr->cast.type);
+                if (type == JIT_NONE) {
+                        fatal("jit: casts only go to integer and floating "
+                                        "point types");
+                }
+                jit_expr_to(expr->cast.expr, type);
+                break;
+        case EXPR_UNARY:
+                if (jit_expr_type(expr->unary.expr) != JIT_INT) {
+                        jit_float_unary(expr->unary.op, expr->unary.expr);
+                        break;
+                }
+                jit_expr(expr->unary.expr);
+                switch ((int) expr->unary.op) {
+                case '+':
+                        break;
+                case '-':
+                        emit_group3(3, RAX);
+                        break;
+                case '~':
+                        emit_group3(2, RAX);
+                        break;
+                case '!':
+                        emit_test_rax();
+                        emit_setcc(CC_E);
+                        break;
+                default:
+                        fatal("jit: unsupported unary operator %s",
+                                        token_kind_str(expr->unary.op));
+                        break;
+                }
+                break;
+        case EXPR_BINARY:
+                jit_binary(expr->binary.op, expr->binary.left,
+                                expr->binary.right);
+                break;
+        case EXPR_TERNARY:
+                else_label = jit_new_label();
+                end_label = jit_new_label();
+                type = jit_expr_type(expr);
+                jit_branch_false(expr->ternary.cond, else_label);
+                jit_expr_to(expr->ternary.if_true, type);
+                emit_jmp(end_label);
+                jit_bind(else_label);
+                jit_expr_to(expr->ternary.if_false, type);
+                jit_bind(end_label);
+                break;
+        default:
+                fatal("jit: unsupported expression kind %d", expr->kind);
+                break;
+        }
+}
+
+static void
+jit_block(StmtBlock block)
+{
+        size_t mark;
+
+        mark = buf_len(jit_scope);
+        for (size_t i = 0; i < block.num_stmts; ++i) {
+                jit_stmt(block.stmts[i]);
+        }
+        buf_trunc(jit_scope, mark);
+}
+
+static void
+jit_loop_body(StmtBlock block, int break_label, int continue_label)
+{
+        buf_push(jit_loops, (JitLoop) { break_label, continue_label });
+        jit_block(block);
+        buf_trunc(jit_loops, buf_len(jit_loops) - 1);
+}
+
+static TokenKind
+assign_op_to_binary(TokenKind op)
+{
+        switch (op) {
+        case TOKEN_ADD_ASSIGN:
+        case TOKEN_INC:
+                return '+';
+        case TOKEN_SUB_ASSIGN:
+        case TOKEN_DEC:
+                return '-';
+        case TOKEN_OR_ASSIGN:
+                return '|';
+        case TOKEN_AND_ASSIGN:
+                return '&';
+        case TOKEN_XOR_ASSIGN:
+                return '^';
+        case TOKEN_LSHIFT_ASSIGN:
+                return TOKEN_LSHIFT;
+        case TOKEN_RSHIFT_ASSIGN:
+                return TOKEN_RSHIFT;
+        case TOKEN_MUL_ASSIGN:
+                return '*';
+        case TOKEN_DIV_ASSIGN:
+                return '/';
+        case TOKEN_MOD_ASSIGN:
+                return '%';
+        default:
+                fatal("jit: unsupported assignment operator %s",
+                                token_kind_str(op));
+                return 0;
+        }
+}
+
+static void
+jit_assign(AssignStmt *assign)
+{
+        Expr one = { .kind = EXPR_INT, .int_val = 1 };
+        Expr *right;
+        TokenKind op;
+        JitType type;
+        int var;
+
+        if (assign->left->kind != EXPR_NAME) {
+                fatal("jit: can only assign to local variables");
+        }
+        var = jit_find_var(assign->left->name);
+        type = jit_vars[var].type;
+        if (assign->op == '=') {
+                jit_expr_to(assign->right, type);
+        } else {
+                right = assign->right ? assign->right : &one;
+                op = assign_op_to_binary(assign->op);
+                jit_binary(op, assign->left, right);
+                jit_convert(jit_binary_type(op, type, jit_expr_type(right)),
+                                type);
+        }
+        jit_store_value(var);
+}
+
+// Compares RAX with val, through RCX where val takes more than 32 bits.
+static void
+emit_cmp_rax(int64_t val)
+{
+        if (is_imm32(val)) {
+                emit_alu_ri(ALU_CMP, RAX, val);
+        } else {
+                emit_mov_ri(RCX, val);
+                emit_alu_rr(0x39, RAX, RCX);
+        }
+}
+
+// Leaves the switch value minus the cluster's lowest value in RAX, and
+// jumps to miss_label if that is outside the cluster. Values below the
+// cluster wrap around to large unsigned ones, so one compare covers both
+// ends.
+static void
+jit_switch_range(int var, SwitchCluster *c, int miss_label)
+{
+        jit_load_var(RAX, var);
+        if (is_imm32(c->lo)) {
+                emit_alu_ri(ALU_SUB, RAX, c->lo);
+        } else {
+                emit_mov_ri(RCX, c->lo);
+                emit_alu_rr(0x29, RAX, RCX);
+        }
+        emit_alu_ri(ALU_CMP, RAX, (uint64_t) c->hi - (uint64_t) c->lo);
+        emit_jcc(CC_A, miss_label);
+}
+
+// Emits the test for one cluster, which jumps to the case on a match and
+// falls through when the value is not in the cluster.
+static void
+jit_switch_cluster(SwitchCluster *c, int var, int *case_labels,
+                int default_label)
+{
+        SwitchValue *values;
+        uint64_t mask;
+        size_t lea_pos;
+        size_t table_pos;
+        size_t k;
+        int miss_label;
+        int label;
+
+        values = c->values;
+        switch (c->kind) {
+        case CLUSTER_COMPARE:
+                jit_load_var(RAX, var);
+                emit_cmp_rax(c->lo);
+                emit_jcc(CC_E, case_labels[values[0].case_index]);
+                break;
+        case CLUSTER_BIT_TEST:
+                miss_label = jit_new_label();
+                jit_switch_range(var, c, miss_label);
+                // One mask per case, made when its first value comes up.
+                for (size_t i = 0; i < c->num_values; ++i) {
+                        for (k = 0; k < i && values[k].case_index !=
+                                        values[i].case_index; ++k) {
+                        }
+                        if (k < i) {
+                                continue;
+                        }
+                        mask = 0;
+                        for (size_t j = i; j < c->num_values; ++j) {
+                                if (values[j].case_index ==
+                                                values[i].case_index) {
+                                        mask |= 1ull << ((uint64_t)
+                                                        values[j].val -
+                                                        (uint64_t) c->lo);
+                                }
+                        }
+                        emit_mov_ri(RCX, mask);
+                        // bt rcx, rax; jc case
+                        emit_rex(RAX, RCX);
+                        emit8(0x0F);
+                        emit8(0xA3);
+                        emit_modrm(3, RAX, RCX);
+                        emit_jcc(CC_B, case_labels[values[i].case_index]);
+                }
+                emit_jmp(default_label);
+                jit_bind(miss_label);
+                break;
+        case CLUSTER_JUMP_TABLE:
+                miss_label = jit_new_label();
+                jit_switch_range(var, c, miss_label);
+                // lea rcx, [rip + table]
+                emit8(0x48);
+                emit8(0x8D);
+                emit8(0x0D);
+                lea_pos = buf_len(jit_code);
+                emit32(0);
+                // movsxd rax, dword [rcx + rax * 4]; add rax, rcx; jmp rax
+                emit8(0x48);
+                emit8(0x63);
+                emit8(0x04);
+                emit8(0x81);
+                emit_alu_rr(0x01, RAX, RCX);
+                emit8(0xFF);
+                emit8(0xE0);
+                // The table holds each slot's target relative to the table,
+                // with the gaps going to the default.
+                table_pos = buf_len(jit_code);
+                patch32(lea_pos, table_pos - (lea_pos + 4));
+                k = 0;
+                for (uint64_t slot = 0; slot <= (uint64_t) c->hi -
+                                (uint64_t) c->lo; ++slot) {
+                        label = default_label;
+                        if ((uint64_t) values[k].val - (uint64_t) c->lo ==
+                                        slot) {
+                                label = case_labels[values[k++].case_index];
+                        }
+                        buf_push(jit_fixups, (JitFixup) { buf_len(jit_code),
+                                        label, table_pos });
+                        emit32(0);
+                }
+                jit_bind(miss_label);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+// Dispatches on the clusters from lo to hi, by binary search if the plan
+// says so and in order otherwise.
+static void
+jit_switch_tree(SwitchPlan *plan, size_t lo, size_t hi, int var,
+                int *case_labels, int default_label)
+{
+        int left_label;
+        size_t mid;
+
+        if (plan->tree && hi - lo > 1) {
+                mid = lo + (hi - lo) / 2;
+                left_label = jit_new_label();
+                jit_load_var(RAX, var);
+                emit_cmp_rax(plan->clusters[mid].lo);
+                emit_jcc(CC_L, left_label);
+                jit_switch_tree(plan, mid, hi, var, case_labels,
+                                default_label);
+                jit_bind(left_label);
+                jit_switch_tree(plan, lo, mid, var, case_labels,
+                                default_label);
+                return;
+        }
+        for (size_t i = lo; i < hi; ++i) {
+                jit_switch_cluster(&plan->clusters[i], var, case_labels,
+                                default_label);
+        }
+        emit_jmp(default_label);
+}
+
+// Switches whose case values are all constants dispatch as planned by
+// switch_plan; the others compare against each case in turn.
+static void
+jit_switch(SwitchStmt *switch_stmt)
+{
+        SwitchPlan plan;
+        int *case_labels;
+        int default_label;
+        int end_label;
+        int continue_label;
+        size_t mark;
+        int var;
+
+        if (jit_expr_type(switch_stmt->expr) != JIT_INT) {
+                fatal("jit: switch on a non-integer value");
+        }
+        for (size_t i = 0; i < switch_stmt->num_cases; ++i) {
+                for (size_t j = 0; j < switch_stmt->cases[i].num_exprs; ++j) {
+                        if (jit_expr_type(switch_stmt->cases[i].exprs[j]) !=
+                                        JIT_INT) {
+                                fatal("jit: case values must be integers");
+                        }
+                }
+        }
+        jit_expr(switch_stmt->expr);
+        mark = buf_len(jit_scope);
+        var = jit_def_var(NULL);
+        jit_store_var(var, RAX);
+
+        case_labels = NULL;
+        end_label = jit_new_label();
+        default_label = end_label;
+        for (size_t i = 0; i < switch_stmt->num_cases; ++i) {
+                buf_push(case_labels, jit_new_label());
+                if (switch_stmt->cases[i].is_default) {
+                        default_label = case_labels[i];
+                }
+        }
+        if (switch_plan(switch_stmt, &plan)) {
+                jit_switch_tree(&plan, 0, buf_len(plan.clusters), var,
+                                case_labels, default_label);
+                switch_plan_free(&plan);
+        } else {
+                for (size_t i = 0; i < switch_stmt->num_cases; ++i) {
+                        SwitchCase *c = &switch_stmt->cases[i];
+
+                        for (size_t j = 0; j < c->num_exprs; ++j) {
+                                if (is_imm_expr(c->exprs[j])) {
+                                        jit_load_var(RAX, var);
+                                        emit_alu_ri(ALU_CMP, RAX,
+                                                        c->exprs[j]->int_val);
+                                } else {
+                                        jit_expr(c->exprs[j]);
+                                        jit_load_var(RCX, var);
+                                        emit_alu_rr(0x39, RCX, RAX);
+                                }
+                                emit_jcc(CC_E, case_labels[i]);
+                        }
+                }
+                emit_jmp(default_label);
+        }
+        buf_trunc(jit_scope, mark);
+
+        // Cases don't fall through, so break leaves the switch and continue
+        // goes to the enclosing loop. The label is read before the push,
+        // which bumps the length before its value is evaluated.
+        continue_label = buf_len(jit_loops) ?
+                jit_loops[buf_len(jit_loops) - 1].continue_label : -1;
+        buf_push(jit_loops, (JitLoop) { end_label, continue_label });
+        for (size_t i = 0; i < switch_stmt->num_cases; ++i) {
+                jit_bind(case_labels[i]);
+                jit_block(switch_stmt->cases[i].block);
+                emit_jmp(end_label);
+        }
+        buf_trunc(jit_loops, buf_len(jit_loops) - 1);
+        jit_bind(end_label);
+        buf_free(case_labels);
+}
+
+// The result of a function that ends without returning a value.
+static void
+jit_zero_result(void)
+{
+        emit_mov_ri(RAX, 0);
+        if (jit_ret_type != JIT_INT) {
+                // xorpd xmm0, xmm0
+                emit_sse(0x66, 0x57, 0, 0, false);
+        }
+}
+
+static void
+jit_stmt(Stmt *stmt)
+{
+        int cond_label;
+        int next_label;
+        int end_label;
+        size_t mark;
+        IfStmt *if_stmt;
+        JitType type;
+        int var;
+
+        switch (stmt->kind) {
+        case STMT_RETURN:
+                if (!stmt->expr) {
+                        jit_zero_result();
+                } else {
+                        jit_expr_to(stmt->expr, jit_ret_type);
+                        if (jit_ret_type == JIT_F32) {
+                                // cvtsd2ss xmm0, xmm0
+                                emit_sse(0xF2, 0x5A, 0, 0, false);
+                        }
+                }
+                emit_jmp(jit_epilogue);
+                break;
+        case STMT_BREAK:
+        case STMT_CONTINUE:
+                if (buf_len(jit_loops) == 0) {
+                        fatal("jit: break or continue outside of loop");
+                }
+                end_label = stmt->kind == STMT_BREAK ?
+                        jit_loops[buf_len(jit_loops) - 1].break_label :
+                        jit_loops[buf_len(jit_loops) - 1].continue_label;
+                if (end_label < 0) {
+                        fatal("jit: continue outside of loop");
+                }
+                emit_jmp(end_label);
+                break;
+        case STMT_BLOCK:
+                jit_block(stmt->block);
+                break;
+        case STMT_IF:
+                if_stmt = &stmt->if_stmt;
+                end_label = jit_new_label();
+                next_label = jit_new_label();
+                jit_branch_false(if_stmt->cond, next_label);
+                jit_block(if_stmt->then_block);
+                emit_jmp(end_label);
+                for (size_t i = 0; i < if_stmt->num_elseifs; ++i) {
+                        jit_bind(next_label);
+                        next_label = jit_new_label();
+                        jit_branch_false(if_stmt->elseifs[i].cond,
+                                        next_label);
+                        jit_block(if_stmt->elseifs[i].block);
+                        emit_jmp(end_label);
+                }
+                jit_bind(next_label);
+                jit_block(if_stmt->else_block);
+                jit_bind(end_label);
+                break;
+        case STMT_WHILE:
+                cond_label = jit_new_label();
+                end_label = jit_new_label();
+                jit_bind(cond_label);
+                jit_branch_false(stmt->while_stmt.cond, end_label);
+                jit_loop_body(stmt->while_stmt.block, end_label, cond_label);
+                emit_jmp(cond_label);
+                jit_bind(end_label);
+                break;
+        case STMT_DO:
+                next_label = jit_new_label();
+                cond_label = jit_new_label();
+                end_label = jit_new_label();
+                jit_bind(next_label);
+                jit_loop_body(stmt->while_stmt.block, end_label, cond_label);
+                jit_bind(cond_label);
+                emit_jcc(jit_cond(stmt->while_stmt.cond), next_label);
+                jit_bind(end_label);
+                break;
+        case STMT_FOR:
+                mark = buf_len(jit_scope);
+                for (size_t i = 0; i < stmt->for_stmt.init.num_stmts; ++i) {
+                        jit_stmt(stmt->for_stmt.init.stmts[i]);
+                }
+                cond_label = jit_new_label();
+                next_label = jit_new_label();
+                end_label = jit_new_label();
+                jit_bind(cond_label);
+                if (stmt->for_stmt.cond) {
+                        jit_branch_false(stmt->for_stmt.cond, end_label);
+                }
+                jit_loop_body(stmt->for_stmt.block, end_label, next_label);
+                jit_bind(next_label);
+                jit_block(stmt->for_stmt.next);
+                emit_jmp(cond_label);
+                jit_bind(end_label);
+                buf_trunc(jit_scope, mark);
+                break;
+        case STMT_SWITCH:
+                jit_switch(&stmt->switch_stmt);
+                break;
+        case STMT_ASSIGN:
+                jit_assign(&stmt->assign);
+                break;
+        case STMT_AUTO_ASSIGN:
+                type = jit_expr_type(stmt->autoassign.init);
+                jit_expr(stmt->autoassign.init);
+                var = jit_def_var(stmt->autoassign.name);
+                jit_vars[var].type = type;
+                jit_store_value(var);
+                break;
+        case STMT_EXPR:
+                jit_expr(stmt->expr);
+                break;
+        default:
+                fatal("jit: unsupported statement kind %d", stmt->kind);
+                break;
+        }
+}
+
+// Float arguments and results travel in XMM registers, the rest in the
+// integer ones; anything else is refused before any code is emitted.
+static void
+jit_check_signature(FuncDecl *func, const char *name)
+{
+        if (func->num_params > JIT_MAX_PARAMS) {
+                fatal("jit: '%s' has more than %d parameters", name,
+                                JIT_MAX_PARAMS);
+        }
+        for (size_t i = 0; i < func->num_params; ++i) {
+                if (jit_type_of(func->params[i].type) == JIT_NONE) {
+                        fatal("jit: parameter '%s' of '%s' must have an "
+                                        "integer or floating point type",
+                                        func->params[i].name, name);
+                }
+        }
+        if (jit_type_of(func->ret_type) == JIT_NONE) {
+                fatal("jit: '%s' must return an integer or floating point "
+                                "type", name);
+        }
+}
+
+bool
+jit_int_func(Decl *decl)
+{
+        FuncDecl *func;
+
+        func = &decl->func;
+        for (size_t i = 0; i < func->num_params; ++i) {
+                if (jit_type_of(func->params[i].type) != JIT_INT) {
+                        return false;
+                }
+        }
+        return jit_type_of(func->ret_type) == JIT_INT;
+}
+
+static void
+jit_func_decl(JitEntry *entry)
+{
+        FuncDecl *func;
+        int frame_size;
+        int num_ints;
+        int num_floats;
+        int var;
+
+        func = &entry->decl->func;
+        buf_free(jit_vars);
+        buf_free(jit_loop_ranges);
+        buf_free(jit_labels);
+        buf_free(jit_fixups);
+        buf_free(jit_loops);
+        jit_pos = 0;
+        for (size_t i = 0; i < func->num_params; ++i) {
+                jit_scan_def(func->params[i].name);
+        }
+        jit_scan_block(func->block);
+        buf_free(jit_scope);
+        jit_extend_intervals();
+        jit_alloc_regs();
+
+        // Keep RSP 16 byte aligned after the prologue.
+        frame_size = 8 * jit_num_slots;
+        if ((8 * jit_num_saved + frame_size) % 16 != 0) {
+                frame_size += 8;
+        }
+
+        entry->offset = buf_len(jit_code);
+        emit_push(RBP);
+        emit_mov_rr(RBP, RSP);
+        for (int i = 0; i < jit_num_saved; ++i) {
+                emit_push(jit_saved[i]);
+        }
+        if (frame_size) {
+                emit_alu_ri(ALU_SUB, RSP, frame_size);
+        }
+
+        jit_next_var = 0;
+        jit_depth = 0;
+        jit_epilogue = jit_new_label();
+        jit_ret_type = jit_type_of(func->ret_type);
+        num_ints = 0;
+        num_floats = 0;
+        for (size_t i = 0; i < func->num_params; ++i) {
+                var = jit_def_var(func->params[i].name);
+                jit_vars[var].type = jit_type_of(func->params[i].type);
+                if (jit_vars[var].type == JIT_INT) {
+                        jit_store_var(var, arg_regs[num_ints++]);
+                        continue;
+                }
+                if (jit_vars[var].type == JIT_F32) {
+                        // cvtss2sd xmmN, xmmN
+                        emit_sse(0xF3, 0x5A, num_floats, num_floats, false);
+                }
+                emit_movq_from_xmm(RAX, num_floats++);
+                jit_store_var(var, RAX);
+        }
+        jit_block(func->block);
+        buf_free(jit_scope);
+        jit_zero_result();
+
+        jit_bind(jit_epilogue);
+        // lea rsp, [rbp - 8 * num_saved]
+        emit_rex(RSP, RBP);
+        emit8(0x8D);
+        emit_modrm(1, RSP, RBP);
+        emit8(-8 * jit_num_saved);
+        for (int i = jit_num_saved - 1; i >= 0; --i) {
+                emit_pop(jit_saved[i]);
+        }
+        emit_pop(RBP);
+        emit8(0xC3);
+
+        for (JitFixup *it = jit_fixups; it != buf_end(jit_fixups); ++it) {
+                assert(jit_labels[it->label] != SIZE_MAX);
+                patch32(it->pos, jit_labels[it->label] - it->base);
+        }
+}
+
+JitModule *
+jit_compile(Decl **decls, size_t num_decls)
+{
+        JitModule *module;
+        long page_size;
+        void *mem;
+
+        // A fatal error may have cut the last compile short.
+        jit_reset();
+        for (size_t i = 0; i < num_decls; ++i) {
+                if (decls[i]->kind == DECL_FUNC) {
+                        buf_push(jit_entries, (JitEntry) { decls[i]->name,
+                                        decls[i], 0 });
+                }
+        }
+        for (JitEntry *it = jit_entries; it != buf_end(jit_entries); ++it) {
+                jit_check_signature(&it->decl->func, it->name);
+        }
+        for (JitEntry *it = jit_entries; it != buf_end(jit_entries); ++it) {
+                jit_func_decl(it);
+        }
+        for (JitCall *it = jit_calls; it != buf_end(jit_calls); ++it) {
+                patch32(it->pos, jit_entry(it->name)->offset - (it->pos + 4));
+        }
+
+        // Map writable, copy, then flip to executable so pages are never
+        // writable and executable at the same time.
+        module = xcalloc(1, sizeof(JitModule));
+        page_size = sysconf(_SC_PAGESIZE);
+        module->code_size = buf_len(jit_code);
+        module->map_size = (module->code_size + page_size) & ~(page_size - 1);
+        mem = mmap(NULL, module->map_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+                fatal("jit: failed to map %zu bytes", module->map_size);
+        }
+        memcpy(mem, jit_code, module->code_size);
+        if (mprotect(mem, module->map_size, PROT_READ | PROT_EXEC) != 0) {
+                fatal("jit: failed to make code executable");
+        }
+        module->code = mem;
+        module->entries = jit_entries;
+        jit_entries = NULL;
+        jit_reset();
+        return module;
+}
+
+void
+jit_reset(void)
+{
+        buf_free(jit_code);
+        buf_free(jit_entries);
+        buf_free(jit_calls);
+        buf_free(jit_vars);
+        buf_free(jit_scope);
+        buf_free(jit_loop_ranges);
+        buf_free(jit_labels);
+        buf_free(jit_fixups);
+        buf_free(jit_loops);
+}
+
+void *
+jit_func(JitModule *module, const char *name)
+{
+        name = str_intern(name);
+        for (JitEntry *it = module->entries; it != buf_end(module->entries);
+                        ++it) {
+                if (it->name == name) {
+                        return module->code + it->offset;
+                }
+        }
+        return NULL;
+}
+
+size_t
+jit_code_size(JitModule *module)
+{
+        return module->code_size;
+}
+
+void
+jit_free(JitModule *module)
+{
+        munmap(module->code, module->map_size);
+        buf_free(module->entries);
+        xfree(module);
+}
+
+#define BLOCK(...) ((StmtBlock) { (Stmt *[]) { __VA_ARGS__ }, \
+                sizeof((Stmt *[]) { __VA_ARGS__ }) / sizeof(Stmt *) })
+#define NAME(x) expr_name(str_intern(x))
+#define BIN(op, l, r) expr_binary((op), (l), (r))
+
+void
+jit_test(void)
+{
+#if defined(__x86_64__)
+        typedef int64_t (*Func1)(int64_t);
+        typedef int64_t (*Func2)(int64_t, int64_t);
+        FuncParam ab[] = { { str_intern("a") }, { str_intern("b") } };
+        FuncParam n[] = { { str_intern("n") } };
+        StmtBlock empty = { 0 };
+        volatile double zero = 0;
+        jmp_buf jmp;
+        Decl *floats[6];
+        Decl *dispatch_decl;
+        JitModule *module;
+        Func2 add;
+        Func2 gcd;
+        Func1 fact;
+        Func1 sum;
+        Func1 classify;
+        Func1 spill;
+        Func1 collatz;
+        Func1 dispatch;
+        Func1 skip;
+        int64_t (*answer)(void);
+        double (*hyp)(double, double);
+        double (*mix)(int64_t, double, float);
+        float (*third)(float);
+        int64_t (*trunc)(double);
+        int64_t (*cmp)(double, double);
+        double (*call)(int64_t);
+
+        Decl *decls[] = {
+                // func add(a, b) { return a + b; }
+                decl_func(str_intern("add"), ab, 2, NULL, BLOCK(
+                        stmt_return(BIN('+', NAME("a"), NAME("b"))))),
+                // func fact(n) { if (n == 0) { return 1; }
+                //                return n * fact(n - 1); }
+                decl_func(str_intern("fact"), n, 1, NULL, BLOCK(
+                        stmt_if(BIN(TOKEN_EQ, NAME("n"), expr_int(0)),
+                                BLOCK(stmt_return(expr_int(1))), NULL, 0,
+                                empty),
+                        stmt_return(BIN('*', NAME("n"),
+                                expr_call(NAME("fact"), (Expr *[]) {
+                                        BIN('-', NAME("n"), expr_int(1)) },
+                                        1))))),
+                // func sum(n) { s := 0;
+                //               for (i := 0; i < n; i++) {
+                //                   if (i % 3 == 0) { continue; }
+                //                   s += i; }
+                //               return s; }
+                decl_func(str_intern("sum"), n, 1, NULL, BLOCK(
+                        stmt_auto_assign(str_intern("s"), expr_int(0)),
+                        stmt_for(BLOCK(stmt_auto_assign(str_intern("i"),
+                                                expr_int(0))),
+                                BIN('<', NAME("i"), NAME("n")),
+                                BLOCK(stmt_assign(TOKEN_INC, NAME("i"),
+                                                NULL)),
+                                BLOCK(stmt_if(BIN(TOKEN_EQ,
+                                                BIN('%', NAME("i"),
+                                                        expr_int(3)),
+                                                expr_int(0)),
+                                        BLOCK(stmt_continue()), NULL, 0,
+                                        empty),
+                                stmt_assign(TOKEN_ADD_ASSIGN, NAME("s"),
+                                        NAME("i")))),
+                        stmt_return(NAME("s")))),
+                // func gcd(a, b) { while (b != 0) { t := b; b = a % b;
+                //                                   a = t; }
+                //                  return a; }
+                decl_func(str_intern("gcd"), ab, 2, NULL, BLOCK(
+                        stmt_while(BIN(TOKEN_NOTEQ, NAME("b"), expr_int(0)),
+                                BLOCK(stmt_auto_assign(str_intern("t"),
+                                                NAME("b")),
+                                        stmt_assign('=', NAME("b"),
+                                                BIN('%', NAME("a"),
+                                                        NAME("b"))),
+                                        stmt_assign('=', NAME("a"),
+                                                NAME("t")))),
+                        stmt_return(NAME("a")))),
+                // func classify(n) { switch (n) { case 1, 2: return 10;
+                //                    case 3: return 20; default: return -1; } }
+                decl_func(str_intern("classify"), n, 1, NULL, BLOCK(
+                        stmt_switch(NAME("n"), (SwitchCase[]) {
+                                { (Expr *[]) { expr_int(1), expr_int(2) }, 2,
+                                        false,
+                                        BLOCK(stmt_return(expr_int(10))) },
+                                { (Expr *[]) { expr_int(3) }, 1, false,
+                                        BLOCK(stmt_return(expr_int(20))) },
+                                { NULL, 0, true, BLOCK(stmt_return(
+                                        expr_unary('-', expr_int(1)))) }
+                        }, 3))),
+                // func answer() { return add(40, add(1, 1)); }
+                decl_func(str_intern("answer"), NULL, 0, NULL, BLOCK(
+                        stmt_return(expr_call(NAME("add"), (Expr *[]) {
+                                expr_int(40), expr_call(NAME("add"),
+                                        (Expr *[]) { expr_int(1),
+                                        expr_int(1) }, 2) }, 2)))),
+                // Eight simultaneously live locals force spills.
+                decl_func(str_intern("spill"), n, 1, NULL, BLOCK(
+                        stmt_auto_assign(str_intern("v1"), BIN('+', NAME("n"),
+                                        expr_int(1))),
+                        stmt_auto_assign(str_intern("v2"), BIN('+', NAME("n"),
+                                        expr_int(2))),
+                        stmt_auto_assign(str_intern("v3"), BIN('+', NAME("n"),
+                                        expr_int(3))),
+                        stmt_auto_assign(str_intern("v4"), BIN('+', NAME("n"),
+                                        expr_int(4))),
+                        stmt_auto_assign(str_intern("v5"), BIN('+', NAME("n"),
+                                        expr_int(5))),
+                        stmt_auto_assign(str_intern("v6"), BIN('+', NAME("n"),
+                                        expr_int(6))),
+                        stmt_auto_assign(str_intern("v7"), expr_call(
+                                        NAME("add"), (Expr *[]) { NAME("v1"),
+                                        NAME("v2") }, 2)),
+                        stmt_return(BIN('*', BIN('+', BIN('+', NAME("v1"),
+                                        NAME("v2")), BIN('+', NAME("v3"),
+                                        NAME("v4"))), BIN('-', BIN('+',
+                                        NAME("v5"), NAME("v6")), NAME("v7")))))),
+                // func collatz(n) { steps := 0;
+                //                   do { n = n & 1 ? 3 * n + 1 : n >> 1;
+                //                        steps++; } while (n != 1 && n > 0);
+                //                   return steps; }
+                decl_func(str_intern("collatz"), n, 1, NULL, BLOCK(
+                        stmt_auto_assign(str_intern("steps"), expr_int(0)),
+                        stmt_do(BIN(TOKEN_AND, BIN(TOKEN_NOTEQ, NAME("n"),
+                                                expr_int(1)),
+                                        BIN('>', NAME("n"), expr_int(0))),
+                                BLOCK(stmt_assign('=', NAME("n"),
+                                                expr_ternary(BIN('&',
+                                                        NAME("n"),
+                                                        expr_int(1)),
+                                                BIN('+', BIN('*', expr_int(3),
+                                                        NAME("n")),
+                                                        expr_int(1)),
+                                                BIN(TOKEN_RSHIFT, NAME("n"),
+                                                        expr_int(1)))),
+                                        stmt_assign(TOKEN_INC, NAME("steps"),
+                                                NULL))),
+                        stmt_return(NAME("steps")))),
+        };
+
+        module = jit_compile(decls, sizeof(decls) / sizeof(*decls));
+        add = (Func2) jit_func(module, "add");
+        fact = (Func1) jit_func(module, "fact");
+        sum = (Func1) jit_func(module, "sum");
+        gcd = (Func2) jit_func(module, "gcd");
+        classify = (Func1) jit_func(module, "classify");
+        spill = (Func1) jit_func(module, "spill");
+        collatz = (Func1) jit_func(module, "collatz");
+        answer = (int64_t (*)(void)) jit_func(module, "answer");
+        assert(jit_func(module, "missing") == NULL);
+
+        assert(add(2, 3) == 5);
+        assert(add(-7, 3) == -4);
+        assert(fact(0) == 1);
+        assert(fact(10) == 3628800);
+        assert(sum(10) == 1 + 2 + 4 + 5 + 7 + 8);
+        assert(gcd(1071, 462) == 21);
+        assert(classify(1) == 10);
+        assert(classify(2) == 10);
+        assert(classify(3) == 20);
+        assert(classify(4) == -1);
+        assert(spill(1) == (2 + 3 + 4 + 5) * (6 + 7 - 5));
+        assert(collatz(27) == 111);
+        assert(answer() == 42);
+        jit_free(module);
+
+        // A jump table, a bit test and compares, some against values that
+        // need all 64 bits, found by binary search.
+        init_stream("func dispatch(x: int): int {\n"
+                        "    switch (x) {\n"
+                        "    case 0: return 10;\n"
+                        "    case 1: return 11;\n"
+                        "    case 2: return 12;\n"
+                        "    case 3: return 13;\n"
+                        "    case 4, 6: return 14;\n"
+                        "    case -100, -98, -96: return 20;\n"
+                        "    case 1000: return 30;\n"
+                        "    case 1 << 40: return 40;\n"
+                        "    case -9223372036854775807 - 1: return 50;\n"
+                        "    default: return -1;\n"
+                        "    }\n"
+                        "}\n");
+        dispatch_decl = parse_decl();
+        module = jit_compile(&dispatch_decl, 1);
+        dispatch = (Func1) jit_func(module, "dispatch");
+        for (int64_t i = 0; i <= 4; ++i) {
+                assert(dispatch(i) == 10 + i);
+        }
+        assert(dispatch(6) == 14);
+        assert(dispatch(5) == -1 && dispatch(7) == -1);
+        assert(dispatch(-1) == -1);
+        assert(dispatch(-100) == 20 && dispatch(-96) == 20);
+        assert(dispatch(-99) == -1 && dispatch(-101) == -1);
+        assert(dispatch(-95) == -1);
+        assert(dispatch(1000) == 30 && dispatch(999) == -1);
+        assert(dispatch(1ll << 40) == 40 && dispatch((1ll << 40) + 1) == -1);
+        assert(dispatch(INT64_MIN) == 50 && dispatch(INT64_MIN + 1) == -1);
+        assert(dispatch(INT64_MAX) == -1);
+        jit_free(module);
+
+        // continue inside a switch goes to the loop around it.
+        init_stream("func skip(c: int): int {\n"
+                        "    a := 0;\n"
+                        "    for (i := 0; i < 6; i++) {\n"
+                        "        switch (c) {\n"
+                        "        case 1: a = a + 10;\n"
+                        "        case 3: continue;\n"
+                        "        }\n"
+                        "        a = a + 1;\n"
+                        "    }\n"
+                        "    return a;\n"
+                        "}\n");
+        dispatch_decl = parse_decl();
+        module = jit_compile(&dispatch_decl, 1);
+        skip = (Func1) jit_func(module, "skip");
+        assert(skip(1) == 66 && skip(2) == 6 && skip(3) == 0);
+        jit_free(module);
+
+        // Floats and doubles are computed with SSE, converting like C.
+        init_stream("func hyp(a: double, b: double): double {\n"
+                        "    return a * a + b * b;\n"
+                        "}\n"
+                        "func mix(n: int, x: double, f: float): double {\n"
+                        "    y := n + x;\n"
+                        "    y *= f;\n"
+                        "    return y - n / 2;\n"
+                        "}\n"
+                        "func third(x: float): float { return x / 3; }\n"
+                        "func trunc(x: double): int { return cast(int) -x; }\n"
+                        "func cmp(x: double, y: double): int {\n"
+                        "    r := 0;\n"
+                        "    if (x < y) { r += 1; }\n"
+                        "    if (x <= y) { r += 2; }\n"
+                        "    if (x > y) { r += 4; }\n"
+                        "    if (x >= y) { r += 8; }\n"
+                        "    if (x == y) { r += 16; }\n"
+                        "    if (x != y) { r += 32; }\n"
+                        "    if (x) { r += 64; }\n"
+                        "    return r + !y * 128;\n"
+                        "}\n"
+                        "func call(n: int): double {\n"
+                        "    return hyp(n, 4) + third(n);\n"
+                        "}\n");
+        for (size_t i = 0; i < sizeof(floats) / sizeof(*floats); ++i) {
+                floats[i] = parse_decl();
+        }
+        module = jit_compile(floats, sizeof(floats) / sizeof(*floats));
+        hyp = (double (*)(double, double)) jit_func(module, "hyp");
+        mix = (double (*)(int64_t, double, float)) jit_func(module, "mix");
+        third = (float (*)(float)) jit_func(module, "third");
+        trunc = (int64_t (*)(double)) jit_func(module, "trunc");
+        cmp = (int64_t (*)(double, double)) jit_func(module, "cmp");
+        call = (double (*)(int64_t)) jit_func(module, "call");
+        assert(hyp(3, 4) == 25 && hyp(0.5, -1.5) == 2.5);
+        assert(mix(3, 0.5, 2) == 6 && mix(5, -1, 0.25f) == -1);
+        assert(third(1) == 1.0f / 3 && third(-6) == -2);
+        assert(trunc(2.9) == -2 && trunc(-7.5) == 7);
+        assert(cmp(1, 2) == 1 + 2 + 32 + 64);
+        assert(cmp(2, 1) == 4 + 8 + 32 + 64);
+        assert(cmp(-1, -1) == 2 + 8 + 16 + 64);
+        assert(cmp(0, 0) == 2 + 8 + 16 + 128);
+        assert(cmp(zero / zero, 1) == 32 + 64);
+        assert(cmp(1, zero / zero) == 32 + 64);
+        assert(call(3) == 26 && call(-3) == 24);
+        jit_free(module);
+
+        // Parameters of other types are refused, not miscompiled as ints.
+        init_stream("func deref(p: int*): int { return 0; }");
+        floats[0] = parse_decl();
+        fatal_jmp = &jmp;
+        if (setjmp(jmp) == 0) {
+                jit_compile(floats, 1);
+                assert(0);
+        }
+        fatal_jmp = NULL;
+        assert(jit_entries && !jit_int_func(floats[0]));
+        jit_reset();
+        assert(!jit_entries && !jit_code);
+#endif
+}
+
+#undef BLOCK
+#undef NAME
+#undef BIN
@@ -0,0 +1,39 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include "ast.h"
+#include "common.h"
+
+// Compiled functions follow the System V AMD64 calling convention. Integer
+// parameters and results are treated as int64_t and float and double ones
+// as their C types, so func f(a: int, x: double): int can be called through
+// an int64_t (*)(int64_t, double). Untyped parameters are ints.
+#define JIT_MAX_PARAMS 6
+
+typedef struct JitModule JitModule;
+
+JitModule *
+jit_compile(Decl **decls, size_t num_decls);
+
+void *
+jit_func(JitModule *module, const char *name);
+
+size_t
+jit_code_size(JitModule *module);
+
+void
+jit_free(JitModule *module);
+
+// Frees what a compile that ended in a fatal error left behind.
+void
+jit_reset(void);
+
+// Whether decl, a function, takes and returns only integers, so that it
+// can be called through int64_t parameters and result.
+bool
+jit_int_func(Decl *decl);
+
+void
+jit_test(void);
+
+#endif
@@ -1,5 +1,43 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "ast.h"
 #include "lex.h"
 #include "common.h"
+#include "diag.h"
+#include "dtoa.h"
+#include "prof.h"
+#include "stats.h"
+#include "trace.h"
+#include "unicode.h"
+
+THREAD_LOCAL Token token;
+THREAD_LOCAL const char *stream;
+THREAD_LOCAL const char *stream_start;
+THREAD_LOCAL SrcPos stream_base;
+const char *keyword_typedef;
+const char *keyword_enum;
+const char *keyword_struct;
+const char *keyword_union;
+const char *keyword_var;
+const char *keyword_const;
+const char *keyword_func;
+const char *keyword_cast;
+const char *keyword_break;
+const char *keyword_continue;
+const char *keyword_return;
+const char *keyword_if;
+const char *keyword_else;
+const char *keyword_while;
+const char *keyword_do;
+const char *keyword_for;
+const char *keyword_switch;
+const char *keyword_case;
+const char *keyword_default;
 
 uint8_t char_to_digit[256] = {
         ['0'] = 0,
@@ -27,36 +65,54 @@ char escape_to_char[256] = {
         ['v'] = '\v',
         ['b'] = '\b',
         ['a'] = '\a',
+        ['\\'] = '\\',
+        ['"'] = '"',
+        ['\''] = '\'',
         ['0'] = 0
 };
 
+const char *token_kind_names[TOKEN_KEYWORD + 1] = {
+        [TOKEN_EOF] = "end of file",
+        [TOKEN_ERROR] = "invalid token",
+        [TOKEN_INT] = "integer",
+        [TOKEN_FLOAT] = "float",
+        [TOKEN_STR] = "string",
+        [TOKEN_NAME] = "name",
+        [TOKEN_LSHIFT] = "<<",
+        [TOKEN_RSHIFT] = ">>",
+        [TOKEN_EQ] = "==",
+        [TOKEN_NOTEQ] = "!=",
+        [TOKEN_LTEQ] = "<=",
+        [TOKEN_GTEQ] = ">=",
+        [TOKEN_AND] = "&&",
+        [TOKEN_OR] = "||",
+        [TOKEN_INC] = "++",
+        [TOKEN_DEC] = "--",
+        [TOKEN_COLON_ASSIGN] = ":=",
+        [TOKEN_ADD_ASSIGN] = "+=",
+        [TOKEN_SUB_ASSIGN] = "-=",
+        [TOKEN_OR_ASSIGN] = "|=",
+        [TOKEN_AND_ASSIGN] = "&=",
+        [TOKEN_XOR_ASSIGN] = "^=",
+        [TOKEN_LSHIFT_ASSIGN] = "<<=",
+        [TOKEN_RSHIFT_ASSIGN] = ">>=",
+        [TOKEN_MUL_ASSIGN] = "*=",
+        [TOKEN_DIV_ASSIGN] = "/=",
+        [TOKEN_MOD_ASSIGN] = "%=",
+        [TOKEN_KEYWORD] = "keyword"
+};
+
 size_t
 copy_token_kind_str(char *dest, size_t dest_size, TokenKind kind)
 {
         size_t n;
 
-        n = 0;
-
-        switch (kind) {
-        case TOKEN_EOF:
-                n = snprintf(dest, dest_size, "end of file");
-                break;
-        case TOKEN_INT:
-                n = snprintf(dest, dest_size, "integer");
-                break;
-        case TOKEN_FLOAT:
-                n = snprintf(dest, dest_size, "float");
-                break;
-        case TOKEN_NAME:
-                n = snprintf(dest, dest_size, "name");
-                break;
-        default:
-                if (kind < 128 && isprint(kind)) {
-                        n = snprintf(dest, dest_size, "%c", kind);
-                } else {
-                        n = snprintf(dest, dest_size, "<ASCII %d>", kind);
-                }
-                break;
+        if (kind <= TOKEN_KEYWORD && token_kind_names[kind]) {
+                n = snprintf(dest, dest_size, "%s", token_kind_names[kind]);
+        } else if (kind < 128 && isprint(kind)) {
+                n = snprintf(dest, dest_size, "%c", kind);
+        } else {
+                n = snprintf(dest, dest_size, "<ASCII %d>", kind);
         }
         return n;
 }
@@ -74,13 +130,60 @@ token_kind_str(TokenKind kind)
         return buf;
 }
 
+// Set when the token being scanned is malformed; next_token then turns it
+// into a TOKEN_ERROR so the parser can skip it without reporting it again.
+static THREAD_LOCAL bool lex_failed;
+
+// Set on lex_parallel's worker threads, which only find where tokens start
+// and end: they leave names uninterned and strings undecoded, and touch
+// nothing shared such as diagnostics or stats.
+static THREAD_LOCAL bool lex_scan_only;
+
+typedef struct LexPipe LexPipe;
+
+// Tokens replayed by next_token instead of scanning, up to TOKEN_EOF. When
+// they come from a pipeline, stream_tokens_end is the end of the current
+// batch.
+static THREAD_LOCAL const Token *stream_tokens;
+static THREAD_LOCAL const Token *stream_tokens_end;
+static THREAD_LOCAL LexPipe *stream_pipe;
+
+static void
+lex_error(const char *fmt, ...)
+{
+        va_list args;
+
+        lex_failed = true;
+        if (lex_scan_only) {
+                return;
+        }
+        va_start(args, fmt);
+        diag_verror(token.start, MAX(stream, token.start + 1), fmt, args);
+        va_end(args);
+}
+
 void
 init_keywords(void)
 {
+        keyword_typedef = str_intern("typedef");
+        keyword_enum = str_intern("enum");
+        keyword_struct = str_intern("struct");
+        keyword_union = str_intern("union");
+        keyword_var = str_intern("var");
+        keyword_const = str_intern("const");
+        keyword_func = str_intern("func");
+        keyword_cast = str_intern("cast");
+        keyword_break = str_intern("break");
+        keyword_continue = str_intern("continue");
+        keyword_return = str_intern("return");
         keyword_if = str_intern("if");
-        keyword_for = str_intern("for");
+        keyword_else = str_intern("else");
         keyword_while = str_intern("while");
-        // ...
+        keyword_do = str_intern("do");
+        keyword_for = str_intern("for");
+        keyword_switch = str_intern("switch");
+        keyword_case = str_intern("case");
+        keyword_default = str_intern("default");
 }
 
 void
@@ -110,20 +213,20 @@ scan_int(void)
         }
 
         while (1) {
-                digit = char_to_digit[(int) *stream];
+                digit = char_to_digit[(unsigned char) *stream];
 
                 if (digit == 0 && *stream != '0') {
                         break;
                 }
 
                 if (digit >= base) {
-                        syntax_error("Digit '%c' out of range for base %llu.",
+                        lex_error("Digit '%c' out of range for base %llu.",
                                         *stream, base);
                         digit = 0;
                 }
 
                 if (val > (UINT64_MAX - digit)/base) {
-                        syntax_error("Integer literal overflow.");
+                        lex_error("Integer literal overflow.");
                         while (isdigit(*stream)) {
                                 ++stream;
                         }
@@ -163,7 +266,7 @@ scan_float(void)
                         ++stream;
                 }
                 if (!isdigit(*stream)) {
-                        syntax_error("Expected digit after float literal "
+                        lex_error("Expected digit after float literal "
                                         "exponent, found '%c'.", *stream);
                 }
                 while (isdigit(*stream)) {
@@ -173,7 +276,7 @@ scan_float(void)
 
         val = strtod(start, NULL);
         if (val == HUGE_VAL || val == -HUGE_VAL) {
-                syntax_error("Float literal overflow.");
+                lex_error("Float literal overflow.");
         }
 
         token.kind = TOKEN_FLOAT;
@@ -188,15 +291,23 @@ scan_char(void)
         assert(*stream == '\'');
         ++stream;
 
+        val = 0;
         if (*stream == '\'') {
-                syntax_error("Char literal cannot be empty.");
-        } else if (*stream == '\n') {
-                syntax_error("Char literal cannot contain newline.");
+                ++stream;
+                lex_error("Char literal cannot be empty.");
+                return;
+        } else if (*stream == '\n' || *stream == 0) {
+                lex_error("Char literal cannot contain newline.");
+                return;
         } else if (*stream == '\\') {
                 ++stream;
-                val = escape_to_char[(int) *stream];
+                if (*stream == '\n' || *stream == 0) {
+                        lex_error("Char literal cannot contain newline.");
+                        return;
+                }
+                val = escape_to_char[(unsigned char) *stream];
                 if (val == '\0' && *stream != '0') {
-                        syntax_error("Invalid char literal escape '\\%c'.",
+                        lex_error("Invalid char literal escape '\\%c'.",
                                         *stream);
                 }
                 ++stream;
@@ -206,8 +317,15 @@ scan_char(void)
         }
 
         if (*stream != '\'') {
-                syntax_error("Expected closing char quote, got '%c'.",
-                                *stream);
+                // Skip to the closing quote if there is one on this line.
+                while (*stream && *stream != '\'' && *stream != '\n') {
+                        ++stream;
+                }
+                if (*stream == '\'') {
+                        ++stream;
+                }
+                lex_error("Expected closing char quote.");
+                return;
         } else {
                 ++stream;
         }
@@ -220,52 +338,238 @@ scan_char(void)
 void
 scan_str(void)
 {
+        uint32_t cp;
         char val;
         char *str;
+        int n;
 
-        str = NULL;
+        str = buf_stack(char, 256);
         assert(*stream == '\"');
         ++stream;
 
         while (*stream && *stream != '\"') {
                 val = *stream;
-                if (val == '\n') {
-                        syntax_error("String literal cannot contain newline.");
+                if ((unsigned char) val >= 0x80) {
+                        n = utf8_decode(stream, &cp);
+                        if (!n) {
+                                // One error for the lead byte and the
+                                // continuation bytes after it.
+                                lex_error("Invalid UTF-8 in string "
+                                                "literal.");
+                                for (n = 1; (stream[n] & 0xC0) == 0x80;
+                                                ++n) {
+                                }
+                        }
+                        if (!lex_scan_only) {
+                                for (int i = 0; i < n; ++i) {
+                                        sbuf_push(str, stream[i]);
+                                }
+                        }
+                        stream += n;
+                        continue;
+                } else if (val == '\n') {
+                        // Resume lexing on the next line.
+                        lex_error("String literal cannot contain newline.");
+                        break;
                 } else if (val == '\\') {
                         ++stream;
-                        val = escape_to_char[(int) *stream];
+                        if (*stream == '\n' || *stream == 0) {
+                                // Left for the newline and end checks.
+                                continue;
+                        }
+                        val = escape_to_char[(unsigned char) *stream];
                         if (val == 0 && *stream != '0') {
-                                syntax_error("Invalid string literal escape "
+                                lex_error("Invalid string literal escape "
                                                 "'\\%c'.", *stream);
                         }
                 }
-                buf_push(str, val);
+                if (!lex_scan_only) {
+                        sbuf_push(str, val);
+                }
                 ++stream;
         }
 
-        if (*stream) {
-                assert(*stream == '\"');
+        if (*stream == '\"') {
                 ++stream;
-        } else {
-                syntax_error("Unexpected end of file within string literal.");
+        } else if (!*stream) {
+                lex_error("Unexpected end of file within string literal.");
         }
 
-        buf_push(str, 0);
         token.kind = TOKEN_STR;
-        token.str_val = str;
+        token.str_val = NULL;
+        if (!lex_scan_only) {
+                // The literal lives as long as the AST it ends up in.
+                sbuf_push(str, 0);
+                token.str_val = ast_dup(str, buf_len(str));
+        }
 }
 
-void
-next_token(void)
+// Streaming input. The window holds the unlexed tail of the previous
+// chunks followed by the latest one, NUL-terminated at stream_limit.
+// Before a token is scanned, stream_token_end finds how far the scanner
+// may look; if that reaches the end of the window, the window is cut at
+// the token's start and refilled. Only the current token and a couple of
+// bytes of operator lookahead are carried over, so memory stays at the
+// chunk size plus the longest token.
+static THREAD_LOCAL int stream_fd = -1;
+static char *stream_buf;
+static size_t stream_cap;
+static size_t stream_chunk;
+static const char *stream_limit;
+static bool stream_eof;
+static uint32_t stream_line;
+static uint32_t stream_col;
+
+// The last byte the scanner needs to see to finish the token at p. It
+// errs on the long side: a number may take in a sign after any 'e', and a
+// literal ends at its closing quote or the end of its line.
+static const char *
+stream_token_end(const char *p)
 {
+        const char *q;
+
+        if (*p == '"' || *p == '\'') {
+                for (q = p + 1; *q && *q != *p && *q != '\n'; ++q) {
+                        if (*q == '\\' && q[1] && q[1] != '\n') {
+                                ++q;
+                        }
+                }
+                return q;
+        } else if (isdigit(*p) || *p == '.') {
+                for (q = p + 1; isalnum(*q) || *q == '.' || ((*q == '+' ||
+                                        *q == '-') && tolower(q[-1]) == 'e');
+                                ++q) {
+                }
+                return q;
+        } else if (isalpha(*p) || *p == '_' || (unsigned char) *p >= 0x80) {
+                // Any UTF-8 may be part of a name.
+                for (q = p + 1; isalnum(*q) || *q == '_' ||
+                                (unsigned char) *q >= 0x80; ++q) {
+                }
+                return q;
+        } else if (!*p) {
+                return p;
+        } else if (strchr("_'\"()[]{},;:.?!~+-*/%&|^<>=", *p)) {
+                // Operators are at most three bytes long.
+                return p[1] ? p + 2 : p + 1;
+        }
+        for (q = p; *q && !isspace(*q) && !isalnum(*q) &&
+                        !strchr("_'\"()[]{},;:.?!~+-*/%&|^<>=", *q); ++q) {
+        }
+        return q;
+}
+
+static void
+stream_refill(void)
+{
+        const char *line_start;
+        size_t keep;
+        ssize_t n;
+
+        // Remember where the window starts before dropping the lexed part.
+        line_start = stream;
+        while (line_start > stream_buf && line_start[-1] != '\n') {
+                --line_start;
+        }
+        if (line_start > stream_buf) {
+                stream_col = stream - line_start;
+        } else {
+                stream_col += stream - stream_buf;
+        }
+        stream_line += count_newlines(stream_buf, stream - stream_buf);
+        stream_base += stream - stream_buf;
+
+        keep = stream_limit - stream;
+        memmove(stream_buf, stream, keep);
+        if (stream_cap < keep + stream_chunk + 1) {
+                stream_cap = keep + stream_chunk + 1;
+                stream_buf = xrealloc(stream_buf, stream_cap);
+        }
+        do {
+                n = read(stream_fd, stream_buf + keep, stream_chunk);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+                diag_error(NULL, NULL, "read failed: %s", strerror(errno));
+        } else if ((uint64_t) stream_base + keep + n > SRCPOS_MAX) {
+                diag_error(NULL, NULL, "file is larger than 4 GB");
+                n = -1;
+        }
+        if (n <= 0) {
+                stream_eof = true;
+                n = 0;
+        }
+        stream_buf[keep + n] = 0;
+        stream = stream_buf;
+        stream_start = stream_buf;
+        stream_limit = stream_buf + keep + n;
+}
+
+// Makes sure the next token lies entirely inside the window.
+static void
+stream_fill(void)
+{
+        for (;;) {
+                while (isspace(*stream)) {
+                        ++stream;
+                }
+                if (stream_eof || stream_token_end(stream) < stream_limit) {
+                        return;
+                }
+                stream_refill();
+        }
+}
+
+static void
+lex_pipe_next(void);
+
+static void
+stream_stop_tokens(void);
+
+// Scans the rest of a name. ASCII letters, digits and underscores take
+// the fast path; anything else must decode to an XID_Continue character.
+static void
+scan_name(void)
+{
+        uint32_t cp;
+        int n;
+
+        for (;;) {
+                while (isalnum(*stream) || *stream == '_') {
+                        ++stream;
+                }
+                if ((unsigned char) *stream < 0x80) {
+                        break;
+                }
+                n = utf8_decode(stream, &cp);
+                if (!n || !xid_continue(cp)) {
+                        break;
+                }
+                stream += n;
+        }
+        token.kind = TOKEN_NAME;
+        token.name = lex_scan_only ? NULL :
+                str_intern_range(token.start, stream);
+}
+
+// Scans the token at stream into token.
+static void
+scan_token(void)
+{
+        uint32_t cp;
         char c;
+        int n;
 
         while (isspace(*stream)) {
                 ++stream;
         }
+        if (stream_fd >= 0) {
+                stream_fill();
+        }
 
         token.start = stream;
+        token.pos = stream_base + (stream - stream_start);
         token.mod = TOKENMOD_NONE;
+        lex_failed = false;
 
         switch (*stream) {
         case '\'':
@@ -275,7 +579,11 @@ next_token(void)
                 scan_str();
                 break;
         case '.':
-                scan_float();
+                if (isdigit(stream[1])) {
+                        scan_float();
+                } else {
+                        token.kind = *stream++;
+                }
                 break;
         case '0': case '1': case '2': case '3': case '4': case '5': case '6':
         case '7': case '8': case '9':
@@ -298,11 +606,7 @@ next_token(void)
         case 'H': case 'I': case 'J': case 'K': case 'L': case 'M': case 'N':
         case 'O': case 'P': case 'Q': case 'R': case 'S': case 'T': case 'U':
         case 'V': case 'W': case 'X': case 'Y': case 'Z': case '_':
-                while (isalnum(*stream) || *stream == '_') {
-                        ++stream;
-                }
-                token.kind = TOKEN_NAME;
-                token.name = str_intern_range(token.start, stream);
+                scan_name();
                 break;
         case '<':
                 token.kind = *stream++;
@@ -337,34 +641,502 @@ next_token(void)
         CASE1('/', '=', TOKEN_DIV_ASSIGN);
         CASE1('*', '=', TOKEN_MUL_ASSIGN);
         CASE1('%', '=', TOKEN_MOD_ASSIGN);
+        CASE1('=', '=', TOKEN_EQ);
+        CASE1('!', '=', TOKEN_NOTEQ);
         CASE2('-', '=', TOKEN_SUB_ASSIGN, '-', TOKEN_DEC);
         CASE2('+', '=', TOKEN_ADD_ASSIGN, '+', TOKEN_INC);
-        CASE2('&', '=', TOKEN_AND_ASSIGN, '|', TOKEN_AND);
+        CASE2('&', '=', TOKEN_AND_ASSIGN, '&', TOKEN_AND);
         CASE2('|', '=', TOKEN_OR_ASSIGN, '|', TOKEN_OR);
-        default:
+        case '(': case ')': case '[': case ']': case '{': case '}': case ',':
+        case ';': case '?': case '~':
                 token.kind = *stream++;
                 break;
+        case '\0':
+                token.kind = TOKEN_EOF;
+                break;
+        default:
+                n = utf8_decode(stream, &cp);
+                if (n && xid_start(cp)) {
+                        stream += n;
+                        scan_name();
+                        break;
+                }
+                // Skip the whole run of stray bytes as one error token.
+                while (*stream && !isspace(*stream) && !isalnum(*stream) &&
+                                !strchr("_'\"()[]{},;:.?!~+-*/%&|^<>=",
+                                        *stream)) {
+                        ++stream;
+                }
+                lex_error("Invalid character '%.*s'.",
+                                (int) (stream - token.start), token.start);
+                break;
         }
 
+        if (lex_failed) {
+                token.kind = TOKEN_ERROR;
+        }
         token.end = stream;
+        if (!lex_scan_only) {
+                STAT_INC(tokens[token.kind]);
+        }
+}
+
+void
+next_token(void)
+{
+        if (!stream_tokens) {
+                scan_token();
+                return;
+        }
+        if (stream_tokens == stream_tokens_end) {
+                lex_pipe_next();
+        }
+        token = *stream_tokens;
+        if (token.kind != TOKEN_EOF) {
+                ++stream_tokens;
+        }
 }
 
 void
 init_stream(const char *str)
 {
         stream = str;
+        stream_start = str;
+        stream_base = 0;
+        stream_fd = -1;
+        stream_stop_tokens();
+        next_token();
+}
+
+// Lexes from fd, chunk bytes at a time (LEX_CHUNK_SIZE if 0), instead of
+// from a string in memory. The caller closes fd and calls free_stream when
+// done.
+void
+init_stream_fd(int fd, size_t chunk)
+{
+        stream_stop_tokens();
+        stream_fd = fd;
+        stream_chunk = chunk ? chunk : LEX_CHUNK_SIZE;
+        stream_eof = false;
+        stream_base = 0;
+        stream_line = 0;
+        stream_col = 0;
+        if (stream_cap < stream_chunk + 1) {
+                stream_cap = stream_chunk + 1;
+                stream_buf = xrealloc(stream_buf, stream_cap);
+        }
+        stream_buf[0] = 0;
+        stream = stream_buf;
+        stream_start = stream_buf;
+        stream_limit = stream_buf;
+        next_token();
+}
+
+void
+free_stream(void)
+{
+        xfree(stream_buf);
+        stream_buf = NULL;
+        stream_cap = 0;
+        stream_fd = -1;
+        stream_stop_tokens();
+        stream = "";
+        stream_start = stream;
+}
+
+// Line and column of ptr, which must point into the current token of a
+// streamed input; the text before it is gone by the time anything prints.
+SrcLoc
+stream_locate(const char *ptr)
+{
+        const char *line_start;
+        uint32_t col;
+
+        assert(ptr >= stream_buf && ptr <= stream_limit);
+        line_start = ptr;
+        while (line_start > stream_buf && line_start[-1] != '\n') {
+                --line_start;
+        }
+        col = ptr - line_start + 1;
+        if (line_start == stream_buf) {
+                col += stream_col;
+        }
+        return (SrcLoc) { stream_line + count_newlines(stream_buf,
+                                ptr - stream_buf) + 1, col };
+}
+
+// Completes a token from a scan-only thread the way next_token would have:
+// interns its name or decodes its string. A malformed token is scanned
+// again on this thread to report it.
+static void
+lex_finish_token(Token *it)
+{
+        if (it->kind == TOKEN_NAME) {
+                it->name = str_intern_range(it->start, it->end);
+        } else if (it->kind == TOKEN_STR) {
+                token = *it;
+                stream = it->start;
+                scan_str();
+                it->str_val = token.str_val;
+        } else if (it->kind == TOKEN_ERROR) {
+                stream = it->start;
+                scan_token();
+                *it = token;
+                return;
+        }
+        STAT_INC(tokens[it->kind]);
+}
+
+// Parallel lexing. No token spans a newline, so a file split right after
+// newlines can be lexed chunk by chunk on separate threads. Each worker
+// records where the first token after its chunk starts; if that is not
+// where the next chunk's first token starts, the next chunk is lexed again
+// from the right place. Chunks that hit a lexing error are also lexed
+// again, on the calling thread, so their diagnostics are reported there.
+// Stitching interns names and decodes strings in token order, giving the
+// same tokens as a next_token loop.
+typedef struct LexChunk {
+        const char *src;
+        const char *begin;
+        const char *end;
+        const char *first;
+        const char *stop;
+        Token *tokens;
+        size_t num_tokens;
+        size_t cap;
+        bool failed;
+        bool started;
+        pthread_t thread;
+} LexChunk;
+
+// Workers grow their token arrays with plain realloc: the x* allocators'
+// tracking and counters are not thread-safe.
+static void *
+lex_chunk(void *arg)
+{
+        LexChunk *chunk;
+        Token *tokens;
+
+        chunk = arg;
+        trace_thread_name("lex");
+        trace_begin("lex", prof_file);
+        lex_scan_only = true;
+        stream_start = chunk->src;
+        stream_base = 0;
+        stream = chunk->begin;
+        next_token();
+        chunk->first = token.start;
+        while (token.start < chunk->end && !is_token(TOKEN_EOF)) {
+                if (is_token(TOKEN_ERROR)) {
+                        chunk->failed = true;
+                        break;
+                }
+                if (chunk->num_tokens == chunk->cap) {
+                        chunk->cap = chunk->cap ? 2 * chunk->cap : 1024;
+                        tokens = realloc(chunk->tokens,
+                                        chunk->cap * sizeof(Token));
+                        if (!tokens) {
+                                chunk->failed = true;
+                                break;
+                        }
+                        chunk->tokens = tokens;
+                }
+                chunk->tokens[chunk->num_tokens++] = token;
+                next_token();
+        }
+        chunk->stop = token.start;
+        trace_end();
+        return NULL;
+}
+
+// Lexes from start on this thread until a token starts at or after end and
+// returns where it starts.
+static const char *
+lex_relex(Token **tokens, const char *src, const char *start,
+                const char *end)
+{
+        stream_start = src;
+        stream_base = 0;
+        stream = start;
+        for (next_token(); token.start < end && !is_token(TOKEN_EOF);
+                        next_token()) {
+                buf_push(*tokens, token);
+        }
+        return token.start;
+}
+
+// Returns the tokens of src, which must be NUL-terminated at src[len],
+// lexed on num_threads threads. The result is a stretchy buffer ending in
+// TOKEN_EOF; pass it to init_stream_tokens to parse it.
+Token *
+lex_parallel(const char *src, size_t len, int num_threads)
+{
+        LexChunk *chunks;
+        LexChunk *chunk;
+        Token *tokens;
+        const char *end;
+        const char *begin;
+        const char *split;
+        const char *stop;
+        size_t total;
+
+        stream_stop_tokens();
+        stream_fd = -1;
+        // Sequential lexing stops at the first NUL.
+        end = memchr(src, 0, len);
+        if (!end) {
+                end = src + len;
+        }
+        len = end - src;
+        if (num_threads < 1 || len < LEX_PARALLEL_MIN) {
+                num_threads = 1;
+        }
+
+        chunks = xcalloc(num_threads, sizeof(LexChunk));
+        begin = src;
+        for (int i = 0; i < num_threads; ++i) {
+                chunk = &chunks[i];
+                chunk->src = src;
+                chunk->begin = begin;
+                chunk->end = end;
+                if (i + 1 < num_threads) {
+                        // Each chunk ends just after a newline.
+                        split = MAX(begin, src + len / num_threads * (i + 1));
+                        chunk->end = memchr(split, '\n', end - split);
+                        chunk->end = chunk->end ? chunk->end + 1 : end;
+                }
+                begin = chunk->end;
+                // A chunk without a thread is lexed while stitching.
+                chunk->started = num_threads > 1 && pthread_create(
+                                &chunk->thread, NULL, lex_chunk, chunk) == 0;
+                if (!chunk->started) {
+                        chunk->failed = true;
+                }
+        }
+
+        total = 0;
+        for (int i = 0; i < num_threads; ++i) {
+                if (chunks[i].started) {
+                        pthread_join(chunks[i].thread, NULL);
+                }
+                total += chunks[i].num_tokens;
+        }
+
+        tokens = NULL;
+        buf__fit(tokens, total + 1);
+        stop = src;
+        for (int i = 0; i < num_threads; ++i) {
+                chunk = &chunks[i];
+                if (chunk->failed || chunk->first != stop) {
+                        stop = lex_relex(&tokens, src, stop, chunk->end);
+                        free(chunk->tokens);
+                        continue;
+                }
+                for (Token *it = chunk->tokens; it != chunk->tokens +
+                                chunk->num_tokens; ++it) {
+                        lex_finish_token(it);
+                        buf_push(tokens, *it);
+                }
+                stop = chunk->stop;
+                free(chunk->tokens);
+        }
+        xfree(chunks);
+
+        // Whatever follows the last chunk, which is just the end of file.
+        lex_relex(&tokens, src, stop, end);
+        buf_push(tokens, token);
+        return tokens;
+}
+
+// Makes next_token hand out tokens, which must end in TOKEN_EOF, instead
+// of scanning. free_stream or another init_stream stops it.
+void
+init_stream_tokens(const Token *tokens)
+{
+        stream_stop_tokens();
+        stream_tokens = tokens;
+        next_token();
+}
+
+// Pipelined lexing. A lexer thread scans ahead of the parser and fills a
+// ring of token batches; the parser's next_token replays one batch at a
+// time and hands it back when done. Each side only writes its own end of
+// the ring, so it needs no locks. The lexer thread scans only, like
+// lex_parallel's workers; the parser's thread finishes each batch as it
+// takes it, so names, strings and diagnostics come out as they would from
+// a next_token loop.
+struct LexPipe {
+        const char *src;
+        Token *tokens;
+        size_t *counts;
+        size_t num_slots;
+        bool stop;
+        pthread_t thread;
+        // Batches filled by the lexer and released by the parser. They are
+        // kept apart so that each side's writes leave the other's cache
+        // line alone.
+        char pad0[64];
+        size_t head;
+        char pad1[64];
+        size_t tail;
+        char pad2[64];
+};
+
+#define LEX_PIPE_SPINS 100
+
+// Waits for the other side of the pipeline: spinning is cheapest while it
+// keeps up, yielding lets it run when the two share a core.
+static void
+lex_pipe_pause(int *spins)
+{
+        if (++*spins > LEX_PIPE_SPINS) {
+                sched_yield();
+        }
+}
+
+static void *
+lex_pipe_run(void *arg)
+{
+        LexPipe *pipe;
+        Token *batch;
+        size_t slot;
+        size_t n;
+        int spins;
+
+        pipe = arg;
+        trace_thread_name("lex");
+        trace_begin("lex", prof_file);
+        lex_scan_only = true;
+        stream_start = pipe->src;
+        stream_base = 0;
+        stream = pipe->src;
+        for (;;) {
+                spins = 0;
+                while (!__atomic_load_n(&pipe->stop, __ATOMIC_RELAXED) &&
+                                pipe->head - __atomic_load_n(&pipe->tail,
+                                        __ATOMIC_ACQUIRE) == pipe->num_slots) {
+                        lex_pipe_pause(&spins);
+                }
+                if (__atomic_load_n(&pipe->stop, __ATOMIC_RELAXED)) {
+                        trace_end();
+                        return NULL;
+                }
+                slot = pipe->head & (pipe->num_slots - 1);
+                batch = pipe->tokens + slot * LEX_PIPE_BATCH;
+                n = 0;
+                do {
+                        next_token();
+                        batch[n++] = token;
+                } while (n < LEX_PIPE_BATCH && !is_token(TOKEN_EOF));
+                pipe->counts[slot] = n;
+                __atomic_store_n(&pipe->head, pipe->head + 1,
+                                __ATOMIC_RELEASE);
+                if (is_token(TOKEN_EOF)) {
+                        trace_end();
+                        return NULL;
+                }
+        }
+}
+
+// Waits for the next batch and starts replaying it.
+static void
+lex_pipe_acquire(LexPipe *pipe)
+{
+        Token *batch;
+        size_t slot;
+        size_t n;
+        int spins;
+
+        spins = 0;
+        while (__atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE) == pipe->tail) {
+                lex_pipe_pause(&spins);
+        }
+        slot = pipe->tail & (pipe->num_slots - 1);
+        batch = pipe->tokens + slot * LEX_PIPE_BATCH;
+        n = pipe->counts[slot];
+        for (Token *it = batch; it != batch + n; ++it) {
+                lex_finish_token(it);
+        }
+        stream_tokens = batch;
+        stream_tokens_end = batch + n;
+}
+
+// Hands the batch just replayed back to the lexer thread and takes the
+// next one.
+static void
+lex_pipe_next(void)
+{
+        LexPipe *pipe;
+
+        pipe = stream_pipe;
+        __atomic_store_n(&pipe->tail, pipe->tail + 1, __ATOMIC_RELEASE);
+        lex_pipe_acquire(pipe);
+}
+
+static void
+stream_stop_tokens(void)
+{
+        LexPipe *pipe;
+
+        pipe = stream_pipe;
+        if (pipe) {
+                __atomic_store_n(&pipe->stop, true, __ATOMIC_RELAXED);
+                pthread_join(pipe->thread, NULL);
+                xfree(pipe->counts);
+                xfree(pipe->tokens);
+                xfree(pipe);
+        }
+        stream_pipe = NULL;
+        stream_tokens = NULL;
+        stream_tokens_end = NULL;
+}
+
+// Lexes str on a thread of its own while next_token hands out its tokens,
+// through a ring of num_slots batches (LEX_PIPE_SLOTS if 0, rounded up to
+// a power of two). free_stream or another init_stream stops the thread.
+void
+init_stream_pipe(const char *str, size_t num_slots)
+{
+        LexPipe *pipe;
+        size_t slots;
+
+        stream_stop_tokens();
+        stream = str;
+        stream_start = str;
+        stream_base = 0;
+        stream_fd = -1;
+        num_slots = num_slots ? num_slots : LEX_PIPE_SLOTS;
+        for (slots = 1; slots < num_slots; slots *= 2) {
+        }
+        pipe = xcalloc(1, sizeof(LexPipe));
+        pipe->src = str;
+        pipe->num_slots = slots;
+        pipe->tokens = xmalloc(slots * LEX_PIPE_BATCH * sizeof(Token));
+        pipe->counts = xcalloc(slots, sizeof(size_t));
+        if (pthread_create(&pipe->thread, NULL, lex_pipe_run, pipe) != 0) {
+                xfree(pipe->counts);
+                xfree(pipe->tokens);
+                xfree(pipe);
+                next_token();
+                return;
+        }
+        stream_pipe = pipe;
+        lex_pipe_acquire(pipe);
         next_token();
 }
 
 void
 print_token(Token token)
 {
+        char buf[DTOA_BUF_SIZE];
+
         switch (token.kind) {
         case TOKEN_INT:
                 printf("TOKEN INT: %" PRIu64 "\n", token.int_val);
                 break;
         case TOKEN_FLOAT:
-                printf("TOKEN FLOAT: %f\n", token.float_val);
+                double_to_str(token.float_val, buf);
+                printf("TOKEN FLOAT: %s\n", buf);
                 break;
         case TOKEN_NAME:
                 printf("TOKEN NAME: %.*s\n",
@@ -399,6 +1171,21 @@ match_token(TokenKind kind)
         }
 }
 
+// Reports an error at the current token. Error tokens were reported by
+// the lexer already and are not reported again.
+void
+token_error(const char *fmt, ...)
+{
+        va_list args;
+
+        if (token.kind == TOKEN_ERROR) {
+                return;
+        }
+        va_start(args, fmt);
+        diag_verror(token.start, MAX(token.end, token.start + 1), fmt, args);
+        va_end(args);
+}
+
 bool
 expect_token(TokenKind kind)
 {
@@ -409,12 +1196,215 @@ expect_token(TokenKind kind)
                 return true;
         } else {
                 copy_token_kind_str(buf, sizeof(buf), kind);
-                fatal("expected token %s got %s\n", buf,
+                token_error("expected %s, got %s", buf,
                                 token_kind_str(token.kind));
                 return false;
         }
 }
 
+// Streams str through a temporary file in chunks of every size from 1 to
+// 16 bytes and checks that the tokens match lexing it from memory.
+static void
+stream_test(void)
+{
+        const char *str;
+        Token *expected;
+        Token *it;
+        FILE *f;
+        DiagContext ctx;
+        SrcLoc loc;
+        SrcPos broken;
+
+        str = "func f(x: int): int {\n"
+                "    s := \"a string \\\" with spaces\";\n"
+                "    c := ' ';\n"
+                "\tlong_identifier_name_0123456789 <<= 0x1f + 3.25e-2;\n"
+                "    return x >= 1 ? 'q' : 1.5;\n"
+                "    n\xC3\xA4me := \"\xE6\x97\xA5\xE6\x9C\xAC\";\n"
+                "}\n"
+                "var e = \"broken\n"
+                "  @@ 09 'ab' xyz";
+        broken = strstr(str, "\"broken") - str;
+        expected = NULL;
+        diag_begin(&ctx, "stream.ion", str);
+        init_stream(str);
+        for (;;) {
+                buf_push(expected, token);
+                if (is_token(TOKEN_EOF)) {
+                        break;
+                }
+                next_token();
+        }
+        diag_free(&ctx);
+
+        f = tmpfile();
+        fputs(str, f);
+        fflush(f);
+        for (size_t chunk = 1; chunk <= 16; ++chunk) {
+                lseek(fileno(f), 0, SEEK_SET);
+                diag_begin(&ctx, "stream.ion", NULL);
+                init_stream_fd(fileno(f), chunk);
+                for (it = expected; it != buf_end(expected); ++it) {
+                        assert(token.kind == it->kind && token.pos == it->pos);
+                        assert(token.end - token.start == it->end - it->start);
+                        if (is_token(TOKEN_NAME)) {
+                                assert(token.name == it->name);
+                        } else if (is_token(TOKEN_STR)) {
+                                assert(strcmp(token.str_val, it->str_val) == 0);
+                        } else if (is_token(TOKEN_INT) ||
+                                        is_token(TOKEN_FLOAT)) {
+                                assert(token.int_val == it->int_val);
+                        }
+                        if (it->pos == broken) {
+                                // The unterminated string on line 8.
+                                loc = stream_locate(token.start);
+                                assert(loc.line == 8 && loc.col == 9);
+                        }
+                        next_token();
+                }
+                assert(diag_num_errors() == 4);
+                // The window holds at most a chunk plus the longest token.
+                assert(stream_cap <= chunk +
+                                strlen("long_identifier_name_0123456789") + 1);
+                diag_free(&ctx);
+        }
+
+        // Input without whitespace must not make the window grow.
+        fclose(f);
+        free_stream();
+        f = tmpfile();
+        for (int i = 0; i < 1000; ++i) {
+                fputs("x<<=1;", f);
+        }
+        fflush(f);
+        lseek(fileno(f), 0, SEEK_SET);
+        diag_begin(&ctx, "stream.ion", NULL);
+        init_stream_fd(fileno(f), 16);
+        for (int i = 0; i < 1000; ++i) {
+                assert(is_token_name(str_intern("x")));
+                next_token();
+                assert(is_token(TOKEN_LSHIFT_ASSIGN));
+                next_token();
+                next_token();
+                next_token();
+        }
+        assert(is_token(TOKEN_EOF) && diag_num_errors() == 0);
+        assert(stream_cap <= 16 + 3);
+        diag_free(&ctx);
+
+        // Positions past SRCPOS_MAX are reported instead of wrapping.
+        lseek(fileno(f), 0, SEEK_SET);
+        diag_begin(&ctx, "stream.ion", NULL);
+        init_stream_fd(fileno(f), 16);
+        stream_base = SRCPOS_MAX - 64;
+        while (!is_token(TOKEN_EOF)) {
+                next_token();
+        }
+        assert(diag_num_errors() == 1);
+        assert(token.pos <= SRCPOS_MAX);
+        diag_free(&ctx);
+
+        fclose(f);
+        free_stream();
+        buf_free(expected);
+}
+
+static void
+assert_same_token(const Token *a, const Token *b)
+{
+        assert(a->kind == b->kind && a->mod == b->mod && a->pos == b->pos);
+        assert(a->start == b->start && a->end == b->end);
+        if (a->kind == TOKEN_STR) {
+                assert(strcmp(a->str_val, b->str_val) == 0);
+        } else if (a->kind == TOKEN_NAME || a->kind == TOKEN_INT ||
+                        a->kind == TOKEN_FLOAT) {
+                assert(a->int_val == b->int_val);
+        }
+}
+
+// Lexes a file big enough to be split both with a next_token loop and with
+// lex_parallel on various numbers of threads and compares the tokens, then
+// does the same through the lexing pipeline.
+static void
+lex_parallel_test(void)
+{
+        const char *lines[] = {
+                "func f(x: int): int { return x <<= 0x1f + 3.25e-2; }\n",
+                "    s := \"a \\\"quoted\\\" string\\n\" + 'q' + '\\n';\n",
+                "\n\n   \t\n",
+                "var long_identifier_name_0123456789 = 1.5 ? 07 : 0b101;\n",
+        };
+        DiagContext ctx;
+        ArenaMark mark;
+        Token *expected;
+        Token *tokens;
+        const char *line;
+        char *src;
+        int errors;
+
+        src = NULL;
+        for (int i = 0; buf_len(src) < LEX_PARALLEL_MIN + 4096; ++i) {
+                // Errors make their chunk be lexed again.
+                line = i % 5000 == 4999 ? "x := \"bad \\q escape\" @ 1;\n" :
+                        lines[i % 4];
+                for (; *line; ++line) {
+                        buf_push(src, *line);
+                }
+        }
+        buf_push(src, 0);
+        mark = arena_mark(&ast_arena);
+        expected = NULL;
+        diag_begin(&ctx, "parallel.ion", src);
+        init_stream(src);
+        for (;;) {
+                buf_push(expected, token);
+                if (is_token(TOKEN_EOF)) {
+                        break;
+                }
+                next_token();
+        }
+        errors = diag_num_errors();
+        assert(errors > 0);
+        diag_free(&ctx);
+
+        for (int threads = 1; threads <= 8; threads += 3) {
+                diag_begin(&ctx, "parallel.ion", src);
+                tokens = lex_parallel(src, buf_len(src) - 1, threads);
+                assert(buf_len(tokens) == buf_len(expected));
+                for (size_t i = 0; i < buf_len(tokens); ++i) {
+                        assert_same_token(&tokens[i], &expected[i]);
+                }
+                assert(diag_num_errors() == errors);
+                init_stream_tokens(tokens);
+                assert(is_token_name(keyword_func));
+                free_stream();
+                diag_free(&ctx);
+                buf_free(tokens);
+        }
+
+        // So does the pipeline, however few batches it has in flight.
+        for (size_t slots = 1; slots <= 16; slots *= 4) {
+                diag_begin(&ctx, "parallel.ion", src);
+                init_stream_pipe(src, slots);
+                for (Token *it = expected; it != buf_end(expected); ++it) {
+                        assert_same_token(&token, it);
+                        next_token();
+                }
+                assert_token_eof();
+                assert(diag_num_errors() == errors);
+                free_stream();
+                diag_free(&ctx);
+        }
+        // Stopping early shuts the lexer thread down.
+        init_stream_pipe(src, 2);
+        assert(is_token_name(keyword_func));
+        free_stream();
+
+        buf_free(expected);
+        buf_free(src);
+        arena_reset(&ast_arena, mark);
+}
+
 void
 lex_test(void)
 {
@@ -444,14 +1434,15 @@ lex_test(void)
         assert_token_eof();
 
         // String literal tests.
-        init_stream("\"foo\" \"a\\nb\"");
+        init_stream("\"foo\" \"a\\nb\" \"q\\\"\\\\\"");
         assert_token_str("foo");
         assert_token_str("a\nb");
+        assert_token_str("q\"\\");
         assert_token_eof();
 
         // Operator tests.
         init_stream(": := + += - -= -- ++ < <= << <<= > >= >> >>= ^ ^= / /= "
-                        "* *= % %=");
+                        "* *= % %= = == ! != & && &= | || |=");
         assert_token(':');
         assert_token(TOKEN_COLON_ASSIGN);
         assert_token('+');
@@ -476,10 +1467,20 @@ lex_test(void)
         assert_token(TOKEN_MUL_ASSIGN);
         assert_token('%');
         assert_token(TOKEN_MOD_ASSIGN);
+        assert_token('=');
+        assert_token(TOKEN_EQ);
+        assert_token('!');
+        assert_token(TOKEN_NOTEQ);
+        assert_token('&');
+        assert_token(TOKEN_AND);
+        assert_token(TOKEN_AND_ASSIGN);
+        assert_token('|');
+        assert_token(TOKEN_OR);
+        assert_token(TOKEN_OR_ASSIGN);
         assert_token_eof();
 
         // Misc tests.
-        const char *str = "XY+(XY)_HELLO1,234+994";
+        const char *str = "XY+(XY)_HELLO1,234+994 a.b";
         init_stream(str);
         assert_token_name("XY");
         assert_token('+');
@@ -491,5 +1492,70 @@ lex_test(void)
         assert_token_int(234);
         assert_token('+');
         assert_token_int(994);
+        assert_token_name("a");
+        assert_token('.');
+        assert_token_name("b");
+        assert_token_eof();
+
+        // Error tests: each malformed token becomes one error token and
+        // lexing resumes right after it.
+        DiagContext ctx;
+        str = "1 @$ 2 09 \"abc\n 3 '' 'x";
+        diag_begin(&ctx, "lex.ion", str);
+        init_stream(str);
+        assert_token_int(1);
+        assert_token(TOKEN_ERROR);
+        assert_token_int(2);
+        assert_token(TOKEN_ERROR);
+        assert_token(TOKEN_ERROR);
+        assert_token_int(3);
+        assert_token(TOKEN_ERROR);
+        assert_token(TOKEN_ERROR);
+        assert_token_eof();
+        assert(diag_num_errors() == 5);
+        diag_free(&ctx);
+
+        // A backslash right before the end of the input or a line must not
+        // escape it.
+        str = "\"abc\\";
+        diag_begin(&ctx, "lex.ion", str);
+        init_stream(str);
+        assert_token(TOKEN_ERROR);
         assert_token_eof();
+        str = "'\\";
+        init_stream(str);
+        assert_token(TOKEN_ERROR);
+        assert_token_eof();
+        str = "\"a\\\n'\\\n1";
+        init_stream(str);
+        assert_token(TOKEN_ERROR);
+        assert_token(TOKEN_ERROR);
+        assert_token_int(1);
+        assert_token_eof();
+        assert(diag_num_errors() == 4);
+        diag_free(&ctx);
+
+        // UTF-8 names start with XID_Start and go on with XID_Continue;
+        // other characters are errors, and strings take any valid UTF-8.
+        str = "h\xC3\xA9llo \xE5\x90\x8D\xE5\x89\x8D x\xCC\x81y "
+                "\xCC\x81 \xE2\x82\xAC a\xE2\x82\xAC "
+                "\"\xE6\x97\xA5\xE6\x9C\xAC\" \"\xE6\x97\" \xFF";
+        diag_begin(&ctx, "lex.ion", str);
+        init_stream(str);
+        assert_token_name("h\xC3\xA9llo");
+        assert_token_name("\xE5\x90\x8D\xE5\x89\x8D");
+        assert_token_name("x\xCC\x81y");
+        assert_token(TOKEN_ERROR);
+        assert_token(TOKEN_ERROR);
+        assert_token_name("a");
+        assert_token(TOKEN_ERROR);
+        assert_token_str("\xE6\x97\xA5\xE6\x9C\xAC");
+        assert_token(TOKEN_ERROR);
+        assert_token(TOKEN_ERROR);
+        assert_token_eof();
+        assert(diag_num_errors() == 5);
+        diag_free(&ctx);
+
+        stream_test();
+        lex_parallel_test();
 }
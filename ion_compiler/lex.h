@@ -6,6 +6,16 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "common.h"
+#include "loc.h"
+
+#define LEX_CHUNK_SIZE (64 * 1024)
+// Smallest input lex_parallel splits across threads.
+#define LEX_PARALLEL_MIN (1 << 20)
+// Tokens per batch and batches in flight for init_stream_pipe.
+#define LEX_PIPE_BATCH 256
+#define LEX_PIPE_SLOTS 16
+
 #define assert_token(x)       assert(match_token(x))
 #define assert_token_name(x)  assert(token.name == str_intern(x) && \
                                                 match_token(TOKEN_NAME))
@@ -68,6 +78,7 @@ typedef enum TokenKind {
         TOKEN_MUL_ASSIGN,
         TOKEN_DIV_ASSIGN,
         TOKEN_MOD_ASSIGN,
+        TOKEN_ERROR,
         TOKEN_KEYWORD
 } TokenKind;
 
@@ -82,6 +93,7 @@ typedef enum TokenMod {
 typedef struct Token {
         TokenKind kind;
         TokenMod mod;
+        SrcPos pos;
         const char *start;
         const char *end;
         union {
@@ -92,13 +104,32 @@ typedef struct Token {
         };
 } Token;
 
-Token token;
-const char *stream;
-const char *keyword_if;
-const char *keyword_for;
-const char *keyword_while;
+extern THREAD_LOCAL Token token;
+extern THREAD_LOCAL const char *stream;
+extern THREAD_LOCAL const char *stream_start;
+extern THREAD_LOCAL SrcPos stream_base;
+extern const char *keyword_typedef;
+extern const char *keyword_enum;
+extern const char *keyword_struct;
+extern const char *keyword_union;
+extern const char *keyword_var;
+extern const char *keyword_const;
+extern const char *keyword_func;
+extern const char *keyword_cast;
+extern const char *keyword_break;
+extern const char *keyword_continue;
+extern const char *keyword_return;
+extern const char *keyword_if;
+extern const char *keyword_else;
+extern const char *keyword_while;
+extern const char *keyword_do;
+extern const char *keyword_for;
+extern const char *keyword_switch;
+extern const char *keyword_case;
+extern const char *keyword_default;
 extern uint8_t char_to_digit[256];
 extern char escape_to_char[256];
+extern const char *token_kind_names[TOKEN_KEYWORD + 1];
 
 void
 init_keywords(void);
@@ -121,6 +152,24 @@ next_token(void);
 void
 init_stream(const char *str);
 
+void
+init_stream_fd(int fd, size_t chunk);
+
+void
+free_stream(void);
+
+SrcLoc
+stream_locate(const char *ptr);
+
+Token *
+lex_parallel(const char *src, size_t len, int num_threads);
+
+void
+init_stream_tokens(const Token *tokens);
+
+void
+init_stream_pipe(const char *str, size_t num_slots);
+
 void
 print_token(Token token);
 
@@ -133,6 +182,9 @@ is_token_name(const char *name);
 bool
 match_token(TokenKind kind);
 
+void
+token_error(const char *fmt, ...);
+
 bool
 expect_token(TokenKind kind);
 
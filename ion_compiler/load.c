@@ -0,0 +1,606 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "load.h"
+#include "trace.h"
+
+bool load_use_pool;
+
+// A file goes from QUEUED to DONE in order; its one operation at a time is
+// the open while OPENING and a read while READING. An OPENED file waits
+// for room in the byte budget before its buffer is allocated.
+typedef enum LoadState {
+        LOAD_QUEUED,
+        LOAD_OPENING,
+        LOAD_OPENED,
+        LOAD_READING,
+        LOAD_DONE
+} LoadState;
+
+typedef struct LoadSlot {
+        LoadState state;
+        int fd;
+        int error;
+        char *buf;
+        size_t size;
+        size_t done;
+} LoadSlot;
+
+// One open or read, as handed to either backend. res is the descriptor or
+// byte count, or a negated errno.
+typedef struct LoadJob {
+        uint32_t file;
+        bool open;
+        int fd;
+        const char *path;
+        char *buf;
+        size_t len;
+        off_t off;
+        long res;
+} LoadJob;
+
+struct Loader {
+        const char **paths;
+        LoadSlot *files;
+        size_t num_files;
+        // Files before next have been handed out; those up to opened have
+        // been started.
+        size_t next;
+        size_t opened;
+        size_t max_bytes;
+        size_t bytes;
+        size_t in_flight;
+        bool stopping;
+
+        // io_uring, when ring_fd >= 0.
+        int ring_fd;
+        void *sq_ring;
+        size_t sq_ring_size;
+        void *cq_ring;
+        size_t cq_ring_size;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+        unsigned *sq_head;
+        unsigned *sq_tail;
+        unsigned sq_mask;
+        unsigned sq_entries;
+        unsigned *sq_array;
+        unsigned *cq_head;
+        unsigned *cq_tail;
+        unsigned cq_mask;
+        struct io_uring_cqe *cqes;
+        unsigned to_submit;
+
+        // The thread pool otherwise. Jobs and their results go through two
+        // rings under one lock; each file has at most one job, so neither
+        // ring can overflow. With no threads, jobs run as they are queued.
+        pthread_mutex_t lock;
+        pthread_cond_t work_cond;
+        pthread_cond_t done_cond;
+        pthread_t threads[LOAD_THREADS];
+        int num_threads;
+        LoadJob jobs[LOAD_MAX_FILES];
+        size_t jobs_head;
+        size_t jobs_tail;
+        LoadJob results[LOAD_MAX_FILES];
+        size_t results_head;
+        size_t results_tail;
+        bool pool_stop;
+};
+
+static void
+load_run_job(LoadJob *job)
+{
+        if (job->open) {
+                job->res = open(job->path, O_RDONLY | O_CLOEXEC);
+        } else {
+                job->res = pread(job->fd, job->buf, job->len, job->off);
+        }
+        if (job->res < 0) {
+                job->res = -errno;
+        }
+}
+
+static void *
+pool_run(void *arg)
+{
+        Loader *l;
+        LoadJob job;
+
+        l = arg;
+        trace_thread_name("load");
+        pthread_mutex_lock(&l->lock);
+        for (;;) {
+                while (l->jobs_head == l->jobs_tail && !l->pool_stop) {
+                        pthread_cond_wait(&l->work_cond, &l->lock);
+                }
+                if (l->pool_stop) {
+                        break;
+                }
+                job = l->jobs[l->jobs_head++ % LOAD_MAX_FILES];
+                pthread_mutex_unlock(&l->lock);
+                trace_begin(job.open ? "open" : "read", l->paths[job.file]);
+                load_run_job(&job);
+                trace_end();
+                pthread_mutex_lock(&l->lock);
+                l->results[l->results_tail++ % LOAD_MAX_FILES] = job;
+                pthread_cond_signal(&l->done_cond);
+        }
+        pthread_mutex_unlock(&l->lock);
+        return NULL;
+}
+
+static bool
+uring_init(Loader *l)
+{
+        struct io_uring_params p = { 0 };
+        char *sq;
+        char *cq;
+        int fd;
+
+        fd = syscall(__NR_io_uring_setup, LOAD_MAX_FILES, &p);
+        if (fd < 0) {
+                return false;
+        }
+        // Opening and reading through the ring need Linux 5.6, which is
+        // also when IORING_FEAT_RW_CUR_POS appeared.
+        if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+                close(fd);
+                return false;
+        }
+        l->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        l->cq_ring_size = p.cq_off.cqes +
+                p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                l->sq_ring_size = MAX(l->sq_ring_size, l->cq_ring_size);
+        }
+        l->sq_ring = mmap(NULL, l->sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        l->cq_ring = l->sq_ring;
+        if (l->sq_ring != MAP_FAILED &&
+                        !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+                l->cq_ring = mmap(NULL, l->cq_ring_size,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_CQ_RING);
+        }
+        l->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        l->sqes = MAP_FAILED;
+        if (l->sq_ring != MAP_FAILED && l->cq_ring != MAP_FAILED) {
+                l->sqes = mmap(NULL, l->sqes_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_SQES);
+        }
+        if (l->sqes == MAP_FAILED) {
+                if (l->cq_ring != MAP_FAILED && l->cq_ring != l->sq_ring) {
+                        munmap(l->cq_ring, l->cq_ring_size);
+                }
+                if (l->sq_ring != MAP_FAILED) {
+                        munmap(l->sq_ring, l->sq_ring_size);
+                }
+                close(fd);
+                return false;
+        }
+
+        sq = l->sq_ring;
+        cq = l->cq_ring;
+        l->sq_head = (unsigned *) (sq + p.sq_off.head);
+        l->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+        l->sq_mask = *(unsigned *) (sq + p.sq_off.ring_mask);
+        l->sq_entries = p.sq_entries;
+        l->sq_array = (unsigned *) (sq + p.sq_off.array);
+        l->cq_head = (unsigned *) (cq + p.cq_off.head);
+        l->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+        l->cq_mask = *(unsigned *) (cq + p.cq_off.ring_mask);
+        l->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+        l->ring_fd = fd;
+        return true;
+}
+
+static void
+uring_free(Loader *l)
+{
+        munmap(l->sqes, l->sqes_size);
+        if (l->cq_ring != l->sq_ring) {
+                munmap(l->cq_ring, l->cq_ring_size);
+        }
+        munmap(l->sq_ring, l->sq_ring_size);
+        close(l->ring_fd);
+}
+
+static void
+uring_queue(Loader *l, LoadJob *job)
+{
+        struct io_uring_sqe *sqe;
+        unsigned tail;
+        unsigned idx;
+
+        tail = *l->sq_tail;
+        assert(tail - __atomic_load_n(l->sq_head, __ATOMIC_ACQUIRE) <
+                        l->sq_entries);
+        idx = tail & l->sq_mask;
+        sqe = &l->sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        if (job->open) {
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = (uintptr_t) job->path;
+                sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        } else {
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = job->fd;
+                sqe->addr = (uintptr_t) job->buf;
+                sqe->len = job->len;
+                sqe->off = job->off;
+        }
+        sqe->user_data = job->file;
+        l->sq_array[idx] = idx;
+        __atomic_store_n(l->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++l->to_submit;
+}
+
+// Submits what has been queued and, if wait is set, waits for at least
+// one completion.
+static void
+uring_enter(Loader *l, bool wait)
+{
+        int n;
+
+        if (!l->to_submit && !wait) {
+                return;
+        }
+        n = syscall(__NR_io_uring_enter, l->ring_fd, l->to_submit,
+                        wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0,
+                        NULL, 0);
+        if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                fatal("io_uring_enter: %s", strerror(errno));
+        }
+        if (n > 0) {
+                l->to_submit -= n;
+        }
+}
+
+static void
+pool_queue(Loader *l, LoadJob *job)
+{
+        if (l->num_threads == 0) {
+                load_run_job(job);
+                l->results[l->results_tail++ % LOAD_MAX_FILES] = *job;
+                return;
+        }
+        pthread_mutex_lock(&l->lock);
+        l->jobs[l->jobs_tail++ % LOAD_MAX_FILES] = *job;
+        pthread_cond_signal(&l->work_cond);
+        pthread_mutex_unlock(&l->lock);
+}
+
+static void
+load_queue(Loader *l, uint32_t file, bool open)
+{
+        LoadSlot *f;
+        LoadJob job;
+
+        f = &l->files[file];
+        job = (LoadJob) { .file = file, .open = open };
+        if (open) {
+                job.path = l->paths[file];
+        } else {
+                // A read's length is 32 bits in the ring; the rest of a
+                // larger file comes in further reads.
+                job.fd = f->fd;
+                job.buf = f->buf + f->done;
+                job.len = MIN(f->size - f->done, (size_t) 1 << 30);
+                job.off = f->done;
+        }
+        ++l->in_flight;
+        if (l->ring_fd >= 0) {
+                uring_queue(l, &job);
+        } else {
+                pool_queue(l, &job);
+        }
+}
+
+static void
+load_fail(Loader *l, LoadSlot *f, int error)
+{
+        if (f->buf) {
+                xfree(f->buf);
+                f->buf = NULL;
+                l->bytes -= f->size + 1;
+        }
+        if (f->fd >= 0) {
+                close(f->fd);
+                f->fd = -1;
+        }
+        f->error = error;
+        f->state = LOAD_DONE;
+}
+
+// Moves file on after its open or read finished with res.
+static void
+load_complete(Loader *l, uint32_t file, long res)
+{
+        struct stat st;
+        LoadSlot *f;
+
+        --l->in_flight;
+        f = &l->files[file];
+        if (res < 0) {
+                load_fail(l, f, -res);
+                return;
+        }
+        if (f->state == LOAD_OPENING) {
+                f->fd = res;
+                if (fstat(f->fd, &st) != 0) {
+                        load_fail(l, f, errno);
+                } else if (S_ISDIR(st.st_mode)) {
+                        load_fail(l, f, EISDIR);
+                } else {
+                        f->size = st.st_size;
+                        f->state = LOAD_OPENED;
+                }
+                return;
+        }
+        assert(f->state == LOAD_READING);
+        f->done += res;
+        // A file that shrank since fstat ends early.
+        if (res > 0 && f->done < f->size && !l->stopping) {
+                load_queue(l, file, false);
+                return;
+        }
+        f->buf[f->done] = 0;
+        close(f->fd);
+        f->fd = -1;
+        f->state = LOAD_DONE;
+}
+
+// Waits for at least one operation to finish and handles every one that
+// has.
+static void
+load_wait(Loader *l)
+{
+        LoadJob done[LOAD_MAX_FILES];
+        unsigned head;
+        size_t n;
+
+        if (l->ring_fd >= 0) {
+                uring_enter(l, true);
+                head = *l->cq_head;
+                while (head != __atomic_load_n(l->cq_tail, __ATOMIC_ACQUIRE)) {
+                        load_complete(l, l->cqes[head & l->cq_mask].user_data,
+                                        l->cqes[head & l->cq_mask].res);
+                        ++head;
+                        __atomic_store_n(l->cq_head, head, __ATOMIC_RELEASE);
+                }
+                return;
+        }
+        if (l->num_threads) {
+                pthread_mutex_lock(&l->lock);
+                while (l->results_head == l->results_tail) {
+                        pthread_cond_wait(&l->done_cond, &l->lock);
+                }
+        }
+        for (n = 0; l->results_head != l->results_tail; ++n) {
+                done[n] = l->results[l->results_head++ % LOAD_MAX_FILES];
+        }
+        if (l->num_threads) {
+                pthread_mutex_unlock(&l->lock);
+        }
+        for (size_t i = 0; i < n; ++i) {
+                load_complete(l, done[i].file, done[i].res);
+        }
+}
+
+// Starts whatever can be started: reads of opened files, in order, while
+// the budget has room, and opens of further files. The next file to hand
+// out may always be read, so that one large file cannot stall the loader.
+static void
+load_pump(Loader *l)
+{
+        LoadSlot *f;
+
+        for (size_t i = l->next; i < l->opened; ++i) {
+                f = &l->files[i];
+                if (f->state != LOAD_OPENED) {
+                        continue;
+                }
+                if (i != l->next && l->bytes + f->size + 1 > l->max_bytes) {
+                        break;
+                }
+                f->buf = xmalloc(f->size + 1);
+                l->bytes += f->size + 1;
+                f->state = LOAD_READING;
+                if (f->size) {
+                        load_queue(l, i, false);
+                } else {
+                        f->buf[0] = 0;
+                        close(f->fd);
+                        f->fd = -1;
+                        f->state = LOAD_DONE;
+                }
+        }
+        while (l->opened < l->num_files &&
+                        l->opened - l->next < LOAD_MAX_FILES) {
+                l->files[l->opened].state = LOAD_OPENING;
+                load_queue(l, l->opened++, true);
+        }
+        if (l->ring_fd >= 0) {
+                uring_enter(l, false);
+        }
+}
+
+// Starts loading paths, which must stay valid until loader_free, or until
+// trace_write when tracing. A
+// max_bytes of 0 means LOAD_MAX_BYTES.
+Loader *
+loader_new(const char **paths, size_t num_paths, size_t max_bytes)
+{
+        Loader *l;
+
+        l = xcalloc(1, sizeof(Loader));
+        l->paths = paths;
+        l->num_files = num_paths;
+        l->files = xcalloc(num_paths, sizeof(LoadSlot));
+        for (size_t i = 0; i < num_paths; ++i) {
+                l->files[i].fd = -1;
+        }
+        l->max_bytes = max_bytes ? max_bytes : LOAD_MAX_BYTES;
+        l->ring_fd = -1;
+        if (load_use_pool || !uring_init(l)) {
+                pthread_mutex_init(&l->lock, NULL);
+                pthread_cond_init(&l->work_cond, NULL);
+                pthread_cond_init(&l->done_cond, NULL);
+                while (l->num_threads < LOAD_THREADS &&
+                                pthread_create(&l->threads[l->num_threads],
+                                        NULL, pool_run, l) == 0) {
+                        ++l->num_threads;
+                }
+        }
+        load_pump(l);
+        return l;
+}
+
+// Waits for the next file, in the order the paths were given, and fills
+// in *file. Returns false once every file has been handed out.
+bool
+loader_next(Loader *l, LoadedFile *file)
+{
+        LoadSlot *f;
+
+        if (l->next == l->num_files) {
+                return false;
+        }
+        f = &l->files[l->next];
+        while (f->state != LOAD_DONE) {
+                load_wait(l);
+                load_pump(l);
+        }
+        *file = (LoadedFile) {
+                .path = l->paths[l->next],
+                .src = f->buf,
+                .len = f->done,
+                .error = f->error,
+        };
+        if (f->buf) {
+                l->bytes -= f->size + 1;
+                f->buf = NULL;
+        }
+        ++l->next;
+        // Keep reading while the caller works on this one.
+        load_pump(l);
+        return true;
+}
+
+// Frees the loader and whatever it read that was not handed out.
+void
+loader_free(Loader *l)
+{
+        LoadSlot *f;
+
+        l->stopping = true;
+        while (l->in_flight) {
+                load_wait(l);
+        }
+        for (f = l->files; f != l->files + l->num_files; ++f) {
+                xfree(f->buf);
+                if (f->fd >= 0) {
+                        close(f->fd);
+                }
+        }
+        if (l->ring_fd >= 0) {
+                uring_free(l);
+        } else {
+                pthread_mutex_lock(&l->lock);
+                l->pool_stop = true;
+                pthread_cond_broadcast(&l->work_cond);
+                pthread_mutex_unlock(&l->lock);
+                for (int i = 0; i < l->num_threads; ++i) {
+                        pthread_join(l->threads[i], NULL);
+                }
+                pthread_mutex_destroy(&l->lock);
+                pthread_cond_destroy(&l->work_cond);
+                pthread_cond_destroy(&l->done_cond);
+        }
+        xfree(l->files);
+        xfree(l);
+}
+
+void
+load_test(void)
+{
+        char dir[] = "/tmp/ion_load_test_XXXXXX";
+        const char **paths;
+        char path[64];
+        LoadedFile file;
+        Loader *l;
+        size_t size;
+        size_t max;
+        FILE *f;
+        char *expected;
+
+        assert(mkdtemp(dir));
+        paths = NULL;
+        for (int i = 0; i < 300; ++i) {
+                snprintf(path, sizeof(path), "%s/%d.ion", dir, i);
+                buf_push(paths, strf("%s", path));
+                if (i % 97 == 13) {
+                        // Missing.
+                        continue;
+                }
+                f = fopen(path, "w");
+                // Sizes from empty up to 25 KB.
+                for (int j = 0; j < i * 83; ++j) {
+                        fputc('a' + (i + j) % 26, f);
+                }
+                fclose(f);
+        }
+        buf_push(paths, strf("%s", dir));
+
+        for (int pool = 0; pool < 2; ++pool) {
+                load_use_pool = pool;
+                max = 16 * 1024;
+                l = loader_new(paths, buf_len(paths), max);
+                for (size_t i = 0; loader_next(l, &file); ++i) {
+                        assert(file.path == paths[i]);
+                        // At most one file more than the budget.
+                        assert(l->bytes <= max + 25 * 1024);
+                        if (i == buf_len(paths) - 1) {
+                                assert(!file.src && file.error == EISDIR);
+                                continue;
+                        } else if (i % 97 == 13) {
+                                assert(!file.src && file.error == ENOENT);
+                                continue;
+                        }
+                        size = i * 83;
+                        assert(file.src && file.len == size);
+                        assert(file.src[size] == 0);
+                        expected = read_file(paths[i]);
+                        assert(memcmp(file.src, expected, size) == 0);
+                        xfree(expected);
+                        xfree(file.src);
+                }
+                assert(l->next == buf_len(paths) && l->bytes == 0);
+                loader_free(l);
+
+                // Stopping early drops what was read ahead.
+                l = loader_new(paths, buf_len(paths), 0);
+                assert(loader_next(l, &file) && file.len == 0);
+                xfree(file.src);
+                loader_free(l);
+        }
+        load_use_pool = false;
+
+        for (const char **it = paths; it != buf_end(paths); ++it) {
+                remove(*it);
+                xfree((char *) *it);
+        }
+        buf_free(paths);
+}
@@ -0,0 +1,46 @@
+#ifndef _LOAD_H_
+#define _LOAD_H_
+
+#include <stdbool.h>
+
+#include "common.h"
+
+// Batched source loading. A loader opens and reads many files at once,
+// through io_uring where the kernel has it and through a small pool of
+// threads doing open and pread where it does not, and hands them back in
+// the order they were given as soon as each is read. Reading stops ahead
+// of the caller once the buffers it has not taken yet reach max_bytes, so
+// memory stays bounded however many files there are.
+
+// Files open at once, and the default for max_bytes.
+#define LOAD_MAX_FILES 64
+#define LOAD_MAX_BYTES (16 << 20)
+#define LOAD_THREADS 4
+
+typedef struct Loader Loader;
+
+typedef struct LoadedFile {
+        const char *path;
+        // NUL-terminated contents, which the caller frees with xfree, or
+        // NULL if the file could not be read, with errno in error.
+        char *src;
+        size_t len;
+        int error;
+} LoadedFile;
+
+// Forces the thread pool even where io_uring works.
+extern bool load_use_pool;
+
+Loader *
+loader_new(const char **paths, size_t num_paths, size_t max_bytes);
+
+bool
+loader_next(Loader *loader, LoadedFile *file);
+
+void
+loader_free(Loader *loader);
+
+void
+load_test(void);
+
+#endif
@@ -0,0 +1,150 @@
+#include "common.h"
+#include "loc.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+size_t
+count_newlines(const char *src, size_t len)
+{
+        size_t count;
+        size_t i;
+
+        count = 0;
+        i = 0;
+#ifdef __SSE2__
+        __m128i newline = _mm_set1_epi8('\n');
+        __m128i zero = _mm_setzero_si128();
+        __m128i acc;
+        __m128i sums;
+
+        // Matches are counted per byte lane, subtracting the all-ones
+        // compare result, and folded into count before a lane can wrap.
+        while (i + 16 <= len) {
+                acc = zero;
+                for (int n = 0; n < 255 && i + 16 <= len; ++n, i += 16) {
+                        acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(
+                                                _mm_loadu_si128((const __m128i *)
+                                                        (src + i)), newline));
+                }
+                sums = _mm_sad_epu8(acc, zero);
+                count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+        }
+#endif
+        for (; i < len; ++i) {
+                count += src[i] == '\n';
+        }
+        return count;
+}
+
+// Writes the offset just past every newline in src to starts.
+static void
+find_line_starts(const char *src, size_t len, SrcPos *starts)
+{
+        size_t i;
+
+        i = 0;
+#ifdef __SSE2__
+        __m128i newline = _mm_set1_epi8('\n');
+        unsigned mask;
+
+        for (; i + 16 <= len; i += 16) {
+                mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(
+                                                (const __m128i *) (src + i)),
+                                        newline));
+                while (mask) {
+                        *starts++ = i + __builtin_ctz(mask) + 1;
+                        mask &= mask - 1;
+                }
+        }
+#endif
+        for (; i < len; ++i) {
+                if (src[i] == '\n') {
+                        *starts++ = i + 1;
+                }
+        }
+}
+
+void
+line_table_init(LineTable *table, const char *src, size_t len)
+{
+        *table = (LineTable) { src, len };
+}
+
+SrcLoc
+line_table_lookup(LineTable *table, SrcPos pos)
+{
+        size_t lo;
+        size_t hi;
+        size_t mid;
+
+        if (!table->starts) {
+                table->num_lines = count_newlines(table->src, table->len) + 1;
+                table->starts = xmalloc(table->num_lines * sizeof(SrcPos));
+                table->starts[0] = 0;
+                find_line_starts(table->src, table->len, table->starts + 1);
+        }
+        if (pos > table->len) {
+                pos = table->len;
+        }
+        // Find the last line starting at or before pos.
+        lo = 0;
+        hi = table->num_lines;
+        while (hi - lo > 1) {
+                mid = lo + (hi - lo) / 2;
+                if (table->starts[mid] <= pos) {
+                        lo = mid;
+                } else {
+                        hi = mid;
+                }
+        }
+        return (SrcLoc) { lo + 1, pos - table->starts[lo] + 1 };
+}
+
+void
+line_table_free(LineTable *table)
+{
+        xfree(table->starts);
+        table->starts = NULL;
+        table->num_lines = 0;
+}
+
+void
+loc_test(void)
+{
+        LineTable table;
+        const char *src;
+        char *big;
+        SrcLoc loc;
+        size_t n;
+
+        src = "ab\n\ncd\nef";
+        line_table_init(&table, src, strlen(src));
+        assert(!table.starts);
+        loc = line_table_lookup(&table, 0);
+        assert(loc.line == 1 && loc.col == 1);
+        assert(table.num_lines == 4);
+        loc = line_table_lookup(&table, 2);
+        assert(loc.line == 1 && loc.col == 3);
+        loc = line_table_lookup(&table, 3);
+        assert(loc.line == 2 && loc.col == 1);
+        loc = line_table_lookup(&table, 5);
+        assert(loc.line == 3 && loc.col == 2);
+        loc = line_table_lookup(&table, 9);
+        assert(loc.line == 4 && loc.col == 3);
+        line_table_free(&table);
+
+        // Long enough to cross the vector loop's lane flush.
+        n = 16 * 300 + 7;
+        big = xmalloc(n);
+        for (size_t i = 0; i < n; ++i) {
+                big[i] = i % 3 == 0 ? '\n' : 'x';
+        }
+        assert(count_newlines(big, n) == (n + 2) / 3);
+        line_table_init(&table, big, n);
+        loc = line_table_lookup(&table, n - 2);
+        assert(loc.line == (n + 2) / 3 && loc.col == 2);
+        line_table_free(&table);
+        xfree(big);
+}
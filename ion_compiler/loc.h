@@ -0,0 +1,43 @@
+#ifndef _LOC_H_
+#define _LOC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Source positions are 32-bit byte offsets from the start of a file, which
+// limits files to 4 GB. Lines and columns are only worked out when a
+// position is printed: the first lookup in a file builds its table of line
+// starts and every lookup is then a binary search.
+
+#define SRCPOS_MAX UINT32_MAX
+
+typedef uint32_t SrcPos;
+
+typedef struct SrcLoc {
+        uint32_t line;
+        uint32_t col;
+} SrcLoc;
+
+typedef struct LineTable {
+        const char *src;
+        size_t len;
+        SrcPos *starts;
+        size_t num_lines;
+} LineTable;
+
+size_t
+count_newlines(const char *src, size_t len);
+
+void
+line_table_init(LineTable *table, const char *src, size_t len);
+
+SrcLoc
+line_table_lookup(LineTable *table, SrcPos pos);
+
+void
+line_table_free(LineTable *table);
+
+void
+loc_test(void);
+
+#endif
@@ -1,18 +1,68 @@
 #include "ast.h"
+#include "cgen.h"
 #include "common.h"
+#include "diag.h"
+#include "driver.h"
+#include "dtoa.h"
+#include "ion.h"
+#include "ir.h"
+#include "jit.h"
 #include "lex.h"
+#include "load.h"
+#include "loc.h"
+#include "parse.h"
+#include "prof.h"
+#include "resolve.h"
+#include "server.h"
+#include "stats.h"
+#include "switch.h"
+#include "sym.h"
+#include "trace.h"
+#include "unicode.h"
+#include "walk.h"
 
 void
 run_tests(void)
 {
         common_test();
+        diag_test();
+        loc_test();
         lex_test();
+        load_test();
         ast_test();
+        walk_test();
+        switch_test();
+        jit_test();
+        ir_test();
+        prof_test();
+        trace_test();
+        unicode_test();
+        dtoa_test();
+        ion_test();
+        cgen_test();
+        parse_test();
+        stats_test();
+        sym_test();
+        resolve_test();
+        server_test();
 }
 
 int
 main(int argc, char **argv)
 {
+        Options opts;
+
+        parse_options(argc, argv, &opts);
+        init_keywords();
+        if (opts.server) {
+                return server_run(opts.socket_path);
+        } else if (opts.path) {
+                return compile(&opts);
+        }
+
+        STAT_PHASE_BEGIN(STATS_PHASE_TESTS);
         run_tests();
+        STAT_PHASE_END(STATS_PHASE_TESTS);
+        print_stats(opts.stats_mode);
         return 0;
 }
@@ -0,0 +1,997 @@
+#include "diag.h"
+#include "parse.h"
+
+// Recursive descent parser for the grammar in syntax.txt. Lists are
+// collected in scratch buffers and copied into the AST arena when done.
+//
+// Syntax errors go to the diagnostics context and parsing carries on. After
+// the first error the parser is in panic mode and stays quiet until it
+// resynchronizes at the next statement, block or declaration, so one
+// mistake produces one message.
+
+static bool panic_mode;
+
+// Stamp a freshly built node with the position it starts at.
+
+static Typespec *
+typespec_at(SrcPos pos, Typespec *type)
+{
+        type->pos = pos;
+        return type;
+}
+
+static Expr *
+expr_at(SrcPos pos, Expr *expr)
+{
+        expr->pos = pos;
+        return expr;
+}
+
+static Stmt *
+stmt_at(SrcPos pos, Stmt *stmt)
+{
+        stmt->pos = pos;
+        return stmt;
+}
+
+static void
+parse_error(const char *fmt, ...)
+{
+        va_list args;
+        char msg[256];
+
+        if (!panic_mode) {
+                va_start(args, fmt);
+                vsnprintf(msg, sizeof(msg), fmt, args);
+                va_end(args);
+                token_error("%s", msg);
+        }
+        panic_mode = true;
+}
+
+static bool
+expect(TokenKind kind)
+{
+        if (panic_mode) {
+                return match_token(kind);
+        }
+        panic_mode = !expect_token(kind);
+        return !panic_mode;
+}
+
+static bool
+is_keyword(const char *name)
+{
+        return is_token_name(name);
+}
+
+static bool
+match_keyword(const char *name)
+{
+        if (is_token_name(name)) {
+                next_token();
+                return true;
+        }
+        return false;
+}
+
+static void
+expect_keyword(const char *name)
+{
+        if (!match_keyword(name)) {
+                parse_error("expected keyword '%s', got %s", name,
+                                token_kind_str(token.kind));
+        }
+}
+
+static const char *
+parse_name(void)
+{
+        const char *name;
+
+        name = is_token(TOKEN_NAME) ? token.name : NULL;
+        expect(TOKEN_NAME);
+        return name;
+}
+
+static Typespec *
+parse_type_func(void)
+{
+        Typespec **args;
+        Typespec *ret;
+
+        args = buf_stack(Typespec *, 8);
+        expect('(');
+        if (!is_token(')')) {
+                sbuf_push(args, parse_type());
+                while (match_token(',')) {
+                        sbuf_push(args, parse_type());
+                }
+        }
+        expect(')');
+        ret = NULL;
+        if (match_token(':')) {
+                ret = parse_type();
+        }
+        return typespec_func(ast_list(args), buf_len(args), ret);
+}
+
+static Typespec *
+parse_type_base(void)
+{
+        Typespec *type;
+
+        if (match_keyword(keyword_func)) {
+                return parse_type_func();
+        } else if (match_token('(')) {
+                type = parse_type();
+                expect(')');
+                return type;
+        }
+        return typespec_name(parse_name());
+}
+
+Typespec *
+parse_type(void)
+{
+        Typespec *type;
+        Expr *size;
+        SrcPos pos;
+
+        pos = token.pos;
+        type = typespec_at(pos, parse_type_base());
+        for (;;) {
+                if (match_token('[')) {
+                        size = NULL;
+                        if (!is_token(']')) {
+                                size = parse_expr();
+                        }
+                        expect(']');
+                        type = typespec_at(pos, typespec_array(type, size));
+                } else if (match_token('*')) {
+                        type = typespec_at(pos, typespec_ptr(type));
+                } else {
+                        return type;
+                }
+        }
+}
+
+static Expr *
+parse_expr_compound(Typespec *type)
+{
+        Expr **args;
+
+        args = buf_stack(Expr *, 8);
+        expect('{');
+        if (!is_token('}')) {
+                sbuf_push(args, parse_expr());
+                while (match_token(',')) {
+                        if (is_token('}')) {
+                                break;
+                        }
+                        sbuf_push(args, parse_expr());
+                }
+        }
+        expect('}');
+        return expr_compound(type, ast_list(args), buf_len(args));
+}
+
+static Expr *
+parse_expr_unary(void);
+
+static Expr *
+parse_expr_operand(void)
+{
+        Typespec *type;
+        Expr *expr;
+        SrcPos pos;
+
+        pos = token.pos;
+        if (is_token(TOKEN_INT)) {
+                expr = expr_int(token.int_val);
+                next_token();
+                return expr;
+        } else if (is_token(TOKEN_FLOAT)) {
+                expr = expr_float(token.float_val);
+                next_token();
+                return expr;
+        } else if (is_token(TOKEN_STR)) {
+                expr = expr_str(token.str_val);
+                next_token();
+                return expr;
+        } else if (match_keyword(keyword_cast)) {
+                expect('(');
+                type = parse_type();
+                expect(')');
+                return expr_cast(type, parse_expr_unary());
+        } else if (is_token(TOKEN_NAME)) {
+                expr = expr_name(parse_name());
+                if (is_token('{')) {
+                        return parse_expr_compound(typespec_at(pos,
+                                                typespec_name(expr->name)));
+                }
+                return expr;
+        } else if (is_token('{')) {
+                return parse_expr_compound(NULL);
+        } else if (match_token('(')) {
+                if (match_token(':')) {
+                        type = parse_type();
+                        expect(')');
+                        return parse_expr_compound(type);
+                }
+                expr = parse_expr();
+                expect(')');
+                return expr;
+        }
+        parse_error("unexpected %s in expression",
+                        token_kind_str(token.kind));
+        return expr_alloc(EXPR_NONE);
+}
+
+static Expr *
+parse_expr_base(void)
+{
+        Expr **args;
+        Expr *expr;
+        Expr *index;
+        SrcPos pos;
+
+        pos = token.pos;
+        expr = expr_at(pos, parse_expr_operand());
+        for (;;) {
+                if (match_token('(')) {
+                        args = buf_stack(Expr *, 8);
+                        if (!is_token(')')) {
+                                sbuf_push(args, parse_expr());
+                                while (match_token(',')) {
+                                        sbuf_push(args, parse_expr());
+                                }
+                        }
+                        expect(')');
+                        expr = expr_at(pos, expr_call(expr, ast_list(args),
+                                                buf_len(args)));
+                } else if (match_token('[')) {
+                        index = parse_expr();
+                        expect(']');
+                        expr = expr_at(pos, expr_index(expr, index));
+                } else if (match_token('.')) {
+                        expr = expr_at(pos, expr_field(expr, parse_name()));
+                } else {
+                        return expr;
+                }
+        }
+}
+
+static bool
+is_unary_op(void)
+{
+        return is_token('+') || is_token('-') || is_token('*') ||
+                is_token('&') || is_token('!') || is_token('~');
+}
+
+static Expr *
+parse_expr_unary(void)
+{
+        TokenKind op;
+        SrcPos pos;
+
+        if (is_unary_op()) {
+                op = token.kind;
+                pos = token.pos;
+                next_token();
+                return expr_at(pos, expr_unary(op, parse_expr_unary()));
+        }
+        return parse_expr_base();
+}
+
+static bool
+is_mul_op(void)
+{
+        return is_token('*') || is_token('/') || is_token('%') ||
+                is_token('&') || is_token(TOKEN_LSHIFT) ||
+                is_token(TOKEN_RSHIFT);
+}
+
+static Expr *
+parse_expr_mul(void)
+{
+        TokenKind op;
+        Expr *expr;
+        SrcPos pos;
+
+        pos = token.pos;
+        expr = parse_expr_unary();
+        while (is_mul_op()) {
+                op = token.kind;
+                next_token();
+                expr = expr_at(pos, expr_binary(op, expr, parse_expr_unary()));
+        }
+        return expr;
+}
+
+static bool
+is_add_op(void)
+{
+        return is_token('+') || is_token('-') || is_token('|') ||
+                is_token('^');
+}
+
+static Expr *
+parse_expr_add(void)
+{
+        TokenKind op;
+        Expr *expr;
+        SrcPos pos;
+
+        pos = token.pos;
+        expr = parse_expr_mul();
+        while (is_add_op()) {
+                op = token.kind;
+                next_token();
+                expr = expr_at(pos, expr_binary(op, expr, parse_expr_mul()));
+        }
+        return expr;
+}
+
+static bool
+is_cmp_op(void)
+{
+        return is_token(TOKEN_EQ) || is_token(TOKEN_NOTEQ) ||
+                is_token('<') || is_token(TOKEN_LTEQ) || is_token('>') ||
+                is_token(TOKEN_GTEQ);
+}
+
+static Expr *
+parse_expr_cmp(void)
+{
+        TokenKind op;
+        Expr *expr;
+        SrcPos pos;
+
+        pos = token.pos;
+        expr = parse_expr_add();
+        while (is_cmp_op()) {
+                op = token.kind;
+                next_token();
+                expr = expr_at(pos, expr_binary(op, expr, parse_expr_add()));
+        }
+        return expr;
+}
+
+static Expr *
+parse_expr_and(void)
+{
+        Expr *expr;
+        SrcPos pos;
+
+        pos = token.pos;
+        expr = parse_expr_cmp();
+        while (match_token(TOKEN_AND)) {
+                expr = expr_at(pos, expr_binary(TOKEN_AND, expr,
+                                        parse_expr_cmp()));
+        }
+        return expr;
+}
+
+static Expr *
+parse_expr_or(void)
+{
+        Expr *expr;
+        SrcPos pos;
+
+        pos = token.pos;
+        expr = parse_expr_and();
+        while (match_token(TOKEN_OR)) {
+                expr = expr_at(pos, expr_binary(TOKEN_OR, expr,
+                                        parse_expr_and()));
+        }
+        return expr;
+}
+
+static Expr *
+parse_expr_ternary(void)
+{
+        Expr *cond;
+        Expr *if_true;
+        SrcPos pos;
+
+        pos = token.pos;
+        cond = parse_expr_or();
+        if (match_token('?')) {
+                if_true = parse_expr_ternary();
+                expect(':');
+                return expr_at(pos, expr_ternary(cond, if_true,
+                                        parse_expr_ternary()));
+        }
+        return cond;
+}
+
+Expr *
+parse_expr(void)
+{
+        return parse_expr_ternary();
+}
+
+static Expr *
+parse_paren_expr(void)
+{
+        Expr *expr;
+
+        expect('(');
+        expr = parse_expr();
+        expect(')');
+        return expr;
+}
+
+StmtBlock
+parse_stmt_block(void)
+{
+        Stmt **stmts;
+
+        stmts = buf_stack(Stmt *, 16);
+        if (expect('{')) {
+                // An opening brace is a safe point to resume reporting.
+                panic_mode = false;
+        }
+        while (!is_token(TOKEN_EOF) && !is_token('}')) {
+                sbuf_push(stmts, parse_stmt());
+        }
+        expect('}');
+        return (StmtBlock) { ast_list(stmts), buf_len(stmts) };
+}
+
+static bool
+is_assign_op(void)
+{
+        return is_token('=') || (token.kind >= TOKEN_ADD_ASSIGN &&
+                        token.kind <= TOKEN_MOD_ASSIGN);
+}
+
+static Stmt *
+parse_simple_stmt(void)
+{
+        TokenKind op;
+        Expr *expr;
+        SrcPos pos;
+
+        pos = token.pos;
+        expr = parse_expr();
+        if (is_token(TOKEN_COLON_ASSIGN)) {
+                if (expr->kind != EXPR_NAME) {
+                        token_error(":= must be preceded by a name");
+                }
+                next_token();
+                return stmt_at(pos, stmt_auto_assign(expr->name, parse_expr()));
+        } else if (is_assign_op()) {
+                op = token.kind;
+                next_token();
+                return stmt_at(pos, stmt_assign(op, expr, parse_expr()));
+        } else if (is_token(TOKEN_INC) || is_token(TOKEN_DEC)) {
+                op = token.kind;
+                next_token();
+                return stmt_at(pos, stmt_assign(op, expr, NULL));
+        }
+        return stmt_at(pos, stmt_expr(expr));
+}
+
+static StmtBlock
+parse_simple_stmt_list(TokenKind end)
+{
+        Stmt **stmts;
+
+        stmts = buf_stack(Stmt *, 4);
+        if (!is_token(end)) {
+                sbuf_push(stmts, parse_simple_stmt());
+                while (match_token(',')) {
+                        sbuf_push(stmts, parse_simple_stmt());
+                }
+        }
+        return (StmtBlock) { ast_list(stmts), buf_len(stmts) };
+}
+
+static Stmt *
+parse_stmt_if(void)
+{
+        Expr *cond;
+        StmtBlock then_block;
+        StmtBlock else_block;
+        ElseIf *elseifs;
+        ElseIf elseif;
+
+        cond = parse_paren_expr();
+        then_block = parse_stmt_block();
+        else_block = (StmtBlock) { 0 };
+        elseifs = buf_stack(ElseIf, 4);
+        while (match_keyword(keyword_else)) {
+                if (!match_keyword(keyword_if)) {
+                        else_block = parse_stmt_block();
+                        break;
+                }
+                elseif.cond = parse_paren_expr();
+                elseif.block = parse_stmt_block();
+                sbuf_push(elseifs, elseif);
+        }
+        return stmt_if(cond, then_block, ast_list(elseifs), buf_len(elseifs),
+                        else_block);
+}
+
+static Stmt *
+parse_stmt_for(void)
+{
+        StmtBlock init;
+        StmtBlock next;
+        Expr *cond;
+
+        expect('(');
+        init = parse_simple_stmt_list(';');
+        expect(';');
+        cond = NULL;
+        if (!is_token(';')) {
+                cond = parse_expr();
+        }
+        expect(';');
+        next = parse_simple_stmt_list(')');
+        expect(')');
+        return stmt_for(init, cond, next, parse_stmt_block());
+}
+
+static Stmt *
+parse_stmt_switch(void)
+{
+        SwitchCase *cases;
+        SwitchCase c;
+        Stmt **stmts;
+        Expr *expr;
+
+        expr = parse_paren_expr();
+        cases = buf_stack(SwitchCase, 16);
+        expect('{');
+        while (!is_token(TOKEN_EOF) && !is_token('}')) {
+                c = (SwitchCase) { 0 };
+                if (match_keyword(keyword_default)) {
+                        c.is_default = true;
+                } else {
+                        expect_keyword(keyword_case);
+                        c.exprs = buf_stack(Expr *, 4);
+                        sbuf_push(c.exprs, parse_expr());
+                        while (match_token(',')) {
+                                sbuf_push(c.exprs, parse_expr());
+                        }
+                        c.num_exprs = buf_len(c.exprs);
+                        c.exprs = ast_list(c.exprs);
+                }
+                expect(':');
+                stmts = buf_stack(Stmt *, 16);
+                while (!is_token(TOKEN_EOF) && !is_token('}') &&
+                                !is_keyword(keyword_case) &&
+                                !is_keyword(keyword_default)) {
+                        sbuf_push(stmts, parse_stmt());
+                }
+                c.block = (StmtBlock) { ast_list(stmts), buf_len(stmts) };
+                sbuf_push(cases, c);
+        }
+        expect('}');
+        return stmt_switch(expr, ast_list(cases), buf_len(cases));
+}
+
+static Stmt *
+parse_stmt_no_sync(void)
+{
+        Stmt *stmt;
+        Expr *expr;
+        StmtBlock block;
+
+        if (match_keyword(keyword_if)) {
+                return parse_stmt_if();
+        } else if (match_keyword(keyword_while)) {
+                expr = parse_paren_expr();
+                return stmt_while(expr, parse_stmt_block());
+        } else if (match_keyword(keyword_do)) {
+                block = parse_stmt_block();
+                expect_keyword(keyword_while);
+                expr = parse_paren_expr();
+                expect(';');
+                return stmt_do(expr, block);
+        } else if (match_keyword(keyword_for)) {
+                return parse_stmt_for();
+        } else if (match_keyword(keyword_switch)) {
+                return parse_stmt_switch();
+        } else if (is_token('{')) {
+                return stmt_block(parse_stmt_block());
+        } else if (match_keyword(keyword_return)) {
+                expr = NULL;
+                if (!is_token(';')) {
+                        expr = parse_expr();
+                }
+                stmt = stmt_return(expr);
+        } else if (match_keyword(keyword_break)) {
+                stmt = stmt_break();
+        } else if (match_keyword(keyword_continue)) {
+                stmt = stmt_continue();
+        } else {
+                stmt = parse_simple_stmt();
+        }
+        if (expect(';')) {
+                // The statement ended where it should have; nothing to skip.
+                panic_mode = false;
+        }
+        return stmt;
+}
+
+// Skips the rest of a statement after an error: past the next ';' or the
+// closing brace of a nested block, or up to the '}' that closes the
+// enclosing one.
+static void
+sync_stmt(void)
+{
+        int depth;
+
+        depth = 0;
+        while (!is_token(TOKEN_EOF)) {
+                if (is_token('}')) {
+                        if (depth == 0) {
+                                break;
+                        }
+                        next_token();
+                        if (--depth == 0) {
+                                break;
+                        }
+                        continue;
+                } else if (is_token(';') && depth == 0) {
+                        next_token();
+                        break;
+                } else if (is_token('{')) {
+                        ++depth;
+                }
+                next_token();
+        }
+        panic_mode = false;
+}
+
+Stmt *
+parse_stmt(void)
+{
+        Stmt *stmt;
+        SrcPos pos;
+
+        pos = token.pos;
+        stmt = stmt_at(pos, parse_stmt_no_sync());
+        if (panic_mode) {
+                sync_stmt();
+        }
+        return stmt;
+}
+
+static Decl *
+parse_decl_enum(void)
+{
+        const char *name;
+        EnumItem *items;
+        EnumItem item;
+
+        name = parse_name();
+        items = buf_stack(EnumItem, 16);
+        expect('{');
+        while (!is_token(TOKEN_EOF) && !is_token('}')) {
+                item.name = parse_name();
+                item.init = NULL;
+                if (match_token('=')) {
+                        item.init = parse_expr();
+                }
+                sbuf_push(items, item);
+                if (!match_token(',')) {
+                        break;
+                }
+        }
+        expect('}');
+        return decl_enum(name, ast_list(items), buf_len(items));
+}
+
+static Decl *
+parse_decl_aggregate(DeclKind kind)
+{
+        const char *name;
+        AggregateItem *items;
+        AggregateItem item;
+
+        name = parse_name();
+        items = buf_stack(AggregateItem, 16);
+        expect('{');
+        while (!is_token(TOKEN_EOF) && !is_token('}')) {
+                item.names = buf_stack(const char *, 4);
+                sbuf_push(item.names, parse_name());
+                while (match_token(',')) {
+                        sbuf_push(item.names, parse_name());
+                }
+                item.num_names = buf_len(item.names);
+                item.names = ast_list(item.names);
+                expect(':');
+                item.type = parse_type();
+                expect(';');
+                sbuf_push(items, item);
+                if (panic_mode) {
+                        break;
+                }
+        }
+        expect('}');
+        return decl_aggregate(kind, name, ast_list(items), buf_len(items));
+}
+
+static Decl *
+parse_decl_var(void)
+{
+        const char *name;
+        Typespec *type;
+        Expr *expr;
+
+        name = parse_name();
+        type = NULL;
+        expr = NULL;
+        if (match_token(':')) {
+                type = parse_type();
+                if (match_token('=')) {
+                        expr = parse_expr();
+                }
+        } else {
+                expect('=');
+                expr = parse_expr();
+        }
+        match_token(';');
+        return decl_var(name, type, expr);
+}
+
+static Decl *
+parse_decl_func(void)
+{
+        const char *name;
+        FuncParam *params;
+        FuncParam param;
+        Typespec *ret_type;
+
+        name = parse_name();
+        params = buf_stack(FuncParam, 8);
+        expect('(');
+        if (!is_token(')')) {
+                do {
+                        param.name = parse_name();
+                        expect(':');
+                        param.type = parse_type();
+                        sbuf_push(params, param);
+                } while (match_token(','));
+        }
+        expect(')');
+        ret_type = NULL;
+        if (match_token(':')) {
+                ret_type = parse_type();
+        }
+        return decl_func(name, ast_list(params), buf_len(params), ret_type,
+                        parse_stmt_block());
+}
+
+static Decl *
+parse_decl_no_sync(void)
+{
+        const char *name;
+        Decl *decl;
+
+        if (match_keyword(keyword_enum)) {
+                return parse_decl_enum();
+        } else if (match_keyword(keyword_struct)) {
+                return parse_decl_aggregate(DECL_STRUCT);
+        } else if (match_keyword(keyword_union)) {
+                return parse_decl_aggregate(DECL_UNION);
+        } else if (match_keyword(keyword_var)) {
+                return parse_decl_var();
+        } else if (match_keyword(keyword_const)) {
+                name = parse_name();
+                expect('=');
+                decl = decl_const(name, parse_expr());
+                match_token(';');
+                return decl;
+        } else if (match_keyword(keyword_typedef)) {
+                name = parse_name();
+                expect('=');
+                decl = decl_typedef(name, parse_type());
+                match_token(';');
+                return decl;
+        } else if (match_keyword(keyword_func)) {
+                return parse_decl_func();
+        }
+        parse_error("expected declaration, got %s",
+                        token_kind_str(token.kind));
+        return NULL;
+}
+
+static bool
+is_decl_keyword(void)
+{
+        return is_keyword(keyword_enum) || is_keyword(keyword_struct) ||
+                is_keyword(keyword_union) || is_keyword(keyword_var) ||
+                is_keyword(keyword_const) || is_keyword(keyword_typedef) ||
+                is_keyword(keyword_func);
+}
+
+// Skips to the next declaration keyword outside of any braces.
+static void
+sync_decl(void)
+{
+        int depth;
+
+        depth = 0;
+        while (!is_token(TOKEN_EOF) && !(depth == 0 && is_decl_keyword())) {
+                if (is_token('{')) {
+                        ++depth;
+                } else if (is_token('}') && depth > 0) {
+                        --depth;
+                }
+                next_token();
+        }
+        panic_mode = false;
+}
+
+// Returns NULL if no declaration could be parsed at all.
+Decl *
+parse_decl(void)
+{
+        Decl *decl;
+        SrcPos pos;
+
+        pos = token.pos;
+        decl = parse_decl_no_sync();
+        if (decl) {
+                decl->pos = pos;
+        }
+        if (panic_mode) {
+                sync_decl();
+        }
+        return decl;
+}
+
+Decl **
+parse_file(void)
+{
+        Decl **decls;
+        Decl *decl;
+        ArenaMark mark;
+
+        // Temporary lists spill into the scratch arena; once a declaration
+        // has been copied into the AST arena its scratch space is reused.
+        decls = NULL;
+        mark = arena_mark(&scratch_arena);
+        panic_mode = false;
+        while (!is_token(TOKEN_EOF)) {
+                decl = parse_decl();
+                if (decl) {
+                        buf_push(decls, decl);
+                }
+                arena_reset(&scratch_arena, mark);
+        }
+        return decls;
+}
+
+static Decl *
+parse_decl_str(const char *str)
+{
+        Decl *decl;
+
+        init_stream(str);
+        decl = parse_decl();
+        assert_token_eof();
+        return decl;
+}
+
+void
+parse_test(void)
+{
+        DiagContext ctx;
+        const char *src;
+        Decl **decls;
+        Decl *d;
+        Stmt *s;
+        Expr *e;
+
+        init_keywords();
+
+        d = parse_decl_str("const N = 1 + 2 * 3");
+        assert(d->kind == DECL_CONST && d->name == str_intern("N"));
+        e = d->const_decl.expr;
+        assert(e->kind == EXPR_BINARY && e->binary.op == '+');
+        assert(e->binary.right->kind == EXPR_BINARY &&
+                        e->binary.right->binary.op == '*');
+
+        // Comparisons bind looser than arithmetic, && looser than ==.
+        d = parse_decl_str("var x = a == b + 1 && c < d ? -e : f[0].g");
+        e = d->var.expr;
+        assert(e->kind == EXPR_TERNARY);
+        assert(e->ternary.cond->binary.op == TOKEN_AND);
+        assert(e->ternary.cond->binary.left->binary.op == TOKEN_EQ);
+        assert(e->ternary.if_true->kind == EXPR_UNARY);
+        assert(e->ternary.if_false->kind == EXPR_FIELD);
+        assert(e->ternary.if_false->field.expr->kind == EXPR_INDEX);
+
+        // Nodes start at their first token.
+        d = parse_decl_str("var y = -a + b[c]");
+        e = d->var.expr;
+        assert(d->pos == 0 && e->pos == 8);
+        assert(e->binary.left->unary.expr->pos == 9);
+        assert(e->binary.right->pos == 13);
+        assert(e->binary.right->index.index->pos == 15);
+
+        d = parse_decl_str("var p: int[16]* = cast(int[16]*) q;");
+        assert(d->var.type->kind == TYPESPEC_PTR);
+        assert(d->var.type->ptr.elem->kind == TYPESPEC_ARRAY);
+        assert(d->var.expr->kind == EXPR_CAST);
+
+        d = parse_decl_str("typedef Handler = func(int, char*): bool");
+        assert(d->typedef_decl.type->kind == TYPESPEC_FUNC);
+        assert(d->typedef_decl.type->func.num_args == 2);
+
+        d = parse_decl_str("enum Color { RED = 1, GREEN, BLUE, }");
+        assert(d->kind == DECL_ENUM && d->enum_decl.num_items == 3);
+        assert(d->enum_decl.items[0].init->int_val == 1);
+
+        d = parse_decl_str("struct Vec { x, y: float; next: Vec*; }");
+        assert(d->kind == DECL_STRUCT && d->aggregate.num_items == 2);
+        assert(d->aggregate.items[0].num_names == 2);
+
+        d = parse_decl_str("var v = Vec{1, 2}");
+        assert(d->var.expr->kind == EXPR_COMPOUND);
+        assert(d->var.expr->compound.num_args == 2);
+        d = parse_decl_str("var a = (:int[2]){3, 4}");
+        assert(d->var.expr->compound.type->kind == TYPESPEC_ARRAY);
+
+        d = parse_decl_str(
+                "func fact(n: int): int {\n"
+                "    r := 1;\n"
+                "    for (i := 1; i <= n; i++) { r *= i; }\n"
+                "    while (n > 0) { n--; if (n == 3) { break; } }\n"
+                "    do { n += 1; } while (n < 10);\n"
+                "    if (n == 0) { return 1; }\n"
+                "    else if (n == 1) { return 2; }\n"
+                "    else { n = n - 1; }\n"
+                "    switch (n) {\n"
+                "    case 1, 2: return 3;\n"
+                "    default: f(n, 2); continue;\n"
+                "    }\n"
+                "    return r;\n"
+                "}");
+        assert(d->kind == DECL_FUNC && d->func.num_params == 1);
+        assert(d->func.block.num_stmts == 7);
+        s = d->func.block.stmts[0];
+        assert(s->kind == STMT_AUTO_ASSIGN);
+        s = d->func.block.stmts[1];
+        assert(s->kind == STMT_FOR && s->for_stmt.init.num_stmts == 1);
+        assert(s->for_stmt.next.stmts[0]->assign.op == TOKEN_INC);
+        assert(d->func.block.stmts[2]->kind == STMT_WHILE);
+        assert(d->func.block.stmts[3]->kind == STMT_DO);
+        s = d->func.block.stmts[4];
+        assert(s->kind == STMT_IF && s->if_stmt.num_elseifs == 1);
+        assert(s->if_stmt.else_block.num_stmts == 1);
+        s = d->func.block.stmts[5];
+        assert(s->kind == STMT_SWITCH && s->switch_stmt.num_cases == 2);
+        assert(s->switch_stmt.cases[0].num_exprs == 2);
+        assert(s->switch_stmt.cases[1].is_default);
+        assert(s->switch_stmt.cases[1].block.num_stmts == 2);
+
+        init_stream("func f() {} var x = 1; const y = 2");
+        decls = parse_file();
+        assert(buf_len(decls) == 3);
+        assert(decls[2]->kind == DECL_CONST);
+        buf_free(decls);
+
+        src = "func f() { x := ; y = 1; }\n"
+                "var a = @;\n"
+                "struct S { a: int; b: ; }\n"
+                "func g(): int { return 1 }\n"
+                "const c = 2;\n"
+                "(x) func h() {}\n";
+        diag_begin(&ctx, "bad.ion", src);
+        init_stream(src);
+        decls = parse_file();
+        assert(diag_num_errors() == 5);
+        assert(buf_len(decls) == 6);
+        assert(decls[0]->func.block.num_stmts == 2);
+        assert(decls[4]->kind == DECL_CONST && decls[5]->kind == DECL_FUNC);
+        buf_free(decls);
+        diag_free(&ctx);
+}
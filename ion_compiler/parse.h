@@ -0,0 +1,29 @@
+#ifndef _PARSE_H_
+#define _PARSE_H_
+
+#include "ast.h"
+#include "common.h"
+#include "lex.h"
+
+Typespec *
+parse_type(void);
+
+Expr *
+parse_expr(void);
+
+Stmt *
+parse_stmt(void);
+
+StmtBlock
+parse_stmt_block(void);
+
+Decl *
+parse_decl(void);
+
+Decl **
+parse_file(void);
+
+void
+parse_test(void);
+
+#endif
@@ -0,0 +1,235 @@
+#define _DEFAULT_SOURCE
+
+#include <inttypes.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "prof.h"
+#include "stats.h"
+
+typedef struct ProfStack {
+        uint32_t phases;
+        const char *file;
+        const char *decl;
+        uint64_t count;
+} ProfStack;
+
+volatile uint32_t prof_stack;
+const char *volatile prof_file;
+const char *volatile prof_decl;
+
+// Filled in by the handler, so it is a fixed table probed linearly rather
+// than anything that allocates. A stack with no slot left, or a sample
+// that comes in while another thread's is being counted, is dropped.
+static ProfStack prof_stacks[PROF_MAX_STACKS];
+static uint64_t prof_num_samples;
+static uint64_t prof_dropped;
+static char prof_busy;
+static struct sigaction prof_saved_action;
+
+// Each phase starts with no declaration; the passes that go through
+// declarations one by one set prof_decl as they go.
+void
+prof_enter(int phase)
+{
+        prof_stack = prof_stack << 4 | (uint32_t) (phase + 1);
+        prof_decl = NULL;
+}
+
+void
+prof_leave(void)
+{
+        prof_stack >>= 4;
+        prof_decl = NULL;
+}
+
+// The path is interned, so that it outlives the file it names.
+void
+prof_set_file(const char *path)
+{
+        prof_file = path ? str_intern(path) : NULL;
+        prof_decl = NULL;
+}
+
+static void
+prof_handler(int sig)
+{
+        uint32_t phases;
+        const char *file;
+        const char *decl;
+        uint64_t hash;
+        ProfStack *it;
+
+        (void) sig;
+        if (__atomic_test_and_set(&prof_busy, __ATOMIC_ACQUIRE)) {
+                __atomic_add_fetch(&prof_dropped, 1, __ATOMIC_RELAXED);
+                return;
+        }
+        phases = prof_stack;
+        file = prof_file;
+        decl = prof_decl;
+        hash = (phases * 0x9E3779B97F4A7C15ull) ^ (uintptr_t) file ^
+                ((uintptr_t) decl >> 3) * 31;
+        for (size_t i = 0; i < PROF_MAX_STACKS; ++i) {
+                it = &prof_stacks[(hash + i) % PROF_MAX_STACKS];
+                if (it->count == 0) {
+                        *it = (ProfStack) { phases, file, decl, 0 };
+                }
+                if (it->phases == phases && it->file == file &&
+                                it->decl == decl) {
+                        ++it->count;
+                        ++prof_num_samples;
+                        __atomic_clear(&prof_busy, __ATOMIC_RELEASE);
+                        return;
+                }
+        }
+        ++prof_dropped;
+        __atomic_clear(&prof_busy, __ATOMIC_RELEASE);
+}
+
+// Clears the counts and starts sampling. Returns false if the timer could
+// not be set up.
+bool
+prof_start(void)
+{
+        struct sigaction action;
+        struct itimerval timer;
+
+        memset(prof_stacks, 0, sizeof(prof_stacks));
+        prof_num_samples = 0;
+        prof_dropped = 0;
+        action = (struct sigaction) { .sa_handler = prof_handler };
+        // Restarting the calls a sample interrupts keeps reads and waits
+        // from failing with EINTR.
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, &prof_saved_action) != 0) {
+                return false;
+        }
+        timer.it_interval = (struct timeval) { 0, PROF_INTERVAL_US };
+        timer.it_value = timer.it_interval;
+        if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+                sigaction(SIGPROF, &prof_saved_action, NULL);
+                return false;
+        }
+        return true;
+}
+
+void
+prof_stop(void)
+{
+        struct itimerval timer = { 0 };
+
+        setitimer(ITIMER_PROF, &timer, NULL);
+        sigaction(SIGPROF, &prof_saved_action, NULL);
+}
+
+uint64_t
+prof_samples(void)
+{
+        return __atomic_load_n(&prof_num_samples, __ATOMIC_RELAXED);
+}
+
+static int
+cmp_line(const void *a, const void *b)
+{
+        return strcmp(*(char **) a, *(char **) b);
+}
+
+// Writes the stacks sorted by name, outermost phase first. Samples taken
+// outside any phase are counted under "other".
+void
+prof_write(Writer *w)
+{
+        char **lines;
+        char *line;
+        char *tmp;
+        ProfStack *it;
+        int shift;
+
+        lines = NULL;
+        for (it = prof_stacks; it != prof_stacks + PROF_MAX_STACKS; ++it) {
+                if (it->count == 0) {
+                        continue;
+                }
+                line = strf("%s", it->phases ? "" : "other");
+                for (shift = 28; shift >= 0; shift -= 4) {
+                        uint32_t phase = it->phases >> shift & 0xF;
+
+                        if (phase) {
+                                tmp = strf("%s%s%s", line, *line ? ";" : "",
+                                                stats_phase_names[phase - 1]);
+                                xfree(line);
+                                line = tmp;
+                        }
+                }
+                if (it->file) {
+                        tmp = strf("%s;%s", line, it->file);
+                        xfree(line);
+                        line = tmp;
+                }
+                if (it->decl) {
+                        tmp = strf("%s;%s", line, it->decl);
+                        xfree(line);
+                        line = tmp;
+                }
+                tmp = strf("%s %" PRIu64 "\n", line, it->count);
+                xfree(line);
+                buf_push(lines, tmp);
+        }
+        if (lines) {
+                qsort(lines, buf_len(lines), sizeof(*lines), cmp_line);
+        }
+        for (size_t i = 0; i < buf_len(lines); ++i) {
+                writer_printf(w, "%s", lines[i]);
+                xfree(lines[i]);
+        }
+        buf_free(lines);
+}
+
+void
+prof_test(void)
+{
+        volatile uint64_t x;
+        uint32_t saved_stack;
+        clock_t start;
+        Writer *w;
+
+        // Spin under a known phase, file and declaration until a few
+        // samples have landed, giving up after two seconds of CPU time.
+        saved_stack = prof_stack;
+        assert(prof_start());
+        prof_enter(STATS_PHASE_PARSE);
+        prof_set_file("prof.ion");
+        prof_decl = str_intern("spin");
+        start = clock();
+        x = 0;
+        while (prof_samples() < 3 && clock() - start < 2 * CLOCKS_PER_SEC) {
+                for (int i = 0; i < 100000; ++i) {
+                        x += i;
+                }
+        }
+        prof_leave();
+        prof_set_file(NULL);
+        prof_stop();
+        assert(prof_stack == saved_stack);
+
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, -1);
+        prof_write(w);
+        writer_flush(w);
+        assert(prof_samples() >= 3);
+        assert(strstr(w->mem, "parse;prof.ion;spin "));
+        writer_free(w);
+        xfree(w);
+
+        // Phases nest outermost first, and stop counting once left.
+        prof_enter(STATS_PHASE_CGEN);
+        prof_enter(STATS_PHASE_IR);
+        assert((prof_stack & 0xFF) == ((STATS_PHASE_CGEN + 1) << 4 |
+                                (STATS_PHASE_IR + 1)));
+        prof_leave();
+        prof_leave();
+        assert(prof_stack == saved_stack);
+}
@@ -0,0 +1,53 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+
+// Sampling profiler. While it runs, SIGPROF interrupts the process every
+// PROF_INTERVAL_US of CPU time, and the handler counts a sample against
+// the phases, file and declaration the compiler is working on. prof_write
+// gives the counts as collapsed stacks, "phase;...;file;decl count" per
+// line, which is what flamegraph.pl and speedscope read.
+
+#define PROF_INTERVAL_US 1000
+#define PROF_MAX_STACKS 4096
+// Phases nest at most this deep; each takes 4 bits of prof_stack.
+#define PROF_MAX_DEPTH 8
+
+// Where the main thread is, kept up to date whether or not the profiler
+// runs. A sample that interrupts a lexer or loader thread is counted
+// against these too, since that thread works for the main thread's file.
+// prof_stack holds one more than each running phase, innermost in the
+// low bits, so that the handler reads the whole stack in one load.
+extern volatile uint32_t prof_stack;
+extern const char *volatile prof_file;
+extern const char *volatile prof_decl;
+
+void
+prof_enter(int phase);
+
+void
+prof_leave(void);
+
+void
+prof_set_file(const char *path);
+
+bool
+prof_start(void);
+
+void
+prof_stop(void);
+
+uint64_t
+prof_samples(void);
+
+void
+prof_write(Writer *w);
+
+void
+prof_test(void);
+
+#endif
@@ -0,0 +1,556 @@
+#include "diag.h"
+#include "parse.h"
+#include "prof.h"
+#include "resolve.h"
+#include "stats.h"
+
+static const char *builtin_type_names[] = {
+        "void", "bool", "char", "int", "uint", "long", "ulong", "int8",
+        "uint8", "int16", "uint16", "int32", "uint32", "int64", "uint64",
+        "float", "double",
+};
+
+#define NUM_BUILTIN_TYPES (sizeof(builtin_type_names) / \
+                sizeof(*builtin_type_names))
+
+static const char *builtin_types[NUM_BUILTIN_TYPES];
+
+static void
+resolve_decl(Resolver *r, uint32_t index);
+
+static void
+resolve_expr(Resolver *r, uint32_t from, Expr *expr);
+
+static void
+resolve_block(Resolver *r, uint32_t from, StmtBlock block);
+
+static void
+resolve_error(SrcPos pos, const char *name, const char *fmt, ...)
+{
+        const char *start;
+        va_list args;
+
+        start = diag_ctx->src ? diag_ctx->src + pos : NULL;
+        va_start(args, fmt);
+        diag_verror(start, start ? start + strlen(name) : NULL, fmt, args);
+        va_end(args);
+}
+
+static void
+add_global(Resolver *r, const char *name, uint32_t index, SrcPos pos)
+{
+        SymbolId id;
+
+        id = symbol_id(name);
+        while (buf_len(r->globals) <= id) {
+                buf_push(r->globals, 0);
+        }
+        if (r->globals[id]) {
+                resolve_error(pos, name, "redefinition of '%s'", name);
+                return;
+        }
+        r->globals[id] = index + 1;
+}
+
+static uint32_t
+find_global(Resolver *r, const char *name)
+{
+        SymbolId id;
+
+        id = symbol_id(name);
+        return id < buf_len(r->globals) ? r->globals[id] : 0;
+}
+
+// Indexes decls by name. Enum items name their enum.
+void
+resolver_init(Resolver *r, Decl **decls, size_t num_decls)
+{
+        Decl *decl;
+
+        *r = (Resolver) { 0 };
+        for (size_t i = 0; i < NUM_BUILTIN_TYPES; ++i) {
+                builtin_types[i] = str_intern(builtin_type_names[i]);
+        }
+        r->decls = xcalloc(num_decls, sizeof(ResolvedDecl));
+        r->num_decls = num_decls;
+        for (uint32_t i = 0; i < num_decls; ++i) {
+                decl = decls[i];
+                r->decls[i].decl = decl;
+                add_global(r, decl->name, i, decl->pos);
+                if (decl->kind == DECL_ENUM) {
+                        for (size_t j = 0; j < decl->enum_decl.num_items;
+                                        ++j) {
+                                add_global(r, decl->enum_decl.items[j].name,
+                                                i, decl->pos);
+                        }
+                }
+        }
+}
+
+static bool
+is_type_decl(Decl *decl)
+{
+        return decl->kind == DECL_STRUCT || decl->kind == DECL_UNION ||
+                decl->kind == DECL_ENUM || decl->kind == DECL_TYPEDEF;
+}
+
+// Records that from refers to the declaration at index. If eager, that
+// declaration must be resolved now; otherwise it is queued. Enum items may
+// refer to their own enum.
+static void
+add_ref(Resolver *r, uint32_t from, uint32_t index, bool eager)
+{
+        ResolvedDecl *rd;
+        uint32_t *it;
+
+        if (index == from) {
+                return;
+        }
+        rd = &r->decls[from];
+        for (it = rd->refs; it != buf_end(rd->refs) && *it != index; ++it) {
+        }
+        if (it == buf_end(rd->refs)) {
+                buf_push(rd->refs, index);
+        }
+
+        if (eager) {
+                resolve_decl(r, index);
+        } else if (r->decls[index].state == RESOLVE_UNRESOLVED) {
+                buf_push(r->pending, index);
+        }
+}
+
+static void
+resolve_type_name(Resolver *r, uint32_t from, Typespec *type, bool eager)
+{
+        uint32_t index;
+
+        for (size_t i = 0; i < NUM_BUILTIN_TYPES; ++i) {
+                if (type->name == builtin_types[i]) {
+                        return;
+                }
+        }
+        index = find_global(r, type->name);
+        if (!index) {
+                resolve_error(type->pos, type->name, "undeclared type '%s'",
+                                type->name);
+        } else if (!is_type_decl(r->decls[index - 1].decl) ||
+                        r->decls[index - 1].decl->name != type->name) {
+                resolve_error(type->pos, type->name, "'%s' is not a type",
+                                type->name);
+        } else {
+                add_ref(r, from, index - 1, eager);
+        }
+}
+
+// Anything behind a pointer only needs to exist.
+static void
+resolve_typespec(Resolver *r, uint32_t from, Typespec *type, bool eager)
+{
+        if (!type) {
+                return;
+        }
+        switch (type->kind) {
+        case TYPESPEC_NAME:
+                resolve_type_name(r, from, type, eager);
+                break;
+        case TYPESPEC_FUNC:
+                for (size_t i = 0; i < type->func.num_args; ++i) {
+                        resolve_typespec(r, from, type->func.args[i], eager);
+                }
+                resolve_typespec(r, from, type->func.ret, eager);
+                break;
+        case TYPESPEC_ARRAY:
+                resolve_typespec(r, from, type->array.elem, eager);
+                resolve_expr(r, from, type->array.size);
+                break;
+        case TYPESPEC_PTR:
+                resolve_typespec(r, from, type->ptr.elem, false);
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+resolve_name(Resolver *r, uint32_t from, Expr *expr)
+{
+        uint32_t index;
+        Decl *decl;
+
+        if (sym_lookup(&r->locals, expr->name)) {
+                return;
+        }
+        index = find_global(r, expr->name);
+        if (!index) {
+                resolve_error(expr->pos, expr->name, "undeclared name '%s'",
+                                expr->name);
+                return;
+        }
+        decl = r->decls[index - 1].decl;
+        if (is_type_decl(decl) && decl->name == expr->name) {
+                resolve_error(expr->pos, expr->name, "'%s' is a type",
+                                expr->name);
+                return;
+        }
+        // Inside a function body nothing needs resolving first.
+        add_ref(r, from, index - 1, buf_len(r->locals.scopes) == 0);
+}
+
+static void
+resolve_expr(Resolver *r, uint32_t from, Expr *expr)
+{
+        bool eager;
+
+        if (!expr) {
+                return;
+        }
+        eager = buf_len(r->locals.scopes) == 0;
+        switch (expr->kind) {
+        case EXPR_NAME:
+                resolve_name(r, from, expr);
+                break;
+        case EXPR_CAST:
+                resolve_typespec(r, from, expr->cast.type, eager);
+                resolve_expr(r, from, expr->cast.expr);
+                break;
+        case EXPR_CALL:
+                resolve_expr(r, from, expr->call.expr);
+                for (size_t i = 0; i < expr->call.num_args; ++i) {
+                        resolve_expr(r, from, expr->call.args[i]);
+                }
+                break;
+        case EXPR_INDEX:
+                resolve_expr(r, from, expr->index.expr);
+                resolve_expr(r, from, expr->index.index);
+                break;
+        case EXPR_FIELD:
+                // Fields need types to be looked up.
+                resolve_expr(r, from, expr->field.expr);
+                break;
+        case EXPR_COMPOUND:
+                resolve_typespec(r, from, expr->compound.type, eager);
+                for (size_t i = 0; i < expr->compound.num_args; ++i) {
+                        resolve_expr(r, from, expr->compound.args[i]);
+                }
+                break;
+        case EXPR_UNARY:
+                resolve_expr(r, from, expr->unary.expr);
+                break;
+        case EXPR_BINARY:
+                resolve_expr(r, from, expr->binary.left);
+                resolve_expr(r, from, expr->binary.right);
+                break;
+        case EXPR_TERNARY:
+                resolve_expr(r, from, expr->ternary.cond);
+                resolve_expr(r, from, expr->ternary.if_true);
+                resolve_expr(r, from, expr->ternary.if_false);
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+resolve_stmt(Resolver *r, uint32_t from, Stmt *stmt)
+{
+        switch (stmt->kind) {
+        case STMT_RETURN:
+        case STMT_EXPR:
+                resolve_expr(r, from, stmt->expr);
+                break;
+        case STMT_BLOCK:
+                resolve_block(r, from, stmt->block);
+                break;
+        case STMT_IF:
+                resolve_expr(r, from, stmt->if_stmt.cond);
+                resolve_block(r, from, stmt->if_stmt.then_block);
+                for (size_t i = 0; i < stmt->if_stmt.num_elseifs; ++i) {
+                        resolve_expr(r, from, stmt->if_stmt.elseifs[i].cond);
+                        resolve_block(r, from,
+                                        stmt->if_stmt.elseifs[i].block);
+                }
+                resolve_block(r, from, stmt->if_stmt.else_block);
+                break;
+        case STMT_WHILE:
+        case STMT_DO:
+                resolve_expr(r, from, stmt->while_stmt.cond);
+                resolve_block(r, from, stmt->while_stmt.block);
+                break;
+        case STMT_FOR:
+                // Names declared in the header are visible in the loop.
+                sym_push_scope(&r->locals);
+                for (size_t i = 0; i < stmt->for_stmt.init.num_stmts; ++i) {
+                        resolve_stmt(r, from, stmt->for_stmt.init.stmts[i]);
+                }
+                resolve_expr(r, from, stmt->for_stmt.cond);
+                resolve_block(r, from, stmt->for_stmt.next);
+                resolve_block(r, from, stmt->for_stmt.block);
+                sym_pop_scope(&r->locals);
+                break;
+        case STMT_SWITCH:
+                resolve_expr(r, from, stmt->switch_stmt.expr);
+                for (size_t i = 0; i < stmt->switch_stmt.num_cases; ++i) {
+                        SwitchCase *c = &stmt->switch_stmt.cases[i];
+
+                        for (size_t j = 0; j < c->num_exprs; ++j) {
+                                resolve_expr(r, from, c->exprs[j]);
+                        }
+                        resolve_block(r, from, c->block);
+                }
+                break;
+        case STMT_ASSIGN:
+                resolve_expr(r, from, stmt->assign.left);
+                resolve_expr(r, from, stmt->assign.right);
+                break;
+        case STMT_AUTO_ASSIGN:
+                resolve_expr(r, from, stmt->autoassign.init);
+                if (!sym_bind(&r->locals, stmt->autoassign.name, SYM_LOCAL)) {
+                        resolve_error(stmt->pos, stmt->autoassign.name,
+                                        "redefinition of '%s'",
+                                        stmt->autoassign.name);
+                } else {
+                        sym_lookup(&r->locals, stmt->autoassign.name)->local =
+                                stmt;
+                }
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+resolve_block(Resolver *r, uint32_t from, StmtBlock block)
+{
+        sym_push_scope(&r->locals);
+        for (size_t i = 0; i < block.num_stmts; ++i) {
+                resolve_stmt(r, from, block.stmts[i]);
+        }
+        sym_pop_scope(&r->locals);
+}
+
+static void
+resolve_func_body(Resolver *r, uint32_t index)
+{
+        FuncDecl *func;
+        Sym *sym;
+
+        func = &r->decls[index].decl->func;
+        prof_decl = r->decls[index].decl->name;
+        sym_push_scope(&r->locals);
+        for (size_t i = 0; i < func->num_params; ++i) {
+                sym = sym_bind(&r->locals, func->params[i].name, SYM_PARAM);
+                if (!sym) {
+                        resolve_error(r->decls[index].decl->pos,
+                                        func->params[i].name,
+                                        "duplicate parameter '%s'",
+                                        func->params[i].name);
+                } else {
+                        sym->param = &func->params[i];
+                }
+        }
+        resolve_block(r, index, func->block);
+        sym_pop_scope(&r->locals);
+}
+
+static void
+resolve_decl(Resolver *r, uint32_t index)
+{
+        ResolvedDecl *rd;
+        Decl *decl;
+
+        rd = &r->decls[index];
+        decl = rd->decl;
+        if (rd->state == RESOLVE_RESOLVED) {
+                return;
+        } else if (rd->state == RESOLVE_RESOLVING) {
+                resolve_error(decl->pos, decl->name,
+                                "cyclic dependency on '%s'", decl->name);
+                return;
+        }
+
+        rd->state = RESOLVE_RESOLVING;
+        switch (decl->kind) {
+        case DECL_ENUM:
+                for (size_t i = 0; i < decl->enum_decl.num_items; ++i) {
+                        resolve_expr(r, index, decl->enum_decl.items[i].init);
+                }
+                break;
+        case DECL_STRUCT:
+        case DECL_UNION:
+                for (size_t i = 0; i < decl->aggregate.num_items; ++i) {
+                        resolve_typespec(r, index,
+                                        decl->aggregate.items[i].type, true);
+                }
+                break;
+        case DECL_VAR:
+                resolve_typespec(r, index, decl->var.type, true);
+                resolve_expr(r, index, decl->var.expr);
+                break;
+        case DECL_CONST:
+                resolve_expr(r, index, decl->const_decl.expr);
+                break;
+        case DECL_TYPEDEF:
+                resolve_typespec(r, index, decl->typedef_decl.type, true);
+                break;
+        case DECL_FUNC:
+                for (size_t i = 0; i < decl->func.num_params; ++i) {
+                        resolve_typespec(r, index, decl->func.params[i].type,
+                                        true);
+                }
+                resolve_typespec(r, index, decl->func.ret_type, true);
+                buf_push(r->bodies, index);
+                break;
+        default:
+                break;
+        }
+        rd->state = RESOLVE_RESOLVED;
+        ++r->num_resolved;
+}
+
+// Resolves everything queued so far.
+static void
+resolve_pending(Resolver *r)
+{
+        uint32_t index;
+
+        while (buf_len(r->pending) || buf_len(r->bodies)) {
+                if (buf_len(r->bodies)) {
+                        index = r->bodies[buf_len(r->bodies) - 1];
+                        buf_trunc(r->bodies, buf_len(r->bodies) - 1);
+                        resolve_func_body(r, index);
+                } else {
+                        index = r->pending[buf_len(r->pending) - 1];
+                        buf_trunc(r->pending, buf_len(r->pending) - 1);
+                        resolve_decl(r, index);
+                }
+        }
+}
+
+// Resolves the declaration called name and everything it reaches. Returns
+// false if there is no such declaration.
+bool
+resolve_entry(Resolver *r, const char *name)
+{
+        uint32_t index;
+
+        index = find_global(r, str_intern(name));
+        if (!index) {
+                return false;
+        }
+        resolve_decl(r, index - 1);
+        resolve_pending(r);
+        return true;
+}
+
+void
+resolve_all(Resolver *r)
+{
+        for (uint32_t i = 0; i < r->num_decls; ++i) {
+                resolve_decl(r, i);
+                resolve_pending(r);
+        }
+}
+
+// The declarations resolved so far, which are those reachable from the
+// entry points, in their original order. The caller frees the buffer.
+Decl **
+resolve_live_decls(Resolver *r)
+{
+        Decl **live;
+
+        live = NULL;
+        buf__fit(live, r->num_resolved);
+        for (size_t i = 0; i < r->num_decls; ++i) {
+                if (r->decls[i].state == RESOLVE_RESOLVED) {
+                        buf_push(live, r->decls[i].decl);
+                }
+        }
+        return live;
+}
+
+void
+resolver_free(Resolver *r)
+{
+        for (size_t i = 0; i < r->num_decls; ++i) {
+                buf_free(r->decls[i].refs);
+        }
+        xfree(r->decls);
+        buf_free(r->globals);
+        buf_free(r->pending);
+        buf_free(r->bodies);
+        sym_table_free(&r->locals);
+}
+
+static size_t
+resolve_src(const char *src, const char *entry, Resolver *r)
+{
+        DiagContext ctx;
+        Decl **decls;
+        size_t errors;
+
+        diag_begin(&ctx, "resolve.ion", src);
+        init_stream(src);
+        decls = parse_file();
+        assert(diag_num_errors() == 0);
+        resolver_init(r, decls, buf_len(decls));
+        if (!entry || !resolve_entry(r, entry)) {
+                resolve_all(r);
+        }
+        errors = diag_num_errors();
+        buf_free(decls);
+        diag_free(&ctx);
+        return errors;
+}
+
+void
+resolve_test(void)
+{
+        Resolver r;
+        Decl **live;
+
+        // Only what main reaches is resolved, in any order, and functions
+        // may call each other.
+        assert(resolve_src(
+                        "func main(): int { return even(N); }\n"
+                        "func even(n: int): int { return n ? odd(n - 1) : 1; }\n"
+                        "func odd(n: int): int { return n ? even(n - 1) : 0; }\n"
+                        "const N = M + 1;\n"
+                        "const M = 2;\n"
+                        "struct Node { next: Node*; v: Vec; }\n"
+                        "struct Vec { x: int; y: int; }\n"
+                        "func unused(): Nope { return what; }\n",
+                        "main", &r) == 0);
+        assert(r.num_resolved == 5);
+        assert(r.decls[7].state == RESOLVE_UNRESOLVED);
+        assert(buf_len(r.decls[0].refs) == 2);
+        // Exports keep what they reach alive as well.
+        assert(resolve_entry(&r, "Node"));
+        live = resolve_live_decls(&r);
+        assert(buf_len(live) == 7);
+        assert(live[0] == r.decls[0].decl && live[6] == r.decls[6].decl);
+        buf_free(live);
+        resolver_free(&r);
+
+        // Locals shadow globals and go out of scope with their block.
+        assert(resolve_src(
+                        "var x: int;\n"
+                        "func f(a: int): int {\n"
+                        "    for (i := 0; i < a; i++) { x := i; x += a; }\n"
+                        "    if (a) { y := 1; } else { y := 2; }\n"
+                        "    return y;\n"
+                        "}\n",
+                        NULL, &r) == 1);
+        resolver_free(&r);
+
+        assert(resolve_src(
+                        "const A = B;\n"
+                        "const B = A;\n"
+                        "struct S { t: T; }\n"
+                        "struct T { s: S; }\n"
+                        "enum E { P = 1, Q = P }\n"
+                        "var v: main;\n"
+                        "func main() { E := 1; E := 2; }\n",
+                        NULL, &r) == 4);
+        resolver_free(&r);
+}
@@ -0,0 +1,61 @@
+#ifndef _RESOLVE_H_
+#define _RESOLVE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "common.h"
+#include "sym.h"
+
+// Name resolution. resolver_init only indexes the top-level declarations
+// by name; a declaration is resolved when an entry point reaches it.
+// Constants, variables, types and function signatures need whatever they
+// name resolved first, so a cycle among them is an error. Pointer targets
+// and function bodies only need their names to exist: what they refer to
+// is queued and resolved later, which lets structs point to themselves and
+// functions call each other.
+
+typedef enum ResolveState {
+        RESOLVE_UNRESOLVED,
+        RESOLVE_RESOLVING,
+        RESOLVE_RESOLVED
+} ResolveState;
+
+typedef struct ResolvedDecl {
+        Decl *decl;
+        ResolveState state;
+        // Indices of the declarations this one refers to, each listed once.
+        uint32_t *refs;
+} ResolvedDecl;
+
+typedef struct Resolver {
+        ResolvedDecl *decls;
+        size_t num_decls;
+        // Index + 1 of the declaration each symbol ID names, or 0.
+        uint32_t *globals;
+        uint32_t *pending;
+        uint32_t *bodies;
+        SymTable locals;
+        size_t num_resolved;
+} Resolver;
+
+void
+resolver_init(Resolver *r, Decl **decls, size_t num_decls);
+
+bool
+resolve_entry(Resolver *r, const char *name);
+
+void
+resolve_all(Resolver *r);
+
+Decl **
+resolve_live_decls(Resolver *r);
+
+void
+resolver_free(Resolver *r);
+
+void
+resolve_test(void);
+
+#endif
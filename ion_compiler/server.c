@@ -0,0 +1,484 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "driver.h"
+#include "server.h"
+#include "stats.h"
+
+// The server keeps the intern table, keywords and parsed files warm across
+// requests. Each request counts as one generation: scratch memory is reset
+// after every request, cached files remember the last generation that
+// used them, and files left idle too long or beyond the cache budget are
+// dropped together with their AST arenas. Interned strings are never
+// freed one by one, so once the table outgrows its budget the whole cache
+// goes and interning starts over.
+
+#define CACHE_MAX_IDLE 256
+#define CACHE_BUDGET (256 << 20)
+#define SCRATCH_KEEP (4 << 20)
+#define INTERN_BUDGET (64 << 20)
+
+typedef struct CacheEntry {
+        SourceFile *file;
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+        size_t bytes;
+        uint64_t generation;
+} CacheEntry;
+
+static CacheEntry *cache;
+static size_t cache_bytes;
+static uint64_t generation;
+static volatile sig_atomic_t server_stop;
+
+static void
+cache_evict(CacheEntry *entry)
+{
+        cache_bytes -= entry->bytes;
+        source_free(entry->file);
+        *entry = cache[buf_len(cache) - 1];
+        buf_trunc(cache, buf_len(cache) - 1);
+}
+
+// Serves unchanged files from the cache. Files are identified by device
+// and inode, so any spelling of the path hits the same entry.
+static SourceFile *
+cache_load(const char *path)
+{
+        CacheEntry *entry;
+        SourceFile *file;
+        struct stat st;
+
+        if (stat(path, &st) != 0) {
+                return NULL;
+        }
+        for (entry = cache; entry != buf_end(cache); ++entry) {
+                if (entry->dev == st.st_dev && entry->ino == st.st_ino) {
+                        break;
+                }
+        }
+        if (entry != buf_end(cache)) {
+                if (entry->size == st.st_size &&
+                                entry->mtime.tv_sec == st.st_mtim.tv_sec &&
+                                entry->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+                        entry->generation = generation;
+                        return entry->file;
+                }
+                cache_evict(entry);
+        }
+
+        file = source_parse(path);
+        if (file && file->diags.num_errors == 0) {
+                buf_push(cache, ((CacheEntry) { file, st.st_dev, st.st_ino,
+                                        st.st_size, st.st_mtim,
+                                        source_size(file), generation }));
+                cache_bytes += buf_end(cache)[-1].bytes;
+        }
+        return file;
+}
+
+static void
+cache_release(SourceFile *file)
+{
+        for (CacheEntry *it = cache; it != buf_end(cache); ++it) {
+                if (it->file == file) {
+                        return;
+                }
+        }
+        source_free(file);
+}
+
+// Drops files no request has used for CACHE_MAX_IDLE generations, then the
+// least recently used ones until the cache fits its budget.
+static void
+cache_reclaim(void)
+{
+        CacheEntry *oldest;
+
+        for (size_t i = 0; i < buf_len(cache);) {
+                if (generation - cache[i].generation > CACHE_MAX_IDLE) {
+                        cache_evict(&cache[i]);
+                } else {
+                        ++i;
+                }
+        }
+        while (cache_bytes > CACHE_BUDGET) {
+                oldest = cache;
+                for (CacheEntry *it = cache; it != buf_end(cache); ++it) {
+                        if (it->generation < oldest->generation) {
+                                oldest = it;
+                        }
+                }
+                cache_evict(oldest);
+        }
+}
+
+static void
+cache_clear(void)
+{
+        while (buf_len(cache)) {
+                cache_evict(cache);
+        }
+        buf_free(cache);
+}
+
+// Runs one compile with the client's descriptors in place of stdout and
+// stderr, then returns the request's memory.
+static int
+run_request(const char *cwd, int argc, char **argv, int out_fd, int err_fd)
+{
+        jmp_buf jmp;
+        Options opts;
+        volatile int status;
+        int saved_out;
+        int saved_err;
+
+        ++generation;
+        fflush(stdout);
+        fflush(stderr);
+        saved_out = dup(STDOUT_FILENO);
+        saved_err = dup(STDERR_FILENO);
+        dup2(out_fd, STDOUT_FILENO);
+        dup2(err_fd, STDERR_FILENO);
+
+        status = 1;
+        fatal_jmp = &jmp;
+        if (setjmp(jmp) == 0) {
+                if (chdir(cwd) != 0) {
+                        fatal("cannot change directory to '%s'", cwd);
+                }
+                parse_options(argc, argv, &opts);
+                if (opts.server || !opts.path) {
+                        fatal("the compile server only compiles files");
+                } else if (strcmp(opts.path, "-") == 0) {
+                        fatal("the compile server cannot read standard "
+                                        "input");
+                }
+                status = compile(&opts);
+        }
+        fatal_jmp = NULL;
+
+        fflush(stdout);
+        fflush(stderr);
+        dup2(saved_out, STDOUT_FILENO);
+        dup2(saved_err, STDERR_FILENO);
+        close(saved_out);
+        close(saved_err);
+
+        arena_reset(&scratch_arena, (ArenaMark) { 0 });
+        arena_reset(&ast_arena, (ArenaMark) { 0 });
+        if (arena_size(&scratch_arena) > SCRATCH_KEEP) {
+                arena_free(&scratch_arena);
+        }
+        cache_reclaim();
+        if (intern_size() > INTERN_BUDGET) {
+                cache_clear();
+                intern_reset();
+                init_keywords();
+        }
+        return status;
+}
+
+static bool
+read_full(int fd, void *buf, size_t len)
+{
+        ssize_t n;
+
+        while (len) {
+                n = read(fd, buf, len);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                } else if (n <= 0) {
+                        return false;
+                }
+                buf = (char *) buf + n;
+                len -= n;
+        }
+        return true;
+}
+
+// Receives the request header and the client's two descriptors.
+static bool
+recv_header(int conn, ServerRequest *req, int fds[2])
+{
+        union {
+                struct cmsghdr hdr;
+                char buf[CMSG_SPACE(2 * sizeof(int))];
+        } ctrl;
+        struct msghdr msg = { 0 };
+        struct cmsghdr *cmsg;
+        struct iovec iov;
+
+        iov.iov_base = req;
+        iov.iov_len = sizeof(*req);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = sizeof(ctrl.buf);
+        if (recvmsg(conn, &msg, 0) != sizeof(*req)) {
+                return false;
+        }
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg,
+                                cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET &&
+                                cmsg->cmsg_type == SCM_RIGHTS &&
+                                cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int))) {
+                        memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+                }
+        }
+        return req->magic == SERVER_MAGIC && req->len <= SERVER_MAX_REQUEST &&
+                fds[0] >= 0 && fds[1] >= 0;
+}
+
+static void
+serve(int conn)
+{
+        ServerRequest req;
+        ServerReply reply;
+        char **args;
+        char *payload;
+        char *end;
+        int fds[2] = { -1, -1 };
+
+        payload = NULL;
+        args = NULL;
+        if (recv_header(conn, &req, fds)) {
+                payload = xmalloc(req.len + 1);
+                payload[req.len] = 0;
+        }
+        if (payload && read_full(conn, payload, req.len)) {
+                // The working directory comes first, then argv.
+                end = payload + req.len;
+                for (char *arg = payload + strlen(payload) + 1; arg < end;
+                                arg += strlen(arg) + 1) {
+                        buf_push(args, arg);
+                }
+                if (buf_len(args)) {
+                        memset(&stats, 0, sizeof(stats));
+                        buf_push(args, NULL);
+                        reply.status = run_request(payload, buf_len(args) - 1,
+                                        args, fds[0], fds[1]);
+                        if (write(conn, &reply, sizeof(reply)) !=
+                                        sizeof(reply)) {
+                                perror("ion server: reply failed");
+                        }
+                }
+        }
+        if (fds[0] >= 0) {
+                close(fds[0]);
+        }
+        if (fds[1] >= 0) {
+                close(fds[1]);
+        }
+        buf_free(args);
+        xfree(payload);
+}
+
+static void
+on_signal(int sig)
+{
+        server_stop = 1;
+}
+
+static bool
+server_alive(struct sockaddr_un *addr)
+{
+        int fd;
+        bool alive;
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        alive = fd >= 0 && connect(fd, (struct sockaddr *) addr,
+                        sizeof(*addr)) == 0;
+        if (fd >= 0) {
+                close(fd);
+        }
+        return alive;
+}
+
+int
+server_run(const char *socket_path)
+{
+        struct sockaddr_un addr = { 0 };
+        struct sigaction sa = { 0 };
+        char default_path[sizeof(addr.sun_path)];
+        const char *err;
+        int listen_fd;
+        int conn;
+
+        if (!socket_path) {
+                socket_path = getenv(SERVER_SOCKET_ENV);
+        }
+        if (!socket_path) {
+                err = server_socket_path(default_path, sizeof(default_path),
+                                true);
+                if (err) {
+                        fatal("%s: %s", default_path, err);
+                }
+                socket_path = default_path;
+        }
+        if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+                fatal("socket path '%s' is too long", socket_path);
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path);
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+                fatal("cannot create socket: %s", strerror(errno));
+        }
+        if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+                // A socket file nobody answers on is left over from a
+                // server that died; take it over.
+                if (errno != EADDRINUSE || server_alive(&addr)) {
+                        fatal("cannot bind '%s': %s", socket_path,
+                                        strerror(errno));
+                }
+                unlink(socket_path);
+                if (bind(listen_fd, (struct sockaddr *) &addr,
+                                        sizeof(addr)) != 0) {
+                        fatal("cannot bind '%s': %s", socket_path,
+                                        strerror(errno));
+                }
+        }
+        if (listen(listen_fd, 64) != 0) {
+                fatal("cannot listen on '%s': %s", socket_path,
+                                strerror(errno));
+        }
+
+        sa.sa_handler = on_signal;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        signal(SIGPIPE, SIG_IGN);
+
+        source_load = cache_load;
+        source_release = cache_release;
+        fprintf(stderr, "ion: compile server listening on %s\n", socket_path);
+        while (!server_stop) {
+                conn = accept(listen_fd, NULL, NULL);
+                if (conn < 0) {
+                        if (errno != EINTR) {
+                                perror("ion server: accept failed");
+                        }
+                        continue;
+                }
+                if (server_peer_trusted(conn)) {
+                        serve(conn);
+                } else {
+                        fprintf(stderr, "ion server: refusing a connection "
+                                        "from another user\n");
+                }
+                close(conn);
+        }
+
+        close(listen_fd);
+        unlink(socket_path);
+        cache_clear();
+        source_load = source_parse;
+        source_release = source_free;
+        return 0;
+}
+
+void
+server_test(void)
+{
+        char path[] = "/tmp/ion_server_test_XXXXXX";
+        char out[4096];
+        char cwd[4096];
+        char *argv[] = { "ion", path, NULL };
+        char *ir_argv[] = { "ion", "--emit-ir", path, NULL };
+        const char *saved_runtime;
+        SourceFile *file;
+        int pipe_fds[2];
+        int err_fds[2];
+        ssize_t n;
+        FILE *f;
+        int fd;
+
+        fd = mkstemp(path);
+        assert(fd >= 0);
+        f = fdopen(fd, "w");
+        fputs("func f(): int { return 1; }\n", f);
+        fclose(f);
+
+        file = cache_load(path);
+        assert(file && buf_len(cache) == 1);
+        cache_release(file);
+        assert(cache_load(path) == file);
+
+        f = fopen(path, "w");
+        fputs("func g(x: int): int { return x; }\n", f);
+        fclose(f);
+        file = cache_load(path);
+        assert(buf_len(cache) == 1 && cache[0].file == file);
+        assert(file->decls[0]->name == str_intern("g"));
+
+        source_load = cache_load;
+        source_release = cache_release;
+        assert(getcwd(cwd, sizeof(cwd)));
+        assert(pipe(pipe_fds) == 0);
+        assert(run_request(cwd, 2, argv, pipe_fds[1], pipe_fds[1]) == 0);
+        close(pipe_fds[1]);
+        n = read(pipe_fds[0], out, sizeof(out) - 1);
+        close(pipe_fds[0]);
+        assert(n > 0);
+        out[n] = 0;
+        assert(strstr(out, "int g(int x) {"));
+
+        // What the IR does not cover is left out of --emit-ir, with the
+        // reason on stderr rather than in the IR.
+        f = fopen(path, "w");
+        fputs("const N = 2;\nfunc h(): int { return N; }\n", f);
+        fclose(f);
+        assert(pipe(pipe_fds) == 0);
+        assert(pipe(err_fds) == 0);
+        assert(run_request(cwd, 3, ir_argv, pipe_fds[1], err_fds[1]) == 0);
+        close(pipe_fds[1]);
+        close(err_fds[1]);
+        n = read(pipe_fds[0], out, sizeof(out) - 1);
+        close(pipe_fds[0]);
+        assert(n > 0);
+        out[n] = 0;
+        assert(strcmp(out, "; h: not supported by the IR\n") == 0);
+        n = read(err_fds[0], out, sizeof(out) - 1);
+        close(err_fds[0]);
+        assert(n > 0);
+        out[n] = 0;
+        assert(strstr(out, "warning: ir: 'h' uses global 'N'"));
+        source_load = source_parse;
+        source_release = source_free;
+
+        saved_runtime = getenv("XDG_RUNTIME_DIR");
+        setenv("XDG_RUNTIME_DIR", "/run/user/test", 1);
+        assert(!server_socket_path(out, sizeof(out), false));
+        assert(strcmp(out, "/run/user/test/" SERVER_SOCKET_NAME) == 0);
+        assert(server_socket_path(out, 8, false));
+        if (saved_runtime) {
+                setenv("XDG_RUNTIME_DIR", saved_runtime, 1);
+        } else {
+                unsetenv("XDG_RUNTIME_DIR");
+        }
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pipe_fds) == 0);
+        assert(server_peer_trusted(pipe_fds[0]));
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+
+        generation += CACHE_MAX_IDLE + 1;
+        cache_reclaim();
+        assert(buf_len(cache) == 0 && cache_bytes == 0);
+        cache_clear();
+        unlink(path);
+
+        intern_reset();
+        assert(intern_count() == 0 && intern_size() == 0);
+        init_keywords();
+        assert(str_intern("func") == keyword_func);
+}
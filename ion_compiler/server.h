@@ -0,0 +1,51 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compile server protocol. A client connects to the server's Unix socket
+// and sends a ServerRequest header carrying its stdout and stderr as
+// SCM_RIGHTS, then len bytes holding its working directory and its
+// arguments, each NUL-terminated. The server runs the compile with the
+// client's descriptors standing in for its own and answers with a
+// ServerReply holding the exit status.
+//
+// The socket lives in $XDG_RUNTIME_DIR or, failing that, in a directory
+// only its owner can enter. Each side also checks that the other runs as
+// the same user before trusting it with descriptors.
+
+#define SERVER_MAGIC 0x494f4e31
+#define SERVER_MAX_REQUEST (1 << 20)
+#define SERVER_SOCKET_ENV "ION_SOCKET"
+#define SERVER_SOCKET_NAME "ion.sock"
+#define SERVER_SOCKET_DIR_FMT "/tmp/ion-%u"
+
+typedef struct ServerRequest {
+        uint32_t magic;
+        uint32_t len;
+} ServerRequest;
+
+typedef struct ServerReply {
+        int32_t status;
+} ServerReply;
+
+int
+server_run(const char *socket_path);
+
+// Writes the default socket path into path and returns NULL, or returns
+// why it cannot be used. With create set, the private directory the
+// socket lives in is made if missing.
+const char *
+server_socket_path(char *path, size_t size, bool create);
+
+// Whether the process at the other end of a connected socket runs as the
+// same user as this one.
+bool
+server_peer_trusted(int fd);
+
+void
+server_test(void);
+
+#endif
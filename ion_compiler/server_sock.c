@@ -0,0 +1,63 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "server.h"
+
+// Shared by the server and ionc, so it only depends on libc.
+
+const char *
+server_socket_path(char *path, size_t size, bool create)
+{
+        const char *runtime;
+        struct stat st;
+        size_t len;
+
+        runtime = getenv("XDG_RUNTIME_DIR");
+        if (runtime && *runtime) {
+                if ((size_t) snprintf(path, size, "%s/%s", runtime,
+                                        SERVER_SOCKET_NAME) >= size) {
+                        return "socket path is too long";
+                }
+                return NULL;
+        }
+
+        // Without a runtime directory the socket goes in a directory of
+        // our own under /tmp, which nobody else may have created first.
+        snprintf(path, size, SERVER_SOCKET_DIR_FMT, (unsigned) getuid());
+        if (create && mkdir(path, 0700) != 0 && errno != EEXIST) {
+                return "cannot create socket directory";
+        }
+        if (lstat(path, &st) != 0) {
+                return "no socket directory";
+        }
+        if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() ||
+                        (st.st_mode & 077)) {
+                return "socket directory is not private to this user";
+        }
+        len = strlen(path);
+        if ((size_t) snprintf(path + len, size - len, "/%s",
+                                SERVER_SOCKET_NAME) >= size - len) {
+                return "socket path is too long";
+        }
+        return NULL;
+}
+
+bool
+server_peer_trusted(int fd)
+{
+        struct ucred cred;
+        socklen_t len;
+
+        len = sizeof(cred);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+                return false;
+        }
+        return len == sizeof(cred) && cred.uid == getuid();
+}
@@ -0,0 +1,256 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+
+#include "ast.h"
+#include "ir.h"
+#include "lex.h"
+#include "stats.h"
+
+Stats stats;
+
+const char *stats_phase_names[NUM_STATS_PHASES] = {
+        [STATS_PHASE_READ] = "read",
+        [STATS_PHASE_PARSE] = "parse",
+        [STATS_PHASE_RESOLVE] = "resolve",
+        [STATS_PHASE_IR] = "ir",
+        [STATS_PHASE_CGEN] = "cgen",
+        [STATS_PHASE_TESTS] = "tests",
+};
+
+typedef struct NodeCounts {
+        const char *name;
+        const char **kind_names;
+        size_t num_kinds;
+        uint64_t *counts;
+        size_t node_size;
+} NodeCounts;
+
+static NodeCounts node_counts[] = {
+        { "typespecs", typespec_kind_names, TYPESPEC_PTR + 1, stats.typespecs,
+                sizeof(Typespec) },
+        { "exprs", expr_kind_names, EXPR_TERNARY + 1, stats.exprs,
+                sizeof(Expr) },
+        { "stmts", stmt_kind_names, STMT_EXPR + 1, stats.stmts,
+                sizeof(Stmt) },
+        { "decls", decl_kind_names, DECL_FUNC + 1, stats.decls,
+                sizeof(Decl) },
+};
+
+double
+stats_now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+bool
+stats_enabled(void)
+{
+#ifdef ION_STATS
+        return true;
+#else
+        return false;
+#endif
+}
+
+static uint64_t
+sum(const uint64_t *counts, size_t n)
+{
+        uint64_t total;
+
+        total = 0;
+        for (size_t i = 0; i < n; ++i) {
+                total += counts[i];
+        }
+        return total;
+}
+
+static void
+print_json_str(FILE *f, const char *str)
+{
+        fputc('"', f);
+        for (; *str; ++str) {
+                if (*str == '"' || *str == '\\') {
+                        fprintf(f, "\\%c", *str);
+                } else if ((unsigned char) *str < 0x20) {
+                        fprintf(f, "\\u%04x", *str);
+                } else {
+                        fputc(*str, f);
+                }
+        }
+        fputc('"', f);
+}
+
+void
+stats_print(FILE *f)
+{
+        uint64_t total;
+
+        if (!stats_enabled()) {
+                fprintf(f, "stats: not compiled in (build with "
+                                "-DION_STATS)\n");
+                return;
+        }
+        fprintf(f, "phases:\n");
+        for (int i = 0; i < NUM_STATS_PHASES; ++i) {
+                if (stats.phase_time[i] > 0) {
+                        fprintf(f, "  %-12s %10.3f ms\n", stats_phase_names[i],
+                                        stats.phase_time[i] * 1e3);
+                }
+        }
+
+        total = sum(stats.tokens, STATS_MAX_KINDS);
+        fprintf(f, "tokens: %" PRIu64 "\n", total);
+        for (int i = 0; i < STATS_MAX_KINDS; ++i) {
+                if (stats.tokens[i]) {
+                        fprintf(f, "  %-12s %10" PRIu64 "\n",
+                                        token_kind_str(i), stats.tokens[i]);
+                }
+        }
+
+        fprintf(f, "intern: %zu entries, %" PRIu64 " hits, %" PRIu64
+                        " misses, %" PRIu64 " bytes\n", intern_count(),
+                        stats.intern_hits, stats.intern_misses,
+                        stats.intern_bytes);
+
+        for (size_t n = 0; n < sizeof(node_counts) / sizeof(*node_counts);
+                        ++n) {
+                NodeCounts *nc = &node_counts[n];
+
+                total = sum(nc->counts, nc->num_kinds);
+                fprintf(f, "%s: %" PRIu64 " nodes, %" PRIu64 " bytes\n",
+                                nc->name, total, total * nc->node_size);
+                for (size_t i = 0; i < nc->num_kinds; ++i) {
+                        if (nc->counts[i]) {
+                                fprintf(f, "  %-12s %10" PRIu64 " %10" PRIu64
+                                                " bytes\n", nc->kind_names[i],
+                                                nc->counts[i], nc->counts[i] *
+                                                nc->node_size);
+                        }
+                }
+        }
+
+        fprintf(f, "pruned: %" PRIu64 " of %" PRIu64 " decls\n",
+                        stats.decls_pruned,
+                        stats.decls_live + stats.decls_pruned);
+        fprintf(f, "bufs: %" PRIu64 " grows, %" PRIu64 " bytes\n",
+                        stats.buf_grows, stats.buf_grow_bytes);
+
+        if (stats.ir_funcs) {
+                fprintf(f, "ir: %" PRIu64 " funcs, %" PRIu64 " instrs\n",
+                                stats.ir_funcs, stats.ir_instrs);
+                for (int i = 0; i < NUM_IR_PASSES; ++i) {
+                        fprintf(f, "  %-12s %10" PRIu64 " runs %10" PRIu64
+                                        " changes %10.3f ms\n",
+                                        ir_pass_names[i], stats.pass_runs[i],
+                                        stats.pass_changes[i],
+                                        stats.pass_time[i] * 1e3);
+                }
+        }
+}
+
+void
+stats_print_json(FILE *f)
+{
+        const char *sep;
+
+        fprintf(f, "{\"enabled\": %s", stats_enabled() ? "true" : "false");
+        if (!stats_enabled()) {
+                fprintf(f, "}\n");
+                return;
+        }
+
+        fprintf(f, ", \"phases_ms\": {");
+        sep = "";
+        for (int i = 0; i < NUM_STATS_PHASES; ++i) {
+                fprintf(f, "%s\"%s\": %.4f", sep, stats_phase_names[i],
+                                stats.phase_time[i] * 1e3);
+                sep = ", ";
+        }
+
+        fprintf(f, "}, \"tokens\": {");
+        sep = "";
+        for (int i = 0; i < STATS_MAX_KINDS; ++i) {
+                if (stats.tokens[i]) {
+                        fprintf(f, "%s", sep);
+                        print_json_str(f, token_kind_str(i));
+                        fprintf(f, ": %" PRIu64, stats.tokens[i]);
+                        sep = ", ";
+                }
+        }
+
+        fprintf(f, "}, \"intern\": {\"entries\": %zu, \"hits\": %" PRIu64
+                        ", \"misses\": %" PRIu64 ", \"bytes\": %" PRIu64 "}",
+                        intern_count(), stats.intern_hits,
+                        stats.intern_misses, stats.intern_bytes);
+
+        for (size_t n = 0; n < sizeof(node_counts) / sizeof(*node_counts);
+                        ++n) {
+                NodeCounts *nc = &node_counts[n];
+
+                fprintf(f, ", \"%s\": {", nc->name);
+                sep = "";
+                for (size_t i = 0; i < nc->num_kinds; ++i) {
+                        if (nc->counts[i]) {
+                                fprintf(f, "%s\"%s\": {\"count\": %" PRIu64
+                                                ", \"bytes\": %" PRIu64 "}",
+                                                sep, nc->kind_names[i],
+                                                nc->counts[i], nc->counts[i] *
+                                                nc->node_size);
+                                sep = ", ";
+                        }
+                }
+                fprintf(f, "}");
+        }
+
+        fprintf(f, ", \"pruned\": {\"live\": %" PRIu64 ", \"removed\": %"
+                        PRIu64 "}", stats.decls_live, stats.decls_pruned);
+        fprintf(f, ", \"bufs\": {\"grows\": %" PRIu64 ", \"bytes\": %" PRIu64
+                        "}", stats.buf_grows, stats.buf_grow_bytes);
+
+        fprintf(f, ", \"ir\": {\"funcs\": %" PRIu64 ", \"instrs\": %" PRIu64
+                        ", \"passes\": {", stats.ir_funcs, stats.ir_instrs);
+        sep = "";
+        for (int i = 0; i < NUM_IR_PASSES; ++i) {
+                fprintf(f, "%s\"%s\": {\"runs\": %" PRIu64 ", \"changes\": %"
+                                PRIu64 ", \"ms\": %.4f}", sep, ir_pass_names[i],
+                                stats.pass_runs[i], stats.pass_changes[i],
+                                stats.pass_time[i] * 1e3);
+                sep = ", ";
+        }
+        fprintf(f, "}}}\n");
+}
+
+void
+stats_test(void)
+{
+#ifdef ION_STATS
+        Stats saved;
+        size_t entries;
+        int *buf;
+
+        saved = stats;
+        entries = intern_count();
+        init_stream("x := y + 1 + stats_test_name");
+        while (token.kind != TOKEN_EOF) {
+                next_token();
+        }
+        assert(stats.tokens[TOKEN_NAME] == saved.tokens[TOKEN_NAME] + 3);
+        assert(stats.tokens['+'] == saved.tokens['+'] + 2);
+        assert(stats.intern_hits + stats.intern_misses ==
+                        saved.intern_hits + saved.intern_misses + 3);
+        assert(intern_count() == entries + 1);
+
+        expr_binary('+', expr_int(1), expr_int(2));
+        assert(stats.exprs[EXPR_INT] == saved.exprs[EXPR_INT] + 2);
+        assert(stats.exprs[EXPR_BINARY] == saved.exprs[EXPR_BINARY] + 1);
+
+        buf = NULL;
+        buf_push(buf, 1);
+        assert(stats.buf_grows > saved.buf_grows);
+        buf_free(buf);
+#endif
+}
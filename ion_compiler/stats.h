@@ -0,0 +1,89 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdbool.h>
+
+#include "common.h"
+#include "prof.h"
+
+// Compiler counters. Built with -DION_STATS the STAT_* macros update the
+// global stats record; without it they expand to nothing, so the hot paths
+// carry no trace of them. The phase macros are the exception: in both
+// builds they tell the profiler which phase is running.
+
+#define STATS_MAX_KINDS 256
+#define STATS_MAX_PASSES 8
+
+typedef enum StatsPhase {
+        STATS_PHASE_READ,
+        STATS_PHASE_PARSE,
+        STATS_PHASE_RESOLVE,
+        STATS_PHASE_IR,
+        STATS_PHASE_CGEN,
+        STATS_PHASE_TESTS,
+        NUM_STATS_PHASES
+} StatsPhase;
+
+typedef struct Stats {
+        uint64_t tokens[STATS_MAX_KINDS];
+        uint64_t intern_hits;
+        uint64_t intern_misses;
+        uint64_t intern_bytes;
+        uint64_t exprs[STATS_MAX_KINDS];
+        uint64_t stmts[STATS_MAX_KINDS];
+        uint64_t decls[STATS_MAX_KINDS];
+        uint64_t typespecs[STATS_MAX_KINDS];
+        uint64_t decls_live;
+        uint64_t decls_pruned;
+        uint64_t buf_grows;
+        uint64_t buf_grow_bytes;
+        double phase_start[NUM_STATS_PHASES];
+        double phase_time[NUM_STATS_PHASES];
+        uint64_t ir_funcs;
+        uint64_t ir_instrs;
+        uint64_t pass_runs[STATS_MAX_PASSES];
+        uint64_t pass_changes[STATS_MAX_PASSES];
+        double pass_start;
+        double pass_time[STATS_MAX_PASSES];
+} Stats;
+
+extern Stats stats;
+extern const char *stats_phase_names[NUM_STATS_PHASES];
+
+#ifdef ION_STATS
+#define STAT_INC(field) ((void) ++stats.field)
+#define STAT_ADD(field, n) ((void) (stats.field += (n)))
+#define STAT_PHASE_BEGIN(p) ((void) (prof_enter(p), \
+                                stats.phase_start[p] = stats_now()))
+#define STAT_PHASE_END(p) ((void) (prof_leave(), stats.phase_time[p] += \
+                                stats_now() - stats.phase_start[p]))
+#define STAT_PASS_BEGIN() ((void) (stats.pass_start = stats_now()))
+#define STAT_PASS_END(p, n) ((void) (++stats.pass_runs[p], \
+                                stats.pass_changes[p] += (n), \
+                                stats.pass_time[p] += \
+                                stats_now() - stats.pass_start))
+#else
+#define STAT_INC(field) ((void) 0)
+#define STAT_ADD(field, n) ((void) 0)
+#define STAT_PHASE_BEGIN(p) prof_enter(p)
+#define STAT_PHASE_END(p) prof_leave()
+#define STAT_PASS_BEGIN() ((void) 0)
+#define STAT_PASS_END(p, n) ((void) 0)
+#endif
+
+double
+stats_now(void);
+
+bool
+stats_enabled(void);
+
+void
+stats_print(FILE *f);
+
+void
+stats_print_json(FILE *f);
+
+void
+stats_test(void);
+
+#endif
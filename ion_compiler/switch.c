@@ -0,0 +1,333 @@
+#include "parse.h"
+#include "switch.h"
+
+const char *switch_cluster_names[NUM_CLUSTER_KINDS] = {
+        [CLUSTER_COMPARE] = "compare",
+        [CLUSTER_BIT_TEST] = "bit test",
+        [CLUSTER_JUMP_TABLE] = "jump table",
+};
+
+// Evaluates integer literals and the operators on them that cannot trap.
+// Arithmetic wraps as it does at run time.
+bool
+switch_const_expr(Expr *expr, int64_t *val)
+{
+        int64_t a;
+        int64_t b;
+
+        switch (expr->kind) {
+        case EXPR_INT:
+                *val = (int64_t) expr->int_val;
+                return true;
+        case EXPR_UNARY:
+                if (!switch_const_expr(expr->unary.expr, &a)) {
+                        return false;
+                }
+                switch ((int) expr->unary.op) {
+                case '+':
+                        *val = a;
+                        return true;
+                case '-':
+                        *val = (int64_t) -(uint64_t) a;
+                        return true;
+                case '~':
+                        *val = ~a;
+                        return true;
+                default:
+                        return false;
+                }
+        case EXPR_BINARY:
+                if (!switch_const_expr(expr->binary.left, &a) ||
+                                !switch_const_expr(expr->binary.right, &b)) {
+                        return false;
+                }
+                switch ((int) expr->binary.op) {
+                case '+':
+                        *val = (int64_t) ((uint64_t) a + (uint64_t) b);
+                        return true;
+                case '-':
+                        *val = (int64_t) ((uint64_t) a - (uint64_t) b);
+                        return true;
+                case '*':
+                        *val = (int64_t) ((uint64_t) a * (uint64_t) b);
+                        return true;
+                case '&':
+                        *val = a & b;
+                        return true;
+                case '|':
+                        *val = a | b;
+                        return true;
+                case '^':
+                        *val = a ^ b;
+                        return true;
+                case TOKEN_LSHIFT:
+                        if (b < 0 || b > 63) {
+                                return false;
+                        }
+                        *val = (int64_t) ((uint64_t) a << b);
+                        return true;
+                default:
+                        return false;
+                }
+        default:
+                return false;
+        }
+}
+
+static int
+cmp_switch_value(const void *a, const void *b)
+{
+        const SwitchValue *x = a;
+        const SwitchValue *y = b;
+
+        if (x->val != y->val) {
+                return x->val < y->val ? -1 : 1;
+        }
+        return x->case_index < y->case_index ? -1 :
+                x->case_index > y->case_index;
+}
+
+// Slots in a table from values[i] to values[j - 1]; the values are sorted,
+// so the difference fits in a uint64_t even where it would overflow.
+static uint64_t
+value_span(SwitchValue *values, size_t i, size_t j)
+{
+        return (uint64_t) values[j - 1].val - (uint64_t) values[i].val + 1;
+}
+
+static void
+push_cluster(SwitchPlan *plan, SwitchClusterKind kind, size_t i, size_t j)
+{
+        buf_push(plan->clusters, (SwitchCluster) { kind, plan->values[i].val,
+                        plan->values[j - 1].val, plan->values + i, j - i });
+}
+
+// The end of the longest run from values[i] dense enough for a table.
+static size_t
+table_end(SwitchValue *values, size_t n, size_t i)
+{
+        size_t end;
+
+        end = i + 1;
+        for (size_t j = i + 1; j <= n; ++j) {
+                uint64_t span = value_span(values, i, j);
+
+                if (span > SWITCH_MAX_TABLE_SIZE) {
+                        break;
+                } else if ((j - i) * 100 >= SWITCH_MIN_DENSITY * span) {
+                        end = j;
+                }
+        }
+        return end;
+}
+
+// The end of the longest run from values[i] that fits one 64-bit mask per
+// case, for few enough cases.
+static size_t
+bit_test_end(SwitchValue *values, size_t n, size_t i)
+{
+        uint32_t cases[SWITCH_MAX_BIT_CASES];
+        size_t num_cases;
+        size_t j;
+        size_t k;
+
+        num_cases = 0;
+        for (j = i; j < n && value_span(values, i, j + 1) <= 64; ++j) {
+                for (k = 0; k < num_cases &&
+                                cases[k] != values[j].case_index; ++k) {
+                }
+                if (k == num_cases) {
+                        if (num_cases == SWITCH_MAX_BIT_CASES) {
+                                break;
+                        }
+                        cases[num_cases++] = values[j].case_index;
+                }
+        }
+        return j;
+}
+
+// Splits the sorted values into clusters from left to right, taking the
+// longest table or bit test that starts at each value, and a compare when
+// neither is worth it. A table whose values go to few enough cases becomes
+// a bit test, which needs no memory.
+static void
+plan_clusters(SwitchPlan *plan)
+{
+        SwitchValue *values;
+        size_t n;
+        size_t i;
+        size_t j;
+
+        values = plan->values;
+        n = buf_len(values);
+        i = 0;
+        while (i < n) {
+                j = table_end(values, n, i);
+                if (j - i >= SWITCH_MIN_TABLE_VALUES) {
+                        if (bit_test_end(values, j, i) == j) {
+                                push_cluster(plan, CLUSTER_BIT_TEST, i, j);
+                        } else {
+                                push_cluster(plan, CLUSTER_JUMP_TABLE, i, j);
+                        }
+                        i = j;
+                        continue;
+                }
+                j = bit_test_end(values, n, i);
+                if (j - i >= SWITCH_MIN_BIT_VALUES) {
+                        push_cluster(plan, CLUSTER_BIT_TEST, i, j);
+                        i = j;
+                        continue;
+                }
+                push_cluster(plan, CLUSTER_COMPARE, i, i + 1);
+                ++i;
+        }
+        plan->tree = buf_len(plan->clusters) >= SWITCH_MIN_TREE_CLUSTERS;
+}
+
+// Plans stmt's dispatch. Returns false, with nothing allocated, if a case
+// value is not a constant, in which case the cases can only be tried in
+// order.
+bool
+switch_plan(SwitchStmt *stmt, SwitchPlan *plan)
+{
+        SwitchValue *values;
+        size_t n;
+        int64_t val;
+
+        *plan = (SwitchPlan) { .default_case = -1 };
+        values = NULL;
+        for (size_t i = 0; i < stmt->num_cases; ++i) {
+                SwitchCase *c = &stmt->cases[i];
+
+                if (c->is_default) {
+                        plan->default_case = i;
+                }
+                for (size_t j = 0; j < c->num_exprs; ++j) {
+                        if (!switch_const_expr(c->exprs[j], &val)) {
+                                buf_free(values);
+                                return false;
+                        }
+                        buf_push(values, (SwitchValue) { val, i });
+                }
+        }
+        if (values) {
+                qsort(values, buf_len(values), sizeof(*values),
+                                cmp_switch_value);
+        }
+        n = 0;
+        for (size_t i = 0; i < buf_len(values); ++i) {
+                if (n == 0 || values[i].val != values[n - 1].val) {
+                        values[n++] = values[i];
+                }
+        }
+        buf_trunc(values, n);
+        plan->values = values;
+        plan_clusters(plan);
+        return true;
+}
+
+void
+switch_plan_free(SwitchPlan *plan)
+{
+        buf_free(plan->values);
+        buf_free(plan->clusters);
+}
+
+void
+switch_plan_print(Writer *w, SwitchPlan *plan)
+{
+        SwitchCluster *c;
+        const char *sep;
+
+        if (buf_len(plan->clusters) == 0) {
+                writer_printf(w, "no cases");
+                return;
+        }
+        if (plan->tree) {
+                writer_printf(w, "binary tree over %zu clusters: ",
+                                buf_len(plan->clusters));
+        } else if (buf_len(plan->clusters) > 1) {
+                writer_printf(w, "in order: ");
+        }
+        sep = "";
+        for (c = plan->clusters; c != buf_end(plan->clusters); ++c) {
+                if (c->kind == CLUSTER_COMPARE) {
+                        // Runs of compares are listed together.
+                        if (c == plan->clusters ||
+                                        c[-1].kind != CLUSTER_COMPARE) {
+                                writer_printf(w, "%scompare %" PRId64, sep,
+                                                c->lo);
+                        } else {
+                                writer_printf(w, ", %" PRId64, c->lo);
+                        }
+                } else {
+                        writer_printf(w, "%s%s [%" PRId64 ", %" PRId64
+                                        "] with %zu values", sep,
+                                        switch_cluster_names[c->kind], c->lo,
+                                        c->hi, c->num_values);
+                }
+                sep = "; ";
+        }
+}
+
+static void
+assert_switch_plan(const char *src, const char *expected)
+{
+        SwitchPlan plan;
+        Stmt *stmt;
+        Writer *w;
+
+        init_stream(src);
+        stmt = parse_stmt();
+        assert(stmt->kind == STMT_SWITCH);
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, -1);
+        if (switch_plan(&stmt->switch_stmt, &plan)) {
+                switch_plan_print(w, &plan);
+                switch_plan_free(&plan);
+        } else {
+                writer_printf(w, "not constant");
+        }
+        writer_flush(w);
+        assert(strcmp(w->mem, expected) == 0);
+        writer_free(w);
+        xfree(w);
+}
+
+void
+switch_test(void)
+{
+        SwitchPlan plan;
+        Stmt *stmt;
+
+        assert_switch_plan("switch (x) { case 0, 1: case 2: case 3: "
+                        "case 4: case 5: case 7: default: }",
+                        "jump table [0, 7] with 7 values");
+        // Few cases in a small range make a bit test rather than a table.
+        assert_switch_plan("switch (x) { case 1, 2, 3, 4: case 5, 6: }",
+                        "bit test [1, 6] with 6 values");
+        assert_switch_plan("switch (c) { case 'a', 'e', 'i', 'o', 'u': "
+                        "case 'y': }",
+                        "bit test [97, 121] with 6 values");
+        assert_switch_plan("switch (x) { case 10: case -5: }",
+                        "in order: compare -5, 10");
+        assert_switch_plan("switch (x) { case 0: case 1: case 2: case 3: "
+                        "case 4: case 1000: case 2000: case 1 << 40: }",
+                        "binary tree over 4 clusters: jump table [0, 4] "
+                        "with 5 values; compare 1000, 2000, 1099511627776");
+        assert_switch_plan("switch (x) { case 9223372036854775807: "
+                        "case -9223372036854775807 - 1: }",
+                        "in order: compare -9223372036854775808, "
+                        "9223372036854775807");
+        assert_switch_plan("switch (x) { case y: }", "not constant");
+        assert_switch_plan("switch (x) { default: }", "no cases");
+
+        // A repeated value goes to the first case that has it.
+        init_stream("switch (x) { case 3: case 1, 3: default: }");
+        stmt = parse_stmt();
+        assert(switch_plan(&stmt->switch_stmt, &plan));
+        assert(buf_len(plan.values) == 2);
+        assert(plan.values[1].val == 3 && plan.values[1].case_index == 0);
+        assert(plan.default_case == 2);
+        switch_plan_free(&plan);
+}
@@ -0,0 +1,79 @@
+#ifndef _SWITCH_H_
+#define _SWITCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "common.h"
+
+// Lowering plans for switch statements. When every case value is a
+// constant, the values are sorted and split into clusters, and each cluster
+// gets the cheapest dispatch its shape allows: a jump table for a dense run
+// of values, a bit test for values in a 64 wide window that go to only a
+// few cases, and a compare for each value left over. With enough clusters
+// a binary search picks the cluster, so that a large sparse switch costs a
+// logarithmic number of compares rather than a linear one.
+
+// A jump table needs this many values, filling this percentage of its
+// slots, and no more slots than the maximum.
+#define SWITCH_MIN_TABLE_VALUES 4
+#define SWITCH_MIN_DENSITY 40
+#define SWITCH_MAX_TABLE_SIZE 4096
+// A bit test needs this many values going to at most this many cases.
+#define SWITCH_MIN_BIT_VALUES 3
+#define SWITCH_MAX_BIT_CASES 3
+#define SWITCH_MIN_TREE_CLUSTERS 4
+
+typedef enum SwitchClusterKind {
+        CLUSTER_COMPARE,
+        CLUSTER_BIT_TEST,
+        CLUSTER_JUMP_TABLE,
+        NUM_CLUSTER_KINDS
+} SwitchClusterKind;
+
+typedef struct SwitchValue {
+        int64_t val;
+        // Index of the case in the switch statement.
+        uint32_t case_index;
+} SwitchValue;
+
+typedef struct SwitchCluster {
+        SwitchClusterKind kind;
+        int64_t lo;
+        int64_t hi;
+        // A slice of the plan's values.
+        SwitchValue *values;
+        size_t num_values;
+} SwitchCluster;
+
+typedef struct SwitchPlan {
+        // Sorted, with only the first case kept for a repeated value, since
+        // that is the one a compare chain would take.
+        SwitchValue *values;
+        SwitchCluster *clusters;
+        // The index of the default case, or -1.
+        int default_case;
+        // Whether the clusters are searched as a binary tree rather than
+        // tried in order.
+        bool tree;
+} SwitchPlan;
+
+extern const char *switch_cluster_names[NUM_CLUSTER_KINDS];
+
+bool
+switch_const_expr(Expr *expr, int64_t *val);
+
+bool
+switch_plan(SwitchStmt *stmt, SwitchPlan *plan);
+
+void
+switch_plan_free(SwitchPlan *plan);
+
+void
+switch_plan_print(Writer *w, SwitchPlan *plan);
+
+void
+switch_test(void);
+
+#endif
@@ -0,0 +1,116 @@
+#include "sym.h"
+
+void
+sym_push_scope(SymTable *table)
+{
+        buf_push(table->scopes, buf_len(table->syms));
+}
+
+void
+sym_pop_scope(SymTable *table)
+{
+        uint32_t mark;
+        Sym *sym;
+
+        assert(buf_len(table->scopes) > 0);
+        mark = table->scopes[buf_len(table->scopes) - 1];
+        buf_trunc(table->scopes, buf_len(table->scopes) - 1);
+        while (buf_len(table->syms) > mark) {
+                sym = &table->syms[buf_len(table->syms) - 1];
+                table->heads[symbol_id(sym->name)] = sym->shadowed;
+                buf_trunc(table->syms, buf_len(table->syms) - 1);
+        }
+}
+
+// Adds a binding for the interned name to the innermost scope and returns
+// it for the caller to fill in, or returns NULL if that scope already has
+// one. The result is only valid until the next bind.
+Sym *
+sym_bind(SymTable *table, const char *name, SymKind kind)
+{
+        SymbolId id;
+        uint32_t head;
+        uint32_t depth;
+
+        id = symbol_id(name);
+        while (buf_len(table->heads) <= id) {
+                buf_push(table->heads, 0);
+        }
+        head = table->heads[id];
+        depth = buf_len(table->scopes);
+        if (head && table->syms[head - 1].depth == depth) {
+                return NULL;
+        }
+        buf_push(table->syms, (Sym) { .kind = kind, .name = name,
+                                .depth = depth, .shadowed = head });
+        table->heads[id] = buf_len(table->syms);
+        return &table->syms[buf_len(table->syms) - 1];
+}
+
+// The innermost binding of the interned name, or NULL.
+Sym *
+sym_lookup(SymTable *table, const char *name)
+{
+        SymbolId id;
+
+        id = symbol_id(name);
+        if (id >= buf_len(table->heads) || !table->heads[id]) {
+                return NULL;
+        }
+        return &table->syms[table->heads[id] - 1];
+}
+
+void
+sym_table_free(SymTable *table)
+{
+        buf_free(table->syms);
+        buf_free(table->heads);
+        buf_free(table->scopes);
+}
+
+void
+sym_test(void)
+{
+        SymTable table = { 0 };
+        const char *x;
+        const char *y;
+        char name[32];
+        Sym *sym;
+
+        x = str_intern("sym_x");
+        y = str_intern("sym_y");
+        assert(!sym_lookup(&table, x));
+
+        sym_push_scope(&table);
+        sym_bind(&table, x, SYM_PARAM);
+        assert(!sym_bind(&table, x, SYM_LOCAL));
+        sym_push_scope(&table);
+        assert(sym_lookup(&table, x)->kind == SYM_PARAM);
+        sym_bind(&table, x, SYM_LOCAL);
+        sym_bind(&table, y, SYM_LOCAL);
+        assert(sym_lookup(&table, x)->kind == SYM_LOCAL);
+        sym_pop_scope(&table);
+        assert(sym_lookup(&table, x)->kind == SYM_PARAM);
+        assert(!sym_lookup(&table, y));
+
+        // A body with thousands of locals, each shadowing a global.
+        for (int i = 0; i < 5000; ++i) {
+                snprintf(name, sizeof(name), "sym_local%d", i);
+                sym = sym_bind(&table, str_intern(name), SYM_DECL);
+                assert(sym && sym->depth == 1);
+        }
+        sym_push_scope(&table);
+        for (int i = 0; i < 5000; ++i) {
+                snprintf(name, sizeof(name), "sym_local%d", i);
+                assert(sym_bind(&table, str_intern(name), SYM_LOCAL));
+        }
+        assert(sym_lookup(&table, str_intern("sym_local4321"))->kind ==
+                        SYM_LOCAL);
+        sym_pop_scope(&table);
+        assert(sym_lookup(&table, str_intern("sym_local4321"))->kind ==
+                        SYM_DECL);
+        assert(buf_len(table.syms) == 5001);
+        sym_pop_scope(&table);
+        assert(buf_len(table.syms) == 0 && !sym_lookup(&table, x));
+        sym_table_free(&table);
+}
@@ -0,0 +1,58 @@
+#ifndef _SYM_H_
+#define _SYM_H_
+
+#include <stdint.h>
+
+#include "ast.h"
+#include "common.h"
+
+// Scoped symbol table. Bindings live on one stack; each name's innermost
+// binding is found by indexing a flat array with the name's symbol ID, and
+// every binding remembers the one it shadows. Looking a name up is one
+// array access, and popping a scope unwinds just the bindings made in it.
+// Tables must be freed before intern_reset renumbers the symbols.
+
+typedef enum SymKind {
+        SYM_NONE,
+        SYM_DECL,
+        SYM_PARAM,
+        SYM_LOCAL
+} SymKind;
+
+typedef struct Sym {
+        SymKind kind;
+        const char *name;
+        union {
+                Decl *decl;
+                FuncParam *param;
+                Stmt *local;
+        };
+        uint32_t depth;
+        uint32_t shadowed;
+} Sym;
+
+typedef struct SymTable {
+        Sym *syms;
+        uint32_t *heads;
+        uint32_t *scopes;
+} SymTable;
+
+void
+sym_push_scope(SymTable *table);
+
+void
+sym_pop_scope(SymTable *table);
+
+Sym *
+sym_bind(SymTable *table, const char *name, SymKind kind);
+
+Sym *
+sym_lookup(SymTable *table, const char *name);
+
+void
+sym_table_free(SymTable *table);
+
+void
+sym_test(void);
+
+#endif
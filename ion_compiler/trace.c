@@ -0,0 +1,232 @@
+#include <pthread.h>
+
+#include "prof.h"
+#include "stats.h"
+#include "trace.h"
+
+typedef struct TraceEvent {
+        double time;
+        const char *name;
+        const char *file;
+        char phase;
+} TraceEvent;
+
+// Threads other than the main one record with plain malloc, like the
+// lexer's, since the x* functions are not theirs to call; an event that
+// does not fit is dropped.
+typedef struct TraceThread {
+        struct TraceThread *next;
+        int id;
+        const char *name;
+        TraceEvent *events;
+        size_t num_events;
+        size_t cap;
+} TraceThread;
+
+bool trace_enabled;
+
+static double trace_epoch;
+static TraceThread *trace_threads;
+static int trace_num_threads;
+static THREAD_LOCAL TraceThread *trace_thread;
+
+// Starts recording, with the calling thread as the main one.
+void
+trace_start(void)
+{
+        trace_epoch = stats_now();
+        trace_enabled = true;
+        trace_thread_name("main");
+}
+
+static TraceThread *
+trace_self(void)
+{
+        TraceThread *t;
+
+        t = trace_thread;
+        if (!t) {
+                t = calloc(1, sizeof(TraceThread));
+                if (!t) {
+                        return NULL;
+                }
+                t->id = __atomic_add_fetch(&trace_num_threads, 1,
+                                __ATOMIC_RELAXED);
+                t->next = __atomic_load_n(&trace_threads, __ATOMIC_RELAXED);
+                while (!__atomic_compare_exchange_n(&trace_threads, &t->next,
+                                        t, true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+                }
+                trace_thread = t;
+        }
+        return t;
+}
+
+void
+trace_thread_name(const char *name)
+{
+        TraceThread *t;
+
+        if (trace_enabled && (t = trace_self())) {
+                t->name = name;
+        }
+}
+
+static void
+trace_event(char phase, const char *name, const char *file)
+{
+        TraceThread *t;
+        TraceEvent *events;
+
+        t = trace_self();
+        if (!t) {
+                return;
+        } else if (t->num_events == t->cap) {
+                events = realloc(t->events, (t->cap ? 2 * t->cap : 64) *
+                                sizeof(TraceEvent));
+                if (!events) {
+                        return;
+                }
+                t->events = events;
+                t->cap = t->cap ? 2 * t->cap : 64;
+        }
+        t->events[t->num_events++] = (TraceEvent) { stats_now(), name, file,
+                phase };
+}
+
+// Begins a span of work on file, which may be NULL, on this thread.
+void
+trace_begin(const char *name, const char *file)
+{
+        if (trace_enabled) {
+                trace_event('B', name, file);
+        }
+}
+
+void
+trace_end(void)
+{
+        if (trace_enabled) {
+                trace_event('E', NULL, NULL);
+        }
+}
+
+static void
+write_json_str(Writer *w, const char *str)
+{
+        writer_write(w, "\"", 1);
+        for (; *str; ++str) {
+                if (*str == '"' || *str == '\\') {
+                        writer_printf(w, "\\%c", *str);
+                } else if ((unsigned char) *str < 0x20) {
+                        writer_printf(w, "\\u%04x", *str);
+                } else {
+                        writer_write(w, str, 1);
+                }
+        }
+        writer_write(w, "\"", 1);
+}
+
+// Writes the events of every thread as a JSON trace and frees them. The
+// other threads must have finished; recording stops.
+void
+trace_write(Writer *w)
+{
+        TraceThread *t;
+        TraceThread *next;
+        const char *sep;
+
+        writer_printf(w, "{\"traceEvents\":[");
+        sep = "\n";
+        for (t = trace_threads; t; t = next) {
+                next = t->next;
+                if (t->name) {
+                        writer_printf(w, "%s{\"name\":\"thread_name\","
+                                        "\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                                        "\"args\":{\"name\":", sep, t->id);
+                        write_json_str(w, t->name);
+                        writer_printf(w, "}}");
+                        sep = ",\n";
+                }
+                for (TraceEvent *e = t->events; e != t->events +
+                                t->num_events; ++e) {
+                        writer_printf(w, "%s{\"ph\":\"%c\",\"ts\":%.3f,"
+                                        "\"pid\":1,\"tid\":%d", sep, e->phase,
+                                        (e->time - trace_epoch) * 1e6, t->id);
+                        if (e->name) {
+                                writer_printf(w, ",\"name\":");
+                                write_json_str(w, e->name);
+                        }
+                        if (e->phase == 'B' && e->file) {
+                                writer_printf(w, ",\"args\":{\"file\":");
+                                write_json_str(w, e->file);
+                                writer_printf(w, "}");
+                        }
+                        writer_printf(w, "}");
+                        sep = ",\n";
+                }
+                free(t->events);
+                free(t);
+        }
+        writer_printf(w, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        trace_threads = NULL;
+        trace_num_threads = 0;
+        trace_thread = NULL;
+        trace_enabled = false;
+}
+
+static size_t
+count_str(const char *str, const char *sub)
+{
+        size_t n;
+
+        n = 0;
+        while ((str = strstr(str, sub))) {
+                ++n;
+                ++str;
+        }
+        return n;
+}
+
+static void *
+trace_test_thread(void *arg)
+{
+        (void) arg;
+        trace_thread_name("worker");
+        trace_begin("lex", prof_file);
+        trace_end();
+        return NULL;
+}
+
+void
+trace_test(void)
+{
+        pthread_t thread;
+        Writer *w;
+
+        trace_begin("lost", NULL);
+        trace_end();
+        trace_start();
+        prof_set_file("a \"quoted\" path.ion");
+        trace_begin("parse", NULL);
+        assert(pthread_create(&thread, NULL, trace_test_thread, NULL) == 0);
+        pthread_join(thread, NULL);
+        trace_end();
+        prof_set_file(NULL);
+
+        w = xmalloc(sizeof(Writer));
+        writer_init(w, -1);
+        trace_write(w);
+        writer_flush(w);
+        assert(strstr(w->mem, "\"tid\":2,\"args\":{\"name\":\"worker\"}}"));
+        assert(strstr(w->mem, "\"tid\":1,\"args\":{\"name\":\"main\"}}"));
+        assert(strstr(w->mem, "\"tid\":2,\"name\":\"lex\",\"args\":{"
+                                "\"file\":\"a \\\"quoted\\\" path.ion\"}}"));
+        assert(strstr(w->mem, "\"tid\":1,\"name\":\"parse\""));
+        assert(!strstr(w->mem, "lost"));
+        assert(count_str(w->mem, "\"ph\":\"B\"") == 2);
+        assert(count_str(w->mem, "\"ph\":\"E\"") == 2);
+        assert(!trace_enabled);
+        writer_free(w);
+        xfree(w);
+}
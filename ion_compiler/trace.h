@@ -0,0 +1,35 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdbool.h>
+
+#include "common.h"
+
+// Timeline of compile phases in Chrome's trace event format, for
+// chrome://tracing and Perfetto. Each thread appends begin and end events
+// to a buffer of its own, which it registers once on a lock-free list;
+// trace_write reads them all after the other threads are gone. The names
+// and files of events are kept by pointer, so they must last until then;
+// interned strings such as prof_file do.
+
+extern bool trace_enabled;
+
+void
+trace_start(void);
+
+void
+trace_thread_name(const char *name);
+
+void
+trace_begin(const char *name, const char *file);
+
+void
+trace_end(void);
+
+void
+trace_write(Writer *w);
+
+void
+trace_test(void);
+
+#endif
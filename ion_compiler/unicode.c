@@ -0,0 +1,555 @@
+#include "unicode.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Code point ranges from 0x80 up, sorted, made with Python's
+// str.isidentifier (Unicode 14.0). S ranges are XID_Start, which implies
+// XID_Continue; C ranges are XID_Continue only. The class rides in the top
+// bit of hi, so the table takes 8 bytes a range.
+#define XID_START_BIT 0x80000000u
+#define S(lo, hi) { (lo), (hi) | XID_START_BIT }
+#define C(lo, hi) { (lo), (hi) }
+
+static const uint32_t xid_ranges[][2] = {
+        S(0x00AA, 0x00AA), S(0x00B5, 0x00B5), C(0x00B7, 0x00B7),
+        S(0x00BA, 0x00BA), S(0x00C0, 0x00D6), S(0x00D8, 0x00F6),
+        S(0x00F8, 0x02C1), S(0x02C6, 0x02D1), S(0x02E0, 0x02E4),
+        S(0x02EC, 0x02EC), S(0x02EE, 0x02EE), C(0x0300, 0x036F),
+        S(0x0370, 0x0374), S(0x0376, 0x0377), S(0x037B, 0x037D),
+        S(0x037F, 0x037F), S(0x0386, 0x0386), C(0x0387, 0x0387),
+        S(0x0388, 0x038A), S(0x038C, 0x038C), S(0x038E, 0x03A1),
+        S(0x03A3, 0x03F5), S(0x03F7, 0x0481), C(0x0483, 0x0487),
+        S(0x048A, 0x052F), S(0x0531, 0x0556), S(0x0559, 0x0559),
+        S(0x0560, 0x0588), C(0x0591, 0x05BD), C(0x05BF, 0x05BF),
+        C(0x05C1, 0x05C2), C(0x05C4, 0x05C5), C(0x05C7, 0x05C7),
+        S(0x05D0, 0x05EA), S(0x05EF, 0x05F2), C(0x0610, 0x061A),
+        S(0x0620, 0x064A), C(0x064B, 0x0669), S(0x066E, 0x066F),
+        C(0x0670, 0x0670), S(0x0671, 0x06D3), S(0x06D5, 0x06D5),
+        C(0x06D6, 0x06DC), C(0x06DF, 0x06E4), S(0x06E5, 0x06E6),
+        C(0x06E7, 0x06E8), C(0x06EA, 0x06ED), S(0x06EE, 0x06EF),
+        C(0x06F0, 0x06F9), S(0x06FA, 0x06FC), S(0x06FF, 0x06FF),
+        S(0x0710, 0x0710), C(0x0711, 0x0711), S(0x0712, 0x072F),
+        C(0x0730, 0x074A), S(0x074D, 0x07A5), C(0x07A6, 0x07B0),
+        S(0x07B1, 0x07B1), C(0x07C0, 0x07C9), S(0x07CA, 0x07EA),
+        C(0x07EB, 0x07F3), S(0x07F4, 0x07F5), S(0x07FA, 0x07FA),
+        C(0x07FD, 0x07FD), S(0x0800, 0x0815), C(0x0816, 0x0819),
+        S(0x081A, 0x081A), C(0x081B, 0x0823), S(0x0824, 0x0824),
+        C(0x0825, 0x0827), S(0x0828, 0x0828), C(0x0829, 0x082D),
+        S(0x0840, 0x0858), C(0x0859, 0x085B), S(0x0860, 0x086A),
+        S(0x0870, 0x0887), S(0x0889, 0x088E), C(0x0898, 0x089F),
+        S(0x08A0, 0x08C9), C(0x08CA, 0x08E1), C(0x08E3, 0x0903),
+        S(0x0904, 0x0939), C(0x093A, 0x093C), S(0x093D, 0x093D),
+        C(0x093E, 0x094F), S(0x0950, 0x0950), C(0x0951, 0x0957),
+        S(0x0958, 0x0961), C(0x0962, 0x0963), C(0x0966, 0x096F),
+        S(0x0971, 0x0980), C(0x0981, 0x0983), S(0x0985, 0x098C),
+        S(0x098F, 0x0990), S(0x0993, 0x09A8), S(0x09AA, 0x09B0),
+        S(0x09B2, 0x09B2), S(0x09B6, 0x09B9), C(0x09BC, 0x09BC),
+        S(0x09BD, 0x09BD), C(0x09BE, 0x09C4), C(0x09C7, 0x09C8),
+        C(0x09CB, 0x09CD), S(0x09CE, 0x09CE), C(0x09D7, 0x09D7),
+        S(0x09DC, 0x09DD), S(0x09DF, 0x09E1), C(0x09E2, 0x09E3),
+        C(0x09E6, 0x09EF), S(0x09F0, 0x09F1), S(0x09FC, 0x09FC),
+        C(0x09FE, 0x09FE), C(0x0A01, 0x0A03), S(0x0A05, 0x0A0A),
+        S(0x0A0F, 0x0A10), S(0x0A13, 0x0A28), S(0x0A2A, 0x0A30),
+        S(0x0A32, 0x0A33), S(0x0A35, 0x0A36), S(0x0A38, 0x0A39),
+        C(0x0A3C, 0x0A3C), C(0x0A3E, 0x0A42), C(0x0A47, 0x0A48),
+        C(0x0A4B, 0x0A4D), C(0x0A51, 0x0A51), S(0x0A59, 0x0A5C),
+        S(0x0A5E, 0x0A5E), C(0x0A66, 0x0A71), S(0x0A72, 0x0A74),
+        C(0x0A75, 0x0A75), C(0x0A81, 0x0A83), S(0x0A85, 0x0A8D),
+        S(0x0A8F, 0x0A91), S(0x0A93, 0x0AA8), S(0x0AAA, 0x0AB0),
+        S(0x0AB2, 0x0AB3), S(0x0AB5, 0x0AB9), C(0x0ABC, 0x0ABC),
+        S(0x0ABD, 0x0ABD), C(0x0ABE, 0x0AC5), C(0x0AC7, 0x0AC9),
+        C(0x0ACB, 0x0ACD), S(0x0AD0, 0x0AD0), S(0x0AE0, 0x0AE1),
+        C(0x0AE2, 0x0AE3), C(0x0AE6, 0x0AEF), S(0x0AF9, 0x0AF9),
+        C(0x0AFA, 0x0AFF), C(0x0B01, 0x0B03), S(0x0B05, 0x0B0C),
+        S(0x0B0F, 0x0B10), S(0x0B13, 0x0B28), S(0x0B2A, 0x0B30),
+        S(0x0B32, 0x0B33), S(0x0B35, 0x0B39), C(0x0B3C, 0x0B3C),
+        S(0x0B3D, 0x0B3D), C(0x0B3E, 0x0B44), C(0x0B47, 0x0B48),
+        C(0x0B4B, 0x0B4D), C(0x0B55, 0x0B57), S(0x0B5C, 0x0B5D),
+        S(0x0B5F, 0x0B61), C(0x0B62, 0x0B63), C(0x0B66, 0x0B6F),
+        S(0x0B71, 0x0B71), C(0x0B82, 0x0B82), S(0x0B83, 0x0B83),
+        S(0x0B85, 0x0B8A), S(0x0B8E, 0x0B90), S(0x0B92, 0x0B95),
+        S(0x0B99, 0x0B9A), S(0x0B9C, 0x0B9C), S(0x0B9E, 0x0B9F),
+        S(0x0BA3, 0x0BA4), S(0x0BA8, 0x0BAA), S(0x0BAE, 0x0BB9),
+        C(0x0BBE, 0x0BC2), C(0x0BC6, 0x0BC8), C(0x0BCA, 0x0BCD),
+        S(0x0BD0, 0x0BD0), C(0x0BD7, 0x0BD7), C(0x0BE6, 0x0BEF),
+        C(0x0C00, 0x0C04), S(0x0C05, 0x0C0C), S(0x0C0E, 0x0C10),
+        S(0x0C12, 0x0C28), S(0x0C2A, 0x0C39), C(0x0C3C, 0x0C3C),
+        S(0x0C3D, 0x0C3D), C(0x0C3E, 0x0C44), C(0x0C46, 0x0C48),
+        C(0x0C4A, 0x0C4D), C(0x0C55, 0x0C56), S(0x0C58, 0x0C5A),
+        S(0x0C5D, 0x0C5D), S(0x0C60, 0x0C61), C(0x0C62, 0x0C63),
+        C(0x0C66, 0x0C6F), S(0x0C80, 0x0C80), C(0x0C81, 0x0C83),
+        S(0x0C85, 0x0C8C), S(0x0C8E, 0x0C90), S(0x0C92, 0x0CA8),
+        S(0x0CAA, 0x0CB3), S(0x0CB5, 0x0CB9), C(0x0CBC, 0x0CBC),
+        S(0x0CBD, 0x0CBD), C(0x0CBE, 0x0CC4), C(0x0CC6, 0x0CC8),
+        C(0x0CCA, 0x0CCD), C(0x0CD5, 0x0CD6), S(0x0CDD, 0x0CDE),
+        S(0x0CE0, 0x0CE1), C(0x0CE2, 0x0CE3), C(0x0CE6, 0x0CEF),
+        S(0x0CF1, 0x0CF2), C(0x0D00, 0x0D03), S(0x0D04, 0x0D0C),
+        S(0x0D0E, 0x0D10), S(0x0D12, 0x0D3A), C(0x0D3B, 0x0D3C),
+        S(0x0D3D, 0x0D3D), C(0x0D3E, 0x0D44), C(0x0D46, 0x0D48),
+        C(0x0D4A, 0x0D4D), S(0x0D4E, 0x0D4E), S(0x0D54, 0x0D56),
+        C(0x0D57, 0x0D57), S(0x0D5F, 0x0D61), C(0x0D62, 0x0D63),
+        C(0x0D66, 0x0D6F), S(0x0D7A, 0x0D7F), C(0x0D81, 0x0D83),
+        S(0x0D85, 0x0D96), S(0x0D9A, 0x0DB1), S(0x0DB3, 0x0DBB),
+        S(0x0DBD, 0x0DBD), S(0x0DC0, 0x0DC6), C(0x0DCA, 0x0DCA),
+        C(0x0DCF, 0x0DD4), C(0x0DD6, 0x0DD6), C(0x0DD8, 0x0DDF),
+        C(0x0DE6, 0x0DEF), C(0x0DF2, 0x0DF3), S(0x0E01, 0x0E30),
+        C(0x0E31, 0x0E31), S(0x0E32, 0x0E32), C(0x0E33, 0x0E3A),
+        S(0x0E40, 0x0E46), C(0x0E47, 0x0E4E), C(0x0E50, 0x0E59),
+        S(0x0E81, 0x0E82), S(0x0E84, 0x0E84), S(0x0E86, 0x0E8A),
+        S(0x0E8C, 0x0EA3), S(0x0EA5, 0x0EA5), S(0x0EA7, 0x0EB0),
+        C(0x0EB1, 0x0EB1), S(0x0EB2, 0x0EB2), C(0x0EB3, 0x0EBC),
+        S(0x0EBD, 0x0EBD), S(0x0EC0, 0x0EC4), S(0x0EC6, 0x0EC6),
+        C(0x0EC8, 0x0ECD), C(0x0ED0, 0x0ED9), S(0x0EDC, 0x0EDF),
+        S(0x0F00, 0x0F00), C(0x0F18, 0x0F19), C(0x0F20, 0x0F29),
+        C(0x0F35, 0x0F35), C(0x0F37, 0x0F37), C(0x0F39, 0x0F39),
+        C(0x0F3E, 0x0F3F), S(0x0F40, 0x0F47), S(0x0F49, 0x0F6C),
+        C(0x0F71, 0x0F84), C(0x0F86, 0x0F87), S(0x0F88, 0x0F8C),
+        C(0x0F8D, 0x0F97), C(0x0F99, 0x0FBC), C(0x0FC6, 0x0FC6),
+        S(0x1000, 0x102A), C(0x102B, 0x103E), S(0x103F, 0x103F),
+        C(0x1040, 0x1049), S(0x1050, 0x1055), C(0x1056, 0x1059),
+        S(0x105A, 0x105D), C(0x105E, 0x1060), S(0x1061, 0x1061),
+        C(0x1062, 0x1064), S(0x1065, 0x1066), C(0x1067, 0x106D),
+        S(0x106E, 0x1070), C(0x1071, 0x1074), S(0x1075, 0x1081),
+        C(0x1082, 0x108D), S(0x108E, 0x108E), C(0x108F, 0x109D),
+        S(0x10A0, 0x10C5), S(0x10C7, 0x10C7), S(0x10CD, 0x10CD),
+        S(0x10D0, 0x10FA), S(0x10FC, 0x1248), S(0x124A, 0x124D),
+        S(0x1250, 0x1256), S(0x1258, 0x1258), S(0x125A, 0x125D),
+        S(0x1260, 0x1288), S(0x128A, 0x128D), S(0x1290, 0x12B0),
+        S(0x12B2, 0x12B5), S(0x12B8, 0x12BE), S(0x12C0, 0x12C0),
+        S(0x12C2, 0x12C5), S(0x12C8, 0x12D6), S(0x12D8, 0x1310),
+        S(0x1312, 0x1315), S(0x1318, 0x135A), C(0x135D, 0x135F),
+        C(0x1369, 0x1371), S(0x1380, 0x138F), S(0x13A0, 0x13F5),
+        S(0x13F8, 0x13FD), S(0x1401, 0x166C), S(0x166F, 0x167F),
+        S(0x1681, 0x169A), S(0x16A0, 0x16EA), S(0x16EE, 0x16F8),
+        S(0x1700, 0x1711), C(0x1712, 0x1715), S(0x171F, 0x1731),
+        C(0x1732, 0x1734), S(0x1740, 0x1751), C(0x1752, 0x1753),
+        S(0x1760, 0x176C), S(0x176E, 0x1770), C(0x1772, 0x1773),
+        S(0x1780, 0x17B3), C(0x17B4, 0x17D3), S(0x17D7, 0x17D7),
+        S(0x17DC, 0x17DC), C(0x17DD, 0x17DD), C(0x17E0, 0x17E9),
+        C(0x180B, 0x180D), C(0x180F, 0x1819), S(0x1820, 0x1878),
+        S(0x1880, 0x18A8), C(0x18A9, 0x18A9), S(0x18AA, 0x18AA),
+        S(0x18B0, 0x18F5), S(0x1900, 0x191E), C(0x1920, 0x192B),
+        C(0x1930, 0x193B), C(0x1946, 0x194F), S(0x1950, 0x196D),
+        S(0x1970, 0x1974), S(0x1980, 0x19AB), S(0x19B0, 0x19C9),
+        C(0x19D0, 0x19DA), S(0x1A00, 0x1A16), C(0x1A17, 0x1A1B),
+        S(0x1A20, 0x1A54), C(0x1A55, 0x1A5E), C(0x1A60, 0x1A7C),
+        C(0x1A7F, 0x1A89), C(0x1A90, 0x1A99), S(0x1AA7, 0x1AA7),
+        C(0x1AB0, 0x1ABD), C(0x1ABF, 0x1ACE), C(0x1B00, 0x1B04),
+        S(0x1B05, 0x1B33), C(0x1B34, 0x1B44), S(0x1B45, 0x1B4C),
+        C(0x1B50, 0x1B59), C(0x1B6B, 0x1B73), C(0x1B80, 0x1B82),
+        S(0x1B83, 0x1BA0), C(0x1BA1, 0x1BAD), S(0x1BAE, 0x1BAF),
+        C(0x1BB0, 0x1BB9), S(0x1BBA, 0x1BE5), C(0x1BE6, 0x1BF3),
+        S(0x1C00, 0x1C23), C(0x1C24, 0x1C37), C(0x1C40, 0x1C49),
+        S(0x1C4D, 0x1C4F), C(0x1C50, 0x1C59), S(0x1C5A, 0x1C7D),
+        S(0x1C80, 0x1C88), S(0x1C90, 0x1CBA), S(0x1CBD, 0x1CBF),
+        C(0x1CD0, 0x1CD2), C(0x1CD4, 0x1CE8), S(0x1CE9, 0x1CEC),
+        C(0x1CED, 0x1CED), S(0x1CEE, 0x1CF3), C(0x1CF4, 0x1CF4),
+        S(0x1CF5, 0x1CF6), C(0x1CF7, 0x1CF9), S(0x1CFA, 0x1CFA),
+        S(0x1D00, 0x1DBF), C(0x1DC0, 0x1DFF), S(0x1E00, 0x1F15),
+        S(0x1F18, 0x1F1D), S(0x1F20, 0x1F45), S(0x1F48, 0x1F4D),
+        S(0x1F50, 0x1F57), S(0x1F59, 0x1F59), S(0x1F5B, 0x1F5B),
+        S(0x1F5D, 0x1F5D), S(0x1F5F, 0x1F7D), S(0x1F80, 0x1FB4),
+        S(0x1FB6, 0x1FBC), S(0x1FBE, 0x1FBE), S(0x1FC2, 0x1FC4),
+        S(0x1FC6, 0x1FCC), S(0x1FD0, 0x1FD3), S(0x1FD6, 0x1FDB),
+        S(0x1FE0, 0x1FEC), S(0x1FF2, 0x1FF4), S(0x1FF6, 0x1FFC),
+        C(0x203F, 0x2040), C(0x2054, 0x2054), S(0x2071, 0x2071),
+        S(0x207F, 0x207F), S(0x2090, 0x209C), C(0x20D0, 0x20DC),
+        C(0x20E1, 0x20E1), C(0x20E5, 0x20F0), S(0x2102, 0x2102),
+        S(0x2107, 0x2107), S(0x210A, 0x2113), S(0x2115, 0x2115),
+        S(0x2118, 0x211D), S(0x2124, 0x2124), S(0x2126, 0x2126),
+        S(0x2128, 0x2128), S(0x212A, 0x2139), S(0x213C, 0x213F),
+        S(0x2145, 0x2149), S(0x214E, 0x214E), S(0x2160, 0x2188),
+        S(0x2C00, 0x2CE4), S(0x2CEB, 0x2CEE), C(0x2CEF, 0x2CF1),
+        S(0x2CF2, 0x2CF3), S(0x2D00, 0x2D25), S(0x2D27, 0x2D27),
+        S(0x2D2D, 0x2D2D), S(0x2D30, 0x2D67), S(0x2D6F, 0x2D6F),
+        C(0x2D7F, 0x2D7F), S(0x2D80, 0x2D96), S(0x2DA0, 0x2DA6),
+        S(0x2DA8, 0x2DAE), S(0x2DB0, 0x2DB6), S(0x2DB8, 0x2DBE),
+        S(0x2DC0, 0x2DC6), S(0x2DC8, 0x2DCE), S(0x2DD0, 0x2DD6),
+        S(0x2DD8, 0x2DDE), C(0x2DE0, 0x2DFF), S(0x3005, 0x3007),
+        S(0x3021, 0x3029), C(0x302A, 0x302F), S(0x3031, 0x3035),
+        S(0x3038, 0x303C), S(0x3041, 0x3096), C(0x3099, 0x309A),
+        S(0x309D, 0x309F), S(0x30A1, 0x30FA), S(0x30FC, 0x30FF),
+        S(0x3105, 0x312F), S(0x3131, 0x318E), S(0x31A0, 0x31BF),
+        S(0x31F0, 0x31FF), S(0x3400, 0x4DBF), S(0x4E00, 0xA48C),
+        S(0xA4D0, 0xA4FD), S(0xA500, 0xA60C), S(0xA610, 0xA61F),
+        C(0xA620, 0xA629), S(0xA62A, 0xA62B), S(0xA640, 0xA66E),
+        C(0xA66F, 0xA66F), C(0xA674, 0xA67D), S(0xA67F, 0xA69D),
+        C(0xA69E, 0xA69F), S(0xA6A0, 0xA6EF), C(0xA6F0, 0xA6F1),
+        S(0xA717, 0xA71F), S(0xA722, 0xA788), S(0xA78B, 0xA7CA),
+        S(0xA7D0, 0xA7D1), S(0xA7D3, 0xA7D3), S(0xA7D5, 0xA7D9),
+        S(0xA7F2, 0xA801), C(0xA802, 0xA802), S(0xA803, 0xA805),
+        C(0xA806, 0xA806), S(0xA807, 0xA80A), C(0xA80B, 0xA80B),
+        S(0xA80C, 0xA822), C(0xA823, 0xA827), C(0xA82C, 0xA82C),
+        S(0xA840, 0xA873), C(0xA880, 0xA881), S(0xA882, 0xA8B3),
+        C(0xA8B4, 0xA8C5), C(0xA8D0, 0xA8D9), C(0xA8E0, 0xA8F1),
+        S(0xA8F2, 0xA8F7), S(0xA8FB, 0xA8FB), S(0xA8FD, 0xA8FE),
+        C(0xA8FF, 0xA909), S(0xA90A, 0xA925), C(0xA926, 0xA92D),
+        S(0xA930, 0xA946), C(0xA947, 0xA953), S(0xA960, 0xA97C),
+        C(0xA980, 0xA983), S(0xA984, 0xA9B2), C(0xA9B3, 0xA9C0),
+        S(0xA9CF, 0xA9CF), C(0xA9D0, 0xA9D9), S(0xA9E0, 0xA9E4),
+        C(0xA9E5, 0xA9E5), S(0xA9E6, 0xA9EF), C(0xA9F0, 0xA9F9),
+        S(0xA9FA, 0xA9FE), S(0xAA00, 0xAA28), C(0xAA29, 0xAA36),
+        S(0xAA40, 0xAA42), C(0xAA43, 0xAA43), S(0xAA44, 0xAA4B),
+        C(0xAA4C, 0xAA4D), C(0xAA50, 0xAA59), S(0xAA60, 0xAA76),
+        S(0xAA7A, 0xAA7A), C(0xAA7B, 0xAA7D), S(0xAA7E, 0xAAAF),
+        C(0xAAB0, 0xAAB0), S(0xAAB1, 0xAAB1), C(0xAAB2, 0xAAB4),
+        S(0xAAB5, 0xAAB6), C(0xAAB7, 0xAAB8), S(0xAAB9, 0xAABD),
+        C(0xAABE, 0xAABF), S(0xAAC0, 0xAAC0), C(0xAAC1, 0xAAC1),
+        S(0xAAC2, 0xAAC2), S(0xAADB, 0xAADD), S(0xAAE0, 0xAAEA),
+        C(0xAAEB, 0xAAEF), S(0xAAF2, 0xAAF4), C(0xAAF5, 0xAAF6),
+        S(0xAB01, 0xAB06), S(0xAB09, 0xAB0E), S(0xAB11, 0xAB16),
+        S(0xAB20, 0xAB26), S(0xAB28, 0xAB2E), S(0xAB30, 0xAB5A),
+        S(0xAB5C, 0xAB69), S(0xAB70, 0xABE2), C(0xABE3, 0xABEA),
+        C(0xABEC, 0xABED), C(0xABF0, 0xABF9), S(0xAC00, 0xD7A3),
+        S(0xD7B0, 0xD7C6), S(0xD7CB, 0xD7FB), S(0xF900, 0xFA6D),
+        S(0xFA70, 0xFAD9), S(0xFB00, 0xFB06), S(0xFB13, 0xFB17),
+        S(0xFB1D, 0xFB1D), C(0xFB1E, 0xFB1E), S(0xFB1F, 0xFB28),
+        S(0xFB2A, 0xFB36), S(0xFB38, 0xFB3C), S(0xFB3E, 0xFB3E),
+        S(0xFB40, 0xFB41), S(0xFB43, 0xFB44), S(0xFB46, 0xFBB1),
+        S(0xFBD3, 0xFC5D), S(0xFC64, 0xFD3D), S(0xFD50, 0xFD8F),
+        S(0xFD92, 0xFDC7), S(0xFDF0, 0xFDF9), C(0xFE00, 0xFE0F),
+        C(0xFE20, 0xFE2F), C(0xFE33, 0xFE34), C(0xFE4D, 0xFE4F),
+        S(0xFE71, 0xFE71), S(0xFE73, 0xFE73), S(0xFE77, 0xFE77),
+        S(0xFE79, 0xFE79), S(0xFE7B, 0xFE7B), S(0xFE7D, 0xFE7D),
+        S(0xFE7F, 0xFEFC), C(0xFF10, 0xFF19), S(0xFF21, 0xFF3A),
+        C(0xFF3F, 0xFF3F), S(0xFF41, 0xFF5A), S(0xFF66, 0xFF9D),
+        C(0xFF9E, 0xFF9F), S(0xFFA0, 0xFFBE), S(0xFFC2, 0xFFC7),
+        S(0xFFCA, 0xFFCF), S(0xFFD2, 0xFFD7), S(0xFFDA, 0xFFDC),
+        S(0x10000, 0x1000B), S(0x1000D, 0x10026), S(0x10028, 0x1003A),
+        S(0x1003C, 0x1003D), S(0x1003F, 0x1004D), S(0x10050, 0x1005D),
+        S(0x10080, 0x100FA), S(0x10140, 0x10174), C(0x101FD, 0x101FD),
+        S(0x10280, 0x1029C), S(0x102A0, 0x102D0), C(0x102E0, 0x102E0),
+        S(0x10300, 0x1031F), S(0x1032D, 0x1034A), S(0x10350, 0x10375),
+        C(0x10376, 0x1037A), S(0x10380, 0x1039D), S(0x103A0, 0x103C3),
+        S(0x103C8, 0x103CF), S(0x103D1, 0x103D5), S(0x10400, 0x1049D),
+        C(0x104A0, 0x104A9), S(0x104B0, 0x104D3), S(0x104D8, 0x104FB),
+        S(0x10500, 0x10527), S(0x10530, 0x10563), S(0x10570, 0x1057A),
+        S(0x1057C, 0x1058A), S(0x1058C, 0x10592), S(0x10594, 0x10595),
+        S(0x10597, 0x105A1), S(0x105A3, 0x105B1), S(0x105B3, 0x105B9),
+        S(0x105BB, 0x105BC), S(0x10600, 0x10736), S(0x10740, 0x10755),
+        S(0x10760, 0x10767), S(0x10780, 0x10785), S(0x10787, 0x107B0),
+        S(0x107B2, 0x107BA), S(0x10800, 0x10805), S(0x10808, 0x10808),
+        S(0x1080A, 0x10835), S(0x10837, 0x10838), S(0x1083C, 0x1083C),
+        S(0x1083F, 0x10855), S(0x10860, 0x10876), S(0x10880, 0x1089E),
+        S(0x108E0, 0x108F2), S(0x108F4, 0x108F5), S(0x10900, 0x10915),
+        S(0x10920, 0x10939), S(0x10980, 0x109B7), S(0x109BE, 0x109BF),
+        S(0x10A00, 0x10A00), C(0x10A01, 0x10A03), C(0x10A05, 0x10A06),
+        C(0x10A0C, 0x10A0F), S(0x10A10, 0x10A13), S(0x10A15, 0x10A17),
+        S(0x10A19, 0x10A35), C(0x10A38, 0x10A3A), C(0x10A3F, 0x10A3F),
+        S(0x10A60, 0x10A7C), S(0x10A80, 0x10A9C), S(0x10AC0, 0x10AC7),
+        S(0x10AC9, 0x10AE4), C(0x10AE5, 0x10AE6), S(0x10B00, 0x10B35),
+        S(0x10B40, 0x10B55), S(0x10B60, 0x10B72), S(0x10B80, 0x10B91),
+        S(0x10C00, 0x10C48), S(0x10C80, 0x10CB2), S(0x10CC0, 0x10CF2),
+        S(0x10D00, 0x10D23), C(0x10D24, 0x10D27), C(0x10D30, 0x10D39),
+        S(0x10E80, 0x10EA9), C(0x10EAB, 0x10EAC), S(0x10EB0, 0x10EB1),
+        S(0x10F00, 0x10F1C), S(0x10F27, 0x10F27), S(0x10F30, 0x10F45),
+        C(0x10F46, 0x10F50), S(0x10F70, 0x10F81), C(0x10F82, 0x10F85),
+        S(0x10FB0, 0x10FC4), S(0x10FE0, 0x10FF6), C(0x11000, 0x11002),
+        S(0x11003, 0x11037), C(0x11038, 0x11046), C(0x11066, 0x11070),
+        S(0x11071, 0x11072), C(0x11073, 0x11074), S(0x11075, 0x11075),
+        C(0x1107F, 0x11082), S(0x11083, 0x110AF), C(0x110B0, 0x110BA),
+        C(0x110C2, 0x110C2), S(0x110D0, 0x110E8), C(0x110F0, 0x110F9),
+        C(0x11100, 0x11102), S(0x11103, 0x11126), C(0x11127, 0x11134),
+        C(0x11136, 0x1113F), S(0x11144, 0x11144), C(0x11145, 0x11146),
+        S(0x11147, 0x11147), S(0x11150, 0x11172), C(0x11173, 0x11173),
+        S(0x11176, 0x11176), C(0x11180, 0x11182), S(0x11183, 0x111B2),
+        C(0x111B3, 0x111C0), S(0x111C1, 0x111C4), C(0x111C9, 0x111CC),
+        C(0x111CE, 0x111D9), S(0x111DA, 0x111DA), S(0x111DC, 0x111DC),
+        S(0x11200, 0x11211), S(0x11213, 0x1122B), C(0x1122C, 0x11237),
+        C(0x1123E, 0x1123E), S(0x11280, 0x11286), S(0x11288, 0x11288),
+        S(0x1128A, 0x1128D), S(0x1128F, 0x1129D), S(0x1129F, 0x112A8),
+        S(0x112B0, 0x112DE), C(0x112DF, 0x112EA), C(0x112F0, 0x112F9),
+        C(0x11300, 0x11303), S(0x11305, 0x1130C), S(0x1130F, 0x11310),
+        S(0x11313, 0x11328), S(0x1132A, 0x11330), S(0x11332, 0x11333),
+        S(0x11335, 0x11339), C(0x1133B, 0x1133C), S(0x1133D, 0x1133D),
+        C(0x1133E, 0x11344), C(0x11347, 0x11348), C(0x1134B, 0x1134D),
+        S(0x11350, 0x11350), C(0x11357, 0x11357), S(0x1135D, 0x11361),
+        C(0x11362, 0x11363), C(0x11366, 0x1136C), C(0x11370, 0x11374),
+        S(0x11400, 0x11434), C(0x11435, 0x11446), S(0x11447, 0x1144A),
+        C(0x11450, 0x11459), C(0x1145E, 0x1145E), S(0x1145F, 0x11461),
+        S(0x11480, 0x114AF), C(0x114B0, 0x114C3), S(0x114C4, 0x114C5),
+        S(0x114C7, 0x114C7), C(0x114D0, 0x114D9), S(0x11580, 0x115AE),
+        C(0x115AF, 0x115B5), C(0x115B8, 0x115C0), S(0x115D8, 0x115DB),
+        C(0x115DC, 0x115DD), S(0x11600, 0x1162F), C(0x11630, 0x11640),
+        S(0x11644, 0x11644), C(0x11650, 0x11659), S(0x11680, 0x116AA),
+        C(0x116AB, 0x116B7), S(0x116B8, 0x116B8), C(0x116C0, 0x116C9),
+        S(0x11700, 0x1171A), C(0x1171D, 0x1172B), C(0x11730, 0x11739),
+        S(0x11740, 0x11746), S(0x11800, 0x1182B), C(0x1182C, 0x1183A),
+        S(0x118A0, 0x118DF), C(0x118E0, 0x118E9), S(0x118FF, 0x11906),
+        S(0x11909, 0x11909), S(0x1190C, 0x11913), S(0x11915, 0x11916),
+        S(0x11918, 0x1192F), C(0x11930, 0x11935), C(0x11937, 0x11938),
+        C(0x1193B, 0x1193E), S(0x1193F, 0x1193F), C(0x11940, 0x11940),
+        S(0x11941, 0x11941), C(0x11942, 0x11943), C(0x11950, 0x11959),
+        S(0x119A0, 0x119A7), S(0x119AA, 0x119D0), C(0x119D1, 0x119D7),
+        C(0x119DA, 0x119E0), S(0x119E1, 0x119E1), S(0x119E3, 0x119E3),
+        C(0x119E4, 0x119E4), S(0x11A00, 0x11A00), C(0x11A01, 0x11A0A),
+        S(0x11A0B, 0x11A32), C(0x11A33, 0x11A39), S(0x11A3A, 0x11A3A),
+        C(0x11A3B, 0x11A3E), C(0x11A47, 0x11A47), S(0x11A50, 0x11A50),
+        C(0x11A51, 0x11A5B), S(0x11A5C, 0x11A89), C(0x11A8A, 0x11A99),
+        S(0x11A9D, 0x11A9D), S(0x11AB0, 0x11AF8), S(0x11C00, 0x11C08),
+        S(0x11C0A, 0x11C2E), C(0x11C2F, 0x11C36), C(0x11C38, 0x11C3F),
+        S(0x11C40, 0x11C40), C(0x11C50, 0x11C59), S(0x11C72, 0x11C8F),
+        C(0x11C92, 0x11CA7), C(0x11CA9, 0x11CB6), S(0x11D00, 0x11D06),
+        S(0x11D08, 0x11D09), S(0x11D0B, 0x11D30), C(0x11D31, 0x11D36),
+        C(0x11D3A, 0x11D3A), C(0x11D3C, 0x11D3D), C(0x11D3F, 0x11D45),
+        S(0x11D46, 0x11D46), C(0x11D47, 0x11D47), C(0x11D50, 0x11D59),
+        S(0x11D60, 0x11D65), S(0x11D67, 0x11D68), S(0x11D6A, 0x11D89),
+        C(0x11D8A, 0x11D8E), C(0x11D90, 0x11D91), C(0x11D93, 0x11D97),
+        S(0x11D98, 0x11D98), C(0x11DA0, 0x11DA9), S(0x11EE0, 0x11EF2),
+        C(0x11EF3, 0x11EF6), S(0x11FB0, 0x11FB0), S(0x12000, 0x12399),
+        S(0x12400, 0x1246E), S(0x12480, 0x12543), S(0x12F90, 0x12FF0),
+        S(0x13000, 0x1342E), S(0x14400, 0x14646), S(0x16800, 0x16A38),
+        S(0x16A40, 0x16A5E), C(0x16A60, 0x16A69), S(0x16A70, 0x16ABE),
+        C(0x16AC0, 0x16AC9), S(0x16AD0, 0x16AED), C(0x16AF0, 0x16AF4),
+        S(0x16B00, 0x16B2F), C(0x16B30, 0x16B36), S(0x16B40, 0x16B43),
+        C(0x16B50, 0x16B59), S(0x16B63, 0x16B77), S(0x16B7D, 0x16B8F),
+        S(0x16E40, 0x16E7F), S(0x16F00, 0x16F4A), C(0x16F4F, 0x16F4F),
+        S(0x16F50, 0x16F50), C(0x16F51, 0x16F87), C(0x16F8F, 0x16F92),
+        S(0x16F93, 0x16F9F), S(0x16FE0, 0x16FE1), S(0x16FE3, 0x16FE3),
+        C(0x16FE4, 0x16FE4), C(0x16FF0, 0x16FF1), S(0x17000, 0x187F7),
+        S(0x18800, 0x18CD5), S(0x18D00, 0x18D08), S(0x1AFF0, 0x1AFF3),
+        S(0x1AFF5, 0x1AFFB), S(0x1AFFD, 0x1AFFE), S(0x1B000, 0x1B122),
+        S(0x1B150, 0x1B152), S(0x1B164, 0x1B167), S(0x1B170, 0x1B2FB),
+        S(0x1BC00, 0x1BC6A), S(0x1BC70, 0x1BC7C), S(0x1BC80, 0x1BC88),
+        S(0x1BC90, 0x1BC99), C(0x1BC9D, 0x1BC9E), C(0x1CF00, 0x1CF2D),
+        C(0x1CF30, 0x1CF46), C(0x1D165, 0x1D169), C(0x1D16D, 0x1D172),
+        C(0x1D17B, 0x1D182), C(0x1D185, 0x1D18B), C(0x1D1AA, 0x1D1AD),
+        C(0x1D242, 0x1D244), S(0x1D400, 0x1D454), S(0x1D456, 0x1D49C),
+        S(0x1D49E, 0x1D49F), S(0x1D4A2, 0x1D4A2), S(0x1D4A5, 0x1D4A6),
+        S(0x1D4A9, 0x1D4AC), S(0x1D4AE, 0x1D4B9), S(0x1D4BB, 0x1D4BB),
+        S(0x1D4BD, 0x1D4C3), S(0x1D4C5, 0x1D505), S(0x1D507, 0x1D50A),
+        S(0x1D50D, 0x1D514), S(0x1D516, 0x1D51C), S(0x1D51E, 0x1D539),
+        S(0x1D53B, 0x1D53E), S(0x1D540, 0x1D544), S(0x1D546, 0x1D546),
+        S(0x1D54A, 0x1D550), S(0x1D552, 0x1D6A5), S(0x1D6A8, 0x1D6C0),
+        S(0x1D6C2, 0x1D6DA), S(0x1D6DC, 0x1D6FA), S(0x1D6FC, 0x1D714),
+        S(0x1D716, 0x1D734), S(0x1D736, 0x1D74E), S(0x1D750, 0x1D76E),
+        S(0x1D770, 0x1D788), S(0x1D78A, 0x1D7A8), S(0x1D7AA, 0x1D7C2),
+        S(0x1D7C4, 0x1D7CB), C(0x1D7CE, 0x1D7FF), C(0x1DA00, 0x1DA36),
+        C(0x1DA3B, 0x1DA6C), C(0x1DA75, 0x1DA75), C(0x1DA84, 0x1DA84),
+        C(0x1DA9B, 0x1DA9F), C(0x1DAA1, 0x1DAAF), S(0x1DF00, 0x1DF1E),
+        C(0x1E000, 0x1E006), C(0x1E008, 0x1E018), C(0x1E01B, 0x1E021),
+        C(0x1E023, 0x1E024), C(0x1E026, 0x1E02A), S(0x1E100, 0x1E12C),
+        C(0x1E130, 0x1E136), S(0x1E137, 0x1E13D), C(0x1E140, 0x1E149),
+        S(0x1E14E, 0x1E14E), S(0x1E290, 0x1E2AD), C(0x1E2AE, 0x1E2AE),
+        S(0x1E2C0, 0x1E2EB), C(0x1E2EC, 0x1E2F9), S(0x1E7E0, 0x1E7E6),
+        S(0x1E7E8, 0x1E7EB), S(0x1E7ED, 0x1E7EE), S(0x1E7F0, 0x1E7FE),
+        S(0x1E800, 0x1E8C4), C(0x1E8D0, 0x1E8D6), S(0x1E900, 0x1E943),
+        C(0x1E944, 0x1E94A), S(0x1E94B, 0x1E94B), C(0x1E950, 0x1E959),
+        S(0x1EE00, 0x1EE03), S(0x1EE05, 0x1EE1F), S(0x1EE21, 0x1EE22),
+        S(0x1EE24, 0x1EE24), S(0x1EE27, 0x1EE27), S(0x1EE29, 0x1EE32),
+        S(0x1EE34, 0x1EE37), S(0x1EE39, 0x1EE39), S(0x1EE3B, 0x1EE3B),
+        S(0x1EE42, 0x1EE42), S(0x1EE47, 0x1EE47), S(0x1EE49, 0x1EE49),
+        S(0x1EE4B, 0x1EE4B), S(0x1EE4D, 0x1EE4F), S(0x1EE51, 0x1EE52),
+        S(0x1EE54, 0x1EE54), S(0x1EE57, 0x1EE57), S(0x1EE59, 0x1EE59),
+        S(0x1EE5B, 0x1EE5B), S(0x1EE5D, 0x1EE5D), S(0x1EE5F, 0x1EE5F),
+        S(0x1EE61, 0x1EE62), S(0x1EE64, 0x1EE64), S(0x1EE67, 0x1EE6A),
+        S(0x1EE6C, 0x1EE72), S(0x1EE74, 0x1EE77), S(0x1EE79, 0x1EE7C),
+        S(0x1EE7E, 0x1EE7E), S(0x1EE80, 0x1EE89), S(0x1EE8B, 0x1EE9B),
+        S(0x1EEA1, 0x1EEA3), S(0x1EEA5, 0x1EEA9), S(0x1EEAB, 0x1EEBB),
+        C(0x1FBF0, 0x1FBF9), S(0x20000, 0x2A6DF), S(0x2A700, 0x2B738),
+        S(0x2B740, 0x2B81D), S(0x2B820, 0x2CEA1), S(0x2CEB0, 0x2EBE0),
+        S(0x2F800, 0x2FA1D), S(0x30000, 0x3134A), C(0xE0100, 0xE01EF),
+};
+
+#undef S
+#undef C
+
+// The length of the well-formed UTF-8 sequence at s, or 0 if there is
+// none. At most avail bytes are read, and none past the first one that
+// breaks the sequence, so a NUL terminator stops it too. Overlong forms,
+// surrogates and code points above U+10FFFF are not well-formed.
+static int
+utf8_seq_len(const unsigned char *s, size_t avail)
+{
+        unsigned char lo;
+        unsigned char hi;
+        int n;
+
+        lo = 0x80;
+        hi = 0xBF;
+        if (s[0] < 0x80) {
+                return 1;
+        } else if (s[0] < 0xC2) {
+                return 0;
+        } else if (s[0] < 0xE0) {
+                n = 2;
+        } else if (s[0] < 0xF0) {
+                n = 3;
+                lo = s[0] == 0xE0 ? 0xA0 : 0x80;
+                hi = s[0] == 0xED ? 0x9F : 0xBF;
+        } else if (s[0] < 0xF5) {
+                n = 4;
+                lo = s[0] == 0xF0 ? 0x90 : 0x80;
+                hi = s[0] == 0xF4 ? 0x8F : 0xBF;
+        } else {
+                return 0;
+        }
+        if ((size_t) n > avail || s[1] < lo || s[1] > hi) {
+                return 0;
+        }
+        for (int i = 2; i < n; ++i) {
+                if (s[i] < 0x80 || s[i] > 0xBF) {
+                        return 0;
+                }
+        }
+        return n;
+}
+
+#ifdef __SSE2__
+static __m128i
+load16(const unsigned char *s)
+{
+        return _mm_loadu_si128((const __m128i *) s);
+}
+#endif
+
+// Returns how many bytes from the start of src are valid UTF-8: len if
+// all of them are. Runs of ASCII are skipped 64 and then 16 bytes at a
+// time by their high bits; only the blocks with other bytes in them are
+// checked a sequence at a time.
+size_t
+utf8_valid_prefix(const char *src, size_t len)
+{
+        const unsigned char *s;
+        size_t end;
+        size_t i;
+        int n;
+
+        s = (const unsigned char *) src;
+        i = 0;
+        while (i < len) {
+#ifdef __SSE2__
+                while (i + 64 <= len && !_mm_movemask_epi8(_mm_or_si128(
+                                        _mm_or_si128(load16(s + i),
+                                                load16(s + i + 16)),
+                                        _mm_or_si128(load16(s + i + 32),
+                                                load16(s + i + 48))))) {
+                        i += 64;
+                }
+                while (i + 16 <= len && !_mm_movemask_epi8(load16(s + i))) {
+                        i += 16;
+                }
+#endif
+                end = MIN(i + 16, len);
+                while (i < end) {
+                        if (s[i] < 0x80) {
+                                ++i;
+                                continue;
+                        }
+                        n = utf8_seq_len(s + i, len - i);
+                        if (!n) {
+                                return i;
+                        }
+                        i += n;
+                }
+        }
+        return len;
+}
+
+// Decodes the sequence at s, which must be NUL-terminated or have four
+// bytes to read, into *cp. Returns its length, or 0 if it is malformed.
+int
+utf8_decode(const char *s, uint32_t *cp)
+{
+        static const unsigned char lead_bits[] = { 0, 0x7F, 0x1F, 0x0F, 0x07 };
+        const unsigned char *u;
+        int n;
+
+        u = (const unsigned char *) s;
+        n = utf8_seq_len(u, 4);
+        if (n) {
+                *cp = u[0] & lead_bits[n];
+                for (int i = 1; i < n; ++i) {
+                        *cp = *cp << 6 | (u[i] & 0x3F);
+                }
+        }
+        return n;
+}
+
+// 0 for neither, 1 for XID_Continue only, 2 for XID_Start.
+static int
+xid_class(uint32_t cp)
+{
+        size_t lo;
+        size_t hi;
+        size_t mid;
+
+        lo = 0;
+        hi = sizeof(xid_ranges) / sizeof(*xid_ranges);
+        while (lo < hi) {
+                mid = lo + (hi - lo) / 2;
+                if (cp < xid_ranges[mid][0]) {
+                        hi = mid;
+                } else if (cp > (xid_ranges[mid][1] & ~XID_START_BIT)) {
+                        lo = mid + 1;
+                } else {
+                        return xid_ranges[mid][1] & XID_START_BIT ? 2 : 1;
+                }
+        }
+        return 0;
+}
+
+bool
+xid_start(uint32_t cp)
+{
+        if (cp < 0x80) {
+                return isalpha(cp) || cp == '_';
+        }
+        return xid_class(cp) == 2;
+}
+
+bool
+xid_continue(uint32_t cp)
+{
+        if (cp < 0x80) {
+                return isalnum(cp) || cp == '_';
+        }
+        return xid_class(cp) != 0;
+}
+
+void
+unicode_test(void)
+{
+        char buf[200];
+        uint32_t cp;
+
+        assert(utf8_valid_prefix("", 0) == 0);
+        assert(utf8_valid_prefix("h\xC3\xA9llo \xE2\x82\xAC \xF0\x9D\x84\x9E",
+                                15) == 15);
+        // Overlong, surrogate, too large, stray continuation, truncated.
+        assert(utf8_valid_prefix("a\xC0\x80", 3) == 1);
+        assert(utf8_valid_prefix("a\xE0\x80\x80", 4) == 1);
+        assert(utf8_valid_prefix("a\xED\xA0\x80", 4) == 1);
+        assert(utf8_valid_prefix("a\xF4\x90\x80\x80", 5) == 1);
+        assert(utf8_valid_prefix("a\x80", 2) == 1);
+        assert(utf8_valid_prefix("a\xE2\x82", 3) == 1);
+        assert(utf8_valid_prefix("\xE2\x82\xAC", 2) == 0);
+
+        // Long ASCII runs go through the vector loops; errors anywhere
+        // after them are still found at the right offset.
+        memset(buf, 'x', sizeof(buf));
+        assert(utf8_valid_prefix(buf, sizeof(buf)) == sizeof(buf));
+        for (size_t i = 0; i + 3 <= sizeof(buf); i += 7) {
+                memset(buf, 'x', sizeof(buf));
+                memcpy(buf + i, "\xE2\x82\xAC", 3);
+                assert(utf8_valid_prefix(buf, sizeof(buf)) == sizeof(buf));
+                buf[i + 2] = 'x';
+                assert(utf8_valid_prefix(buf, sizeof(buf)) == i);
+        }
+
+        assert(utf8_decode("\xC3\xA9", &cp) == 2 && cp == 0xE9);
+        assert(utf8_decode("\xE2\x82\xAC", &cp) == 3 && cp == 0x20AC);
+        assert(utf8_decode("\xF0\x9D\x84\x9E", &cp) == 4 && cp == 0x1D11E);
+        assert(utf8_decode("\xE2\x82", &cp) == 0);
+        assert(utf8_decode("\xFF", &cp) == 0);
+
+        assert(xid_start('a') && xid_start('_') && !xid_start('1'));
+        assert(xid_continue('1') && !xid_continue('$'));
+        assert(xid_start(0xE9) && xid_start(0x4E2D) && xid_start(0x0391));
+        assert(!xid_start(0x0301) && xid_continue(0x0301));
+        assert(!xid_start(0x20AC) && !xid_continue(0x20AC));
+        assert(!xid_continue(0xD800) && !xid_continue(0x10FFFF));
+        assert(xid_start(0x30000) && !xid_start(0x3134B));
+}
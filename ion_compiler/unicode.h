@@ -0,0 +1,28 @@
+#ifndef _UNICODE_H_
+#define _UNICODE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common.h"
+
+// UTF-8 and identifier classes. Sources are UTF-8; names may use any
+// character with the Unicode XID_Start property followed by XID_Continue
+// ones, besides the ASCII letters, digits and underscore.
+
+size_t
+utf8_valid_prefix(const char *src, size_t len);
+
+int
+utf8_decode(const char *s, uint32_t *cp);
+
+bool
+xid_start(uint32_t cp);
+
+bool
+xid_continue(uint32_t cp);
+
+void
+unicode_test(void);
+
+#endif
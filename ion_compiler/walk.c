@@ -0,0 +1,434 @@
+#include <unistd.h>
+
+#include "walk.h"
+
+// Optional children that are absent are left out.
+static void
+push_child(AstNode **kids, AstKind kind, void *ptr)
+{
+        if (ptr) {
+                buf_push(*kids, AST_NODE(kind, ptr));
+        }
+}
+
+static void
+push_exprs(AstNode **kids, Expr **exprs, size_t num_exprs)
+{
+        for (Expr **it = exprs; it != exprs + num_exprs; ++it) {
+                push_child(kids, AST_EXPR, *it);
+        }
+}
+
+static void
+push_typespec_children(AstNode **kids, Typespec *t)
+{
+        switch (t->kind) {
+        case TYPESPEC_NAME:
+                break;
+        case TYPESPEC_FUNC:
+                for (Typespec **it = t->func.args;
+                                it != t->func.args + t->func.num_args; ++it) {
+                        push_child(kids, AST_TYPESPEC, *it);
+                }
+                push_child(kids, AST_TYPESPEC, t->func.ret);
+                break;
+        case TYPESPEC_ARRAY:
+                push_child(kids, AST_TYPESPEC, t->array.elem);
+                push_child(kids, AST_EXPR, t->array.size);
+                break;
+        case TYPESPEC_PTR:
+                push_child(kids, AST_TYPESPEC, t->ptr.elem);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+static void
+push_expr_children(AstNode **kids, Expr *e)
+{
+        switch (e->kind) {
+        case EXPR_NONE:
+        case EXPR_INT:
+        case EXPR_FLOAT:
+        case EXPR_STR:
+        case EXPR_NAME:
+                break;
+        case EXPR_CAST:
+                push_child(kids, AST_TYPESPEC, e->cast.type);
+                push_child(kids, AST_EXPR, e->cast.expr);
+                break;
+        case EXPR_CALL:
+                push_child(kids, AST_EXPR, e->call.expr);
+                push_exprs(kids, e->call.args, e->call.num_args);
+                break;
+        case EXPR_INDEX:
+                push_child(kids, AST_EXPR, e->index.expr);
+                push_child(kids, AST_EXPR, e->index.index);
+                break;
+        case EXPR_FIELD:
+                push_child(kids, AST_EXPR, e->field.expr);
+                break;
+        case EXPR_COMPOUND:
+                push_child(kids, AST_TYPESPEC, e->compound.type);
+                push_exprs(kids, e->compound.args, e->compound.num_args);
+                break;
+        case EXPR_UNARY:
+                push_child(kids, AST_EXPR, e->unary.expr);
+                break;
+        case EXPR_BINARY:
+                push_child(kids, AST_EXPR, e->binary.left);
+                push_child(kids, AST_EXPR, e->binary.right);
+                break;
+        case EXPR_TERNARY:
+                push_child(kids, AST_EXPR, e->ternary.cond);
+                push_child(kids, AST_EXPR, e->ternary.if_true);
+                push_child(kids, AST_EXPR, e->ternary.if_false);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+static void
+push_stmt_children(AstNode **kids, Stmt *s)
+{
+        switch (s->kind) {
+        case STMT_BREAK:
+        case STMT_CONTINUE:
+                break;
+        case STMT_RETURN:
+        case STMT_EXPR:
+                push_child(kids, AST_EXPR, s->expr);
+                break;
+        case STMT_BLOCK:
+                push_child(kids, AST_BLOCK, &s->block);
+                break;
+        case STMT_IF:
+                push_child(kids, AST_EXPR, s->if_stmt.cond);
+                push_child(kids, AST_BLOCK, &s->if_stmt.then_block);
+                for (ElseIf *it = s->if_stmt.elseifs;
+                                it != s->if_stmt.elseifs +
+                                s->if_stmt.num_elseifs; ++it) {
+                        push_child(kids, AST_ELSEIF, it);
+                }
+                push_child(kids, AST_BLOCK, &s->if_stmt.else_block);
+                break;
+        case STMT_WHILE:
+        case STMT_DO:
+                push_child(kids, AST_EXPR, s->while_stmt.cond);
+                push_child(kids, AST_BLOCK, &s->while_stmt.block);
+                break;
+        case STMT_FOR:
+                push_child(kids, AST_BLOCK, &s->for_stmt.init);
+                push_child(kids, AST_EXPR, s->for_stmt.cond);
+                push_child(kids, AST_BLOCK, &s->for_stmt.next);
+                push_child(kids, AST_BLOCK, &s->for_stmt.block);
+                break;
+        case STMT_SWITCH:
+                push_child(kids, AST_EXPR, s->switch_stmt.expr);
+                for (SwitchCase *it = s->switch_stmt.cases;
+                                it != s->switch_stmt.cases +
+                                s->switch_stmt.num_cases; ++it) {
+                        push_child(kids, AST_CASE, it);
+                }
+                break;
+        case STMT_ASSIGN:
+                push_child(kids, AST_EXPR, s->assign.left);
+                push_child(kids, AST_EXPR, s->assign.right);
+                break;
+        case STMT_AUTO_ASSIGN:
+                push_child(kids, AST_EXPR, s->autoassign.init);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+static void
+push_decl_children(AstNode **kids, Decl *d)
+{
+        switch (d->kind) {
+        case DECL_ENUM:
+                for (EnumItem *it = d->enum_decl.items;
+                                it != d->enum_decl.items +
+                                d->enum_decl.num_items; ++it) {
+                        push_child(kids, AST_EXPR, it->init);
+                }
+                break;
+        case DECL_STRUCT:
+        case DECL_UNION:
+                for (AggregateItem *it = d->aggregate.items;
+                                it != d->aggregate.items +
+                                d->aggregate.num_items; ++it) {
+                        push_child(kids, AST_TYPESPEC, it->type);
+                }
+                break;
+        case DECL_VAR:
+                push_child(kids, AST_TYPESPEC, d->var.type);
+                push_child(kids, AST_EXPR, d->var.expr);
+                break;
+        case DECL_CONST:
+                push_child(kids, AST_EXPR, d->const_decl.expr);
+                break;
+        case DECL_TYPEDEF:
+                push_child(kids, AST_TYPESPEC, d->typedef_decl.type);
+                break;
+        case DECL_FUNC:
+                for (FuncParam *it = d->func.params;
+                                it != d->func.params + d->func.num_params;
+                                ++it) {
+                        push_child(kids, AST_TYPESPEC, it->type);
+                }
+                push_child(kids, AST_TYPESPEC, d->func.ret_type);
+                push_child(kids, AST_BLOCK, &d->func.block);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+// Appends node's children to *kids in source order.
+static void
+push_children(AstNode **kids, AstNode node)
+{
+        switch (node.kind) {
+        case AST_TYPESPEC:
+                push_typespec_children(kids, node.type);
+                break;
+        case AST_EXPR:
+                push_expr_children(kids, node.expr);
+                break;
+        case AST_STMT:
+                push_stmt_children(kids, node.stmt);
+                break;
+        case AST_DECL:
+                push_decl_children(kids, node.decl);
+                break;
+        case AST_BLOCK:
+                for (Stmt **it = node.block->stmts;
+                                it != node.block->stmts +
+                                node.block->num_stmts; ++it) {
+                        push_child(kids, AST_STMT, *it);
+                }
+                break;
+        case AST_ELSEIF:
+                push_child(kids, AST_EXPR, node.elseif->cond);
+                push_child(kids, AST_BLOCK, &node.elseif->block);
+                break;
+        case AST_CASE:
+                push_exprs(kids, node.switch_case->exprs,
+                                node.switch_case->num_exprs);
+                push_child(kids, AST_BLOCK, &node.switch_case->block);
+                break;
+        default:
+                assert(0);
+                break;
+        }
+}
+
+// Visits the tree under root. A node stays on the stack while its subtree
+// is walked, so each frame is pushed and popped once and its children are
+// pushed in reverse to come off the stack in source order.
+void
+ast_walk(AstNode root, Walker *walkers, size_t num_walkers)
+{
+        WalkFrame *stack;
+        WalkFrame *frame;
+        AstNode *kids;
+        uint32_t active;
+        size_t top;
+
+        assert(num_walkers <= WALK_MAX_WALKERS);
+        if (!root.ptr || num_walkers == 0) {
+                return;
+        }
+        stack = NULL;
+        kids = NULL;
+        active = (uint32_t) ((1ull << num_walkers) - 1);
+        buf_push(stack, (WalkFrame) { .node = root, .active = active });
+        while (buf_len(stack)) {
+                top = buf_len(stack) - 1;
+                frame = &stack[top];
+                if (frame->leaving) {
+                        for (size_t i = 0; i < num_walkers; ++i) {
+                                if ((frame->active >> i & 1) &&
+                                                walkers[i].post) {
+                                        walkers[i].post(walkers[i].ctx, frame);
+                                }
+                        }
+                        buf_trunc(stack, top);
+                        continue;
+                }
+                frame->leaving = true;
+                active = 0;
+                for (size_t i = 0; i < num_walkers; ++i) {
+                        if ((frame->active >> i & 1) && (!walkers[i].pre ||
+                                        walkers[i].pre(walkers[i].ctx,
+                                                frame))) {
+                                active |= 1u << i;
+                        }
+                }
+                frame->active = active;
+                if (!active) {
+                        continue;
+                }
+                buf_trunc(kids, 0);
+                push_children(&kids, frame->node);
+                buf__fit(stack, buf_len(kids));
+                for (size_t i = buf_len(kids); i > 0; --i) {
+                        buf_push(stack, ((WalkFrame) {
+                                .node = kids[i - 1],
+                                .parent = stack[top].node,
+                                .index = (uint32_t) (i - 1),
+                                .depth = stack[top].depth + 1,
+                                .active = active,
+                        }));
+                }
+        }
+        buf_free(kids);
+        buf_free(stack);
+}
+
+typedef struct WalkCounts {
+        size_t nodes;
+        size_t posts;
+        uint32_t max_depth;
+        uint32_t kinds[AST_CASE + 1];
+} WalkCounts;
+
+static bool
+count_pre(void *ctx, WalkFrame *frame)
+{
+        WalkCounts *counts;
+
+        counts = ctx;
+        ++counts->nodes;
+        ++counts->kinds[frame->node.kind];
+        counts->max_depth = MAX(counts->max_depth, frame->depth);
+        return true;
+}
+
+static void
+count_post(void *ctx, WalkFrame *frame)
+{
+        WalkCounts *counts;
+
+        counts = ctx;
+        ++counts->posts;
+}
+
+// Stops at expressions, like a pass that only cares about statements.
+static bool
+count_stmts_pre(void *ctx, WalkFrame *frame)
+{
+        if (frame->node.kind == AST_EXPR) {
+                return false;
+        }
+        return count_pre(ctx, frame);
+}
+
+typedef struct WalkOrder {
+        char *order;
+} WalkOrder;
+
+static bool
+order_pre(void *ctx, WalkFrame *frame)
+{
+        WalkOrder *w;
+
+        w = ctx;
+        if (frame->node.kind == AST_EXPR &&
+                        frame->node.expr->kind == EXPR_NAME) {
+                buf_push(w->order, frame->node.expr->name[0]);
+        }
+        return true;
+}
+
+static void
+order_post(void *ctx, WalkFrame *frame)
+{
+        WalkOrder *w;
+
+        w = ctx;
+        if (frame->node.kind == AST_EXPR &&
+                        frame->node.expr->kind == EXPR_BINARY) {
+                buf_push(w->order, (char) frame->node.expr->binary.op);
+        }
+}
+
+void
+walk_test(void)
+{
+        WalkCounts all = { 0 };
+        WalkCounts stmts = { 0 };
+        WalkOrder order = { 0 };
+        Walker walkers[3];
+        StmtBlock block;
+        Expr *e;
+        Stmt *s;
+        Decl *d;
+        ArenaMark mark;
+        char buf[16];
+        int saved_stdout;
+        int depth;
+        FILE *f;
+
+        mark = arena_mark(&ast_arena);
+        // a * (b + c) walks to "abc+*" in post order.
+        e = expr_binary('*', expr_name("a"),
+                        expr_binary('+', expr_name("b"), expr_name("c")));
+        walkers[0] = (Walker) { order_pre, order_post, &order };
+        ast_walk(AST_NODE(AST_EXPR, e), walkers, 1);
+        buf_push(order.order, 0);
+        assert(strcmp(order.order, "abc+*") == 0);
+        buf_free(order.order);
+
+        // Deep enough to overflow the C stack if the walk recursed.
+        depth = 100000;
+        e = expr_name("x");
+        for (int i = 0; i < depth; ++i) {
+                e = expr_binary('+', e, expr_int(i));
+        }
+        s = stmt_return(e);
+        block = (StmtBlock) { ast_dup(&s, sizeof(s)), 1 };
+        d = decl_func("deep", NULL, 0, typespec_name("int"), block);
+
+        // Fused: both walkers see the decl, block and return; one prunes
+        // the expression while the other goes on to every leaf.
+        walkers[0] = (Walker) { count_stmts_pre, count_post, &stmts };
+        walkers[1] = (Walker) { count_pre, count_post, &all };
+        ast_walk(AST_NODE(AST_DECL, d), walkers, 2);
+        assert(all.nodes == all.posts);
+        assert(all.kinds[AST_DECL] == 1 && all.kinds[AST_BLOCK] == 1);
+        assert(all.kinds[AST_STMT] == 1 && all.kinds[AST_TYPESPEC] == 1);
+        assert(all.kinds[AST_EXPR] == 2 * (size_t) depth + 1);
+        assert(all.max_depth == 3 + depth);
+        assert(stmts.nodes == 4 && stmts.posts == 4);
+        assert(stmts.kinds[AST_EXPR] == 0);
+
+        ast_walk(AST_NODE(AST_EXPR, NULL), walkers, 2);
+        assert(all.nodes == all.posts);
+
+        // The printers walk too.
+        fflush(stdout);
+        f = tmpfile();
+        saved_stdout = dup(STDOUT_FILENO);
+        dup2(fileno(f), STDOUT_FILENO);
+        print_expr(e);
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        rewind(f);
+        assert(fgets(buf, sizeof(buf), f));
+        assert(strcmp(buf, "(+ (+ (+ (+ (+ ") == 0);
+        fseek(f, -8, SEEK_END);
+        assert(fgets(buf, sizeof(buf), f));
+        assert(strcmp(buf, ") 99999)") == 0);
+        fclose(f);
+        arena_reset(&ast_arena, mark);
+}
@@ -0,0 +1,75 @@
+#ifndef _WALK_H_
+#define _WALK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "common.h"
+
+// AST traversal driven by an explicit stack on the heap, so that the depth
+// of a tree is bounded by memory rather than by the C stack. A walk visits
+// each node once, calling every walker's pre callback on the way down and
+// its post callback on the way up. Running several walkers in one walk
+// fuses their passes: each node is fetched once for all of them. A walker
+// whose pre callback returns false skips the node's children and its post
+// callback without holding up the others.
+
+typedef enum AstKind {
+        AST_NONE,
+        AST_TYPESPEC,
+        AST_EXPR,
+        AST_STMT,
+        AST_DECL,
+        AST_BLOCK,
+        AST_ELSEIF,
+        AST_CASE
+} AstKind;
+
+typedef struct AstNode {
+        AstKind kind;
+        union {
+                void *ptr;
+                Typespec *type;
+                Expr *expr;
+                Stmt *stmt;
+                Decl *decl;
+                StmtBlock *block;
+                ElseIf *elseif;
+                SwitchCase *switch_case;
+        };
+} AstNode;
+
+#define AST_NODE(k, p) ((AstNode) { .kind = (k), .ptr = (p) })
+
+typedef struct WalkFrame {
+        AstNode node;
+        AstNode parent;
+        // Position among the parent's children; absent optional children
+        // such as a return without a value are not counted.
+        uint32_t index;
+        uint32_t depth;
+        // Bit i is set while walker i visits this node.
+        uint32_t active;
+        bool leaving;
+} WalkFrame;
+
+// The frame is only valid for the duration of the call.
+typedef bool (*WalkPre)(void *ctx, WalkFrame *frame);
+typedef void (*WalkPost)(void *ctx, WalkFrame *frame);
+
+typedef struct Walker {
+        WalkPre pre;
+        WalkPost post;
+        void *ctx;
+} Walker;
+
+#define WALK_MAX_WALKERS 32
+
+void
+ast_walk(AstNode root, Walker *walkers, size_t num_walkers);
+
+void
+walk_test(void);
+
+#endif